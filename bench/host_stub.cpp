@@ -0,0 +1,111 @@
+// Native stand-in for the real hostfxr and hostpolicy, used by launch_bench.
+//
+// The same DLL is copied as both hostfxr.dll (into a fake dotnet root) and hostpolicy.dll (next to it). As hostfxr
+// it loads hostpolicy.dll through LoadLibraryExW and calls corehost_load/corehost_main, the same sequence the real
+// hostfxr runs, so the proxy's hostpolicy interception and deps injection are exercised without a runtime.
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <hostfxr.h>
+#include <host_interface.h>
+
+#include <string>
+
+namespace
+{
+// Set by corehost_load, checked by corehost_main to verify the proxy injected the .deps.json.
+bool g_additional_deps_set{ false };
+
+typedef int (*corehost_load_fn)(const host_interface_t* init);
+typedef int (*corehost_main_fn)(const int argc, const pal::char_t* argv[]);
+typedef int (*corehost_unload_fn)();
+
+std::wstring get_module_directory()
+{
+    HMODULE self{ nullptr };
+    GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+        reinterpret_cast<LPCWSTR>(&get_module_directory), &self);
+
+    wchar_t path[MAX_PATH];
+    GetModuleFileNameW(self, path, MAX_PATH);
+
+    std::wstring directory(path);
+    directory.resize(directory.find_last_of(L'\\') + 1);
+    return directory;
+}
+
+int run_host(const int argc, const char_t** argv, const char_t* host_path, const char_t* dotnet_root,
+    const char_t* app_path, int64_t bundle_header_offset)
+{
+    const std::wstring hostpolicy_path = get_module_directory() + L"hostpolicy.dll";
+    const HMODULE hostpolicy = LoadLibraryExW(hostpolicy_path.c_str(), nullptr, 0);
+    if (!hostpolicy)
+        return 1;
+
+    const auto corehost_load = reinterpret_cast<corehost_load_fn>(GetProcAddress(hostpolicy, "corehost_load"));
+    const auto corehost_main = reinterpret_cast<corehost_main_fn>(GetProcAddress(hostpolicy, "corehost_main"));
+    const auto corehost_unload = reinterpret_cast<corehost_unload_fn>(GetProcAddress(hostpolicy, "corehost_unload"));
+    if (!corehost_load || !corehost_main || !corehost_unload)
+        return 1;
+
+    host_interface_t init{};
+    init.version_lo = HOST_INTERFACE_LAYOUT_VERSION_LO;
+    init.version_hi = HOST_INTERFACE_LAYOUT_VERSION_HI;
+    init.is_framework_dependent = 1;
+    init.host_mode = apphost;
+    init.host_info_host_path = host_path;
+    init.host_info_dotnet_root = dotnet_root;
+    init.host_info_app_path = app_path;
+    init.single_file_bundle_header_offset = static_cast<size_t>(bundle_header_offset);
+
+    int ret = corehost_load(&init);
+    if (ret == 0)
+    {
+        ret = corehost_main(argc, argv);
+    }
+
+    corehost_unload();
+    return ret;
+}
+}
+
+#define SHARED_API extern "C" __declspec(dllexport)
+
+SHARED_API int HOSTFXR_CALLTYPE hostfxr_main_startupinfo(const int argc, const char_t* argv[], const char_t* host_path,
+    const char_t* dotnet_root, const char_t* app_path)
+{
+    return run_host(argc, argv, host_path, dotnet_root, app_path, 0);
+}
+
+SHARED_API int HOSTFXR_CALLTYPE hostfxr_main_bundle_startupinfo(const int argc, const char_t* argv[],
+    const char_t* host_path, const char_t* dotnet_root, const char_t* app_path, int64_t bundle_header_offset)
+{
+    return run_host(argc, argv, host_path, dotnet_root, app_path, bundle_header_offset);
+}
+
+SHARED_API hostfxr_error_writer_fn HOSTFXR_CALLTYPE hostfxr_set_error_writer(hostfxr_error_writer_fn error_writer)
+{
+    return nullptr;
+}
+
+SHARED_API int corehost_load(const host_interface_t* init)
+{
+    g_additional_deps_set = init->additional_deps_serialized != nullptr && init->additional_deps_serialized[0] != L'\0';
+    return 0;
+}
+
+SHARED_API int corehost_main(const int argc, const pal::char_t* argv[])
+{
+    // launch_bench sets this for runs through the proxy, a missing .deps.json injection fails the run.
+    wchar_t expect[2];
+    if (GetEnvironmentVariableW(L"HOOKFXR_BENCH_EXPECT_DEPS", expect, 2) > 0 && !g_additional_deps_set)
+        return 2;
+
+    return 0;
+}
+
+SHARED_API int corehost_unload()
+{
+    return 0;
+}
@@ -0,0 +1,280 @@
+// End-to-end launch overhead of the hookfxr proxy.
+//
+// Lays out a work directory that mirrors a real deployment: an apphost stand-in (a copy of this executable) next to
+// the proxy hostfxr.dll, hookfxr.ini, the app and its .deps.json, and a fake dotnet root whose hostfxr.dll and
+// hostpolicy.dll are copies of host_stub.dll. Every run launches a fresh apphost process, either loading the stub
+// hostfxr directly (baseline) or going through the proxy, which redirects the app, hooks the stub hostpolicy and
+// injects the .deps.json. Launch times are printed as JSON.
+//
+// Usage: launch_bench.exe [runs] [--cold] [--proxy <hostfxr.dll>] [--stub <host_stub.dll>]
+//   --cold purges the standby list before every run so each launch reads its images from disk. This requires
+//   running elevated.
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <hostfxr.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+// winternl.h: SYSTEM_INFORMATION_CLASS::SystemMemoryListInformation, SYSTEM_MEMORY_LIST_COMMAND::MemoryPurgeStandbyList
+#define BENCH_SYSTEM_MEMORY_LIST_INFORMATION 80
+#define BENCH_MEMORY_PURGE_STANDBY_LIST 4
+
+typedef LONG(NTAPI* nt_set_system_information_fn)(int information_class, PVOID information, ULONG length);
+
+struct launch_stats
+{
+    double m_p50_us{ 0 };
+    double m_p99_us{ 0 };
+    double m_mean_us{ 0 };
+};
+
+std::filesystem::path get_executable_path()
+{
+    wchar_t path[MAX_PATH];
+    GetModuleFileNameW(nullptr, path, MAX_PATH);
+    return path;
+}
+
+[[noreturn]] void fail(const char* what)
+{
+    std::fprintf(stderr, "launch_bench: %s (error %lu)\n", what, GetLastError());
+    std::exit(1);
+}
+
+bool enable_privilege(const wchar_t* name)
+{
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        return false;
+
+    TOKEN_PRIVILEGES privileges{};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    const bool ok = LookupPrivilegeValueW(nullptr, name, &privileges.Privileges[0].Luid) &&
+        AdjustTokenPrivileges(token, FALSE, &privileges, sizeof(privileges), nullptr, nullptr) &&
+        GetLastError() == ERROR_SUCCESS;
+
+    CloseHandle(token);
+    return ok;
+}
+
+void purge_standby_list()
+{
+    static const auto nt_set_system_information = reinterpret_cast<nt_set_system_information_fn>(
+        GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "NtSetSystemInformation"));
+
+    int command = BENCH_MEMORY_PURGE_STANDBY_LIST;
+    if (!nt_set_system_information ||
+        nt_set_system_information(BENCH_SYSTEM_MEMORY_LIST_INFORMATION, &command, sizeof(command)) < 0)
+    {
+        fail("Failed to purge the standby list, --cold requires running elevated");
+    }
+}
+
+void write_file(const std::filesystem::path& path, const std::string& content)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << content;
+    if (!file)
+        fail("Failed to write work directory file");
+}
+
+void prepare_work_directory(const std::filesystem::path& work, const std::filesystem::path& proxy,
+    const std::filesystem::path& stub)
+{
+    const std::filesystem::path fxr_directory = work / L"dotnet" / L"host" / L"fxr" / L"99.0.0";
+    std::filesystem::create_directories(fxr_directory);
+
+    constexpr auto overwrite = std::filesystem::copy_options::overwrite_existing;
+    std::filesystem::copy_file(get_executable_path(), work / L"apphost.exe", overwrite);
+    std::filesystem::copy_file(proxy, work / L"hostfxr.dll", overwrite);
+    std::filesystem::copy_file(stub, fxr_directory / L"hostfxr.dll", overwrite);
+    std::filesystem::copy_file(stub, fxr_directory / L"hostpolicy.dll", overwrite);
+
+    write_file(work / L"app.dll", "");
+    write_file(work / L"app.deps.json", "{}");
+    write_file(work / L"target.dll", "");
+    write_file(work / L"hookfxr.ini",
+        "[hookfxr]\r\n"
+        "enable=true\r\n"
+        "target_assembly=target.dll\r\n"
+        "dotnet_root_override=" + (work / L"dotnet").string() + "\r\n"
+        "merge_deps_json=true\r\n"
+        "log_file=\r\n"
+        "log_level=error\r\n");
+}
+
+// Launches one apphost process and returns its wall time in microseconds.
+double launch(const std::filesystem::path& work, const std::filesystem::path& hostfxr)
+{
+    std::wstring command_line = L"\"" + (work / L"apphost.exe").wstring() + L"\" --child \"" + hostfxr.wstring() +
+        L"\" \"" + (work / L"dotnet").wstring() + L"\" \"" + (work / L"app.dll").wstring() + L"\"";
+
+    STARTUPINFOW startup_info{};
+    startup_info.cb = sizeof(startup_info);
+    PROCESS_INFORMATION process_info{};
+
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&start);
+
+    if (!CreateProcessW(nullptr, command_line.data(), nullptr, nullptr, FALSE, 0, nullptr, work.c_str(),
+        &startup_info, &process_info))
+    {
+        fail("Failed to launch apphost");
+    }
+
+    WaitForSingleObject(process_info.hProcess, INFINITE);
+    QueryPerformanceCounter(&end);
+
+    DWORD exit_code;
+    GetExitCodeProcess(process_info.hProcess, &exit_code);
+    CloseHandle(process_info.hThread);
+    CloseHandle(process_info.hProcess);
+
+    if (exit_code != 0)
+    {
+        std::fprintf(stderr, "launch_bench: apphost exited with %lx\n", exit_code);
+        std::exit(1);
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return static_cast<double>(end.QuadPart - start.QuadPart) * 1e6 / static_cast<double>(frequency.QuadPart);
+}
+
+launch_stats summarize(std::vector<double> samples)
+{
+    std::ranges::sort(samples);
+
+    const auto percentile = [&](double p)
+    {
+        const size_t rank = static_cast<size_t>(std::ceil(p * static_cast<double>(samples.size())));
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+    };
+
+    launch_stats stats;
+    stats.m_p50_us = percentile(0.50);
+    stats.m_p99_us = percentile(0.99);
+    for (const double sample : samples)
+    {
+        stats.m_mean_us += sample;
+    }
+    stats.m_mean_us /= static_cast<double>(samples.size());
+    return stats;
+}
+
+void print_stats(const char* name, const launch_stats& stats, const char* separator)
+{
+    std::printf("  \"%s\": {\"p50_us\": %.1f, \"p99_us\": %.1f, \"mean_us\": %.1f}%s\n",
+        name, stats.m_p50_us, stats.m_p99_us, stats.m_mean_us, separator);
+}
+
+// Apphost stand-in: loads the given hostfxr and runs the app through it, like the real apphost does.
+int run_child(int argc, wchar_t** argv)
+{
+    const HMODULE hostfxr = LoadLibraryW(argv[2]);
+    if (!hostfxr)
+        return 1;
+
+    const auto hostfxr_main_startupinfo = reinterpret_cast<hostfxr_main_startupinfo_fn>(
+        GetProcAddress(hostfxr, "hostfxr_main_startupinfo"));
+    if (!hostfxr_main_startupinfo)
+        return 1;
+
+    const std::wstring host_path = get_executable_path().wstring();
+    return hostfxr_main_startupinfo(argc, const_cast<const wchar_t**>(argv), host_path.c_str(), argv[3], argv[4]);
+}
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    if (argc == 5 && std::wstring(argv[1]) == L"--child")
+        return run_child(argc, argv);
+
+    const std::filesystem::path directory = get_executable_path().parent_path();
+    std::filesystem::path proxy = directory / L"hostfxr.dll";
+    std::filesystem::path stub = directory / L"host_stub.dll";
+    int runs = 200;
+    bool cold = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::wstring arg(argv[i]);
+        if (arg == L"--cold")
+        {
+            cold = true;
+        }
+        else if (arg == L"--proxy" && i + 1 < argc)
+        {
+            proxy = argv[++i];
+        }
+        else if (arg == L"--stub" && i + 1 < argc)
+        {
+            stub = argv[++i];
+        }
+        else
+        {
+            runs = std::max(1, _wtoi(argv[i]));
+        }
+    }
+
+    if (cold && !enable_privilege(SE_PROF_SINGLE_PROCESS_NAME))
+        fail("Failed to enable SeProfileSingleProcessPrivilege, --cold requires running elevated");
+
+    const std::filesystem::path work = directory / L"launch_bench_work";
+    prepare_work_directory(work, proxy, stub);
+
+    const std::filesystem::path baseline_hostfxr = work / L"dotnet" / L"host" / L"fxr" / L"99.0.0" / L"hostfxr.dll";
+    const std::filesystem::path proxy_hostfxr = work / L"hostfxr.dll";
+
+    std::vector<double> baseline;
+    std::vector<double> proxied;
+    baseline.reserve(runs);
+    proxied.reserve(runs);
+
+    // Interleaved, so drift in machine load affects both sides equally.
+    for (int i = 0; i < runs; ++i)
+    {
+        SetEnvironmentVariableW(L"HOOKFXR_BENCH_EXPECT_DEPS", nullptr);
+        if (cold)
+        {
+            purge_standby_list();
+        }
+        baseline.push_back(launch(work, baseline_hostfxr));
+
+        SetEnvironmentVariableW(L"HOOKFXR_BENCH_EXPECT_DEPS", L"1");
+        if (cold)
+        {
+            purge_standby_list();
+        }
+        proxied.push_back(launch(work, proxy_hostfxr));
+    }
+
+    const launch_stats baseline_stats = summarize(baseline);
+    const launch_stats proxy_stats = summarize(proxied);
+
+    launch_stats overhead;
+    overhead.m_p50_us = proxy_stats.m_p50_us - baseline_stats.m_p50_us;
+    overhead.m_p99_us = proxy_stats.m_p99_us - baseline_stats.m_p99_us;
+    overhead.m_mean_us = proxy_stats.m_mean_us - baseline_stats.m_mean_us;
+
+    std::printf("{\n  \"runs\": %d,\n  \"cold\": %s,\n", runs, cold ? "true" : "false");
+    print_stats("baseline", baseline_stats, ",");
+    print_stats("proxy", proxy_stats, ",");
+    print_stats("overhead", overhead, "");
+    std::printf("}\n");
+    return 0;
+}
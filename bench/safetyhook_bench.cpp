@@ -0,0 +1,708 @@
+// Micro-benchmarks for lib/safetyhook.
+//
+// Prints one JSON document to stdout so results can be diffed between runs. An optional argument only runs the
+// benchmarks whose name contains it.
+//
+// Windows: build the bench project of hookfxr.sln (Release|x64).
+// Linux:   g++ -std=c++23 -O2 -I../lib/safetyhook safetyhook_bench.cpp ../lib/safetyhook/safetyhook.cpp
+//          ../lib/safetyhook/Zydis.c -o safetyhook_bench -lpthread
+
+#include <safetyhook.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if SAFETYHOOK_OS_LINUX
+#include <dlfcn.h>
+#endif
+
+namespace
+{
+using bench_clock = std::chrono::steady_clock;
+
+struct bench_result
+{
+    std::string m_name;
+    uint64_t m_iterations{ 0 };
+    double m_total_ns{ 0 };
+    // Extra numeric fields, e.g. throughput of the multi-threaded benchmark.
+    std::vector<std::pair<std::string, double>> m_extra;
+};
+
+std::vector<bench_result> g_results;
+std::string_view g_filter;
+
+// Keeps the optimizer from discarding results of the measured calls.
+std::atomic<int> g_sink{ 0 };
+
+bool selected(std::string_view name)
+{
+    return g_filter.empty() || name.find(g_filter) != std::string_view::npos;
+}
+
+template <typename Fn>
+bench_result& measure(std::string name, uint64_t iterations, Fn&& fn)
+{
+    // One untimed round to fault in code and data.
+    fn(std::min<uint64_t>(iterations, 16));
+
+    const auto start = bench_clock::now();
+    fn(iterations);
+    const auto end = bench_clock::now();
+
+    bench_result& result = g_results.emplace_back();
+    result.m_name = std::move(name);
+    result.m_iterations = iterations;
+    result.m_total_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    return result;
+}
+
+void fail(const char* what)
+{
+    std::fprintf(stderr, "safetyhook_bench: %s\n", what);
+    std::exit(1);
+}
+
+// Hook targets. Each benchmark gets its own target so hooks never overlap.
+SAFETYHOOK_NOINLINE int target_create(int a, int b)
+{
+    volatile int x = a;
+    x = x * b + 7;
+    return x ^ b;
+}
+
+SAFETYHOOK_NOINLINE int target_toggle(int a, int b)
+{
+    volatile int x = a;
+    x = x * b + 11;
+    return x ^ b;
+}
+
+SAFETYHOOK_NOINLINE int target_call(int a, int b)
+{
+    volatile int x = a;
+    x = x * b + 13;
+    return x ^ b;
+}
+
+SAFETYHOOK_NOINLINE int target_mid(int a, int b)
+{
+    volatile int x = a;
+    x = x * b + 17;
+    return x ^ b;
+}
+
+SAFETYHOOK_NOINLINE int target_threads(int a, int b)
+{
+    volatile int x = a;
+    x = x * b + 19;
+    return x ^ b;
+}
+
+// Distinct targets for hooking many sites at once, e.g. a mod loader patching a whole assembly.
+constexpr size_t g_many_count = 5000;
+
+template <size_t N>
+SAFETYHOOK_NOINLINE int target_many(int a, int b)
+{
+    volatile int x = a;
+    x = x * b + static_cast<int>(N);
+    return x ^ b;
+}
+
+template <size_t... I>
+std::array<void*, sizeof...(I)> make_many_targets(std::index_sequence<I...>)
+{
+    return { reinterpret_cast<void*>(&target_many<I>)... };
+}
+
+SafetyHookInline g_call_hook;
+SafetyHookInline g_threads_hook;
+
+SAFETYHOOK_NOINLINE int detour_empty(int a, int b)
+{
+    return a + b;
+}
+
+SAFETYHOOK_NOINLINE int detour_call(int a, int b)
+{
+    return g_call_hook.call<int>(a, b);
+}
+
+SAFETYHOOK_NOINLINE int detour_threads(int a, int b)
+{
+    return g_threads_hook.call<int>(a, b);
+}
+
+void mid_empty(SafetyHookContext&)
+{
+}
+
+// Calls through a volatile pointer, the same way the hooked variants are reached.
+template <typename Fn>
+void call_loop(Fn* fn, uint64_t iterations)
+{
+    Fn* volatile target = fn;
+    int acc = 0;
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        acc += target(static_cast<int>(i), 3);
+    }
+    g_sink.fetch_add(acc, std::memory_order_relaxed);
+}
+
+void bench_inline_create()
+{
+    if (!selected("inline_create_destroy"))
+        return;
+
+    measure("inline_create_destroy", 2000, [](uint64_t n)
+    {
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            auto hook = safetyhook::create_inline(target_create, detour_empty);
+            if (!hook)
+                fail("create_inline failed");
+        }
+    });
+}
+
+void bench_hook_plan_cache()
+{
+    if (!selected("inline_create_5k") && !selected("hook_plan_cache_load_5k"))
+        return;
+
+    static const auto targets = make_many_targets(std::make_index_sequence<g_many_count>{});
+    std::vector<safetyhook::InlineHook> hooks;
+    hooks.reserve(targets.size());
+
+    // Hooks are created disabled so only setup (decoding and trampoline construction) is measured.
+    const auto create_all = [&](uint64_t n)
+    {
+        hooks.clear();
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            auto hook = safetyhook::InlineHook::create(targets[i], reinterpret_cast<void*>(detour_empty),
+                safetyhook::InlineHook::StartDisabled);
+            if (!hook)
+                fail("InlineHook::create failed");
+            hooks.push_back(std::move(*hook));
+        }
+    };
+
+    safetyhook::HookPlanCache::set_global(nullptr);
+    const bench_result& decode = measure("inline_create_5k_decode", g_many_count, create_all);
+    const double decode_ns_per_op = decode.m_total_ns / static_cast<double>(decode.m_iterations);
+
+    // Plan every target once and persist the plans, the way the first launch would.
+    const auto first_launch = safetyhook::HookPlanCache::create();
+    safetyhook::HookPlanCache::set_global(first_launch);
+    create_all(g_many_count);
+    hooks.clear();
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "safetyhook_bench.plans";
+    if (!first_launch->save(path))
+        fail("HookPlanCache::save failed");
+
+    const auto later_launch = safetyhook::HookPlanCache::create();
+    bench_result& load = measure("hook_plan_cache_load_5k", 1, [&](uint64_t)
+    {
+        if (!later_launch->load(path))
+            fail("HookPlanCache::load failed");
+    });
+    load.m_extra.emplace_back("plans", static_cast<double>(later_launch->size()));
+
+    safetyhook::HookPlanCache::set_global(later_launch);
+    bench_result& cached = measure("inline_create_5k_cached", g_many_count, create_all);
+    cached.m_extra.emplace_back("saved_ns_per_hook",
+        decode_ns_per_op - cached.m_total_ns / static_cast<double>(cached.m_iterations));
+
+    hooks.clear();
+    safetyhook::HookPlanCache::set_global(nullptr);
+    std::filesystem::remove(path);
+}
+
+void bench_inline_toggle()
+{
+    if (!selected("inline_enable_disable"))
+        return;
+
+    auto hook = safetyhook::InlineHook::create(
+        reinterpret_cast<void*>(target_toggle), reinterpret_cast<void*>(detour_empty),
+        safetyhook::InlineHook::StartDisabled);
+    if (!hook)
+        fail("InlineHook::create failed");
+
+    measure("inline_enable_disable", 2000, [&](uint64_t n)
+    {
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            if (!hook->enable() || !hook->disable())
+                fail("enable/disable failed");
+        }
+    });
+}
+
+void bench_inline_soft_toggle()
+{
+    if (!selected("inline_soft_enable_disable"))
+        return;
+
+    auto hook = safetyhook::InlineHook::create(
+        reinterpret_cast<void*>(target_toggle), reinterpret_cast<void*>(detour_empty),
+        static_cast<safetyhook::InlineHook::Flags>(
+            safetyhook::InlineHook::StartDisabled | safetyhook::InlineHook::SoftToggle));
+    if (!hook)
+        fail("InlineHook::create failed");
+
+    measure("inline_soft_enable_disable", 2'000'000, [&](uint64_t n)
+    {
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            if (!hook->enable() || !hook->disable())
+                fail("enable/disable failed");
+        }
+    });
+}
+
+void bench_call_through()
+{
+    constexpr uint64_t iterations = 20'000'000;
+
+    if (selected("call_direct"))
+    {
+        measure("call_direct", iterations, [](uint64_t n) { call_loop(&target_call, n); });
+    }
+
+    if (selected("call_inline_hooked"))
+    {
+        g_call_hook = safetyhook::create_inline(target_call, detour_call);
+        if (!g_call_hook)
+            fail("create_inline failed");
+
+        measure("call_inline_hooked", iterations, [](uint64_t n) { call_loop(&target_call, n); });
+        g_call_hook = {};
+    }
+
+    // A disabled soft hook still runs the gate and the relocated prologue on every call.
+    if (selected("call_inline_soft_disabled"))
+    {
+        g_call_hook = safetyhook::create_inline(target_call, detour_call,
+            static_cast<safetyhook::InlineHook::Flags>(
+                safetyhook::InlineHook::StartDisabled | safetyhook::InlineHook::SoftToggle));
+        if (!g_call_hook)
+            fail("create_inline failed");
+
+        measure("call_inline_soft_disabled", iterations, [](uint64_t n) { call_loop(&target_call, n); });
+        g_call_hook = {};
+    }
+
+    if (selected("call_inline_soft_sampled"))
+    {
+        g_call_hook = safetyhook::create_inline(target_call, detour_call, safetyhook::InlineHook::SoftToggle);
+        if (!g_call_hook || !g_call_hook.set_sample_period(100))
+            fail("create_inline failed");
+
+        measure("call_inline_soft_sampled", iterations, [](uint64_t n) { call_loop(&target_call, n); });
+        g_call_hook = {};
+    }
+
+    if (selected("call_mid_hooked"))
+    {
+        auto hook = safetyhook::create_mid(target_mid, mid_empty);
+        if (!hook)
+            fail("create_mid failed");
+
+        measure("call_mid_hooked", iterations, [](uint64_t n) { call_loop(&target_mid, n); });
+    }
+}
+
+struct bench_object
+{
+    virtual ~bench_object() = default;
+    virtual int value() { return 1; }
+};
+
+int vm_value(bench_object*)
+{
+    return 2;
+}
+
+// Index of bench_object::value in the VMT, the Itanium ABI emits two destructor entries.
+#if defined(_MSC_VER)
+constexpr size_t g_value_index = 1;
+#else
+constexpr size_t g_value_index = 2;
+#endif
+
+void bench_vmt()
+{
+    constexpr size_t object_count = 100'000;
+
+    std::vector<std::unique_ptr<bench_object>> objects;
+    std::vector<void*> pointers;
+    objects.reserve(object_count);
+    pointers.reserve(object_count);
+    for (size_t i = 0; i < object_count; ++i)
+    {
+        pointers.push_back(objects.emplace_back(std::make_unique<bench_object>()).get());
+    }
+
+    if (selected("vmt_create_per_object"))
+    {
+        // Every per-object hook clones the VMT into its own allocation, so this is kept much smaller.
+        constexpr size_t hook_count = 10'000;
+        std::vector<safetyhook::VmtHook> hooks;
+        hooks.reserve(hook_count);
+
+        measure("vmt_create_per_object", hook_count, [&](uint64_t n)
+        {
+            hooks.clear();
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                auto hook = safetyhook::VmtHook::create(pointers[i]);
+                if (!hook)
+                    fail("VmtHook::create failed");
+                hooks.push_back(std::move(*hook));
+            }
+        });
+    }
+
+    if (selected("vmt_class_apply") || selected("vmt_class_remove"))
+    {
+        auto hook = safetyhook::VmtHook::create(pointers[0], safetyhook::VmtHook::ClassLevel);
+        if (!hook)
+            fail("VmtHook::create failed");
+
+        auto vm = hook->hook_method(g_value_index, vm_value);
+        if (!vm)
+            fail("hook_method failed");
+
+        const std::span<void* const> all(pointers);
+        measure("vmt_class_apply", object_count, [&](uint64_t n)
+        {
+            hook->apply(all.first(n));
+        });
+
+        measure("vmt_class_remove", object_count, [&](uint64_t n)
+        {
+            hook->remove(all.first(n));
+        });
+    }
+}
+
+void bench_threads()
+{
+    if (!selected("call_inline_toggling_mt"))
+        return;
+
+    g_threads_hook = safetyhook::create_inline(target_threads, detour_threads);
+    if (!g_threads_hook)
+        fail("create_inline failed");
+
+    const unsigned int thread_count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    constexpr auto duration = std::chrono::milliseconds(500);
+
+    std::atomic<bool> stop{ false };
+    std::atomic<uint64_t> calls{ 0 };
+    uint64_t toggles = 0;
+
+    bench_result& result = measure("call_inline_toggling_mt", 1, [&](uint64_t)
+    {
+        stop = false;
+        calls = 0;
+        toggles = 0;
+
+        std::vector<std::thread> callers;
+        for (unsigned int t = 0; t < thread_count; ++t)
+        {
+            callers.emplace_back([&]
+            {
+                int (*volatile fn)(int, int) = &target_threads;
+                uint64_t local = 0;
+                int acc = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    acc += fn(static_cast<int>(local), 5);
+                    ++local;
+                }
+                calls.fetch_add(local, std::memory_order_relaxed);
+                g_sink.fetch_add(acc, std::memory_order_relaxed);
+            });
+        }
+
+        const auto end = bench_clock::now() + duration;
+        while (bench_clock::now() < end)
+        {
+            if (!g_threads_hook.disable() || !g_threads_hook.enable())
+                fail("enable/disable failed");
+            ++toggles;
+        }
+
+        stop = true;
+        for (auto& caller : callers)
+        {
+            caller.join();
+        }
+    });
+
+    const double seconds = result.m_total_ns / 1e9;
+    result.m_iterations = calls.load();
+    result.m_extra.emplace_back("threads", thread_count);
+    result.m_extra.emplace_back("calls_per_second", static_cast<double>(calls.load()) / seconds);
+    result.m_extra.emplace_back("toggles_per_second", static_cast<double>(toggles) / seconds);
+
+    g_threads_hook = {};
+}
+
+void bench_allocator_scaling()
+{
+    if (!selected("allocator_near_mt"))
+        return;
+
+    // Every thread allocates near its own target, 4GB apart, the way hooks in unrelated modules do.
+    constexpr uint64_t allocations_per_thread = 20'000;
+    constexpr uintptr_t first_target = 0x100'0000'0000;
+    constexpr uintptr_t target_stride = 0x1'0000'0000;
+
+    for (const unsigned int thread_count : { 1u, 2u, 4u, 8u, 16u, 32u })
+    {
+        const auto allocator = safetyhook::Allocator::create();
+
+        bench_result& result = measure("allocator_near_mt/" + std::to_string(thread_count), 1, [&](uint64_t)
+        {
+            std::vector<std::thread> threads;
+            for (unsigned int t = 0; t < thread_count; ++t)
+            {
+                threads.emplace_back([&, t]
+                {
+                    const std::vector<uint8_t*> desired{ reinterpret_cast<uint8_t*>(first_target + t * target_stride) };
+                    std::vector<safetyhook::Allocation> allocations;
+                    allocations.reserve(allocations_per_thread);
+
+                    for (uint64_t i = 0; i < allocations_per_thread; ++i)
+                    {
+                        auto allocation = allocator->allocate_near(desired, 64);
+                        if (!allocation)
+                            fail("allocate_near failed");
+                        allocations.push_back(std::move(*allocation));
+                    }
+                });
+            }
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+        });
+
+        result.m_iterations = allocations_per_thread * thread_count;
+        result.m_extra.emplace_back("threads", thread_count);
+        result.m_extra.emplace_back("allocations_per_second", static_cast<double>(result.m_iterations) /
+            (result.m_total_ns / 1e9));
+        // Every allocation has been freed again, nothing may be left handed out. This is what the allocator kept mapped.
+        if (allocator->allocated_bytes() != 0)
+            fail("allocated_bytes is not 0 after freeing every allocation");
+        result.m_extra.emplace_back("resident_bytes_after_free", static_cast<double>(allocator->resident_bytes()));
+    }
+}
+
+void bench_scan()
+{
+    if (!selected("scan_100mb"))
+        return;
+
+    // Synthetic image: a quarter of the bytes are the most common bytes of x86-64 code, the rest is noise.
+    constexpr size_t image_size = 100 * 1024 * 1024;
+    constexpr uint8_t common_bytes[] = { 0x48, 0x8B, 0x89, 0x00, 0xFF, 0xE8, 0x0F, 0x85, 0x4C, 0x24, 0x8D, 0xCC };
+    constexpr size_t pattern_count = 64;
+    constexpr size_t pattern_size = 16;
+
+    std::vector<uint8_t> image(image_size);
+    uint64_t state = 0x9E3779B97F4A7C15;
+    const auto next = [&state]
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    };
+
+    for (auto& byte : image)
+    {
+        const uint64_t value = next();
+        byte = (value & 3) == 0 ? common_bytes[(value >> 8) % std::size(common_bytes)] : static_cast<uint8_t>(value >> 16);
+    }
+
+    // Signatures are taken from the image, with the rel32 of a call or RIP-relative operand masked out.
+    std::vector<safetyhook::Pattern> patterns;
+    for (size_t i = 0; i < pattern_count; ++i)
+    {
+        const size_t offset = next() % (image_size - pattern_size);
+        std::vector<uint8_t> mask(pattern_size, 1);
+        std::fill_n(mask.begin() + 3, 4, static_cast<uint8_t>(0));
+
+        auto pattern = safetyhook::Pattern::create(std::span(image).subspan(offset, pattern_size), mask);
+        if (!pattern)
+            fail("Pattern::create failed");
+        patterns.push_back(std::move(*pattern));
+    }
+
+    size_t expected_matches = 0;
+
+    // One loop per pattern, the way signatures are usually scanned for.
+    bench_result& naive = measure("scan_100mb_naive", 1, [&](uint64_t)
+    {
+        expected_matches = 0;
+        for (const auto& pattern : patterns)
+        {
+            for (size_t i = 0; i + pattern.size() <= image.size(); ++i)
+            {
+                if (pattern.matches(image.data() + i))
+                {
+                    ++expected_matches;
+                }
+            }
+        }
+    });
+    naive.m_iterations = image_size;
+    naive.m_extra.emplace_back("patterns", pattern_count);
+
+    for (const size_t threads : { size_t{ 1 }, size_t{ 0 } })
+    {
+        std::vector<safetyhook::ScanMatch> matches;
+        bench_result& result = measure(threads == 1 ? "scan_100mb_simd_1t" : "scan_100mb_simd_mt", 1, [&](uint64_t)
+        {
+            matches = safetyhook::scan(image, patterns, { .threads = threads });
+        });
+
+        if (matches.size() != expected_matches)
+            fail("scan returned different matches than the naive loop");
+
+        result.m_iterations = image_size;
+        result.m_extra.emplace_back("patterns", pattern_count);
+        result.m_extra.emplace_back("gb_per_second", static_cast<double>(image_size) / result.m_total_ns);
+    }
+}
+
+#if SAFETYHOOK_OS_LINUX
+void bench_symbol_resolver()
+{
+    constexpr uint64_t lookups = 10'000;
+    // A mix of libc exports and a few names it does not have, looked up round-robin.
+    constexpr std::string_view names[] = { "malloc", "free", "memcpy", "memmove", "strlen", "strcmp", "printf",
+        "fopen", "fclose", "fread", "fwrite", "pthread_create", "pthread_mutex_lock", "pthread_mutex_unlock", "mmap",
+        "munmap", "mprotect", "open", "close", "read", "write", "qsort", "getenv", "setenv", "dl_iterate_phdr",
+        "clock_gettime", "nanosleep", "snprintf", "hookfxr_missing_a", "hookfxr_missing_b", "hookfxr_missing_c",
+        "hookfxr_missing_d" };
+    constexpr size_t name_count = std::size(names);
+
+    std::vector<std::string> c_names(std::begin(names), std::end(names));
+
+    void* libc = dlopen("libc.so.6", RTLD_NOW | RTLD_NOLOAD);
+    if (libc == nullptr)
+        fail("dlopen(libc.so.6) failed");
+
+    if (selected("resolve_dlsym_10k"))
+    {
+        measure("resolve_dlsym_10k", lookups, [&](uint64_t n)
+        {
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                g_sink += dlsym(libc, c_names[i % name_count].c_str()) != nullptr;
+            }
+        });
+    }
+
+    const auto resolver = safetyhook::SymbolResolver::create();
+
+    if (selected("resolve_gnu_hash_10k"))
+    {
+        measure("resolve_gnu_hash_10k", lookups, [&](uint64_t n)
+        {
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                const auto address = resolver->find("libc.so.6", names[i % name_count]);
+                if (!address)
+                    fail("SymbolResolver::find failed");
+                g_sink += *address != nullptr;
+            }
+        });
+    }
+
+    if (selected("resolve_gnu_hash_10k_batch"))
+    {
+        std::array<void*, name_count> addresses{};
+        measure("resolve_gnu_hash_10k_batch", lookups, [&](uint64_t n)
+        {
+            for (uint64_t i = 0; i < n; i += name_count)
+            {
+                const size_t count = std::min<uint64_t>(name_count, n - i);
+                const auto found = resolver->find("libc.so.6", std::span(names, count), std::span(addresses));
+                if (!found)
+                    fail("SymbolResolver::find failed");
+                g_sink += static_cast<int>(*found);
+            }
+        });
+    }
+
+    dlclose(libc);
+}
+#endif
+
+void print_json()
+{
+    std::printf("{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < g_results.size(); ++i)
+    {
+        const bench_result& result = g_results[i];
+        const double ns_per_op = result.m_iterations > 0 ? result.m_total_ns / result.m_iterations : 0.0;
+
+        std::printf("    {\"name\": \"%s\", \"iterations\": %llu, \"total_ns\": %.0f, \"ns_per_op\": %.3f",
+            result.m_name.c_str(), static_cast<unsigned long long>(result.m_iterations), result.m_total_ns, ns_per_op);
+        for (const auto& [key, value] : result.m_extra)
+        {
+            std::printf(", \"%s\": %.3f", key.c_str(), value);
+        }
+        std::printf("}%s\n", i + 1 < g_results.size() ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+}
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+    {
+        g_filter = argv[1];
+    }
+
+    bench_inline_create();
+    bench_hook_plan_cache();
+    bench_inline_toggle();
+    bench_inline_soft_toggle();
+    bench_call_through();
+    bench_vmt();
+    bench_threads();
+    bench_allocator_scaling();
+    bench_scan();
+#if SAFETYHOOK_OS_LINUX
+    bench_symbol_resolver();
+#endif
+
+    print_json();
+    return 0;
+}
@@ -0,0 +1,338 @@
+#include "affinity.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#endif
+
+// Highest CPU number accepted in a CPU list.
+#define HOOKFXR_MAX_CPU 4095
+
+namespace
+{
+bool parse_number(std::wstring_view text, uint32_t& value)
+{
+    if (text.empty() || text.size() > 5)
+        return false;
+
+    value = 0;
+    for (const wchar_t c : text)
+    {
+        if (c < L'0' || c > L'9')
+            return false;
+
+        value = value * 10 + static_cast<uint32_t>(c - L'0');
+    }
+    return true;
+}
+
+bool is_environment_set(const std::wstring& name)
+{
+#ifdef _WIN32
+    return GetEnvironmentVariableW(name.c_str(), nullptr, 0) > 0;
+#else
+    const std::string narrow(name.begin(), name.end());
+    return std::getenv(narrow.c_str()) != nullptr;
+#endif
+}
+
+// The runtime reads its knobs with either prefix.
+bool is_clr_knob_set(std::wstring_view knob)
+{
+    return is_environment_set(std::wstring(L"DOTNET_") + std::wstring(knob)) ||
+        is_environment_set(std::wstring(L"COMPlus_") + std::wstring(knob));
+}
+
+void set_environment(const wchar_t* name, const std::wstring& value)
+{
+#ifdef _WIN32
+    SetEnvironmentVariableW(name, value.c_str());
+#else
+    // Only ever called with ASCII names and values.
+    const std::string narrow_name(name, name + std::char_traits<wchar_t>::length(name));
+    const std::string narrow_value(value.begin(), value.end());
+    setenv(narrow_name.c_str(), narrow_value.c_str(), 1);
+#endif
+}
+
+#ifdef _WIN32
+bool get_numa_node_cpus(int numa_node, std::vector<uint32_t>& cpus)
+{
+    GROUP_AFFINITY affinity{};
+    if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(numa_node), &affinity) || affinity.Mask == 0)
+        return false;
+
+    // SetProcessAffinityMask can only address the processor group the process runs in.
+    if (affinity.Group != 0)
+        return false;
+
+    for (uint32_t cpu = 0; cpu < 64; ++cpu)
+    {
+        if (affinity.Mask & (KAFFINITY{ 1 } << cpu))
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return true;
+}
+
+bool set_affinity(const std::vector<uint32_t>& cpus)
+{
+    DWORD_PTR mask = 0;
+    for (const uint32_t cpu : cpus)
+    {
+        if (cpu >= sizeof(DWORD_PTR) * 8)
+            return false;
+
+        mask |= DWORD_PTR{ 1 } << cpu;
+    }
+
+    return SetProcessAffinityMask(GetCurrentProcess(), mask) != FALSE;
+}
+
+bool set_preferred_numa_node(int, const std::vector<uint32_t>& node_cpus, const std::vector<uint32_t>& applied_cpus)
+{
+    // Windows has no process-wide memory policy. Allocations are served from the node of the processor the thread
+    // runs on, so the node is only in effect if the affinity that was applied keeps the process on its CPUs.
+    return !applied_cpus.empty() && std::ranges::includes(node_cpus, applied_cpus);
+}
+
+bool set_priority(process_priority priority)
+{
+    DWORD priority_class = NORMAL_PRIORITY_CLASS;
+    switch (priority)
+    {
+    case process_priority::idle: priority_class = IDLE_PRIORITY_CLASS; break;
+    case process_priority::below_normal: priority_class = BELOW_NORMAL_PRIORITY_CLASS; break;
+    case process_priority::normal: priority_class = NORMAL_PRIORITY_CLASS; break;
+    case process_priority::above_normal: priority_class = ABOVE_NORMAL_PRIORITY_CLASS; break;
+    case process_priority::high: priority_class = HIGH_PRIORITY_CLASS; break;
+    case process_priority::unchanged: return true;
+    }
+
+    return SetPriorityClass(GetCurrentProcess(), priority_class) != FALSE;
+}
+#else
+// Affinity, memory policy and nice values are per thread on Linux. Threads created later inherit them from their
+// creator, but threads that already exist have to be updated one by one.
+template <typename Fn>
+bool for_each_thread(Fn&& fn)
+{
+    DIR* tasks = opendir("/proc/self/task");
+    if (!tasks)
+        return fn(static_cast<pid_t>(0));
+
+    bool ok = true;
+    while (const dirent* entry = readdir(tasks))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        ok &= fn(static_cast<pid_t>(std::atoi(entry->d_name)));
+    }
+
+    closedir(tasks);
+    return ok;
+}
+
+bool get_numa_node_cpus(int numa_node, std::vector<uint32_t>& cpus)
+{
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(numa_node) + "/cpulist");
+    std::string list;
+    if (!std::getline(file, list))
+        return false;
+
+    return parse_cpu_list(std::wstring(list.begin(), list.end()), cpus) && !cpus.empty();
+}
+
+bool set_affinity(const std::vector<uint32_t>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const uint32_t cpu : cpus)
+    {
+        if (cpu >= CPU_SETSIZE)
+            return false;
+
+        CPU_SET(cpu, &set);
+    }
+
+    return for_each_thread([&](pid_t tid) { return sched_setaffinity(tid, sizeof(set), &set) == 0; });
+}
+
+bool set_preferred_numa_node(int numa_node, const std::vector<uint32_t>&, const std::vector<uint32_t>&)
+{
+    if (numa_node >= static_cast<int>(sizeof(unsigned long) * 8))
+        return false;
+
+    // Applies to the calling thread, which is the one that goes on to start the runtime and create the GC threads.
+    // Called through syscall so there is no dependency on libnuma.
+    const unsigned long node_mask = 1UL << numa_node;
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, &node_mask, sizeof(node_mask) * 8) == 0;
+}
+
+bool set_priority(process_priority priority)
+{
+    int nice_value = 0;
+    switch (priority)
+    {
+    case process_priority::idle: nice_value = 19; break;
+    case process_priority::below_normal: nice_value = 10; break;
+    case process_priority::normal: nice_value = 0; break;
+    case process_priority::above_normal: nice_value = -5; break;
+    case process_priority::high: nice_value = -10; break;
+    case process_priority::unchanged: return true;
+    }
+
+    return for_each_thread([&](pid_t tid) { return setpriority(PRIO_PROCESS, static_cast<id_t>(tid), nice_value) == 0; });
+}
+#endif
+}
+
+bool parse_cpu_list(std::wstring_view text, std::vector<uint32_t>& cpus)
+{
+    cpus.clear();
+
+    while (!text.empty())
+    {
+        const size_t comma = std::min(text.find(L','), text.size());
+        std::wstring_view item = text.substr(0, comma);
+        text.remove_prefix(std::min(comma + 1, text.size()));
+
+        while (!item.empty() && std::iswspace(item.front()))
+            item.remove_prefix(1);
+        while (!item.empty() && std::iswspace(item.back()))
+            item.remove_suffix(1);
+
+        if (item.empty())
+            continue;
+
+        uint32_t first;
+        uint32_t last;
+        if (const size_t dash = item.find(L'-'); dash != std::wstring_view::npos)
+        {
+            if (!parse_number(item.substr(0, dash), first) || !parse_number(item.substr(dash + 1), last) || last < first)
+                return false;
+        }
+        else
+        {
+            if (!parse_number(item, first))
+                return false;
+            last = first;
+        }
+
+        if (last > HOOKFXR_MAX_CPU)
+            return false;
+
+        for (uint32_t cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+
+    std::ranges::sort(cpus);
+    const auto [first, last] = std::ranges::unique(cpus);
+    cpus.erase(first, last);
+    return true;
+}
+
+std::wstring format_cpu_list(const std::vector<uint32_t>& cpus)
+{
+    std::wstring list;
+    for (size_t i = 0; i < cpus.size();)
+    {
+        size_t end = i;
+        while (end + 1 < cpus.size() && cpus[end + 1] == cpus[end] + 1)
+            ++end;
+
+        if (!list.empty())
+            list += L',';
+
+        list += std::to_wstring(cpus[i]);
+        if (end > i)
+        {
+            list += L'-';
+            list += std::to_wstring(cpus[end]);
+        }
+
+        i = end + 1;
+    }
+    return list;
+}
+
+process_priority parse_process_priority(std::wstring_view name)
+{
+    std::wstring value(name);
+    std::ranges::transform(value, value.begin(), ::towlower);
+
+    if (value == L"idle")
+        return process_priority::idle;
+    if (value == L"below_normal")
+        return process_priority::below_normal;
+    if (value == L"normal")
+        return process_priority::normal;
+    if (value == L"above_normal")
+        return process_priority::above_normal;
+    if (value == L"high")
+        return process_priority::high;
+
+    return process_priority::unchanged;
+}
+
+placement_result apply_process_placement(const std::vector<uint32_t>& cpus, int numa_node, process_priority priority)
+{
+    placement_result result;
+    result.m_cpus = cpus;
+
+    std::vector<uint32_t> node_cpus;
+    const bool node_found = numa_node >= 0 && get_numa_node_cpus(numa_node, node_cpus);
+    if (node_found && result.m_cpus.empty())
+    {
+        result.m_cpus = node_cpus;
+    }
+
+    if (!result.m_cpus.empty())
+    {
+        result.m_affinity_applied = set_affinity(result.m_cpus);
+        if (!result.m_affinity_applied)
+        {
+            result.m_cpus.clear();
+        }
+    }
+
+    // After the affinity, whether the node is in effect can depend on the CPUs the process actually ended up on.
+    if (numa_node >= 0)
+    {
+        result.m_numa_node_applied = node_found && set_preferred_numa_node(numa_node, node_cpus, result.m_cpus);
+    }
+
+    result.m_priority_applied = set_priority(priority);
+    return result;
+}
+
+void apply_gc_placement(const std::vector<uint32_t>& cpus)
+{
+    if (cpus.empty())
+        return;
+
+    // A mask set by the user conflicts with the ranges. The heap count is left to the GC, which already sizes it from
+    // the process affinity and would otherwise lose System.GC.HeapCount from the runtimeconfig.json to the variable.
+    if (!is_clr_knob_set(L"GCHeapAffinitizeRanges") && !is_clr_knob_set(L"GCHeapAffinitizeMask"))
+    {
+        set_environment(L"DOTNET_GCHeapAffinitizeRanges", format_cpu_list(cpus));
+    }
+}
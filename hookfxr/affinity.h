@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Process placement (CPU affinity, NUMA node, scheduling priority), applied before the runtime starts so that the
+// GC creates its heaps and threads on the selected CPUs.
+// Kept free of hookfxr's Windows-only headers, it builds and works on Linux as well.
+
+enum class process_priority : uint8_t
+{
+    unchanged,
+    idle,
+    below_normal,
+    normal,
+    above_normal,
+    high,
+};
+
+struct placement_result
+{
+    // CPUs the process was restricted to, empty if the affinity was left unchanged.
+    std::vector<uint32_t> m_cpus;
+    bool m_affinity_applied{ true };
+    // On Windows the node is only in effect if the process ended up on a subset of its CPUs.
+    bool m_numa_node_applied{ true };
+    bool m_priority_applied{ true };
+};
+
+// Parses a CPU list such as "0-3,8,10-11" into sorted, unique CPU numbers. Returns false if the list is malformed.
+bool parse_cpu_list(std::wstring_view text, std::vector<uint32_t>& cpus);
+
+// Formats CPU numbers as a list of ranges, the format of parse_cpu_list and GCHeapAffinitizeRanges.
+std::wstring format_cpu_list(const std::vector<uint32_t>& cpus);
+
+// Returns process_priority::unchanged for an empty or unknown name.
+process_priority parse_process_priority(std::wstring_view name);
+
+// Restricts the process to cpus and prefers memory from numa_node (-1 for none). Without cpus, a NUMA node restricts
+// the process to the CPUs of that node.
+placement_result apply_process_placement(const std::vector<uint32_t>& cpus, int numa_node, process_priority priority);
+
+// Points the GC at the CPUs the process was restricted to (DOTNET_GCHeapAffinitizeRanges), unless the heap affinity
+// is already configured through the environment, e.g. [environment].
+void apply_gc_placement(const std::vector<uint32_t>& cpus);
@@ -0,0 +1,107 @@
+#include "cache_file.h"
+
+#include "defines.h"
+
+namespace
+{
+struct cache_file_header
+{
+    uint32_t m_magic;
+    uint32_t m_version;
+};
+
+HANDLE create_temp_file(const std::wstring& path)
+{
+    return CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+}
+}
+
+cache_writer::cache_writer(uint32_t magic, uint32_t version)
+{
+    write(cache_file_header{ magic, version });
+}
+
+void cache_writer::write(std::wstring_view value)
+{
+    write(static_cast<uint32_t>(value.size()));
+    const auto* bytes = reinterpret_cast<const uint8_t*>(value.data());
+    m_data.insert(m_data.end(), bytes, bytes + value.size() * sizeof(wchar_t));
+}
+
+bool cache_reader::open(const std::wstring& path, uint32_t magic, uint32_t version, size_t max_size)
+{
+    m_data.clear();
+    m_pos = 0;
+
+    const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    DWORD bytes_read = 0;
+    bool ok = GetFileSizeEx(file, &size) && static_cast<uint64_t>(size.QuadPart) <= max_size;
+    if (ok)
+    {
+        m_data.resize(static_cast<size_t>(size.QuadPart));
+        ok = ReadFile(file, m_data.data(), static_cast<DWORD>(m_data.size()), &bytes_read, nullptr) &&
+            bytes_read == m_data.size();
+    }
+
+    CloseHandle(file);
+
+    cache_file_header header;
+    if (!ok || !read(header) || header.m_magic != magic || header.m_version != version)
+    {
+        m_data.clear();
+        m_pos = 0;
+        return false;
+    }
+
+    return true;
+}
+
+bool cache_reader::read(std::wstring& value, size_t max_length)
+{
+    uint32_t length;
+    if (!read(length) || length >= max_length || (m_data.size() - m_pos) / sizeof(wchar_t) < length)
+        return false;
+
+    value.resize(length);
+    std::copy_n(m_data.data() + m_pos, length * sizeof(wchar_t), reinterpret_cast<uint8_t*>(value.data()));
+    m_pos += length * sizeof(wchar_t);
+    return true;
+}
+
+bool cache_file_write(const std::wstring& path, const cache_writer& writer)
+{
+    const std::wstring temp_path = path + L".tmp";
+    HANDLE file = create_temp_file(temp_path);
+
+    // The cache directory is only created by the first cache file written, installs that use no cache never get one.
+    if (file == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PATH_NOT_FOUND)
+    {
+        const std::wstring directory = path.substr(0, path.find_last_of(L'\\') + 1);
+        if (!directory.empty() && CreateDirectoryW(directory.c_str(), nullptr))
+        {
+            file = create_temp_file(temp_path);
+        }
+    }
+
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    const std::vector<uint8_t>& data = writer.data();
+    DWORD written;
+    const bool ok = WriteFile(file, data.data(), static_cast<DWORD>(data.size()), &written, nullptr) &&
+        written == data.size();
+    CloseHandle(file);
+
+    if (!ok || !MoveFileExW(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(temp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
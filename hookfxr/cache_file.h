@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Binary cache files: hookfxr.prefetch, hookfxr.plugins, hookfxr.depscheck and hookfxr.manifest, all of them in the
+// hookfxr.cache directory next to hookfxr.ini.
+// Each starts with a magic and a format version, and is read in one go up to a size limit. It is written to a
+// temporary file next to it that then replaces it, so a launch running concurrently never reads a partial file.
+// Strings are their length as uint32_t followed by that many UTF-16 code units, without terminator.
+
+class cache_writer
+{
+public:
+    cache_writer(uint32_t magic, uint32_t version);
+
+    template <typename T>
+    void write(const T& value)
+    {
+        // Pointers and arrays, e.g. string literals, would write the address or the raw array.
+        static_assert(std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> && !std::is_array_v<T>);
+        const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+        m_data.insert(m_data.end(), bytes, bytes + sizeof(T));
+    }
+
+    void write(std::wstring_view value);
+    void write(const std::wstring& value) { write(std::wstring_view(value)); }
+
+    const std::vector<uint8_t>& data() const { return m_data; }
+
+private:
+    std::vector<uint8_t> m_data;
+};
+
+class cache_reader
+{
+public:
+    // Reads path, returns false if it does not exist, is larger than max_size or has another magic or version.
+    bool open(const std::wstring& path, uint32_t magic, uint32_t version, size_t max_size);
+
+    template <typename T>
+    bool read(T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (m_data.size() - m_pos < sizeof(T))
+            return false;
+
+        std::copy_n(m_data.data() + m_pos, sizeof(T), reinterpret_cast<uint8_t*>(&value));
+        m_pos += sizeof(T);
+        return true;
+    }
+
+    // Fails for strings of max_length code units or more.
+    bool read(std::wstring& value, size_t max_length = SIZE_MAX);
+
+    // True once everything has been read, a file with trailing data is treated as corrupt.
+    bool at_end() const { return m_pos == m_data.size(); }
+
+private:
+    std::vector<uint8_t> m_data;
+    size_t m_pos{ 0 };
+};
+
+// Replaces path with the data of writer. Returns false, leaving path as it was, if it could not be written. Creates the
+// directory of path if it does not exist, but not its parents.
+bool cache_file_write(const std::wstring& path, const cache_writer& writer);
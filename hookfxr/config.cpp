@@ -1,11 +1,11 @@
 #include "config.h"
 
 #include "defines.h"
-#include "shellapi.h"
+#include "startup_manifest.h"
 
 #include <algorithm>
 #include <filesystem>
-#include <iostream>
+#include <string_view>
 
 namespace
 {
@@ -23,30 +23,6 @@ std::wstring get_dll_directory()
     return L"";
 }
 
-std::wstring make_absolute_path(const std::wstring& path)
-{
-    // If path is already absolute, return as-is
-    if (std::filesystem::path(path).is_absolute())
-    {
-        return path;
-    }
-    
-    std::filesystem::path dll_dir = std::filesystem::path(get_dll_directory()).parent_path();
-    std::filesystem::path absolute_path = dll_dir / path;
-    
-    // Normalize the path (resolve .., ., etc.)
-    std::error_code ec;
-    std::filesystem::path canonical_path = std::filesystem::canonical(absolute_path, ec);
-    
-    if (!ec)
-    {
-        return canonical_path.wstring();
-    }
-    
-    // If canonical fails (file doesn't exist), return the absolute path without resolving
-    return std::filesystem::absolute(absolute_path).wstring();
-}
-
 std::wstring read_ini_string(const std::wstring& file_path, const std::wstring& section, const std::wstring& key, const std::wstring& default_value = L"")
 {
     wchar_t buffer[1024];
@@ -62,6 +38,63 @@ std::wstring read_ini_string(const std::wstring& file_path, const std::wstring&
     return std::wstring(buffer);
 }
 
+std::wstring_view trim(std::wstring_view value)
+{
+    const size_t first = value.find_first_not_of(L" \t");
+    if (first == std::wstring_view::npos)
+        return {};
+
+    return value.substr(first, value.find_last_not_of(L" \t") - first + 1);
+}
+
+// Splits NAME=VALUE, returns false for lines that are not an assignment.
+bool parse_assignment(std::wstring_view line, std::pair<std::wstring, std::wstring>& out)
+{
+    line = trim(line);
+    if (line.empty() || line.front() == L'#' || line.front() == L';')
+        return false;
+
+    const size_t equals = line.find(L'=');
+    if (equals == std::wstring_view::npos || equals == 0)
+        return false;
+
+    out.first = trim(line.substr(0, equals));
+    out.second = trim(line.substr(equals + 1));
+    return !out.first.empty();
+}
+
+std::vector<std::pair<std::wstring, std::wstring>> read_ini_section(const std::wstring& file_path, const std::wstring& section)
+{
+    // The section is returned as NAME=VALUE strings, each null terminated, followed by an extra terminator.
+    std::vector<wchar_t> buffer(4096);
+    for (;;)
+    {
+        const DWORD length = GetPrivateProfileSectionW(
+            section.c_str(),
+            buffer.data(),
+            static_cast<DWORD>(buffer.size()),
+            file_path.c_str());
+
+        if (length < buffer.size() - 2)
+        {
+            buffer.resize(length + 1);
+            break;
+        }
+
+        buffer.resize(buffer.size() * 2);
+    }
+
+    std::vector<std::pair<std::wstring, std::wstring>> entries;
+    for (const wchar_t* line = buffer.data(); *line != L'\0'; line += wcslen(line) + 1)
+    {
+        if (std::pair<std::wstring, std::wstring> entry; parse_assignment(line, entry))
+        {
+            entries.push_back(std::move(entry));
+        }
+    }
+    return entries;
+}
+
 bool read_ini_bool(const std::wstring& file_path, const std::wstring& section, const std::wstring& key, bool default_value = false)
 {
     std::wstring value = read_ini_string(file_path, section, key, default_value ? L"true" : L"false");
@@ -70,14 +103,64 @@ bool read_ini_bool(const std::wstring& file_path, const std::wstring& section, c
     return value == L"true" || value == L"1";
 }
 
-void parse_command_line(hookfxr_config& config)
+log_level parse_log_level(std::wstring value, log_level default_value)
+{
+    std::ranges::transform(value, value.begin(), ::towlower);
+
+    if (value == L"trace")
+        return log_level::trace;
+    if (value == L"info")
+        return log_level::info;
+    if (value == L"warning")
+        return log_level::warning;
+    if (value == L"error")
+        return log_level::error;
+    if (value == L"critical")
+        return log_level::critical;
+
+    return default_value;
+}
+
+void parse_cpu_affinity(const std::wstring& value, hookfxr_config& config)
+{
+    if (!parse_cpu_list(value, config.m_cpu_affinity))
+    {
+        HFXR_WARNING(L"Invalid CPU list '{}', leaving the CPU affinity unchanged", value);
+        config.m_cpu_affinity.clear();
+    }
+}
+
+std::wstring parse_plugin_directory(const std::wstring& value)
+{
+    if (value.empty())
+        return value;
+
+    std::wstring directory = make_absolute_path(value);
+    while (directory.size() > 3 && (directory.back() == L'\\' || directory.back() == L'/'))
+    {
+        directory.pop_back();
+    }
+    return directory;
+}
+
+int parse_numa_node(const std::wstring& value, int default_value)
+{
+    if (value.empty())
+        return default_value;
+
+    wchar_t* end;
+    const long node = wcstol(value.c_str(), &end, 10);
+    if (*end != L'\0' || node < 0)
+    {
+        HFXR_WARNING(L"Invalid NUMA node '{}'", value);
+        return default_value;
+    }
+
+    return static_cast<int>(node);
+}
+
+void parse_command_line(hookfxr_config& config, int argc, const wchar_t** argv)
 {
-    int argc;
-    wchar_t** argv = CommandLineToArgvW(GetCommandLineW(), &argc);
-    
-    if (argv == nullptr)
-        return;
-    
     for (int i = 1; i < argc; ++i)
     {
         const std::wstring arg(argv[i]);
@@ -106,19 +189,122 @@ void parse_command_line(hookfxr_config& config)
         {
             config.m_merge_deps_json = false;
         }
+        else if (arg == L"--hookfxr-plugin-dir" && i + 1 < argc)
+        {
+            config.m_plugin_directory = parse_plugin_directory(argv[++i]);
+        }
+        else if (arg == L"--hookfxr-validate-deps")
+        {
+            config.m_validate_deps = true;
+        }
+        else if (arg == L"--hookfxr-no-validate-deps")
+        {
+            config.m_validate_deps = false;
+        }
+        else if (arg == L"--hookfxr-log-file" && i + 1 < argc)
+        {
+            config.m_log_file = make_absolute_path(argv[++i]);
+        }
+        else if (arg == L"--hookfxr-log-level" && i + 1 < argc)
+        {
+            config.m_log_level = parse_log_level(argv[++i], config.m_log_level);
+        }
+        else if (arg == L"--hookfxr-host-trace")
+        {
+            config.m_host_trace = true;
+        }
+        else if (arg == L"--hookfxr-no-host-trace")
+        {
+            config.m_host_trace = false;
+        }
+        else if (arg == L"--hookfxr-cpu-affinity" && i + 1 < argc)
+        {
+            parse_cpu_affinity(argv[++i], config);
+        }
+        else if (arg == L"--hookfxr-numa-node" && i + 1 < argc)
+        {
+            config.m_numa_node = parse_numa_node(argv[++i], config.m_numa_node);
+        }
+        else if (arg == L"--hookfxr-priority" && i + 1 < argc)
+        {
+            config.m_priority = parse_process_priority(argv[++i]);
+        }
+        else if (arg == L"--hookfxr-env" && i + 1 < argc)
+        {
+            if (std::pair<std::wstring, std::wstring> entry; parse_assignment(argv[++i], entry))
+            {
+                config.m_environment.push_back(std::move(entry));
+            }
+        }
+        else if (arg == L"--hookfxr-profile-startup")
+        {
+            config.m_profile_startup = true;
+        }
+        else if (arg == L"--hookfxr-no-profile-startup")
+        {
+            config.m_profile_startup = false;
+        }
+        else if (arg == L"--hookfxr-fast-exit")
+        {
+            config.m_fast_exit = true;
+        }
+        else if (arg == L"--hookfxr-no-fast-exit")
+        {
+            config.m_fast_exit = false;
+        }
+        else if (arg == L"--hookfxr-prefetch" && i + 1 < argc)
+        {
+            config.m_prefetch = parse_prefetch_mode(argv[++i]);
+        }
     }
-    
-    LocalFree(argv);
 }
 }
 
-hookfxr_config get_hookfxr_config()
+std::wstring make_absolute_path(const std::wstring& path)
+{
+    // If path is already absolute, return as-is
+    if (std::filesystem::path(path).is_absolute())
+    {
+        return path;
+    }
+    
+    if (const std::wstring* cached = startup_manifest_find(manifest_entry::absolute_path, path))
+    {
+        return *cached;
+    }
+
+    std::filesystem::path dll_dir = std::filesystem::path(get_dll_directory()).parent_path();
+    std::filesystem::path absolute_path = dll_dir / path;
+    
+    // Normalize the path (resolve .., ., etc.)
+    std::error_code ec;
+    std::filesystem::path canonical_path = std::filesystem::canonical(absolute_path, ec);
+    
+    // If canonical fails (file doesn't exist), use the absolute path without resolving
+    std::wstring result = !ec ? canonical_path.wstring() : std::filesystem::absolute(absolute_path).wstring();
+
+    // Creating or removing the file changes the write time of its directory, which invalidates the result.
+    startup_manifest_add(manifest_entry::absolute_path, path, result,
+        std::filesystem::path(result).parent_path().wstring());
+    return result;
+}
+
+hookfxr_config get_hookfxr_config(int argc, const wchar_t** argv)
 {
     hookfxr_config config{};
 
     // Read from hookfxr.ini
     const std::wstring exe_dir = get_dll_directory();
     const std::wstring ini_path = exe_dir + L"hookfxr.ini";
+
+    // The cache files live in a directory of their own. The manifest and the deps check stamp the write time of the
+    // exe directory, which would change with every cache file written or replaced directly in it. cache_file_write
+    // creates the directory with the first cache file, only the launch after that sees the exe directory changed.
+    const std::wstring cache_dir = exe_dir + L"hookfxr.cache\\";
+    config.m_prefetch_file = cache_dir + L"hookfxr.prefetch";
+    config.m_plugin_index_file = cache_dir + L"hookfxr.plugins";
+    config.m_deps_check_file = cache_dir + L"hookfxr.depscheck";
+    startup_manifest_load(cache_dir + L"hookfxr.manifest", ini_path, argc, argv);
     
     if (GetFileAttributesW(ini_path.c_str()) != INVALID_FILE_ATTRIBUTES)
     {
@@ -127,14 +313,30 @@ hookfxr_config get_hookfxr_config()
         config.m_target_assembly = make_absolute_path(read_ini_string(ini_path, L"hookfxr", L"target_assembly"));
         config.m_dotnet_root_override = read_ini_string(ini_path, L"hookfxr", L"dotnet_root_override");
         config.m_merge_deps_json = read_ini_bool(ini_path, L"hookfxr", L"merge_deps_json", true);
+        config.m_plugin_directory = parse_plugin_directory(read_ini_string(ini_path, L"hookfxr", L"plugin_directory"));
+        config.m_validate_deps = read_ini_bool(ini_path, L"hookfxr", L"validate_deps", false);
+
+        if (const std::wstring log_file = read_ini_string(ini_path, L"hookfxr", L"log_file"); !log_file.empty())
+        {
+            config.m_log_file = make_absolute_path(log_file);
+        }
+        config.m_log_level = parse_log_level(read_ini_string(ini_path, L"hookfxr", L"log_level"), log_level::info);
+        config.m_host_trace = read_ini_bool(ini_path, L"hookfxr", L"host_trace", false);
+        config.m_profile_startup = read_ini_bool(ini_path, L"hookfxr", L"profile_startup", false);
+        config.m_fast_exit = read_ini_bool(ini_path, L"hookfxr", L"fast_exit", true);
+        config.m_prefetch = parse_prefetch_mode(read_ini_string(ini_path, L"hookfxr", L"prefetch"));
+        parse_cpu_affinity(read_ini_string(ini_path, L"hookfxr", L"cpu_affinity"), config);
+        config.m_numa_node = parse_numa_node(read_ini_string(ini_path, L"hookfxr", L"numa_node"), -1);
+        config.m_priority = parse_process_priority(read_ini_string(ini_path, L"hookfxr", L"priority"));
+        config.m_environment = read_ini_section(ini_path, L"environment");
     }
     else
     {
-        std::wcerr << L"hookfxr.ini not found in " << exe_dir << L". Using default configuration.\n";
+        HFXR_WARNING(L"hookfxr.ini not found in {}. Using default configuration.", exe_dir);
     }
 
     // Override with command line arguments
-    parse_command_line(config);
+    parse_command_line(config, argc, argv);
     
     return config;
 }
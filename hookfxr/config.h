@@ -1,5 +1,11 @@
 #pragma once
+#include "affinity.h"
+#include "log.h"
+#include "prefetch.h"
+
 #include <string>
+#include <utility>
+#include <vector>
 
 struct hookfxr_config
 {
@@ -7,6 +13,30 @@ struct hookfxr_config
     std::wstring m_target_assembly;
     std::wstring m_dotnet_root_override;
     bool m_merge_deps_json{ true };
+    // Absolute, without trailing separator. Empty if no plugin directory is configured.
+    std::wstring m_plugin_directory;
+    // hookfxr.cache\hookfxr.plugins next to hookfxr.ini.
+    std::wstring m_plugin_index_file;
+    bool m_validate_deps{ false };
+    // hookfxr.cache\hookfxr.depscheck next to hookfxr.ini.
+    std::wstring m_deps_check_file;
+    std::wstring m_log_file;
+    log_level m_log_level{ log_level::info };
+    bool m_host_trace{ false };
+    bool m_profile_startup{ false };
+    bool m_fast_exit{ true };
+    prefetch_mode m_prefetch{ prefetch_mode::off };
+    // hookfxr.cache\hookfxr.prefetch next to hookfxr.ini.
+    std::wstring m_prefetch_file;
+    std::vector<uint32_t> m_cpu_affinity;
+    int m_numa_node{ -1 };
+    process_priority m_priority{ process_priority::unchanged };
+    // Variables from the [environment] section and --hookfxr-env, in the order they are applied.
+    std::vector<std::pair<std::wstring, std::wstring>> m_environment;
 };
 
-hookfxr_config get_hookfxr_config();
+// Reads hookfxr.ini and applies the --hookfxr-* overrides from the command line the apphost was started with.
+hookfxr_config get_hookfxr_config(int argc, const wchar_t** argv);
+
+// Resolves a relative path against the directory of the executable, like the paths in hookfxr.ini.
+std::wstring make_absolute_path(const std::wstring& path);
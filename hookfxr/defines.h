@@ -3,13 +3,18 @@
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 
-#include <iostream>
+#include <cstdlib>
+
+#include "log.h"
 
 #define HFXR_UNREACHABLE(msg) \
     do { \
-        std::cerr << __FILE__ << ":" << __LINE__ << " hookfxr critical:" << (msg) << std::endl; \
+        log_write(log_level::critical, __FILE__, __LINE__, (msg)); \
+        log_flush(); \
         abort(); \
     } while(0)
 
-#define HFXR_ERROR std::cerr << __FILE__ << ":" << __LINE__ << " hookfxr error:"
-#define HFXR_WERROR std::wcerr << __FILE__ << ":" << __LINE__ << " hookfxr error:"
+#define HFXR_ERROR(...) log_format(log_level::error, __FILE__, __LINE__, __VA_ARGS__)
+#define HFXR_WARNING(...) log_format(log_level::warning, __FILE__, __LINE__, __VA_ARGS__)
+#define HFXR_INFO(...) log_format(log_level::info, __FILE__, __LINE__, __VA_ARGS__)
+#define HFXR_TRACE(...) log_format(log_level::trace, __FILE__, __LINE__, __VA_ARGS__)
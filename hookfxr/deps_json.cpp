@@ -0,0 +1,286 @@
+#include "deps_json.h"
+
+// Nesting deeper than this is not a deps file.
+#define HOOKFXR_JSON_MAX_DEPTH 64
+
+namespace
+{
+class json_parser
+{
+public:
+    explicit json_parser(std::string_view text) : m_pos(text.data()), m_end(text.data() + text.size()) {}
+
+    bool parse(json_value& value)
+    {
+        if (!parse_value(value, 0))
+            return false;
+
+        skip_whitespace();
+        return m_pos == m_end;
+    }
+
+private:
+    const char* m_pos;
+    const char* m_end;
+
+    void skip_whitespace()
+    {
+        while (m_pos != m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\r' || *m_pos == '\n'))
+            ++m_pos;
+    }
+
+    bool consume(char c)
+    {
+        skip_whitespace();
+        if (m_pos == m_end || *m_pos != c)
+            return false;
+
+        ++m_pos;
+        return true;
+    }
+
+    bool parse_hex4(uint32_t& value)
+    {
+        if (m_end - m_pos < 4)
+            return false;
+
+        value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            const char c = *m_pos++;
+            value <<= 4;
+            if (c >= '0' && c <= '9')
+                value |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f')
+                value |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F')
+                value |= static_cast<uint32_t>(c - 'A' + 10);
+            else
+                return false;
+        }
+        return true;
+    }
+
+    static void append_utf8(std::string& out, uint32_t code_point)
+    {
+        if (code_point < 0x80)
+        {
+            out += static_cast<char>(code_point);
+        }
+        else if (code_point < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (code_point >> 6));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        else if (code_point < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (code_point >> 12));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (code_point >> 18));
+            out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+    }
+
+    bool parse_string(std::string& out)
+    {
+        if (!consume('"'))
+            return false;
+
+        out.clear();
+        while (m_pos != m_end)
+        {
+            const char c = *m_pos++;
+            if (c == '"')
+                return true;
+
+            // Control characters have to be escaped.
+            if (static_cast<unsigned char>(c) < 0x20)
+                return false;
+
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+
+            if (m_pos == m_end)
+                return false;
+
+            switch (*m_pos++)
+            {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+                uint32_t code_point;
+                if (!parse_hex4(code_point))
+                    return false;
+
+                // A high surrogate must be followed by an escaped low surrogate, together they are one code point.
+                if (code_point >= 0xDC00 && code_point < 0xE000)
+                    return false;
+
+                if (code_point >= 0xD800 && code_point < 0xDC00)
+                {
+                    uint32_t low;
+                    if (m_end - m_pos < 6 || m_pos[0] != '\\' || m_pos[1] != 'u')
+                        return false;
+
+                    m_pos += 2;
+                    if (!parse_hex4(low) || low < 0xDC00 || low >= 0xE000)
+                        return false;
+
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                }
+
+                append_utf8(out, code_point);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+
+        return false;
+    }
+
+    bool parse_value(json_value& value, int depth)
+    {
+        if (depth > HOOKFXR_JSON_MAX_DEPTH)
+            return false;
+
+        skip_whitespace();
+        if (m_pos == m_end)
+            return false;
+
+        if (*m_pos == '"')
+        {
+            value.m_kind = json_value::kind::string;
+            return parse_string(value.m_string);
+        }
+
+        if (*m_pos == '{')
+        {
+            ++m_pos;
+            value.m_kind = json_value::kind::object;
+            if (consume('}'))
+                return true;
+
+            do
+            {
+                auto& [name, member] = value.m_members.emplace_back();
+                if (!parse_string(name) || !consume(':') || !parse_value(member, depth + 1))
+                    return false;
+            } while (consume(','));
+
+            return consume('}');
+        }
+
+        if (*m_pos == '[')
+        {
+            ++m_pos;
+            value.m_kind = json_value::kind::array;
+            if (consume(']'))
+                return true;
+
+            do
+            {
+                if (!parse_value(value.m_items.emplace_back(), depth + 1))
+                    return false;
+            } while (consume(','));
+
+            return consume(']');
+        }
+
+        value.m_kind = json_value::kind::other;
+        if (*m_pos == '-' || (*m_pos >= '0' && *m_pos <= '9'))
+            return parse_number();
+
+        return consume_literal("true") || consume_literal("false") || consume_literal("null");
+    }
+
+    bool consume_literal(std::string_view literal)
+    {
+        if (static_cast<size_t>(m_end - m_pos) < literal.size() || std::string_view(m_pos, literal.size()) != literal)
+            return false;
+
+        m_pos += literal.size();
+        return true;
+    }
+
+    bool consume_digits()
+    {
+        const char* start = m_pos;
+        while (m_pos != m_end && *m_pos >= '0' && *m_pos <= '9')
+            ++m_pos;
+        return m_pos != start;
+    }
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    bool parse_number()
+    {
+        if (*m_pos == '-')
+            ++m_pos;
+
+        if (m_pos != m_end && *m_pos == '0')
+        {
+            ++m_pos;
+        }
+        else if (!consume_digits())
+        {
+            return false;
+        }
+
+        if (m_pos != m_end && *m_pos == '.')
+        {
+            ++m_pos;
+            if (!consume_digits())
+                return false;
+        }
+
+        if (m_pos != m_end && (*m_pos == 'e' || *m_pos == 'E'))
+        {
+            ++m_pos;
+            if (m_pos != m_end && (*m_pos == '+' || *m_pos == '-'))
+                ++m_pos;
+            if (!consume_digits())
+                return false;
+        }
+
+        return true;
+    }
+};
+}
+
+const json_value* json_value::find(std::string_view key) const
+{
+    for (const auto& [name, value] : m_members)
+    {
+        if (name == key)
+            return &value;
+    }
+    return nullptr;
+}
+
+std::string_view json_value::string_member(std::string_view key) const
+{
+    const json_value* value = find(key);
+    return value && value->m_kind == kind::string ? std::string_view(value->m_string) : std::string_view();
+}
+
+bool parse_json(std::string_view text, json_value& value)
+{
+    return json_parser(text).parse(value);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Just enough JSON for deps files: objects keep their members in order, numbers and literals are validated but only
+// kept as their kind. The grammar is RFC 8259's, without extensions such as comments or trailing commas, which
+// hostpolicy rejects as well.
+// Kept free of hookfxr's Windows-only headers, it builds and works on Linux as well.
+
+struct json_value
+{
+    enum class kind : uint8_t
+    {
+        other, // A number, true, false or null.
+        string,
+        array,
+        object,
+    };
+
+    kind m_kind{ kind::other };
+    std::string m_string;
+    std::vector<std::pair<std::string, json_value>> m_members;
+    std::vector<json_value> m_items;
+
+    // The first member named key, nullptr if there is none or this is not an object.
+    const json_value* find(std::string_view key) const;
+
+    // The member named key if it is a string, empty otherwise.
+    std::string_view string_member(std::string_view key) const;
+};
+
+// Parses text, which must hold exactly one value. Strings are returned as UTF-8, with escapes resolved.
+bool parse_json(std::string_view text, json_value& value);
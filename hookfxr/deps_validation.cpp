@@ -0,0 +1,368 @@
+#include "deps_validation.h"
+
+#include "cache_file.h"
+#include "defines.h"
+#include "deps_json.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#define HOOKFXR_DEPS_CHECK_MAGIC 0x56444648 // "HFDV"
+#define HOOKFXR_DEPS_CHECK_VERSION 2
+// Threads checking assets. Most lookups are answered from the file system cache, a few threads hide the cold ones.
+#define HOOKFXR_DEPS_CHECK_THREADS 4
+// Assets a thread takes at a time.
+#define HOOKFXR_DEPS_CHECK_BATCH 32
+// Missing assets that are logged one by one, the rest are only counted.
+#define HOOKFXR_DEPS_CHECK_MAX_REPORTED 32
+// Upper bounds of stamps in the cache file and of its size, a larger file is treated as corrupt.
+#define HOOKFXR_DEPS_CHECK_MAX_STAMPS 4096
+#define HOOKFXR_DEPS_CHECK_MAX_SIZE (4 * 1024 * 1024)
+
+namespace
+{
+struct asset
+{
+    std::wstring m_deps_file;
+    std::string m_library;
+    std::string m_relative_path;
+    // Paths the asset may be found at, in the order hostpolicy probes them.
+    std::vector<std::wstring> m_candidates;
+};
+
+// Size and write time of a deps file or a searched directory when the validation passed.
+struct stamp
+{
+    std::wstring m_path;
+    uint64_t m_size{ 0 };
+    uint64_t m_write_time{ 0 };
+
+    bool operator==(const stamp&) const = default;
+};
+
+std::wstring to_wide(std::string_view text)
+{
+    std::wstring wide;
+    if (text.empty())
+        return wide;
+
+    const int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), nullptr, 0);
+    wide.resize(static_cast<size_t>(length));
+    MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), wide.data(), length);
+    return wide;
+}
+
+// Joins a directory and a relative path from a deps file, whose separator is '/'.
+std::wstring join_path(const std::wstring& directory, std::string_view relative_path)
+{
+    std::wstring path = directory;
+    if (!path.empty() && path.back() != L'\\' && path.back() != L'/')
+    {
+        path += L'\\';
+    }
+
+    const size_t start = path.size();
+    path += to_wide(relative_path);
+    std::replace(path.begin() + static_cast<ptrdiff_t>(start), path.end(), L'/', L'\\');
+    return path;
+}
+
+std::wstring get_directory(const std::wstring& path)
+{
+    const size_t slash = path.find_last_of(L"\\/");
+    return slash == std::wstring::npos ? std::wstring() : path.substr(0, slash);
+}
+
+std::string_view get_file_name(std::string_view relative_path)
+{
+    const size_t slash = relative_path.find_last_of('/');
+    return slash == std::string_view::npos ? relative_path : relative_path.substr(slash + 1);
+}
+
+bool get_stamp(const std::wstring& path, stamp& out)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+        return false;
+
+    out.m_path = path;
+    out.m_size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    out.m_write_time = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+        data.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+bool read_text_file(const std::wstring& path, std::string& text)
+{
+    const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    bool ok = GetFileSizeEx(file, &size) && size.QuadPart < 0x40000000;
+    if (ok)
+    {
+        DWORD read;
+        text.resize(static_cast<size_t>(size.QuadPart));
+        ok = ReadFile(file, text.data(), static_cast<DWORD>(text.size()), &read, nullptr) && read == text.size();
+    }
+
+    CloseHandle(file);
+
+    // Skip the UTF-8 BOM that some tools write.
+    if (ok && text.starts_with("\xEF\xBB\xBF"))
+    {
+        text.erase(0, 3);
+    }
+
+    return ok;
+}
+
+// Adds the runtime and native assets of the deps file's runtime target, with the paths hostpolicy would probe.
+bool collect_assets(const std::wstring& deps_file, const std::wstring& app_directory,
+    const std::vector<std::wstring>& probe_paths, std::vector<asset>& assets)
+{
+    std::string text;
+    json_value root;
+    if (!read_text_file(deps_file, text) || !parse_json(text, root) || root.m_kind != json_value::kind::object)
+    {
+        HFXR_ERROR(L"Failed to read {}", deps_file);
+        return false;
+    }
+
+    const json_value* targets = root.find("targets");
+    if (!targets || targets->m_members.empty())
+        return true;
+
+    const json_value* target = nullptr;
+    if (const json_value* runtime_target = root.find("runtimeTarget"))
+    {
+        target = targets->find(runtime_target->string_member("name"));
+    }
+    if (!target)
+    {
+        target = &targets->m_members.front().second;
+    }
+
+    const json_value* libraries = root.find("libraries");
+    const std::wstring deps_directory = get_directory(deps_file);
+
+    for (const auto& [library_name, library] : target->m_members)
+    {
+        const json_value* info = libraries ? libraries->find(library_name) : nullptr;
+        const std::string_view type = info ? info->string_member("type") : std::string_view();
+
+        // Reference assemblies are only used to compile against.
+        if (type == "reference")
+            continue;
+
+        const std::string_view package_path = info ? info->string_member("path") : std::string_view();
+
+        for (const char* asset_type : { "runtime", "native" })
+        {
+            const json_value* entries = library.find(asset_type);
+            if (!entries)
+                continue;
+
+            for (const auto& [relative_path, properties] : entries->m_members)
+            {
+                asset& entry = assets.emplace_back();
+                entry.m_deps_file = deps_file;
+                entry.m_library = library_name;
+                entry.m_relative_path = relative_path;
+
+                // App-local assets are flattened into the app directory unless the deps file says otherwise.
+                const std::string_view local_path = properties.string_member("localPath");
+                const std::string_view app_relative_path =
+                    local_path.empty() ? get_file_name(relative_path) : local_path;
+                entry.m_candidates.push_back(join_path(app_directory, app_relative_path));
+                if (deps_directory != app_directory)
+                {
+                    entry.m_candidates.push_back(join_path(deps_directory, app_relative_path));
+                }
+
+                if (!package_path.empty())
+                {
+                    for (const std::wstring& probe_path : probe_paths)
+                    {
+                        entry.m_candidates.push_back(join_path(join_path(probe_path, package_path), relative_path));
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+// Stamps of everything a passing validation depends on. Directories only change their write time when an entry
+// directly in them is added, removed or renamed, assets deeper in a package layout are not covered.
+std::vector<stamp> get_stamps(const std::vector<std::wstring>& deps_files, const std::wstring& app_directory,
+    const std::vector<std::wstring>& probe_paths)
+{
+    std::vector<std::wstring> paths = deps_files;
+    paths.push_back(app_directory);
+    for (const std::wstring& deps_file : deps_files)
+    {
+        paths.push_back(get_directory(deps_file));
+    }
+    paths.insert(paths.end(), probe_paths.begin(), probe_paths.end());
+
+    std::vector<stamp> stamps;
+    for (const std::wstring& path : paths)
+    {
+        if (std::ranges::any_of(stamps, [&](const stamp& existing) { return existing.m_path == path; }))
+            continue;
+
+        // A path that does not exist is recorded as such, creating it invalidates the cache as well.
+        stamp& entry = stamps.emplace_back();
+        if (!get_stamp(path, entry))
+        {
+            entry = stamp{ path };
+        }
+    }
+
+    return stamps;
+}
+
+// The cache is the stamp count, then the size, write time and path of every stamp.
+bool load_cache(const std::wstring& path, std::vector<stamp>& stamps)
+{
+    cache_reader reader;
+    uint32_t stamp_count;
+    if (!reader.open(path, HOOKFXR_DEPS_CHECK_MAGIC, HOOKFXR_DEPS_CHECK_VERSION, HOOKFXR_DEPS_CHECK_MAX_SIZE) ||
+        !reader.read(stamp_count) || stamp_count > HOOKFXR_DEPS_CHECK_MAX_STAMPS)
+    {
+        return false;
+    }
+
+    stamps.resize(stamp_count);
+    for (stamp& entry : stamps)
+    {
+        if (!reader.read(entry.m_size) || !reader.read(entry.m_write_time) || !reader.read(entry.m_path, MAX_PATH))
+            return false;
+    }
+
+    return reader.at_end();
+}
+
+bool save_cache(const std::wstring& path, const std::vector<stamp>& stamps)
+{
+    cache_writer writer(HOOKFXR_DEPS_CHECK_MAGIC, HOOKFXR_DEPS_CHECK_VERSION);
+    writer.write(static_cast<uint32_t>(stamps.size()));
+    for (const stamp& entry : stamps)
+    {
+        writer.write(entry.m_size);
+        writer.write(entry.m_write_time);
+        writer.write(entry.m_path);
+    }
+
+    return cache_file_write(path, writer);
+}
+
+// Checks the candidates of every asset on a few threads. Returns a flag per asset, set if it was found.
+std::vector<uint8_t> check_assets(const std::vector<asset>& assets)
+{
+    std::vector<uint8_t> found(assets.size(), 0);
+    std::atomic<size_t> next{ 0 };
+
+    const auto worker = [&]
+    {
+        for (;;)
+        {
+            const size_t begin = next.fetch_add(HOOKFXR_DEPS_CHECK_BATCH, std::memory_order_relaxed);
+            if (begin >= assets.size())
+                break;
+
+            const size_t end = std::min<size_t>(begin + HOOKFXR_DEPS_CHECK_BATCH, assets.size());
+            for (size_t i = begin; i < end; ++i)
+            {
+                found[i] = std::ranges::any_of(assets[i].m_candidates, [](const std::wstring& candidate)
+                {
+                    const DWORD attributes = GetFileAttributesW(candidate.c_str());
+                    return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+                });
+            }
+        }
+    };
+
+    const size_t thread_count = std::min<size_t>(HOOKFXR_DEPS_CHECK_THREADS - 1,
+        (assets.size() + HOOKFXR_DEPS_CHECK_BATCH - 1) / HOOKFXR_DEPS_CHECK_BATCH);
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+
+    // The calling thread works along instead of waiting idle.
+    worker();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    return found;
+}
+}
+
+bool validate_deps(const std::vector<std::wstring>& deps_files, const std::wstring& app_directory,
+    const std::vector<std::wstring>& probe_paths, const std::wstring& cache_file)
+{
+    if (deps_files.empty())
+        return true;
+
+    const std::vector<stamp> stamps = get_stamps(deps_files, app_directory, probe_paths);
+    if (std::vector<stamp> cached; load_cache(cache_file, cached) && cached == stamps)
+    {
+        HFXR_TRACE(L"Deps assets unchanged since the last validation, using {}", cache_file);
+        return true;
+    }
+
+    std::vector<asset> assets;
+    bool ok = true;
+    for (const std::wstring& deps_file : deps_files)
+    {
+        ok = collect_assets(deps_file, app_directory, probe_paths, assets) && ok;
+    }
+
+    const std::vector<uint8_t> found = check_assets(assets);
+    const size_t missing = static_cast<size_t>(std::ranges::count(found, 0));
+
+    if (missing != 0)
+    {
+        HFXR_ERROR("{} of {} assets listed in the deps files are missing:", missing, assets.size());
+
+        size_t reported = 0;
+        for (size_t i = 0; i < assets.size() && reported < HOOKFXR_DEPS_CHECK_MAX_REPORTED; ++i)
+        {
+            if (found[i])
+                continue;
+
+            HFXR_ERROR(L"  {} ({}) from {}, looked for {}", to_wide(assets[i].m_relative_path),
+                to_wide(assets[i].m_library), assets[i].m_deps_file, assets[i].m_candidates.front());
+            ++reported;
+        }
+
+        if (reported < missing)
+        {
+            HFXR_ERROR("  ... and {} more", missing - reported);
+        }
+    }
+
+    if (!ok || missing != 0)
+        return false;
+
+    HFXR_TRACE("Validated {} assets", assets.size());
+    if (!save_cache(cache_file, stamps))
+    {
+        HFXR_WARNING(L"Failed to write {}", cache_file);
+    }
+
+    return true;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Asset validation of the injected deps files.
+// Before hostpolicy resolves the deps files, every runtime and native asset they list is looked up the way hostpolicy
+// probes for it: next to the app (or the deps file) by file name or localPath, then in the package layout under each
+// probe path. The lookups run on a few threads, and all missing assets are reported together so the launch fails
+// before the runtime is started instead of deep into its startup.
+// A successful validation is remembered in a cache file, together with the size and write time of every deps file
+// and the write time of every directory that was searched. While they are unchanged, a launch only compares them.
+// RID-specific assets (runtimeTargets) and resource assemblies are not validated, hostpolicy selects them itself.
+
+// Returns false and logs every missing asset if an asset of deps_files cannot be found.
+bool validate_deps(const std::vector<std::wstring>& deps_files, const std::wstring& app_directory,
+    const std::vector<std::wstring>& probe_paths, const std::wstring& cache_file);
@@ -1,14 +1,27 @@
 #include "defines.h"
 #include "config.h"
-
-#include <iostream>
+#include "deps_validation.h"
+#include "hookfxr.h"
+#include "host_trace.h"
+#include "hostfxr_locator.h"
+#include "plugin_deps.h"
+#include "prefetch.h"
+#include "startup_info.h"
+#include "startup_manifest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iterator>
 #include <string>
 #include <filesystem>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <vector>
 
 #include <safetyhook.hpp>
 
-#define NETHOST_USE_AS_STATIC
-#include <nethost/nethost.h>
 #include <hostfxr.h>
 #include <host_interface.h>
 
@@ -19,21 +32,42 @@ namespace
 wchar_t g_real_hostfxr_path[HOSTFXR_MAX_PATH] = { '\0' };
 wchar_t g_real_dotnet_root_path[HOSTFXR_MAX_PATH] = { '\0' };
 wchar_t g_original_app_path[HOSTFXR_MAX_PATH] = { '\0' };
-wchar_t g_additional_deps_buffer[HOSTFXR_MAX_PATH] = { '\0' };
+// dotnet_root passed to hookfxr_run, made absolute. Empty to locate the dotnet root.
+std::wstring g_explicit_dotnet_root;
+// .deps.json of the original app with merge_deps_json, empty if it is off or the file does not exist.
+std::wstring g_original_deps_file;
+// Deps files injected through additional_deps_serialized by the last corehost_load, separated by ';'. Kept until the
+// original corehost_load has copied it.
+std::wstring g_additional_deps;
 HMODULE g_real_hostfxr_module{ nullptr };
 
 safetyhook::InlineHook g_inline_hook_loadlibraryex;
 safetyhook::InlineHook g_inline_hook_corehost_load;
+
+// Only installed with profile_startup.
+safetyhook::InlineHook g_inline_hook_corehost_main;
+safetyhook::InlineHook g_inline_hook_coreclr_initialize;
+safetyhook::InlineHook g_inline_hook_coreclr_execute_assembly;
     
 hookfxr_config g_hookfxr_config;
+std::once_flag g_initialized;
+
+// DllMain(DLL_PROCESS_ATTACH) runs before the startup info exists, so its timing is kept until initialize().
+int64_t g_dllmain_start{ 0 };
+int64_t g_dllmain_end{ 0 };
+int64_t g_hostfxr_start{ 0 };
+int64_t g_corehost_main_start{ 0 };
 
 // src/native/corehost/error_codes.h
 enum StatusCode
 {
+    InvalidArgFailure = 0x80008081,
+    ResolverResolveFailure = 0x8000808c,
     FrameworkMissingFailure = 0x80008096,
+    HostInvalidState = 0x800080a3,
 };
     
-bool find_real_dotnet(const wchar_t* app_path)
+bool find_real_dotnet()
 {
     // Already resolved
     if (g_real_hostfxr_module)
@@ -41,44 +75,152 @@ bool find_real_dotnet(const wchar_t* app_path)
         return true;
     }
 
-    // If we fail here, g_real_hostfxr_module will be nullptr and all the proxy functions will return FrameworkMissingFailure.
-    // This causes the apphost to show an error message.
-    const get_hostfxr_parameters params = {
-        .size = sizeof(get_hostfxr_parameters),
-        .assembly_path = app_path,
-        .dotnet_root = nullptr
-    };
-    size_t fxr_path_size{ HOSTFXR_MAX_PATH };
-    size_t dotnet_root_path_size{ HOSTFXR_MAX_PATH };
-    const int ret = get_hostfxr_path_with_root(
-        g_real_hostfxr_path,
-        &fxr_path_size,
-        g_real_dotnet_root_path,
-        &dotnet_root_path_size,
-        &params);
-
-    if (ret != 0)
-    {
-        HFXR_WERROR << "Failed to get hostfxr path with root: " << std::hex << ret << '\n';
-        return false;
+    // dotnet_root_override sets DOTNET_ROOT after the manifest is loaded, the decision is recorded under its value.
+    // A root passed to hookfxr_run is not part of the fingerprint, it is recorded under '|' and the root, which no
+    // DOTNET_ROOT value collides with as '|' cannot appear in a path.
+    std::wstring manifest_key;
+    if (!g_explicit_dotnet_root.empty())
+    {
+        manifest_key = L'|' + g_explicit_dotnet_root;
     }
-    
-    if (fxr_path_size > 0 && fxr_path_size < HOSTFXR_MAX_PATH &&
-        dotnet_root_path_size > 0 && dotnet_root_path_size < HOSTFXR_MAX_PATH)
+    else
+    {
+        wchar_t dotnet_root_variable[HOSTFXR_MAX_PATH];
+        const DWORD variable_length = GetEnvironmentVariableW(L"DOTNET_ROOT", dotnet_root_variable, HOSTFXR_MAX_PATH);
+        manifest_key.assign(dotnet_root_variable, variable_length < HOSTFXR_MAX_PATH ? variable_length : 0);
+    }
+
+    std::wstring dotnet_root;
+    std::wstring hostfxr_path;
+    const std::wstring* cached_root = startup_manifest_find(manifest_entry::dotnet_root, manifest_key);
+    const std::wstring* cached_path = startup_manifest_find(manifest_entry::hostfxr_path, manifest_key);
+    const std::wstring* cached_source = startup_manifest_find(manifest_entry::hostfxr_source, manifest_key);
+    if (cached_root && cached_path && cached_source)
     {
-        g_real_hostfxr_module = LoadLibraryW(g_real_hostfxr_path);
-        if (!g_real_hostfxr_module)
+        dotnet_root = *cached_root;
+        hostfxr_path = *cached_path;
+        HFXR_INFO("Using the dotnet root from {} (startup manifest)",
+            hostfxr_source_name(static_cast<hostfxr_source>(_wtoi(cached_source->c_str()))));
+    }
+    else
+    {
+        // If we fail here, g_real_hostfxr_module will be nullptr and all the proxy functions will return FrameworkMissingFailure.
+        // This causes the apphost to show an error message.
+        const hostfxr_location& location = g_explicit_dotnet_root.empty()
+            ? locate_hostfxr()
+            : locate_hostfxr(get_hostfxr_sources(g_explicit_dotnet_root));
+        if (location.m_dotnet_root.empty())
         {
-            HFXR_ERROR << "Failed to load hostfxr module\n";
+            HFXR_ERROR("Failed to find a dotnet root, set DOTNET_ROOT or dotnet_root_override");
             return false;
         }
 
-        return true;
+        HFXR_INFO("Using the dotnet root from {}", hostfxr_source_name(location.m_source));
+
+        dotnet_root = location.m_dotnet_root.wstring();
+        if (location.m_hostfxr_path.empty())
+        {
+            HFXR_ERROR(L"Failed to find hostfxr in {}\\host\\fxr", dotnet_root);
+            return false;
+        }
+
+        hostfxr_path = location.m_hostfxr_path.wstring();
+
+        // Installing or removing a runtime version adds or removes a directory in host\fxr.
+        const std::wstring fxr_directory = (location.m_dotnet_root / L"host" / L"fxr").wstring();
+        startup_manifest_add(manifest_entry::dotnet_root, manifest_key, dotnet_root, fxr_directory);
+        startup_manifest_add(manifest_entry::hostfxr_path, manifest_key, hostfxr_path, fxr_directory);
+        startup_manifest_add(manifest_entry::hostfxr_source, manifest_key,
+            std::to_wstring(static_cast<int>(location.m_source)), fxr_directory);
+    }
+
+    if (hostfxr_path.size() >= HOSTFXR_MAX_PATH || dotnet_root.size() >= HOSTFXR_MAX_PATH)
+    {
+        HFXR_ERROR("hostfxr path or dotnet root path size is invalid: {}, {}", hostfxr_path.size(), dotnet_root.size());
+        return false;
+    }
+
+    wcscpy_s(g_real_hostfxr_path, HOSTFXR_MAX_PATH, hostfxr_path.c_str());
+    wcscpy_s(g_real_dotnet_root_path, HOSTFXR_MAX_PATH, dotnet_root.c_str());
+
+    HFXR_INFO(L"Found hostfxr {}", hostfxr_path);
+
+    g_real_hostfxr_module = LoadLibraryW(g_real_hostfxr_path);
+    if (!g_real_hostfxr_module)
+    {
+        HFXR_ERROR(L"Failed to load hostfxr module {}", static_cast<const wchar_t*>(g_real_hostfxr_path));
+        return false;
+    }
+
+    prefetch_record_module(g_real_hostfxr_module);
+    return true;
+}
+
+void find_original_deps_file()
+{
+    // Find .deps.json from g_original_app_path, replace .dll extension
+    std::wstring deps_path(g_original_app_path);
+    if (const size_t dot_pos = deps_path.rfind(L'.'); dot_pos != std::wstring::npos)
+    {
+        deps_path.replace(dot_pos, deps_path.size() - dot_pos, L".deps.json");
+    }
+    else
+    {
+        deps_path += L".deps.json";
+    }
+
+    // The manifest stores the path if the file exists and an empty string if it does not.
+    bool deps_exists;
+    if (const std::wstring* cached = startup_manifest_find(manifest_entry::deps_file, g_original_app_path))
+    {
+        deps_exists = !cached->empty();
+    }
+    else
+    {
+        deps_exists = std::filesystem::exists(deps_path);
+        startup_manifest_add(manifest_entry::deps_file, g_original_app_path, deps_exists ? deps_path : L"",
+            std::filesystem::path(deps_path).parent_path().wstring());
+    }
+
+    if (deps_exists)
+    {
+        g_original_deps_file = std::move(deps_path);
+    }
+    else
+    {
+        HFXR_ERROR(L".deps.json not found at {}.", deps_path);
+    }
+}
+
+bool resolve_real_dotnet(const wchar_t* app_path)
+{
+    const int64_t start = startup_info_now();
+    const bool found = find_real_dotnet();
+    startup_info_record_phase(startup_phase::resolve_hostfxr, start, startup_info_now());
+
+    // The deps file is only injected in corehost_load, but looked up here with the other manifest decisions so that
+    // the manifest is written once, after the last of them.
+    g_original_deps_file.clear();
+    if (g_hookfxr_config.m_merge_deps_json)
+    {
+        find_original_deps_file();
+    }
+
+    // A disabled hookfxr only forwards to the real hostfxr and leaves nothing behind next to the executable.
+    if (g_hookfxr_config.m_enable)
+    {
+        startup_manifest_save();
+    }
+
+    startup_info_set_string(startup_string::original_app_path, g_original_app_path);
+    startup_info_set_string(startup_string::app_path, app_path);
+    if (found)
+    {
+        startup_info_set_string(startup_string::dotnet_root, g_real_dotnet_root_path);
+        startup_info_set_string(startup_string::hostfxr_path, g_real_hostfxr_path);
     }
 
-    HFXR_WERROR << L"hostfxr path or dotnet root path size is invalid: "
-              << fxr_path_size << ", " << dotnet_root_path_size << '\n';
-    return false;
+    return found;
 }
 
 const wchar_t* get_overriden_app_path(const wchar_t* real_app_path)
@@ -96,6 +238,8 @@ const wchar_t* get_overriden_app_path(const wchar_t* real_app_path)
 
 int corehost_load_detour(host_interface_t* init)
 {
+    startup_info_record_phase(startup_phase::hostfxr, g_hostfxr_start, startup_info_now());
+
     // Check if there are any breaking changes in the host interface
     if (init->version_hi != HOST_INTERFACE_LAYOUT_VERSION_HI)
     {
@@ -104,93 +248,399 @@ int corehost_load_detour(host_interface_t* init)
         HFXR_UNREACHABLE("Host interface version mismatch");
     }
 
-    // Find .deps.json from g_original_app_path, replace .dll extension
-    std::wstring deps_path(g_original_app_path);
-    if (const size_t dot_pos = deps_path.rfind(L'.'); dot_pos != std::wstring::npos)
+    std::vector<std::wstring> deps_files;
+    if (!g_original_deps_file.empty())
     {
-        deps_path.replace(dot_pos, deps_path.size() - dot_pos, L".deps.json");
+        deps_files.push_back(g_original_deps_file);
     }
-    else
+
+    if (!g_hookfxr_config.m_plugin_directory.empty())
     {
-        deps_path += L".deps.json";
+        std::vector<std::wstring> plugin_deps =
+            find_plugin_deps(g_hookfxr_config.m_plugin_directory, g_hookfxr_config.m_plugin_index_file);
+        HFXR_INFO(L"Found {} plugin deps files in {}", plugin_deps.size(), g_hookfxr_config.m_plugin_directory);
+        std::ranges::move(plugin_deps, std::back_inserter(deps_files));
     }
 
-    wcscpy_s(g_additional_deps_buffer, HOSTFXR_MAX_PATH, deps_path.c_str());
+    if (g_hookfxr_config.m_validate_deps && init->deps_file)
+    {
+        // The app's own deps file sits in the app directory, which hostpolicy probes for app-local assets.
+        const std::wstring app_directory = std::filesystem::path(init->deps_file).parent_path().wstring();
+        const std::vector<std::wstring> probe_paths(init->probe_paths.arr,
+            init->probe_paths.arr + init->probe_paths.len);
+
+        if (!validate_deps(deps_files, app_directory, probe_paths, g_hookfxr_config.m_deps_check_file))
+        {
+            // Fail like hostpolicy does when it cannot resolve an asset, but before the runtime is started.
+            return ResolverResolveFailure;
+        }
+    }
 
-    if (std::filesystem::exists(deps_path))
+    // hostpolicy splits the list at PATH_SEPARATOR, ';' on Windows. Built per call, a second corehost_load must not
+    // get the entries of the first one twice.
+    std::wstring additional_deps;
+    for (const std::wstring& deps_file : deps_files)
     {
-        init->additional_deps_serialized = g_additional_deps_buffer;
+        if (!additional_deps.empty())
+        {
+            additional_deps += L';';
+        }
+        additional_deps += deps_file;
     }
-    else
+
+    if (!additional_deps.empty())
     {
-        HFXR_WERROR << L".deps.json not found at " << deps_path << L".\n";
+        g_additional_deps = std::move(additional_deps);
+        init->additional_deps_serialized = g_additional_deps.c_str();
     }
 
-    return g_inline_hook_corehost_load.call<int>(init);
+    if (init->deps_file)
+    {
+        startup_info_set_string(startup_string::deps_file, init->deps_file);
+    }
+    if (init->additional_deps_serialized)
+    {
+        startup_info_set_string(startup_string::additional_deps, init->additional_deps_serialized);
+    }
+
+    const int ret = g_inline_hook_corehost_load.call<int>(init);
+
+    // hostpolicy has opened its trace file by now.
+    host_trace_end_setup();
+    return ret;
+}
+
+int corehost_main_detour(const int argc, const char_t* argv[])
+{
+    g_corehost_main_start = startup_info_now();
+    if (!g_inline_hook_corehost_load)
+    {
+        startup_info_record_phase(startup_phase::hostfxr, g_hostfxr_start, g_corehost_main_start);
+    }
+
+    return g_inline_hook_corehost_main.call<int>(argc, argv);
+}
+
+int coreclr_initialize_detour(const char* exe_path, const char* app_domain_friendly_name, int property_count,
+    const char** property_keys, const char** property_values, void** host_handle, unsigned int* domain_id)
+{
+    const int64_t start = startup_info_now();
+    startup_info_record_phase(startup_phase::hostpolicy, g_corehost_main_start, start);
+
+    const int ret = g_inline_hook_coreclr_initialize.call<int>(exe_path, app_domain_friendly_name, property_count,
+        property_keys, property_values, host_handle, domain_id);
+
+    startup_info_record_phase(startup_phase::coreclr_initialize, start, startup_info_now());
+    return ret;
+}
+
+int coreclr_execute_assembly_detour(void* host_handle, unsigned int domain_id, int argc, const char** argv,
+    const char* managed_assembly_path, unsigned int* exit_code)
+{
+    const int64_t start = startup_info_now();
+    startup_info_record_phase(startup_phase::execute_assembly, start, 0);
+    if (g_hookfxr_config.m_profile_startup)
+    {
+        startup_info_log_phases();
+    }
+
+    // Past this point the host has done its part, a trace of it is no longer of interest.
+    host_trace_finish(0);
+
+    if (prefetch_is_recording())
+    {
+        prefetch_finish_recording();
+
+        // Kept enabled until now to record the images loaded during startup.
+        if (!g_inline_hook_loadlibraryex.disable().has_value())
+        {
+            HFXR_UNREACHABLE("Could not disable loadlibrary hook");
+        }
+    }
+
+    const int ret = g_inline_hook_coreclr_execute_assembly.call<int>(host_handle, domain_id, argc, argv,
+        managed_assembly_path, exit_code);
+
+    startup_info_record_phase(startup_phase::execute_assembly, start, startup_info_now());
+    return ret;
+}
+
+void hook_export(safetyhook::InlineHook& hook, HMODULE mod, const char* name, void* destination)
+{
+    void* fn = reinterpret_cast<void*>(GetProcAddress(mod, name));
+    if (!fn)
+    {
+        HFXR_ERROR("Could not find {}", name);
+        HFXR_UNREACHABLE("Could not find export to hook");
+    }
+
+    hook = safetyhook::create_inline(fn, destination);
+}
+
+void on_hostpolicy_loaded(HMODULE mod)
+{
+    if (g_inline_hook_corehost_load || g_inline_hook_corehost_main)
+        return;
+
+    // Without the profiler, prefetch recording or the host trace, disable this hook, as we only want to hook
+    // hostpolicy.dll once and don't care about anything else. They still need to see coreclr.dll being loaded.
+    if (!g_hookfxr_config.m_profile_startup && !prefetch_is_recording() && !g_hookfxr_config.m_host_trace &&
+        !g_inline_hook_loadlibraryex.disable().has_value())
+    {
+        HFXR_UNREACHABLE("Could not disable loadlibrary hook");
+    }
+
+    if (g_hookfxr_config.m_merge_deps_json || !g_hookfxr_config.m_plugin_directory.empty() ||
+        g_hookfxr_config.m_host_trace)
+    {
+        hook_export(g_inline_hook_corehost_load, mod, "corehost_load", reinterpret_cast<void*>(&corehost_load_detour));
+    }
+
+    if (g_hookfxr_config.m_profile_startup)
+    {
+        hook_export(g_inline_hook_corehost_main, mod, "corehost_main", reinterpret_cast<void*>(&corehost_main_detour));
+    }
+}
+
+void on_coreclr_loaded(HMODULE mod)
+{
+    if (g_inline_hook_coreclr_initialize)
+        return;
+
+    // Prefetch recording keeps it until managed main starts.
+    if (!prefetch_is_recording() && !g_inline_hook_loadlibraryex.disable().has_value())
+    {
+        HFXR_UNREACHABLE("Could not disable loadlibrary hook");
+    }
+
+    hook_export(g_inline_hook_coreclr_initialize, mod, "coreclr_initialize",
+        reinterpret_cast<void*>(&coreclr_initialize_detour));
+    hook_export(g_inline_hook_coreclr_execute_assembly, mod, "coreclr_execute_assembly",
+        reinterpret_cast<void*>(&coreclr_execute_assembly_detour));
 }
 
 HMODULE loadlibrary_detour(LPCWSTR lpLibFileName, HANDLE hFile, DWORD dwFlags)
 {
+    const int64_t start = startup_info_now();
+
     if (const HMODULE mod = g_inline_hook_loadlibraryex.call<HMODULE>(lpLibFileName, hFile, dwFlags))
     {
+        const std::wstring_view in_path(lpLibFileName);
+        prefetch_record_module(mod);
+
         // Check if we're loading hostpolicy
-        if (const std::wstring in_path(lpLibFileName); !in_path.ends_with(L"hostpolicy.dll"))
+        if (in_path.ends_with(L"hostpolicy.dll"))
+        {
+            on_hostpolicy_loaded(mod);
+        }
+        else if ((g_hookfxr_config.m_profile_startup || prefetch_is_recording() || g_hookfxr_config.m_host_trace) &&
+            in_path.ends_with(L"coreclr.dll"))
         {
-            return mod;
+            startup_info_record_phase(startup_phase::load_coreclr, start, startup_info_now());
+            on_coreclr_loaded(mod);
         }
 
-        if (g_inline_hook_corehost_load)
+        return mod;
+    }
+
+    return NULL;
+}
+
+// Applies all environment variables in one batch, before the real hostfxr is resolved and loaded. Values may refer
+// to existing variables (%VAR%), an empty value removes the variable.
+void apply_environment(const hookfxr_config& config)
+{
+    // Write dotnet override to DOTNET_ROOT so that the hostfxr locator will resolve it from there
+    if (!config.m_dotnet_root_override.empty())
+    {
+        SetEnvironmentVariableW(L"DOTNET_ROOT", config.m_dotnet_root_override.c_str());
+    }
+
+    std::wstring expanded;
+    for (const auto& [name, value] : config.m_environment)
+    {
+        if (value.empty())
         {
-            return mod;
+            SetEnvironmentVariableW(name.c_str(), nullptr);
+            continue;
         }
 
-        // Disable this hook, as we only want to hook hostpolicy.dll once and don't care about anything else
-        if (!g_inline_hook_loadlibraryex.disable().has_value())
+        expanded.resize(value.size() + 1);
+        DWORD length = ExpandEnvironmentStringsW(value.c_str(), expanded.data(), static_cast<DWORD>(expanded.size()));
+        if (length > expanded.size())
         {
-            HFXR_UNREACHABLE("Could not disable loadlibrary hook");
+            expanded.resize(length);
+            length = ExpandEnvironmentStringsW(value.c_str(), expanded.data(), static_cast<DWORD>(expanded.size()));
         }
 
-        void* corehost_load_fn =
-            reinterpret_cast<void*>(GetProcAddress(mod, "corehost_load"));
+        if (length == 0)
+        {
+            HFXR_WARNING(L"Failed to expand environment variable {}", name);
+            continue;
+        }
 
-        if (!corehost_load_fn)
+        // The returned length includes the terminator.
+        expanded.resize(length - 1);
+        SetEnvironmentVariableW(name.c_str(), expanded.c_str());
+        HFXR_TRACE(L"Set environment variable {}={}", name, expanded);
+    }
+}
+
+// Must run before the runtime is loaded, the GC sizes and pins its heaps and threads to the CPUs it sees at startup.
+void apply_placement(const hookfxr_config& config)
+{
+    if (config.m_cpu_affinity.empty() && config.m_numa_node < 0 && config.m_priority == process_priority::unchanged)
+        return;
+
+    const placement_result result = apply_process_placement(config.m_cpu_affinity, config.m_numa_node, config.m_priority);
+    if (!result.m_affinity_applied)
+    {
+        HFXR_WARNING("Failed to set the CPU affinity");
+    }
+    if (!result.m_numa_node_applied)
+    {
+        HFXR_WARNING("Failed to select NUMA node {}", config.m_numa_node);
+    }
+    if (!result.m_priority_applied)
+    {
+        HFXR_WARNING("Failed to set the process priority");
+    }
+
+    if (!result.m_cpus.empty())
+    {
+        apply_gc_placement(result.m_cpus);
+        HFXR_INFO(L"Restricted the process to CPUs {}", format_cpu_list(result.m_cpus));
+    }
+
+    startup_info_set_placement(result.m_cpus, result.m_numa_node_applied ? config.m_numa_node : -1,
+        result.m_priority_applied ? config.m_priority : process_priority::unchanged);
+}
+
+// Runs on the first call into the proxy, outside the loader lock. The apphost has already parsed the command line,
+// so its argv is used instead of re-parsing GetCommandLineW.
+void initialize(const int argc, const char_t* argv[])
+{
+    std::call_once(g_initialized, [&]
+    {
+        const int64_t start = startup_info_now();
+
+        g_hookfxr_config = get_hookfxr_config(argc, argv);
+        log_init(g_hookfxr_config.m_log_file, g_hookfxr_config.m_log_level);
+        startup_info_create();
+        startup_info_set_config(g_hookfxr_config);
+
+        // As early as possible, the replay has to run ahead of the reads it prefetches for.
+        prefetch_start(g_hookfxr_config.m_prefetch, g_hookfxr_config.m_prefetch_file);
+
+        apply_environment(g_hookfxr_config);
+        apply_placement(g_hookfxr_config);
+
+        safetyhook::set_fast_exit(g_hookfxr_config.m_fast_exit);
+
+        if (g_hookfxr_config.m_merge_deps_json || !g_hookfxr_config.m_plugin_directory.empty() ||
+            g_hookfxr_config.m_profile_startup || prefetch_is_recording() || g_hookfxr_config.m_host_trace)
         {
-            HFXR_UNREACHABLE("Could not find corehost_load in hostpolicy.dll");
+            // Hook LoadLibraryExW to intercept hostpolicy.dll loading, as we need to hook one of its exports (corehost_load)
+            // before it is called by the apphost. The profiler, prefetch recording and the host trace additionally
+            // intercept coreclr.dll.
+            g_inline_hook_loadlibraryex = safetyhook::create_inline(
+                LoadLibraryExW,
+                loadlibrary_detour);
         }
 
-        g_inline_hook_corehost_load = safetyhook::create_inline(
-            corehost_load_fn,
-            &corehost_load_detour);
-        
-        return mod;
+        const int64_t end = startup_info_now();
+        startup_info_record_phase(startup_phase::dllmain, g_dllmain_start, g_dllmain_end);
+        startup_info_record_phase(startup_phase::initialize, start, end);
+
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+
+        HFXR_TRACE("DllMain held the loader lock for {} us, initialization took {} us",
+            (g_dllmain_end - g_dllmain_start) * 1'000'000 / frequency.QuadPart,
+            (end - start) * 1'000'000 / frequency.QuadPart);
+    });
+}
+
+// Shared by the apphost entrypoints and hookfxr_run, once the app path has been redirected. Single-file bundles go
+// through the bundle entrypoint of the real hostfxr, which also takes the offset of the bundle header.
+int run_app(const int argc, const char_t* argv[], const char_t* host_path, const wchar_t* applicable_app_path,
+    std::optional<int64_t> bundle_header_offset = std::nullopt)
+{
+    if (!resolve_real_dotnet(applicable_app_path))
+    {
+        return FrameworkMissingFailure;
     }
 
-    return NULL;
+    const FARPROC entrypoint = GetProcAddress(g_real_hostfxr_module,
+        bundle_header_offset ? "hostfxr_main_bundle_startupinfo" : "hostfxr_main_startupinfo");
+    if (!entrypoint)
+    {
+        return -1;
+    }
+
+    host_trace_install(g_real_hostfxr_module);
+    g_hostfxr_start = startup_info_now();
+    if (g_hookfxr_config.m_host_trace)
+    {
+        host_trace_start_capture();
+    }
+
+    int ret;
+    if (bundle_header_offset)
+    {
+        ret = reinterpret_cast<hostfxr_main_bundle_startupinfo_fn>(entrypoint)(
+            argc,
+            argv,
+            host_path,
+            g_real_dotnet_root_path,
+            applicable_app_path,
+            *bundle_header_offset);
+    }
+    else
+    {
+        ret = reinterpret_cast<hostfxr_main_startupinfo_fn>(entrypoint)(
+            argc,
+            argv,
+            host_path,
+            g_real_dotnet_root_path,
+            applicable_app_path);
+    }
+
+    host_trace_finish(ret);
+    return ret;
 }
 }
 
 
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD  ul_reason_for_call, LPVOID lpReserved)
 {
+    if (ul_reason_for_call == DLL_PROCESS_DETACH)
+    {
+        // lpReserved is non-null when the process is exiting rather than unloading us. The hook globals are destroyed
+        // right after this returns; with fast_exit they are then left in place instead of being unpatched.
+        if (lpReserved != nullptr)
+        {
+            safetyhook::notify_process_exit();
+            log_flush_at_exit();
+        }
+        else
+        {
+            // Unloading implies that log_shutdown already stopped the log thread, it holds a reference to us.
+            log_flush();
+        }
+        return TRUE;
+    }
+
     if (ul_reason_for_call != DLL_PROCESS_ATTACH)
         return TRUE;
 
-    g_hookfxr_config = get_hookfxr_config();
+    // Everything else runs in initialize() on the first call into the proxy, as anything done here holds the
+    // loader lock and blocks every other DLL load in the process.
+    g_dllmain_start = startup_info_now();
 
-    // Write dotnet override to DOTNET_ROOT so that nethost will resolve it from there
-    if (!g_hookfxr_config.m_dotnet_root_override.empty())
-    {
-        SetEnvironmentVariableW(L"DOTNET_ROOT", g_hookfxr_config.m_dotnet_root_override.c_str());
-    }
+    DisableThreadLibraryCalls(hModule);
 
-    if (g_hookfxr_config.m_merge_deps_json)
-    {
-        // Hook LoadLibraryExW to intercept hostpolicy.dll loading, as we need to hook one of its exports (corehost_load)
-        // before it is called by the apphost.
-        g_inline_hook_loadlibraryex = safetyhook::create_inline(
-            LoadLibraryExW,
-            loadlibrary_detour);
-    }
+    g_dllmain_end = startup_info_now();
 
     return TRUE;
 }
@@ -206,51 +656,91 @@ extern "C"
 
 SHARED_API int HOSTFXR_CALLTYPE hostfxr_main_bundle_startupinfo(const int argc, const char_t* argv[], const char_t* host_path, const char_t* dotnet_root, const char_t* app_path, int64_t bundle_header_offset)
 {
-    const wchar_t* applicable_app_path = get_overriden_app_path(app_path);
-    if (!find_real_dotnet(applicable_app_path))
+    initialize(argc, argv);
+
+    return run_app(argc, argv, host_path, get_overriden_app_path(app_path), bundle_header_offset);
+}
+
+SHARED_API int HOSTFXR_CALLTYPE hostfxr_main_startupinfo(const int argc, const char_t* argv[], const char_t* host_path, const char_t* dotnet_root, const char_t* app_path)
+{
+    initialize(argc, argv);
+
+    return run_app(argc, argv, host_path, get_overriden_app_path(app_path));
+}
+
+SHARED_API hostfxr_error_writer_fn HOSTFXR_CALLTYPE hostfxr_set_error_writer(hostfxr_error_writer_fn error_writer)
+{
+    // The apphost registers its writer before calling into us, long before the real hostfxr is loaded.
+    return host_trace_set_app_error_writer(error_writer);
+}
+
+SHARED_API const hookfxr_startup_info* HOSTFXR_CALLTYPE hookfxr_get_startup_info()
+{
+    return startup_info_get();
+}
+
+SHARED_API int32_t HOOKFXR_CALLTYPE hookfxr_run(const wchar_t* original_app, const wchar_t* target_app, const hookfxr_run_options* options)
+{
+    static std::atomic<bool> ran{ false };
+
+    if (!original_app || !*original_app || (target_app && !*target_app) ||
+        (options && options->size < HOOKFXR_RUN_OPTIONS_V1_SIZE))
     {
-        return FrameworkMissingFailure;
+        return InvalidArgFailure;
     }
-    
-    auto hostfxr_main_bundle_startupinfo_ptr = reinterpret_cast<hostfxr_main_bundle_startupinfo_fn>(
-        GetProcAddress(g_real_hostfxr_module, "hostfxr_main_bundle_startupinfo"));
 
-    if (hostfxr_main_bundle_startupinfo_ptr)
+    // Only the fields the caller's size covers are read, the ones its hookfxr.h did not have yet stay zero. Fields
+    // of a newer hookfxr.h than ours are ignored.
+    hookfxr_run_options run_options{};
+    if (options)
     {
-        return hostfxr_main_bundle_startupinfo_ptr(
-            argc,
-            argv,
-            host_path,
-            g_real_dotnet_root_path,
-            applicable_app_path,
-            bundle_header_offset);
+        std::memcpy(&run_options, options, std::min(options->size, sizeof(run_options)));
     }
-    return -1;
-}
 
-SHARED_API int HOSTFXR_CALLTYPE hostfxr_main_startupinfo(const int argc, const char_t* argv[], const char_t* host_path, const char_t* dotnet_root, const char_t* app_path)
-{
-    const wchar_t* applicable_app_path = get_overriden_app_path(app_path);
-    if (!find_real_dotnet(applicable_app_path))
+    if (run_options.argc < 0 || (run_options.argc > 0 && !run_options.argv))
+        return InvalidArgFailure;
+
+    if (ran.exchange(true))
+        return HostInvalidState;
+
+    // The apphost hands hostfxr its whole command line, the program name included.
+    wchar_t module_path[HOSTFXR_MAX_PATH];
+    GetModuleFileNameW(nullptr, module_path, HOSTFXR_MAX_PATH);
+    const wchar_t* host_path = run_options.host_path ? run_options.host_path : module_path;
+
+    std::vector<const wchar_t*> argv{ host_path };
+    if (run_options.argc > 0)
     {
-        return FrameworkMissingFailure;
+        argv.insert(argv.end(), run_options.argv, run_options.argv + run_options.argc);
     }
-    
-    auto hostfxr_main_startupinfo_ptr = reinterpret_cast<hostfxr_main_startupinfo_fn>(
-        GetProcAddress(g_real_hostfxr_module, "hostfxr_main_startupinfo"));
+    const int argc = static_cast<int>(argv.size());
 
-    if (hostfxr_main_startupinfo_ptr)
+    initialize(argc, argv.data());
+
+    // Explicit arguments win over hookfxr.ini.
+    if (target_app)
     {
-        return hostfxr_main_startupinfo_ptr(
-            argc,
-            argv,
-            host_path,
-            g_real_dotnet_root_path,
-            applicable_app_path);
+        g_hookfxr_config.m_enable = true;
+        g_hookfxr_config.m_target_assembly = make_absolute_path(target_app);
     }
-    return -1;
+    // Passed to the locator rather than through DOTNET_ROOT, which DOTNET_ROOT_<ARCH> would take precedence over.
+    if (run_options.dotnet_root)
+    {
+        g_explicit_dotnet_root = make_absolute_path(run_options.dotnet_root);
+    }
+    startup_info_set_config(g_hookfxr_config);
+
+    const std::wstring original_app_path = make_absolute_path(original_app);
+    const int32_t ret = run_app(argc, argv.data(), host_path, get_overriden_app_path(original_app_path.c_str()));
+
+    // Unlike the apphost, the launcher keeps running and may FreeLibrary hookfxr. The log thread keeps it loaded
+    // until it is stopped, which has to happen here, outside the loader lock.
+    log_shutdown();
+    return ret;
 }
 
+static_assert(std::is_same_v<decltype(&hookfxr_run), hookfxr_run_fn>);
+
 SHARED_API int HOSTFXR_CALLTYPE hostfxr_main(const int argc, const char_t* argv[])
 {
     // Unsupported
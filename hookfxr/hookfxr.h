@@ -0,0 +1,49 @@
+#pragma once
+
+// Public C API of hookfxr, for native launchers that load hookfxr's hostfxr.dll themselves.
+//
+// Instead of starting the apphost only so that it loads hookfxr, a launcher can LoadLibraryW hookfxr's hostfxr.dll,
+// look up hookfxr_run with GetProcAddress and run the app in its own process. hookfxr then does what it does for an
+// apphost: it reads hookfxr.ini (next to the launcher's executable) and the --hookfxr-* options, locates and loads
+// the real hostfxr, redirects the original app to the target app and injects the original app's .deps.json.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#ifdef _WIN32
+#define HOOKFXR_CALLTYPE __cdecl
+#else
+#define HOOKFXR_CALLTYPE
+#endif
+
+struct hookfxr_run_options
+{
+    // sizeof(struct hookfxr_run_options), fields are only ever appended. hookfxr accepts any size from
+    // HOOKFXR_RUN_OPTIONS_V1_SIZE on and only reads the fields it covers, later fields keep their default.
+    size_t size;
+
+    // Arguments passed to the app, without the program name. May be 0 and NULL.
+    // --hookfxr-* options among them are applied like on an apphost command line.
+    int argc;
+    const wchar_t** argv;
+
+    // Executable the app is started as, NULL for the launcher's own executable.
+    const wchar_t* host_path;
+
+    // Root of the .NET installation to use, NULL to use dotnet_root_override from hookfxr.ini or locate it. Takes
+    // precedence over DOTNET_ROOT_<ARCH> and DOTNET_ROOT, which are left unchanged.
+    const wchar_t* dotnet_root;
+};
+
+// Size of the first version of hookfxr_run_options.
+#define HOOKFXR_RUN_OPTIONS_V1_SIZE (offsetof(struct hookfxr_run_options, dotnet_root) + sizeof(const wchar_t*))
+
+// Runs original_app redirected to target_app and returns the app's exit code, or a host error code (0x8000xxxx) if
+// it could not be started. target_app may be NULL to use target_assembly from hookfxr.ini. options may be NULL.
+// Relative paths are resolved against the directory of the launcher's executable, like the paths in hookfxr.ini.
+// Like the real hostfxr, a process can only run one app, later calls fail.
+typedef int32_t(HOOKFXR_CALLTYPE* hookfxr_run_fn)(
+    const wchar_t* original_app,
+    const wchar_t* target_app,
+    const struct hookfxr_run_options* options);
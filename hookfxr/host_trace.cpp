@@ -0,0 +1,272 @@
+#include "host_trace.h"
+
+#include "defines.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <format>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Number of pipe instances served, hostfxr and hostpolicy each open the trace file once.
+#define HOOKFXR_HOST_TRACE_PIPES 4
+// Upper bound of the captured trace, the oldest half is discarded when it is exceeded.
+#define HOOKFXR_HOST_TRACE_MAX (4 * 1024 * 1024)
+
+namespace
+{
+std::atomic<hostfxr_error_writer_fn> g_app_error_writer{ nullptr };
+std::atomic<bool> g_host_reported_error{ false };
+std::atomic<bool> g_capturing{ false };
+std::atomic<bool> g_environment_set{ false };
+
+// Only touched by host_trace_start_capture and host_trace_finish, which run one after the other.
+std::wstring g_pipe_name;
+std::array<HANDLE, HOOKFXR_HOST_TRACE_PIPES> g_readers{};
+// COREHOST_TRACEFILE before the capture started, restored once the host has opened the pipe.
+std::optional<std::wstring> g_previous_trace_file;
+
+std::mutex g_trace_mutex;
+std::string g_trace;
+bool g_trace_truncated{ false };
+
+// src/native/corehost/error_codes.h, every host failure is in the 0x80008xxx range.
+bool is_host_failure(int status)
+{
+    return (static_cast<unsigned int>(status) & 0xFFFFF000) == 0x80008000;
+}
+
+void HOSTFXR_CALLTYPE error_writer(const char_t* message)
+{
+    g_host_reported_error.store(true, std::memory_order_relaxed);
+
+    // A single message may span several lines and exceed what one log record holds.
+    std::wstring_view remaining(message);
+    while (!remaining.empty())
+    {
+        const size_t line_end = std::min(remaining.find(L'\n'), remaining.size());
+        std::wstring_view line = remaining.substr(0, line_end);
+        remaining.remove_prefix(std::min(line_end + 1, remaining.size()));
+
+        do
+        {
+            const std::wstring_view chunk = line.substr(0, HOOKFXR_LOG_MESSAGE_MAX - 16);
+            line.remove_prefix(chunk.size());
+            HFXR_ERROR(L"[host] {}", chunk);
+        } while (!line.empty());
+    }
+
+    if (const hostfxr_error_writer_fn app_error_writer = g_app_error_writer.load(std::memory_order_acquire))
+    {
+        app_error_writer(message);
+    }
+}
+
+void append_trace(const char* data, size_t size, bool& at_line_start)
+{
+    SYSTEMTIME time;
+    {
+        FILETIME now;
+        GetSystemTimePreciseAsFileTime(&now);
+        SYSTEMTIME utc_time;
+        FileTimeToSystemTime(&now, &utc_time);
+        SystemTimeToTzSpecificLocalTime(nullptr, &utc_time, &time);
+    }
+    const std::string timestamp = std::format("{:02}:{:02}:{:02}.{:03} ",
+        time.wHour, time.wMinute, time.wSecond, time.wMilliseconds);
+
+    std::scoped_lock lock(g_trace_mutex);
+
+    const std::string_view text(data, size);
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        if (at_line_start)
+        {
+            g_trace += timestamp;
+            at_line_start = false;
+        }
+
+        const size_t line_end = text.find('\n', pos);
+        if (line_end == std::string_view::npos)
+        {
+            g_trace += text.substr(pos);
+            break;
+        }
+
+        g_trace += text.substr(pos, line_end + 1 - pos);
+        at_line_start = true;
+        pos = line_end + 1;
+    }
+
+    if (g_trace.size() > HOOKFXR_HOST_TRACE_MAX)
+    {
+        g_trace.erase(0, g_trace.find('\n', g_trace.size() / 2) + 1);
+        g_trace_truncated = true;
+    }
+}
+
+DWORD WINAPI read_pipe(LPVOID parameter)
+{
+    const HANDLE pipe = static_cast<HANDLE>(parameter);
+    if (ConnectNamedPipe(pipe, nullptr) || GetLastError() == ERROR_PIPE_CONNECTED)
+    {
+        bool at_line_start = true;
+        char buffer[4096];
+        DWORD read;
+        while (ReadFile(pipe, buffer, sizeof(buffer), &read, nullptr) && read > 0)
+        {
+            append_trace(buffer, read, at_line_start);
+        }
+    }
+
+    CloseHandle(pipe);
+    return 0;
+}
+
+std::optional<std::wstring> get_environment(const wchar_t* name)
+{
+    const DWORD size = GetEnvironmentVariableW(name, nullptr, 0);
+    if (size == 0)
+        return std::nullopt;
+
+    std::wstring value(size, L'\0');
+    value.resize(GetEnvironmentVariableW(name, value.data(), size));
+    return value;
+}
+
+// Waits for a reader thread. A reader whose client still has the pipe open is blocked in ReadFile, which is cancelled
+// until the thread gives up; retried as the cancellation may land between two reads.
+void stop_reader(HANDLE& reader)
+{
+    if (!reader)
+        return;
+
+    while (WaitForSingleObject(reader, 10) == WAIT_TIMEOUT)
+    {
+        CancelSynchronousIo(reader);
+    }
+
+    CloseHandle(reader);
+    reader = nullptr;
+}
+}
+
+hostfxr_error_writer_fn host_trace_set_app_error_writer(hostfxr_error_writer_fn error_writer)
+{
+    return g_app_error_writer.exchange(error_writer, std::memory_order_acq_rel);
+}
+
+void host_trace_start_capture()
+{
+    // Tracing explicitly requested by the user, leave it going wherever they wanted it.
+    if (GetEnvironmentVariableW(L"COREHOST_TRACE", nullptr, 0) > 0)
+    {
+        HFXR_INFO("COREHOST_TRACE is already set, not capturing the host trace");
+        return;
+    }
+
+    const std::wstring pipe_name = std::format(L"\\\\.\\pipe\\hookfxr-host-trace-{}", GetCurrentProcessId());
+
+    // All instances exist before the host runs, so opening the trace file never races a reader thread.
+    for (int i = 0; i < HOOKFXR_HOST_TRACE_PIPES; ++i)
+    {
+        const HANDLE pipe = CreateNamedPipeW(
+            pipe_name.c_str(),
+            PIPE_ACCESS_INBOUND | (i == 0 ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES,
+            0,
+            64 * 1024,
+            0,
+            nullptr);
+
+        if (pipe == INVALID_HANDLE_VALUE)
+        {
+            HFXR_WARNING("Failed to create host trace pipe: {}", GetLastError());
+            if (i == 0)
+                return;
+
+            break;
+        }
+
+        g_readers[i] = CreateThread(nullptr, 0, read_pipe, pipe, 0, nullptr);
+        if (!g_readers[i])
+        {
+            CloseHandle(pipe);
+        }
+    }
+
+    g_pipe_name = pipe_name;
+    g_previous_trace_file = get_environment(L"COREHOST_TRACEFILE");
+    SetEnvironmentVariableW(L"COREHOST_TRACEFILE", pipe_name.c_str());
+    SetEnvironmentVariableW(L"COREHOST_TRACE", L"1");
+    g_environment_set.store(true, std::memory_order_release);
+    g_capturing.store(true, std::memory_order_release);
+}
+
+void host_trace_end_setup()
+{
+    if (!g_environment_set.exchange(false, std::memory_order_acq_rel))
+        return;
+
+    // Child processes would otherwise inherit full host tracing aimed at our pipe.
+    SetEnvironmentVariableW(L"COREHOST_TRACE", nullptr);
+    SetEnvironmentVariableW(L"COREHOST_TRACEFILE",
+        g_previous_trace_file ? g_previous_trace_file->c_str() : nullptr);
+
+    // Connect to every instance nobody opened, so their readers see the end of the pipe and exit. Opening fails once
+    // no instance is left waiting for a client.
+    for (int i = 0; i < HOOKFXR_HOST_TRACE_PIPES; ++i)
+    {
+        const HANDLE client = CreateFileW(g_pipe_name.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (client == INVALID_HANDLE_VALUE)
+            break;
+
+        CloseHandle(client);
+    }
+}
+
+void host_trace_install(HMODULE hostfxr_module)
+{
+    const auto set_error_writer = reinterpret_cast<hostfxr_set_error_writer_fn>(
+        GetProcAddress(hostfxr_module, "hostfxr_set_error_writer"));
+
+    if (!set_error_writer)
+    {
+        HFXR_WARNING("hostfxr does not export hostfxr_set_error_writer, host errors will not be logged");
+        return;
+    }
+
+    set_error_writer(error_writer);
+}
+
+void host_trace_finish(int status)
+{
+    if (!g_capturing.exchange(false, std::memory_order_acq_rel))
+        return;
+
+    host_trace_end_setup();
+    for (HANDLE& reader : g_readers)
+    {
+        stop_reader(reader);
+    }
+
+    std::string trace;
+    bool truncated;
+    {
+        std::scoped_lock lock(g_trace_mutex);
+        trace.swap(g_trace);
+        truncated = std::exchange(g_trace_truncated, false);
+    }
+
+    if (!is_host_failure(status) && !g_host_reported_error.load(std::memory_order_relaxed))
+        return;
+
+    HFXR_ERROR("Host failed with status {:x}, writing the captured host trace", static_cast<unsigned int>(status));
+    log_write_block(truncated ? "host trace (truncated)" : "host trace", trace);
+}
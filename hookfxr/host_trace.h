@@ -0,0 +1,25 @@
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <hostfxr.h>
+
+// Remembers the error writer the apphost registered on the proxy. Messages are forwarded to it after being logged,
+// so a windowed apphost still gets to show its error dialog.
+hostfxr_error_writer_fn host_trace_set_app_error_writer(hostfxr_error_writer_fn error_writer);
+
+// Starts capturing the verbose host trace (COREHOST_TRACE) into memory. Must run before the real hostfxr is first
+// called, as hostfxr and hostpolicy read COREHOST_TRACE/COREHOST_TRACEFILE when they set up tracing.
+void host_trace_start_capture();
+
+// Called once hostpolicy has set up its tracing. Restores COREHOST_TRACE and COREHOST_TRACEFILE, so child processes
+// do not inherit them, and stops serving the pipe instances nobody opened.
+void host_trace_end_setup();
+
+// Registers the hookfxr error writer on the real hostfxr for the calling thread.
+void host_trace_install(HMODULE hostfxr_module);
+
+// Ends the capture and writes the captured trace to the log if the host failed. Called with 0 once managed main
+// starts, as the host has done its part then, otherwise with the status returned by the real hostfxr.
+void host_trace_finish(int status);
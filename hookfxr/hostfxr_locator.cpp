@@ -0,0 +1,378 @@
+#include "hostfxr_locator.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <cstdlib>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define HOOKFXR_ARCH "x64"
+#define HOOKFXR_ARCH_UPPER "X64"
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define HOOKFXR_ARCH "arm64"
+#define HOOKFXR_ARCH_UPPER "ARM64"
+#elif defined(_M_IX86) || defined(__i386__)
+#define HOOKFXR_ARCH "x86"
+#define HOOKFXR_ARCH_UPPER "X86"
+#else
+#error Unsupported architecture
+#endif
+
+#ifdef _WIN32
+#define HOOKFXR_LIBFXR_NAME "hostfxr.dll"
+#elif defined(__APPLE__)
+#define HOOKFXR_LIBFXR_NAME "libhostfxr.dylib"
+#else
+#define HOOKFXR_LIBFXR_NAME "libhostfxr.so"
+#endif
+
+namespace
+{
+using path_char = std::filesystem::path::value_type;
+
+bool is_digit(path_char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+bool is_identifier_char(path_char c)
+{
+    return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-';
+}
+
+bool is_numeric(path_string_view text)
+{
+    return std::ranges::all_of(text, is_digit);
+}
+
+// Parses a number at the start of text and removes it. Leading zeros are rejected, more than 9 digits as well, which
+// keeps the value within uint32_t.
+bool parse_number(path_string_view& text, uint32_t& value)
+{
+    size_t length = 0;
+    while (length < text.size() && is_digit(text[length]))
+        ++length;
+
+    if (length == 0 || length > 9 || (length > 1 && text[0] == '0'))
+        return false;
+
+    value = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        value = value * 10 + static_cast<uint32_t>(text[i] - '0');
+    }
+
+    text.remove_prefix(length);
+    return true;
+}
+
+// Dot-separated, non-empty identifiers. Numeric identifiers of a pre-release label must not have leading zeros.
+bool is_valid_label(path_string_view label, bool check_leading_zeros)
+{
+    while (true)
+    {
+        const size_t dot = std::min(label.find('.'), label.size());
+        const path_string_view identifier = label.substr(0, dot);
+
+        if (identifier.empty() || !std::ranges::all_of(identifier, is_identifier_char))
+            return false;
+        if (check_leading_zeros && identifier.size() > 1 && identifier[0] == '0' && is_numeric(identifier))
+            return false;
+
+        if (dot == label.size())
+            return true;
+
+        label.remove_prefix(dot + 1);
+    }
+}
+
+int compare_identifier(path_string_view a, path_string_view b)
+{
+    const bool a_numeric = is_numeric(a);
+    const bool b_numeric = is_numeric(b);
+
+    // Numeric identifiers have lower precedence than alphanumeric ones.
+    if (a_numeric != b_numeric)
+        return a_numeric ? -1 : 1;
+
+    // Without leading zeros, the longer number is the larger one, and equal lengths compare like strings.
+    if (a_numeric && a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
+
+    const int result = a.compare(b);
+    return result < 0 ? -1 : (result > 0 ? 1 : 0);
+}
+
+int compare_prerelease(path_string_view a, path_string_view b)
+{
+    // A release has higher precedence than any of its pre-releases.
+    if (a.empty() || b.empty())
+        return a.empty() == b.empty() ? 0 : (a.empty() ? 1 : -1);
+
+    while (!a.empty() && !b.empty())
+    {
+        const size_t a_dot = std::min(a.find('.'), a.size());
+        const size_t b_dot = std::min(b.find('.'), b.size());
+
+        if (const int result = compare_identifier(a.substr(0, a_dot), b.substr(0, b_dot)); result != 0)
+            return result;
+
+        a.remove_prefix(std::min(a_dot + 1, a.size()));
+        b.remove_prefix(std::min(b_dot + 1, b.size()));
+    }
+
+    // All shared identifiers are equal, more identifiers means higher precedence.
+    return a.empty() == b.empty() ? 0 : (a.empty() ? -1 : 1);
+}
+
+std::filesystem::path get_environment(const char* name)
+{
+#ifdef _WIN32
+    const std::wstring wide_name(name, name + std::char_traits<char>::length(name));
+
+    // The first call returns the size including the terminator. Retried if the variable grew in between.
+    std::wstring value;
+    DWORD length = GetEnvironmentVariableW(wide_name.c_str(), nullptr, 0);
+    while (length > 0)
+    {
+        value.resize(length);
+        length = GetEnvironmentVariableW(wide_name.c_str(), value.data(), static_cast<DWORD>(value.size()));
+        if (length < value.size())
+        {
+            value.resize(length);
+            return value;
+        }
+    }
+
+    return {};
+#else
+    const char* value = std::getenv(name);
+    return value ? std::filesystem::path(value) : std::filesystem::path();
+#endif
+}
+
+std::filesystem::path get_default_location()
+{
+#ifdef _WIN32
+    const std::filesystem::path program_files = get_environment("ProgramFiles");
+    return program_files.empty() ? program_files : program_files / "dotnet";
+#elif defined(__APPLE__)
+    return "/usr/local/share/dotnet";
+#else
+    return "/usr/share/dotnet";
+#endif
+}
+}
+
+bool parse_fx_version(path_string_view text, fx_version& version)
+{
+    version = {};
+
+    if (!parse_number(text, version.m_major) || text.empty() || text[0] != '.')
+        return false;
+    text.remove_prefix(1);
+
+    if (!parse_number(text, version.m_minor) || text.empty() || text[0] != '.')
+        return false;
+    text.remove_prefix(1);
+
+    if (!parse_number(text, version.m_patch))
+        return false;
+
+    const size_t plus = std::min(text.find('+'), text.size());
+    if (plus != text.size() && !is_valid_label(text.substr(plus + 1), false))
+        return false;
+    text = text.substr(0, plus);
+
+    if (text.empty())
+        return true;
+
+    if (text[0] != '-' || !is_valid_label(text.substr(1), true))
+        return false;
+
+    version.m_prerelease = text.substr(1);
+    return true;
+}
+
+int compare_fx_version(const fx_version& a, const fx_version& b)
+{
+    if (a.m_major != b.m_major)
+        return a.m_major < b.m_major ? -1 : 1;
+    if (a.m_minor != b.m_minor)
+        return a.m_minor < b.m_minor ? -1 : 1;
+    if (a.m_patch != b.m_patch)
+        return a.m_patch < b.m_patch ? -1 : 1;
+
+    return compare_prerelease(a.m_prerelease, b.m_prerelease);
+}
+
+std::filesystem::path read_install_location(const std::filesystem::path& directory)
+{
+    for (const char* name : { "install_location_" HOOKFXR_ARCH, "install_location" })
+    {
+        std::ifstream file(directory / name);
+        if (!file)
+            continue;
+
+        std::string line;
+        std::getline(file, line);
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+            line.pop_back();
+
+        return line;
+    }
+
+    return {};
+}
+
+std::filesystem::path get_registered_location()
+{
+#ifdef _WIN32
+    // The installers always write to the 32-bit view of the registry.
+    wchar_t value[MAX_PATH];
+    DWORD size = sizeof(value);
+    if (RegGetValueW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\dotnet\\Setup\\InstalledVersions\\" HOOKFXR_ARCH,
+        L"InstallLocation", RRF_RT_REG_SZ | RRF_SUBKEY_WOW6432KEY, nullptr, value, &size) != ERROR_SUCCESS)
+    {
+        return {};
+    }
+
+    return value;
+#else
+    return read_install_location("/etc/dotnet");
+#endif
+}
+
+hostfxr_sources get_hostfxr_sources(const std::filesystem::path& explicit_root)
+{
+    hostfxr_sources sources;
+    if (!explicit_root.empty())
+    {
+        sources.m_explicit = explicit_root;
+        return sources;
+    }
+
+    sources.m_environment = get_environment("DOTNET_ROOT_" HOOKFXR_ARCH_UPPER);
+    if (sources.m_environment.empty())
+    {
+        sources.m_environment = get_environment("DOTNET_ROOT");
+    }
+
+    // The later sources are only consulted if the environment does not name a root.
+    if (sources.m_environment.empty())
+    {
+        sources.m_install_location = get_registered_location();
+        sources.m_default_location = get_default_location();
+    }
+
+    return sources;
+}
+
+bool find_latest_hostfxr(const std::filesystem::path& dotnet_root, hostfxr_location& location)
+{
+    location.m_hostfxr_path.clear();
+
+    std::error_code error;
+    std::filesystem::directory_iterator it(dotnet_root / "host" / "fxr", error);
+    if (error)
+        return false;
+
+    // Only the directory names are compared, the file itself is checked once for the winner.
+    bool found = false;
+    fx_version version;
+    std::filesystem::path latest;
+    for (; it != std::filesystem::directory_iterator(); it.increment(error))
+    {
+        if (error)
+            return false;
+
+        if (!it->is_directory(error))
+            continue;
+
+        const std::filesystem::path& path = it->path();
+        if (!parse_fx_version(path.filename().native(), version))
+            continue;
+
+        if (!found || compare_fx_version(version, location.m_version) > 0)
+        {
+            found = true;
+            location.m_version = std::move(version);
+            latest = path;
+        }
+    }
+
+    if (!found)
+        return false;
+
+    // Like nethost, the highest version wins even if it turns out to have no hostfxr.
+    std::filesystem::path hostfxr_path = latest / HOOKFXR_LIBFXR_NAME;
+    if (!std::filesystem::is_regular_file(hostfxr_path, error))
+        return false;
+
+    location.m_hostfxr_path = std::move(hostfxr_path);
+    return true;
+}
+
+hostfxr_location locate_hostfxr(const hostfxr_sources& sources)
+{
+    hostfxr_location location;
+    if (!sources.m_explicit.empty())
+    {
+        location.m_source = hostfxr_source::explicit_root;
+        location.m_dotnet_root = sources.m_explicit;
+    }
+    else if (!sources.m_environment.empty())
+    {
+        location.m_source = hostfxr_source::environment;
+        location.m_dotnet_root = sources.m_environment;
+    }
+    else if (!sources.m_install_location.empty())
+    {
+        location.m_source = hostfxr_source::install_location;
+        location.m_dotnet_root = sources.m_install_location;
+    }
+    else if (!sources.m_default_location.empty())
+    {
+        location.m_source = hostfxr_source::default_location;
+        location.m_dotnet_root = sources.m_default_location;
+    }
+    else
+    {
+        return location;
+    }
+
+    std::error_code error;
+    if (std::filesystem::path absolute = std::filesystem::absolute(location.m_dotnet_root, error); !error)
+    {
+        location.m_dotnet_root = std::move(absolute);
+    }
+
+    find_latest_hostfxr(location.m_dotnet_root, location);
+    return location;
+}
+
+const hostfxr_location& locate_hostfxr()
+{
+    static const hostfxr_location location = locate_hostfxr(get_hostfxr_sources());
+    return location;
+}
+
+const char* hostfxr_source_name(hostfxr_source source)
+{
+    switch (source)
+    {
+    case hostfxr_source::none: return "none";
+    case hostfxr_source::explicit_root: return "explicit_root";
+    case hostfxr_source::environment: return "environment";
+    case hostfxr_source::install_location: return "install_location";
+    case hostfxr_source::default_location: return "default_location";
+    }
+    return "unknown";
+}
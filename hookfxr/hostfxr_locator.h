@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+// Locates the real hostfxr of a global .NET installation, the way nethost does for framework-dependent apps:
+// the dotnet root comes from the host if it names one, DOTNET_ROOT_<ARCH> or DOTNET_ROOT, then the registered install location (the registry on
+// Windows, /etc/dotnet/install_location* elsewhere), then the default install location. hostfxr is the one in the
+// highest versioned host/fxr/<version> directory of that root.
+// App-local hostfxr (self-contained apps) is not probed, the app directory is where the proxy itself lives.
+// Kept free of hookfxr's Windows-only headers, it builds and works on Linux as well.
+
+using path_string_view = std::basic_string_view<std::filesystem::path::value_type>;
+
+// Version of a host/fxr directory, major.minor.patch[-prerelease][+build].
+struct fx_version
+{
+    uint32_t m_major{ 0 };
+    uint32_t m_minor{ 0 };
+    uint32_t m_patch{ 0 };
+    // Without the leading '-', empty for a release. Build metadata does not take part in ordering and is dropped.
+    std::filesystem::path::string_type m_prerelease;
+};
+
+enum class hostfxr_source : uint8_t
+{
+    none,
+    explicit_root,    // Passed by the host, the dotnet_root of hookfxr_run.
+    environment,      // DOTNET_ROOT_<ARCH> or DOTNET_ROOT.
+    install_location, // Registry or /etc/dotnet/install_location*.
+    default_location, // %ProgramFiles%\dotnet, /usr/share/dotnet or /usr/local/share/dotnet.
+};
+
+// Candidate dotnet roots, in the order they are tried. The first non-empty one is used, without falling back to the
+// next one if it has no hostfxr, which matches nethost.
+struct hostfxr_sources
+{
+    std::filesystem::path m_explicit;
+    std::filesystem::path m_environment;
+    std::filesystem::path m_install_location;
+    std::filesystem::path m_default_location;
+};
+
+struct hostfxr_location
+{
+    hostfxr_source m_source{ hostfxr_source::none };
+    std::filesystem::path m_dotnet_root;
+    // Empty if the dotnet root has no host/fxr/<version>/hostfxr.
+    std::filesystem::path m_hostfxr_path;
+    fx_version m_version;
+};
+
+// Returns false if text is not a valid version. Numbers must not have leading zeros, as in semver.
+bool parse_fx_version(path_string_view text, fx_version& version);
+
+// Semver precedence: negative if a < b, zero if equal, positive if a > b.
+int compare_fx_version(const fx_version& a, const fx_version& b);
+
+// Reads the first line of install_location_<arch>, falling back to install_location, in directory (/etc/dotnet).
+// Returns an empty path if neither file exists.
+std::filesystem::path read_install_location(const std::filesystem::path& directory);
+
+// The registered install location: the InstallLocation registry value of the architecture on Windows,
+// read_install_location("/etc/dotnet") elsewhere. Empty if there is none.
+std::filesystem::path get_registered_location();
+
+// Reads the sources from the process environment, the registry or /etc/dotnet and the default install location.
+// With an explicit_root, that is the only source and nothing else is read.
+hostfxr_sources get_hostfxr_sources(const std::filesystem::path& explicit_root = {});
+
+// Scans host/fxr under dotnet_root. Leaves location.m_hostfxr_path empty if there is no usable version.
+bool find_latest_hostfxr(const std::filesystem::path& dotnet_root, hostfxr_location& location);
+
+// Locates hostfxr from the given sources. Not cached, every call probes the file system again.
+hostfxr_location locate_hostfxr(const hostfxr_sources& sources);
+
+// Locates hostfxr from get_hostfxr_sources(). The result is computed on the first call and then returned for the
+// lifetime of the process, later changes to the environment are not picked up.
+const hostfxr_location& locate_hostfxr();
+
+const char* hostfxr_source_name(hostfxr_source source);
@@ -0,0 +1,337 @@
+#include "log.h"
+
+#include "defines.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <iterator>
+#include <mutex>
+
+// Number of records the ring buffer holds, must be a power of two.
+#define HOOKFXR_LOG_CAPACITY 256
+
+namespace
+{
+struct log_record
+{
+    // Bounded MPMC queue sequence (Vyukov): equals the write position once the record is published, and the write
+    // position plus capacity once it has been drained.
+    std::atomic<uint64_t> m_sequence{ 0 };
+    uint64_t m_timestamp{ 0 };
+    uint32_t m_thread_id{ 0 };
+    log_level m_level{ log_level::info };
+    const char* m_file{ nullptr };
+    int m_line{ 0 };
+    uint32_t m_length{ 0 };
+    wchar_t m_text[HOOKFXR_LOG_MESSAGE_MAX];
+};
+
+std::array<log_record, HOOKFXR_LOG_CAPACITY> g_records{};
+std::atomic<uint64_t> g_write_pos{ 0 };
+std::atomic<uint64_t> g_dropped{ 0 };
+std::atomic<uint32_t> g_pending{ 0 };
+std::atomic<log_level> g_min_level{ log_level::info };
+std::atomic<bool> g_records_initialized{ false };
+std::atomic<bool> g_stop{ false };
+
+// The drain thread and the module reference it holds, see drain_thread_main.
+HANDLE g_drain_thread{ nullptr };
+HMODULE g_drain_module{ nullptr };
+
+// Only ever touched by whoever holds g_drain_mutex.
+std::mutex g_drain_mutex;
+uint64_t g_read_pos{ 0 };
+HANDLE g_file{ INVALID_HANDLE_VALUE };
+std::wstring g_file_path;
+
+void init_records()
+{
+    // Sequences start out as their index. Done lazily since records may be written before log_init.
+    if (g_records_initialized.load(std::memory_order_acquire))
+        return;
+
+    static std::once_flag once;
+    std::call_once(once, []
+    {
+        for (size_t i = 0; i < g_records.size(); ++i)
+        {
+            g_records[i].m_sequence.store(i, std::memory_order_relaxed);
+        }
+        g_records_initialized.store(true, std::memory_order_release);
+    });
+}
+
+const char* level_name(log_level level)
+{
+    switch (level)
+    {
+    case log_level::trace: return "trace";
+    case log_level::info: return "info";
+    case log_level::warning: return "warning";
+    case log_level::error: return "error";
+    case log_level::critical: return "critical";
+    }
+    return "unknown";
+}
+
+void write_sinks(const char* data, size_t size)
+{
+    DWORD written;
+    if (g_file != INVALID_HANDLE_VALUE)
+    {
+        WriteFile(g_file, data, static_cast<DWORD>(size), &written, nullptr);
+    }
+
+    if (const HANDLE err = GetStdHandle(STD_ERROR_HANDLE); err != nullptr && err != INVALID_HANDLE_VALUE)
+    {
+        WriteFile(err, data, static_cast<DWORD>(size), &written, nullptr);
+    }
+}
+
+void format_record(const log_record& record, std::string& out)
+{
+    FILETIME file_time;
+    file_time.dwLowDateTime = static_cast<DWORD>(record.m_timestamp);
+    file_time.dwHighDateTime = static_cast<DWORD>(record.m_timestamp >> 32);
+
+    SYSTEMTIME utc_time{};
+    SYSTEMTIME local_time{};
+    FileTimeToSystemTime(&file_time, &utc_time);
+    SystemTimeToTzSpecificLocalTime(nullptr, &utc_time, &local_time);
+
+    std::string_view file(record.m_file);
+    if (const size_t last_slash = file.find_last_of("\\/"); last_slash != std::string_view::npos)
+    {
+        file.remove_prefix(last_slash + 1);
+    }
+
+    out.clear();
+    std::format_to(std::back_inserter(out), "{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03} [{}] {} {}:{} ",
+        local_time.wYear, local_time.wMonth, local_time.wDay,
+        local_time.wHour, local_time.wMinute, local_time.wSecond, local_time.wMilliseconds,
+        record.m_thread_id, level_name(record.m_level), file, record.m_line);
+
+    const int text_length = static_cast<int>(record.m_length);
+    const int utf8_length = WideCharToMultiByte(CP_UTF8, 0, record.m_text, text_length, nullptr, 0, nullptr, nullptr);
+    const size_t prefix_length = out.size();
+    out.resize(prefix_length + utf8_length);
+    WideCharToMultiByte(CP_UTF8, 0, record.m_text, text_length, out.data() + prefix_length, utf8_length, nullptr, nullptr);
+
+    if (out.empty() || out.back() != '\n')
+    {
+        out += '\n';
+    }
+}
+
+// Caller must hold g_drain_mutex.
+void drain_locked()
+{
+    static std::string line;
+
+    for (;;)
+    {
+        log_record& record = g_records[g_read_pos & (HOOKFXR_LOG_CAPACITY - 1)];
+        if (record.m_sequence.load(std::memory_order_acquire) != g_read_pos + 1)
+            break;
+
+        format_record(record, line);
+        write_sinks(line.data(), line.size());
+
+        record.m_sequence.store(g_read_pos + HOOKFXR_LOG_CAPACITY, std::memory_order_release);
+        ++g_read_pos;
+    }
+
+    if (const uint64_t dropped = g_dropped.exchange(0, std::memory_order_relaxed); dropped > 0)
+    {
+        line = std::format("hookfxr: {} log records were dropped because the log buffer was full\n", dropped);
+        write_sinks(line.data(), line.size());
+    }
+}
+
+DWORD WINAPI drain_thread_main(LPVOID)
+{
+    {
+        std::scoped_lock lock(g_drain_mutex);
+        if (!g_file_path.empty())
+        {
+            g_file = CreateFileW(g_file_path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        }
+    }
+
+    for (;;)
+    {
+        const uint32_t pending = g_pending.load(std::memory_order_acquire);
+        {
+            std::scoped_lock lock(g_drain_mutex);
+            drain_locked();
+        }
+
+        if (g_stop.load(std::memory_order_acquire))
+            break;
+
+        g_pending.wait(pending, std::memory_order_acquire);
+    }
+
+    // The thread holds a reference to hookfxr, so a FreeLibrary can never unmap the code it is running. The reference
+    // is only released by the call that ends the thread.
+    FreeLibraryAndExitThread(g_drain_module, 0);
+}
+}
+
+void log_init(const std::wstring& file_path, log_level min_level)
+{
+    static std::once_flag once;
+    std::call_once(once, [&]
+    {
+        init_records();
+        g_min_level.store(min_level, std::memory_order_relaxed);
+        g_file_path = file_path;
+
+        if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, reinterpret_cast<LPCWSTR>(&log_init),
+            &g_drain_module))
+        {
+            return;
+        }
+
+        // The thread only starts running once the loader lock is released, it must never be waited on from here.
+        g_drain_thread = CreateThread(nullptr, 0, drain_thread_main, nullptr, 0, nullptr);
+        if (!g_drain_thread)
+        {
+            FreeLibrary(g_drain_module);
+        }
+    });
+}
+
+void log_shutdown()
+{
+    if (!g_drain_thread)
+        return;
+
+    g_stop.store(true, std::memory_order_release);
+    g_pending.fetch_add(1, std::memory_order_release);
+    g_pending.notify_one();
+
+    WaitForSingleObject(g_drain_thread, INFINITE);
+    CloseHandle(g_drain_thread);
+    g_drain_thread = nullptr;
+
+    std::scoped_lock lock(g_drain_mutex);
+    drain_locked();
+
+    if (g_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(g_file);
+        g_file = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool log_enabled(log_level level)
+{
+    return level >= g_min_level.load(std::memory_order_relaxed);
+}
+
+void log_write(log_level level, const char* file, int line, std::wstring_view message)
+{
+    if (!log_enabled(level))
+        return;
+
+    init_records();
+
+    uint64_t pos = g_write_pos.load(std::memory_order_relaxed);
+    log_record* record;
+    for (;;)
+    {
+        record = &g_records[pos & (HOOKFXR_LOG_CAPACITY - 1)];
+        const uint64_t sequence = record->m_sequence.load(std::memory_order_acquire);
+        const int64_t diff = static_cast<int64_t>(sequence - pos);
+
+        if (diff == 0)
+        {
+            if (g_write_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Full, the drain thread is behind.
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = g_write_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    FILETIME now;
+    GetSystemTimePreciseAsFileTime(&now);
+
+    record->m_timestamp = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+    record->m_thread_id = GetCurrentThreadId();
+    record->m_level = level;
+    record->m_file = file;
+    record->m_line = line;
+    record->m_length = static_cast<uint32_t>(std::min<size_t>(message.size(), HOOKFXR_LOG_MESSAGE_MAX));
+    std::copy_n(message.data(), record->m_length, record->m_text);
+
+    record->m_sequence.store(pos + 1, std::memory_order_release);
+
+    g_pending.fetch_add(1, std::memory_order_release);
+    g_pending.notify_one();
+}
+
+void log_write(log_level level, const char* file, int line, std::string_view message)
+{
+    if (!log_enabled(level))
+        return;
+
+    wchar_t buffer[HOOKFXR_LOG_MESSAGE_MAX];
+    const int length = MultiByteToWideChar(CP_UTF8, 0, message.data(),
+        static_cast<int>(std::min<size_t>(message.size(), HOOKFXR_LOG_MESSAGE_MAX)), buffer, HOOKFXR_LOG_MESSAGE_MAX);
+    log_write(level, file, line, std::wstring_view(buffer, length > 0 ? length : 0));
+}
+
+void log_flush()
+{
+    init_records();
+
+    std::scoped_lock lock(g_drain_mutex);
+    drain_locked();
+
+    if (g_file != INVALID_HANDLE_VALUE)
+    {
+        FlushFileBuffers(g_file);
+    }
+}
+
+void log_flush_at_exit()
+{
+    init_records();
+
+    std::unique_lock lock(g_drain_mutex, std::try_to_lock);
+    if (!lock.owns_lock())
+        return;
+
+    drain_locked();
+
+    if (g_file != INVALID_HANDLE_VALUE)
+    {
+        FlushFileBuffers(g_file);
+    }
+}
+
+void log_write_block(std::string_view title, std::string_view text)
+{
+    init_records();
+
+    std::scoped_lock lock(g_drain_mutex);
+    drain_locked();
+
+    const std::string header = std::format("----- {} -----\n", title);
+    write_sinks(header.data(), header.size());
+    write_sinks(text.data(), text.size());
+
+    const std::string footer = text.empty() || text.back() == '\n' ? "-----\n" : "\n-----\n";
+    write_sinks(footer.data(), footer.size());
+}
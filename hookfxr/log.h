@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <format>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Longest message a single log record can hold, longer messages are truncated.
+#define HOOKFXR_LOG_MESSAGE_MAX 480
+
+enum class log_level : uint8_t
+{
+    trace,
+    info,
+    warning,
+    error,
+    critical,
+};
+
+// Opens the file sink and starts the background thread that drains the log.
+// Records written before this are kept in the ring buffer and drained once it runs.
+// An empty path disables the file sink, records are then only written to stderr.
+void log_init(const std::wstring& file_path, log_level min_level);
+
+// Stops the background thread, waits for it and closes the file sink. Records written afterwards stay in the ring
+// buffer until log_flush, which writes them to stderr only.
+// Must not be called with the loader lock held. Until this is called, the thread keeps hookfxr loaded, so a
+// FreeLibrary only unloads it once the log has been shut down.
+void log_shutdown();
+
+// Copies a record into the ring buffer. Never blocks and never performs I/O, if the buffer is full the record
+// is dropped and counted instead.
+void log_write(log_level level, const char* file, int line, std::wstring_view message);
+void log_write(log_level level, const char* file, int line, std::string_view message);
+
+// Synchronously drains every pending record on the calling thread.
+void log_flush();
+
+// log_flush for process exit. Every other thread has already been terminated then, possibly while it held the drain
+// lock, so this gives up instead of waiting for it.
+void log_flush_at_exit();
+
+// Synchronously writes a block of text that does not fit into a record (e.g. a captured trace) to the sinks,
+// after draining every pending record so the block ends up in order.
+void log_write_block(std::string_view title, std::string_view text);
+
+bool log_enabled(log_level level);
+
+template <typename... Args>
+void log_format(log_level level, const char* file, int line, std::format_string<Args...> fmt, Args&&... args)
+{
+    if (!log_enabled(level))
+        return;
+
+    char buffer[HOOKFXR_LOG_MESSAGE_MAX];
+    const auto result = std::format_to_n(buffer, std::size(buffer), fmt, std::forward<Args>(args)...);
+    log_write(level, file, line, std::string_view(buffer, static_cast<size_t>(result.out - buffer)));
+}
+
+template <typename... Args>
+void log_format(log_level level, const char* file, int line, std::wformat_string<Args...> fmt, Args&&... args)
+{
+    if (!log_enabled(level))
+        return;
+
+    wchar_t buffer[HOOKFXR_LOG_MESSAGE_MAX];
+    const auto result = std::format_to_n(buffer, std::size(buffer), fmt, std::forward<Args>(args)...);
+    log_write(level, file, line, std::wstring_view(buffer, static_cast<size_t>(result.out - buffer)));
+}
@@ -0,0 +1,142 @@
+#include "plugin_deps.h"
+
+#include "cache_file.h"
+#include "defines.h"
+
+#include <algorithm>
+
+#define HOOKFXR_PLUGIN_INDEX_MAGIC 0x44504648 // "HFPD"
+#define HOOKFXR_PLUGIN_INDEX_VERSION 2
+// Upper bounds of indexed files and of the index's size, a larger index is treated as corrupt and rebuilt.
+#define HOOKFXR_PLUGIN_INDEX_MAX_FILES 4096
+#define HOOKFXR_PLUGIN_INDEX_MAX_SIZE (4 * 1024 * 1024)
+
+namespace
+{
+// The index is the directory's write time and path, then the file count and the file names.
+
+bool get_directory_write_time(const std::wstring& directory, uint64_t& write_time)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(directory.c_str(), GetFileExInfoStandard, &data) ||
+        !(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        return false;
+    }
+
+    write_time = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+        data.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+std::vector<std::wstring> scan_directory(const std::wstring& directory)
+{
+    std::vector<std::wstring> names;
+
+    WIN32_FIND_DATAW data;
+    const std::wstring pattern = directory + L"\\*.deps.json";
+    const HANDLE find = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr,
+        FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE)
+        return names;
+
+    do
+    {
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            names.emplace_back(data.cFileName);
+        }
+    } while (FindNextFileW(find, &data));
+
+    FindClose(find);
+
+    // FindFirstFile's order depends on the file system, hostpolicy resolves conflicts by order.
+    std::ranges::sort(names);
+    return names;
+}
+
+bool save_index(const std::wstring& path, const std::wstring& directory, uint64_t write_time,
+    const std::vector<std::wstring>& names)
+{
+    cache_writer writer(HOOKFXR_PLUGIN_INDEX_MAGIC, HOOKFXR_PLUGIN_INDEX_VERSION);
+    writer.write(write_time);
+    writer.write(directory);
+    writer.write(static_cast<uint32_t>(names.size()));
+    for (const std::wstring& name : names)
+    {
+        writer.write(name);
+    }
+
+    return cache_file_write(path, writer);
+}
+
+// Returns false if the index is missing, corrupt, or was written for another directory or write time.
+bool load_index(const std::wstring& path, const std::wstring& directory, uint64_t write_time,
+    std::vector<std::wstring>& names)
+{
+    cache_reader reader;
+    uint64_t indexed_write_time;
+    std::wstring indexed_directory;
+    uint32_t file_count;
+    if (!reader.open(path, HOOKFXR_PLUGIN_INDEX_MAGIC, HOOKFXR_PLUGIN_INDEX_VERSION, HOOKFXR_PLUGIN_INDEX_MAX_SIZE) ||
+        !reader.read(indexed_write_time) || indexed_write_time != write_time ||
+        !reader.read(indexed_directory, MAX_PATH) || indexed_directory != directory ||
+        !reader.read(file_count) || file_count > HOOKFXR_PLUGIN_INDEX_MAX_FILES)
+    {
+        return false;
+    }
+
+    names.resize(file_count);
+    for (std::wstring& name : names)
+    {
+        if (!reader.read(name, MAX_PATH))
+        {
+            names.clear();
+            return false;
+        }
+    }
+
+    if (!reader.at_end())
+    {
+        names.clear();
+        return false;
+    }
+
+    return true;
+}
+}
+
+std::vector<std::wstring> find_plugin_deps(const std::wstring& directory, const std::wstring& index_file)
+{
+    std::vector<std::wstring> paths;
+
+    uint64_t write_time;
+    if (!get_directory_write_time(directory, write_time))
+    {
+        HFXR_WARNING(L"Plugin directory {} not found", directory);
+        return paths;
+    }
+
+    // The write time is taken before scanning, a change made during the scan invalidates the index it produces.
+    std::vector<std::wstring> names;
+    if (load_index(index_file, directory, write_time, names))
+    {
+        HFXR_TRACE(L"Using plugin index {}", index_file);
+    }
+    else
+    {
+        names = scan_directory(directory);
+        if (!save_index(index_file, directory, write_time, names))
+        {
+            HFXR_WARNING(L"Failed to write plugin index {}", index_file);
+        }
+    }
+
+    paths.reserve(names.size());
+    for (const std::wstring& name : names)
+    {
+        paths.push_back(directory + L'\\' + name);
+    }
+
+    return paths;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Plugin deps discovery.
+// Every *.deps.json directly in the plugin directory is passed to hostpolicy as an additional deps file, so plugins can
+// bring their own managed and native dependencies. The file list is kept in an index file together with the
+// directory's last write time, which changes whenever an entry is added, removed or renamed. As long as it matches,
+// a launch reads the index instead of enumerating the directory.
+
+// Returns the full paths of the *.deps.json files in directory, sorted by file name. Subdirectories are not searched.
+std::vector<std::wstring> find_plugin_deps(const std::wstring& directory, const std::wstring& index_file);
@@ -0,0 +1,810 @@
+#include "prefetch.h"
+
+#include "cache_file.h"
+#include "defines.h"
+
+#include <safetyhook.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cwctype>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define HOOKFXR_PREFETCH_MAGIC 0x46504648 // "HFPF"
+#define HOOKFXR_PREFETCH_VERSION 3
+// Upper bound of recorded ranges, later reads are not recorded.
+#define HOOKFXR_PREFETCH_MAX_RANGES 65536
+// Upper bound of the list's size, a larger file is treated as corrupt.
+#define HOOKFXR_PREFETCH_MAX_SIZE (64 * 1024 * 1024)
+// Slots of the handle table, a power of two. Handles opened once the table is full are not recorded.
+#define HOOKFXR_PREFETCH_MAX_HANDLES 16384
+// Threads issuing reads during replay. Each works on one file at a time, so the disk sees several requests at once.
+#define HOOKFXR_PREFETCH_THREADS 4
+// Percentage of the listed files that may have changed size or write time since they were recorded. When more have,
+// the list is deleted after the replay, and the next launch records it again.
+#define HOOKFXR_PREFETCH_STALE_PERCENT 10
+
+namespace
+{
+// The file is mapped as an image (LoadLibraryExW or SEC_IMAGE), replay then creates the image section itself.
+constexpr uint32_t prefetch_file_image = 1;
+
+struct prefetch_file
+{
+    std::wstring m_path;
+    uint64_t m_size{ 0 };
+    uint64_t m_write_time{ 0 };
+    uint32_t m_flags{ 0 };
+    // The whole file has been recorded, later ranges of it are redundant.
+    bool m_whole{ false };
+};
+
+// The list is the file count, then the size, write time, flags and path of every file, then the range count and the
+// ranges.
+struct prefetch_range
+{
+    uint32_t m_file;
+    uint64_t m_offset;
+    uint64_t m_size;
+};
+
+// Value of a handle_slot: the file index, with the top bit set for an image section.
+constexpr uint32_t handle_image = 0x80000000;
+constexpr uint32_t handle_untracked = UINT32_MAX;
+
+struct handle_slot
+{
+    HANDLE m_handle;
+    uint32_t m_value;
+};
+
+// A range in the order it was used, before consecutive ranges are merged. m_size is written last, a slot whose size
+// is still 0 has been claimed but not filled in yet.
+struct range_log_entry
+{
+    uint32_t m_file;
+    uint64_t m_offset;
+    uint64_t m_size;
+};
+
+safetyhook::InlineHook g_hook_create_file;
+safetyhook::InlineHook g_hook_read_file;
+safetyhook::InlineHook g_hook_create_file_mapping;
+safetyhook::InlineHook g_hook_map_view_of_file;
+safetyhook::InlineHook g_hook_map_view_of_file_ex;
+
+std::atomic<bool> g_recording{ false };
+std::wstring g_prefetch_path;
+
+// Recording state. g_mutex guards the files and is taken when a file is opened or mapped, not on every read.
+std::mutex g_mutex;
+std::vector<prefetch_file> g_files;
+std::unordered_map<std::wstring, uint32_t> g_file_indices;
+std::vector<prefetch_range> g_ranges;
+
+// Handle table, an open addressing hash over a fixed array so that ReadFile can look a handle up without g_mutex.
+// Written under g_mutex, read through atomic_ref. Handles are never forgotten, as CloseHandle is not hooked; a reused
+// handle value is overwritten when it is opened again, and a stale one at worst records a range that did not need to
+// be prefetched.
+handle_slot* g_handles{ nullptr };
+
+// Ranges in the order they were used, appended to without g_mutex and merged into g_ranges when recording finishes.
+range_log_entry* g_range_log{ nullptr };
+std::atomic<uint32_t> g_range_log_size{ 0 };
+
+// Like the hooks, both tables are allocated when recording starts and never freed: a detour that checked g_recording
+// before it was cleared may still use them.
+
+// Set while a detour records, so file APIs called from within the recording are not recorded themselves.
+thread_local bool g_recording_call{ false };
+
+// The log slot the calling thread appended last, extended in place while the thread keeps reading the same file
+// sequentially, so a file read in small chunks takes one slot.
+thread_local uint32_t g_last_slot{ UINT32_MAX };
+thread_local uint32_t g_last_file{ UINT32_MAX };
+thread_local uint64_t g_last_end{ 0 };
+
+// Replay state.
+std::vector<prefetch_file> g_replay_files;
+std::vector<std::vector<prefetch_range>> g_replay_ranges;
+std::atomic<uint32_t> g_replay_next{ 0 };
+std::atomic<uint32_t> g_replay_running{ 0 };
+std::atomic<uint64_t> g_replay_bytes{ 0 };
+std::atomic<uint32_t> g_replay_stale{ 0 };
+int64_t g_replay_start{ 0 };
+
+// Restores the last error on scope exit, the callers of the hooked APIs check it after they return.
+class preserve_last_error
+{
+public:
+    preserve_last_error() : m_error(GetLastError()) {}
+    ~preserve_last_error() { SetLastError(m_error); }
+
+private:
+    DWORD m_error;
+};
+
+uint64_t file_time_value(const FILETIME& time)
+{
+    return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+}
+
+// True if the calling detour must not record: recording has finished, or the call comes from the recording itself.
+bool skip_recording()
+{
+    return !g_recording.load(std::memory_order_relaxed) || g_recording_call;
+}
+
+handle_slot* find_handle_slot(HANDLE handle)
+{
+    const size_t mask = HOOKFXR_PREFETCH_MAX_HANDLES - 1;
+    const size_t start = reinterpret_cast<uintptr_t>(handle) >> 2;
+    for (size_t i = 0; i < HOOKFXR_PREFETCH_MAX_HANDLES; ++i)
+    {
+        handle_slot& slot = g_handles[(start + i) & mask];
+        const HANDLE key = std::atomic_ref(slot.m_handle).load(std::memory_order_acquire);
+        if (key == handle || key == nullptr)
+            return &slot;
+    }
+    return nullptr;
+}
+
+// Lock free. Returns handle_untracked for a handle that was not recorded.
+uint32_t get_handle(HANDLE handle)
+{
+    handle_slot* slot = find_handle_slot(handle);
+    if (!slot || std::atomic_ref(slot->m_handle).load(std::memory_order_acquire) != handle)
+        return handle_untracked;
+
+    return std::atomic_ref(slot->m_value).load(std::memory_order_relaxed);
+}
+
+// Expects g_mutex to be held. The value is published before the key, a reader that finds the key sees it.
+void set_handle(HANDLE handle, uint32_t value)
+{
+    handle_slot* slot = find_handle_slot(handle);
+    if (!slot)
+        return;
+
+    std::atomic_ref(slot->m_value).store(value, std::memory_order_relaxed);
+    std::atomic_ref(slot->m_handle).store(handle, std::memory_order_release);
+}
+
+// Lock free and allocation free, called from the ReadFile detour.
+void log_range(uint32_t file, uint64_t offset, uint64_t size)
+{
+    if (size == 0)
+        return;
+
+    if (g_last_slot != UINT32_MAX && g_last_file == file && g_last_end == offset)
+    {
+        std::atomic_ref(g_range_log[g_last_slot].m_size).fetch_add(size, std::memory_order_release);
+        g_last_end += size;
+        return;
+    }
+
+    const uint32_t slot = g_range_log_size.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= HOOKFXR_PREFETCH_MAX_RANGES)
+    {
+        g_last_slot = UINT32_MAX;
+        return;
+    }
+
+    range_log_entry& entry = g_range_log[slot];
+    entry.m_file = file;
+    entry.m_offset = offset;
+    std::atomic_ref(entry.m_size).store(size, std::memory_order_release);
+
+    g_last_slot = slot;
+    g_last_file = file;
+    g_last_end = offset + size;
+}
+
+// Expects g_mutex to be held.
+uint32_t add_file(std::wstring path, uint64_t size, uint64_t write_time)
+{
+    if (const auto it = g_file_indices.find(path); it != g_file_indices.end())
+        return it->second;
+
+    const uint32_t index = static_cast<uint32_t>(g_files.size());
+    g_file_indices.emplace(path, index);
+    g_files.push_back({ std::move(path), size, write_time });
+    return index;
+}
+
+// Expects g_mutex to be held. Consecutive ranges of the same file are merged, so a file read sequentially in small
+// chunks ends up as a single range.
+void add_range(uint32_t file, uint64_t offset, uint64_t size)
+{
+    prefetch_file& entry = g_files[file];
+    if (entry.m_whole || offset >= entry.m_size)
+        return;
+
+    size = std::min(size, entry.m_size - offset);
+    if (size == 0)
+        return;
+
+    if (offset == 0 && size == entry.m_size)
+    {
+        entry.m_whole = true;
+    }
+
+    if (!g_ranges.empty())
+    {
+        prefetch_range& last = g_ranges.back();
+        if (last.m_file == file && offset >= last.m_offset && offset <= last.m_offset + last.m_size)
+        {
+            last.m_size = std::max(last.m_size, offset + size - last.m_offset);
+            return;
+        }
+    }
+
+    if (g_ranges.size() < HOOKFXR_PREFETCH_MAX_RANGES)
+    {
+        g_ranges.push_back({ file, offset, size });
+    }
+}
+
+void record_open(HANDLE handle)
+{
+    FILE_STANDARD_INFO info;
+    FILETIME write_time;
+    if (GetFileType(handle) != FILE_TYPE_DISK ||
+        !GetFileInformationByHandleEx(handle, FileStandardInfo, &info, sizeof(info)) || info.Directory ||
+        !GetFileTime(handle, nullptr, nullptr, &write_time))
+    {
+        return;
+    }
+
+    wchar_t path[MAX_PATH];
+    const DWORD length = GetFinalPathNameByHandleW(handle, path, MAX_PATH, FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+    if (length == 0 || length >= MAX_PATH)
+        return;
+
+    std::scoped_lock lock(g_mutex);
+    set_handle(handle, add_file(std::wstring(path, length), static_cast<uint64_t>(info.EndOfFile.QuadPart),
+        file_time_value(write_time)));
+}
+
+HANDLE WINAPI create_file_detour(LPCWSTR file_name, DWORD desired_access, DWORD share_mode,
+    LPSECURITY_ATTRIBUTES security_attributes, DWORD creation_disposition, DWORD flags_and_attributes,
+    HANDLE template_file)
+{
+    const HANDLE handle = g_hook_create_file.call<HANDLE>(file_name, desired_access, share_mode, security_attributes,
+        creation_disposition, flags_and_attributes, template_file);
+
+    if (handle == INVALID_HANDLE_VALUE || skip_recording() || creation_disposition != OPEN_EXISTING ||
+        !(desired_access & (GENERIC_READ | GENERIC_EXECUTE | FILE_READ_DATA | FILE_EXECUTE)))
+    {
+        return handle;
+    }
+
+    preserve_last_error last_error;
+    g_recording_call = true;
+    record_open(handle);
+    g_recording_call = false;
+    return handle;
+}
+
+BOOL WINAPI read_file_detour(HANDLE file, LPVOID buffer, DWORD bytes_to_read, LPDWORD bytes_read,
+    LPOVERLAPPED overlapped)
+{
+    if (skip_recording())
+        return g_hook_read_file.call<BOOL>(file, buffer, bytes_to_read, bytes_read, overlapped);
+
+    // Runs on every read of the process while recording, so it neither takes g_mutex nor allocates.
+    const uint32_t handle = get_handle(file);
+    uint32_t index = (handle & handle_image) ? UINT32_MAX : handle;
+    uint64_t offset = 0;
+    if (index != UINT32_MAX)
+    {
+        preserve_last_error last_error;
+        g_recording_call = true;
+
+        // The offset has to be taken before the read moves the file pointer.
+        LARGE_INTEGER position{};
+        if (overlapped)
+        {
+            offset = (static_cast<uint64_t>(overlapped->OffsetHigh) << 32) | overlapped->Offset;
+        }
+        else if (SetFilePointerEx(file, {}, &position, FILE_CURRENT))
+        {
+            offset = static_cast<uint64_t>(position.QuadPart);
+        }
+        else
+        {
+            index = UINT32_MAX;
+        }
+        g_recording_call = false;
+    }
+
+    const BOOL result = g_hook_read_file.call<BOOL>(file, buffer, bytes_to_read, bytes_read, overlapped);
+
+    if (index != UINT32_MAX)
+    {
+        // Only what was read, a read at the end of the file returns fewer bytes. An overlapped read without a count,
+        // e.g. one that is still pending, is recorded with the requested size as the best guess.
+        if (result && bytes_read)
+        {
+            log_range(index, offset, *bytes_read);
+        }
+        else if (overlapped && (result || GetLastError() == ERROR_IO_PENDING))
+        {
+            log_range(index, offset, bytes_to_read);
+        }
+    }
+
+    return result;
+}
+
+HANDLE WINAPI create_file_mapping_detour(HANDLE file, LPSECURITY_ATTRIBUTES attributes, DWORD protect,
+    DWORD maximum_size_high, DWORD maximum_size_low, LPCWSTR name)
+{
+    const HANDLE mapping = g_hook_create_file_mapping.call<HANDLE>(file, attributes, protect, maximum_size_high,
+        maximum_size_low, name);
+
+    if (!mapping || skip_recording())
+        return mapping;
+
+    std::scoped_lock lock(g_mutex);
+    if (const uint32_t handle = get_handle(file); handle != handle_untracked)
+    {
+        set_handle(mapping, (handle & ~handle_image) | ((protect & SEC_IMAGE) ? handle_image : 0));
+    }
+    else if (get_handle(mapping) != handle_untracked)
+    {
+        // The value belongs to a file mapping recorded earlier whose handle has been closed since.
+        set_handle(mapping, handle_untracked);
+    }
+
+    return mapping;
+}
+
+void record_view(HANDLE mapping, DWORD offset_high, DWORD offset_low, SIZE_T size)
+{
+    const uint32_t handle = get_handle(mapping);
+    if (handle == handle_untracked)
+        return;
+
+    const uint32_t index = handle & ~handle_image;
+    std::scoped_lock lock(g_mutex);
+    prefetch_file& file = g_files[index];
+    if (handle & handle_image)
+    {
+        // An image view always covers the whole file, the offsets are relative to the image layout.
+        file.m_flags |= prefetch_file_image;
+        log_range(index, 0, file.m_size);
+        return;
+    }
+
+    // A size of zero maps everything from the offset to the end of the file. add_range clips it to the file.
+    const uint64_t offset = (static_cast<uint64_t>(offset_high) << 32) | offset_low;
+    log_range(index, offset, size == 0 ? file.m_size : size);
+}
+
+LPVOID WINAPI map_view_of_file_detour(HANDLE mapping, DWORD desired_access, DWORD offset_high, DWORD offset_low,
+    SIZE_T size)
+{
+    const LPVOID view = g_hook_map_view_of_file.call<LPVOID>(mapping, desired_access, offset_high, offset_low, size);
+    if (view && !skip_recording())
+    {
+        record_view(mapping, offset_high, offset_low, size);
+    }
+    return view;
+}
+
+LPVOID WINAPI map_view_of_file_ex_detour(HANDLE mapping, DWORD desired_access, DWORD offset_high, DWORD offset_low,
+    SIZE_T size, LPVOID base_address)
+{
+    const LPVOID view = g_hook_map_view_of_file_ex.call<LPVOID>(mapping, desired_access, offset_high, offset_low, size,
+        base_address);
+    if (view && !skip_recording())
+    {
+        record_view(mapping, offset_high, offset_low, size);
+    }
+    return view;
+}
+
+// Hooked in kernelbase, which the kernel32 exports forward to and which API set imports resolve to directly.
+void* find_file_api(const char* name)
+{
+    if (const HMODULE kernelbase = GetModuleHandleW(L"kernelbase.dll"))
+    {
+        if (void* fn = reinterpret_cast<void*>(GetProcAddress(kernelbase, name)))
+            return fn;
+    }
+
+    return reinterpret_cast<void*>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"), name));
+}
+
+bool hook_file_api(safetyhook::InlineHook& hook, const char* name, void* destination)
+{
+    void* fn = find_file_api(name);
+    if (!fn)
+    {
+        HFXR_WARNING("Could not find {}, not recording startup files", name);
+        return false;
+    }
+
+    hook = safetyhook::create_inline(fn, destination);
+    if (!hook)
+    {
+        HFXR_WARNING("Could not hook {}, not recording startup files", name);
+        return false;
+    }
+
+    return true;
+}
+
+// The hooks are disabled, not destroyed: another thread may still be inside a detour or the trampoline it calls.
+// They stay allocated until the process exits, like the LoadLibraryExW hook.
+void disable_hooks()
+{
+    for (safetyhook::InlineHook* hook : { &g_hook_create_file, &g_hook_read_file, &g_hook_create_file_mapping,
+        &g_hook_map_view_of_file, &g_hook_map_view_of_file_ex })
+    {
+        if (!hook->disable().has_value())
+        {
+            HFXR_WARNING("Could not disable a prefetch recording hook");
+        }
+    }
+}
+
+void start_recording()
+{
+    // Zero filled, committed on first touch.
+    g_handles = static_cast<handle_slot*>(VirtualAlloc(nullptr, sizeof(handle_slot) * HOOKFXR_PREFETCH_MAX_HANDLES,
+        MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    g_range_log = static_cast<range_log_entry*>(VirtualAlloc(nullptr,
+        sizeof(range_log_entry) * HOOKFXR_PREFETCH_MAX_RANGES, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    if (!g_handles || !g_range_log)
+    {
+        HFXR_WARNING("Failed to allocate the prefetch recording state: {}", GetLastError());
+        return;
+    }
+
+    g_recording.store(true, std::memory_order_release);
+
+    if (!hook_file_api(g_hook_create_file, "CreateFileW", reinterpret_cast<void*>(&create_file_detour)) ||
+        !hook_file_api(g_hook_read_file, "ReadFile", reinterpret_cast<void*>(&read_file_detour)) ||
+        !hook_file_api(g_hook_create_file_mapping, "CreateFileMappingW",
+            reinterpret_cast<void*>(&create_file_mapping_detour)) ||
+        !hook_file_api(g_hook_map_view_of_file, "MapViewOfFile", reinterpret_cast<void*>(&map_view_of_file_detour)) ||
+        !hook_file_api(g_hook_map_view_of_file_ex, "MapViewOfFileEx",
+            reinterpret_cast<void*>(&map_view_of_file_ex_detour)))
+    {
+        g_recording.store(false, std::memory_order_release);
+        disable_hooks();
+        return;
+    }
+
+    HFXR_INFO(L"Recording startup files to {}", g_prefetch_path);
+}
+
+bool save(const std::wstring& path)
+{
+    cache_writer writer(HOOKFXR_PREFETCH_MAGIC, HOOKFXR_PREFETCH_VERSION);
+
+    writer.write(static_cast<uint32_t>(g_files.size()));
+    for (const prefetch_file& entry : g_files)
+    {
+        writer.write(entry.m_size);
+        writer.write(entry.m_write_time);
+        writer.write(entry.m_flags);
+        writer.write(entry.m_path);
+    }
+
+    writer.write(static_cast<uint32_t>(g_ranges.size()));
+    for (const prefetch_range& range : g_ranges)
+    {
+        writer.write(range.m_file);
+        writer.write(range.m_offset);
+        writer.write(range.m_size);
+    }
+
+    return cache_file_write(path, writer);
+}
+
+// Reads the list into the replay state, grouping the ranges by file in the order the files were first used.
+bool load(const std::wstring& path)
+{
+    cache_reader reader;
+    if (!reader.open(path, HOOKFXR_PREFETCH_MAGIC, HOOKFXR_PREFETCH_VERSION, HOOKFXR_PREFETCH_MAX_SIZE))
+        return false;
+
+    uint32_t file_count;
+    if (!reader.read(file_count) || file_count > HOOKFXR_PREFETCH_MAX_RANGES)
+        return false;
+
+    std::vector<prefetch_file> files(file_count);
+    for (prefetch_file& entry : files)
+    {
+        if (!reader.read(entry.m_size) || !reader.read(entry.m_write_time) || !reader.read(entry.m_flags) ||
+            !reader.read(entry.m_path, MAX_PATH))
+        {
+            return false;
+        }
+    }
+
+    uint32_t range_count;
+    if (!reader.read(range_count) || range_count > HOOKFXR_PREFETCH_MAX_RANGES)
+        return false;
+
+    std::vector<prefetch_range> ranges(range_count);
+    for (prefetch_range& range : ranges)
+    {
+        if (!reader.read(range.m_file) || !reader.read(range.m_offset) || !reader.read(range.m_size) ||
+            range.m_file >= files.size())
+        {
+            return false;
+        }
+    }
+
+    if (!reader.at_end())
+        return false;
+
+    std::vector<uint32_t> order(files.size(), UINT32_MAX);
+    for (const prefetch_range& range : ranges)
+    {
+        if (order[range.m_file] == UINT32_MAX)
+        {
+            order[range.m_file] = static_cast<uint32_t>(g_replay_files.size());
+            g_replay_files.push_back(std::move(files[range.m_file]));
+            g_replay_ranges.emplace_back();
+        }
+
+        g_replay_ranges[order[range.m_file]].push_back(range);
+    }
+
+    return true;
+}
+
+// Maps the file and asks the memory manager to bring the ranges in. The pages land in the standby list, where the
+// runtime's own mapping or read of the file finds them; the view is only needed to name them. A file that is gone or
+// has changed since it was recorded counts as stale, what is left of its ranges is still prefetched.
+uint64_t prefetch_file_ranges(const prefetch_file& entry, const std::vector<prefetch_range>& ranges)
+{
+    const HANDLE file = CreateFileW(entry.m_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        g_replay_stale.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    LARGE_INTEGER size{};
+    FILETIME write_time{};
+    if (!GetFileSizeEx(file, &size) || !GetFileTime(file, nullptr, nullptr, &write_time) ||
+        static_cast<uint64_t>(size.QuadPart) != entry.m_size || file_time_value(write_time) != entry.m_write_time)
+    {
+        g_replay_stale.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    HANDLE mapping = nullptr;
+    if (size.QuadPart > 0)
+    {
+        // An image section created here is shared with the LoadLibrary of the same file later on.
+        if (entry.m_flags & prefetch_file_image)
+        {
+            mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY | SEC_IMAGE, 0, 0, nullptr);
+        }
+        if (!mapping)
+        {
+            mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        }
+    }
+    CloseHandle(file);
+
+    if (!mapping)
+        return 0;
+
+    uint8_t* view = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+    if (!view)
+        return 0;
+
+    std::vector<WIN32_MEMORY_RANGE_ENTRY> entries;
+    uint64_t bytes = 0;
+    if (entry.m_flags & prefetch_file_image)
+    {
+        // An image view follows the section layout rather than the file, so all of it is prefetched. Its ranges
+        // always cover the whole file anyway.
+        MEMORY_BASIC_INFORMATION info;
+        for (uint8_t* address = view; VirtualQuery(address, &info, sizeof(info)) && info.AllocationBase == view;
+            address += info.RegionSize)
+        {
+            entries.push_back({ address, info.RegionSize });
+            bytes += info.RegionSize;
+        }
+    }
+    else
+    {
+        const uint64_t view_size = static_cast<uint64_t>(size.QuadPart);
+        entries.reserve(ranges.size());
+        for (const prefetch_range& range : ranges)
+        {
+            // The file may have shrunk since it was recorded.
+            if (range.m_offset >= view_size)
+                continue;
+
+            const uint64_t length = std::min(range.m_size, view_size - range.m_offset);
+            entries.push_back({ view + range.m_offset, static_cast<SIZE_T>(length) });
+            bytes += length;
+        }
+    }
+
+    if (!entries.empty() && !PrefetchVirtualMemory(GetCurrentProcess(), entries.size(), entries.data(), 0))
+    {
+        bytes = 0;
+    }
+
+    UnmapViewOfFile(view);
+    return bytes;
+}
+
+void replay_thread_main()
+{
+    for (;;)
+    {
+        const uint32_t index = g_replay_next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= g_replay_files.size())
+            break;
+
+        g_replay_bytes.fetch_add(prefetch_file_ranges(g_replay_files[index], g_replay_ranges[index]),
+            std::memory_order_relaxed);
+    }
+
+    if (g_replay_running.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER now;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&now);
+
+        HFXR_TRACE("Prefetched {} KiB from {} files in {} ms", g_replay_bytes.load(std::memory_order_relaxed) / 1024,
+            g_replay_files.size(), (now.QuadPart - g_replay_start) * 1000 / frequency.QuadPart);
+
+        // Replay has already started, so this launch cannot record. The next one records the list again because
+        // it finds no list.
+        const uint32_t stale = g_replay_stale.load(std::memory_order_relaxed);
+        if (stale * uint64_t{ 100 } > g_replay_files.size() * uint64_t{ HOOKFXR_PREFETCH_STALE_PERCENT })
+        {
+            HFXR_INFO(L"{} of {} prefetched files changed since they were recorded, recording {} again on the next "
+                L"launch", stale, g_replay_files.size(), g_prefetch_path);
+            DeleteFileW(g_prefetch_path.c_str());
+        }
+    }
+}
+
+void start_replay()
+{
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+    g_replay_start = start.QuadPart;
+
+    const uint32_t thread_count = std::min<uint32_t>(HOOKFXR_PREFETCH_THREADS,
+        static_cast<uint32_t>(g_replay_files.size()));
+    if (thread_count == 0)
+        return;
+
+    g_replay_running.store(thread_count, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        std::thread(replay_thread_main).detach();
+    }
+
+    HFXR_TRACE(L"Prefetching {} files from {}", g_replay_files.size(), g_prefetch_path);
+}
+}
+
+prefetch_mode parse_prefetch_mode(std::wstring_view name)
+{
+    std::wstring value(name);
+    std::ranges::transform(value, value.begin(), ::towlower);
+
+    if (value == L"on" || value == L"true" || value == L"1")
+        return prefetch_mode::on;
+    if (value == L"record")
+        return prefetch_mode::record;
+
+    return prefetch_mode::off;
+}
+
+void prefetch_start(prefetch_mode mode, const std::wstring& file)
+{
+    if (mode == prefetch_mode::off)
+        return;
+
+    g_prefetch_path = file;
+
+    if (mode == prefetch_mode::on && load(file))
+    {
+        start_replay();
+        return;
+    }
+
+    if (mode == prefetch_mode::on && GetFileAttributesW(file.c_str()) != INVALID_FILE_ATTRIBUTES)
+    {
+        HFXR_WARNING(L"{} is invalid, recording it again", file);
+    }
+
+    start_recording();
+}
+
+bool prefetch_is_recording()
+{
+    return g_recording.load(std::memory_order_acquire);
+}
+
+void prefetch_record_module(HMODULE module)
+{
+    if (!prefetch_is_recording() || !module)
+        return;
+
+    wchar_t path[MAX_PATH];
+    const DWORD length = GetModuleFileNameW(module, path, MAX_PATH);
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (length == 0 || length >= MAX_PATH || !GetFileAttributesExW(path, GetFileExInfoStandard, &attributes))
+        return;
+
+    const uint64_t size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+
+    std::scoped_lock lock(g_mutex);
+    const uint32_t file = add_file(std::wstring(path, length), size, file_time_value(attributes.ftLastWriteTime));
+    g_files[file].m_flags |= prefetch_file_image;
+    log_range(file, 0, size);
+}
+
+void prefetch_finish_recording()
+{
+    if (!g_recording.exchange(false, std::memory_order_acq_rel))
+        return;
+
+    disable_hooks();
+
+    std::scoped_lock lock(g_mutex);
+
+    // A read that was still running when recording stopped may extend its range after this, it is not listed.
+    const uint32_t logged = std::min<uint32_t>(g_range_log_size.load(std::memory_order_relaxed),
+        HOOKFXR_PREFETCH_MAX_RANGES);
+    for (uint32_t i = 0; i < logged; ++i)
+    {
+        range_log_entry& entry = g_range_log[i];
+        if (const uint64_t size = std::atomic_ref(entry.m_size).load(std::memory_order_acquire))
+        {
+            add_range(entry.m_file, entry.m_offset, size);
+        }
+    }
+
+    // Files that were opened but never read or mapped have no ranges and are not worth listing.
+    std::vector<uint32_t> remap(g_files.size(), UINT32_MAX);
+    std::vector<prefetch_file> files;
+    for (prefetch_range& range : g_ranges)
+    {
+        if (remap[range.m_file] == UINT32_MAX)
+        {
+            remap[range.m_file] = static_cast<uint32_t>(files.size());
+            files.push_back(std::move(g_files[range.m_file]));
+        }
+        range.m_file = remap[range.m_file];
+    }
+    g_files = std::move(files);
+
+    uint64_t bytes = 0;
+    for (const prefetch_range& range : g_ranges)
+    {
+        bytes += range.m_size;
+    }
+
+    if (!save(g_prefetch_path))
+    {
+        HFXR_WARNING(L"Failed to write {}: {}", g_prefetch_path, GetLastError());
+        return;
+    }
+
+    HFXR_INFO(L"Recorded {} ranges ({} KiB) from {} files to {}", g_ranges.size(), bytes / 1024, g_files.size(),
+        g_prefetch_path);
+}
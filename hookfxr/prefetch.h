@@ -0,0 +1,37 @@
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Startup file prefetch.
+// While recording, hookfxr notes every file range the process opens, reads or maps (CreateFileW, ReadFile,
+// CreateFileMappingW, MapViewOfFile(Ex) and the images loaded through LoadLibraryExW) until managed main starts,
+// and writes the ordered list to hookfxr.cache\hookfxr.prefetch. On later launches, background threads read the
+// listed ranges ahead in that order as soon as hookfxr initializes, so the runtime finds them in the file cache
+// instead of waiting for hundreds of scattered reads. Each file is listed with its size and write time; when too many
+// of them have changed, the replay deletes the list and the next launch records it again.
+
+enum class prefetch_mode : uint8_t
+{
+    off,
+    on,     // Replay the recorded list, recording it first if there is none.
+    record, // Record the list again, replacing the existing one.
+};
+
+// Returns prefetch_mode::off for an empty or unknown name.
+prefetch_mode parse_prefetch_mode(std::wstring_view name);
+
+// Either starts the replay threads or installs the recording hooks, depending on mode and whether file exists.
+void prefetch_start(prefetch_mode mode, const std::wstring& file);
+
+bool prefetch_is_recording();
+
+// Records the image of a module loaded while recording.
+void prefetch_record_module(HMODULE module);
+
+// Stops recording, disables the recording hooks and writes the list. Called when managed main starts.
+void prefetch_finish_recording();
@@ -0,0 +1,230 @@
+#include "startup_info.h"
+
+#include "config.h"
+#include "defines.h"
+
+#include <algorithm>
+#include <atomic>
+#include <format>
+#include <mutex>
+#include <string>
+
+#include <sddl.h>
+
+namespace
+{
+// Two views of the same section: hookfxr writes through the first, everyone else only gets the second.
+hookfxr_startup_info* g_writable{ nullptr };
+const hookfxr_startup_info* g_readonly{ nullptr };
+std::mutex g_mutex;
+
+wchar_t* string_data(hookfxr_startup_info* info)
+{
+    return reinterpret_cast<wchar_t*>(info);
+}
+
+// Caller must hold g_mutex.
+void set_string_locked(startup_string id, std::wstring_view value)
+{
+    // Offsets are in wchar_t units, the header size is a multiple of it.
+    static_assert(sizeof(hookfxr_startup_info) % sizeof(wchar_t) == 0);
+
+    const uint32_t offset = g_writable->m_size / sizeof(wchar_t);
+    const uint32_t capacity = HOOKFXR_STARTUP_INFO_SIZE / sizeof(wchar_t);
+    if (offset + value.size() + 1 > capacity)
+    {
+        HFXR_WARNING("Startup info is full, dropping string {}", static_cast<uint32_t>(id));
+        return;
+    }
+
+    wchar_t* data = string_data(g_writable) + offset;
+    std::ranges::copy(value, data);
+    data[value.size()] = L'\0';
+
+    g_writable->m_strings[static_cast<uint32_t>(id)] = { offset, static_cast<uint32_t>(value.size()) };
+    std::atomic_ref(g_writable->m_size).store(
+        static_cast<uint32_t>((offset + value.size() + 1) * sizeof(wchar_t)), std::memory_order_release);
+}
+
+const char* phase_name(startup_phase phase)
+{
+    switch (phase)
+    {
+    case startup_phase::dllmain: return "dllmain";
+    case startup_phase::initialize: return "initialize";
+    case startup_phase::resolve_hostfxr: return "resolve_hostfxr";
+    case startup_phase::hostfxr: return "hostfxr";
+    case startup_phase::hostpolicy: return "hostpolicy";
+    case startup_phase::load_coreclr: return "load_coreclr";
+    case startup_phase::coreclr_initialize: return "coreclr_initialize";
+    case startup_phase::execute_assembly: return "execute_assembly";
+    case startup_phase::count: break;
+    }
+    return "unknown";
+}
+}
+
+void startup_info_create()
+{
+    std::scoped_lock lock(g_mutex);
+    if (g_writable)
+        return;
+
+    const std::wstring name = std::format(L"Local\\hookfxr-startup-{}", GetCurrentProcessId());
+
+    // Everyone else may only map the section for reading: the DACL grants the owner SECTION_QUERY and
+    // SECTION_MAP_READ, and being protected it inherits nothing. The handle returned to us keeps full access.
+    PSECURITY_DESCRIPTOR descriptor = nullptr;
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(L"D:P(A;;0x5;;;OW)", SDDL_REVISION_1, &descriptor,
+        nullptr))
+    {
+        HFXR_WARNING("Failed to create the startup info security descriptor: {}", GetLastError());
+        return;
+    }
+
+    SECURITY_ATTRIBUTES attributes{ sizeof(SECURITY_ATTRIBUTES), descriptor, FALSE };
+
+    // The section handle is intentionally never closed, the views keep it alive for the lifetime of the process.
+    const HANDLE section = CreateFileMappingW(INVALID_HANDLE_VALUE, &attributes, PAGE_READWRITE, 0,
+        HOOKFXR_STARTUP_INFO_SIZE, name.c_str());
+    const DWORD error = GetLastError();
+    LocalFree(descriptor);
+
+    if (!section)
+    {
+        HFXR_WARNING("Failed to create the startup info mapping: {}", error);
+        return;
+    }
+
+    // Someone created it before us, with a DACL that is not ours.
+    if (error == ERROR_ALREADY_EXISTS)
+    {
+        HFXR_WARNING(L"{} already exists, not publishing the startup info", name);
+        CloseHandle(section);
+        return;
+    }
+
+    auto* writable = static_cast<hookfxr_startup_info*>(
+        MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, HOOKFXR_STARTUP_INFO_SIZE));
+    const auto* readonly = static_cast<const hookfxr_startup_info*>(
+        MapViewOfFile(section, FILE_MAP_READ, 0, 0, HOOKFXR_STARTUP_INFO_SIZE));
+    if (!writable || !readonly)
+    {
+        HFXR_WARNING("Failed to map the startup info: {}", GetLastError());
+        return;
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    writable->m_magic = HOOKFXR_STARTUP_INFO_MAGIC;
+    writable->m_version = HOOKFXR_STARTUP_INFO_VERSION;
+    writable->m_header_size = sizeof(hookfxr_startup_info);
+    writable->m_size = sizeof(hookfxr_startup_info);
+    writable->m_process_id = GetCurrentProcessId();
+    writable->m_priority = static_cast<uint32_t>(process_priority::unchanged);
+    writable->m_numa_node = -1;
+    writable->m_qpc_frequency = frequency.QuadPart;
+
+    g_writable = writable;
+    g_readonly = readonly;
+
+    SetEnvironmentVariableW(L"HOOKFXR_STARTUP_INFO", name.c_str());
+}
+
+void startup_info_set_config(const hookfxr_config& config)
+{
+    std::scoped_lock lock(g_mutex);
+    if (!g_writable)
+        return;
+
+    g_writable->m_enable = config.m_enable;
+    g_writable->m_merge_deps_json = config.m_merge_deps_json;
+    g_writable->m_host_trace = config.m_host_trace;
+    g_writable->m_log_level = static_cast<uint32_t>(config.m_log_level);
+    g_writable->m_profile_startup = config.m_profile_startup;
+    g_writable->m_validate_deps = config.m_validate_deps;
+    g_writable->m_fast_exit = config.m_fast_exit;
+    g_writable->m_prefetch = static_cast<uint32_t>(config.m_prefetch);
+
+    std::wstring environment;
+    for (const auto& [name, value] : config.m_environment)
+    {
+        environment += std::format(L"{}={}\n", name, value);
+    }
+
+    set_string_locked(startup_string::log_file, config.m_log_file);
+    set_string_locked(startup_string::target_assembly, config.m_target_assembly);
+    set_string_locked(startup_string::dotnet_root_override, config.m_dotnet_root_override);
+    set_string_locked(startup_string::plugin_directory, config.m_plugin_directory);
+    set_string_locked(startup_string::environment, environment);
+}
+
+void startup_info_set_placement(const std::vector<uint32_t>& cpus, int numa_node, process_priority priority)
+{
+    std::scoped_lock lock(g_mutex);
+    if (!g_writable)
+        return;
+
+    g_writable->m_priority = static_cast<uint32_t>(priority);
+    g_writable->m_numa_node = numa_node;
+    set_string_locked(startup_string::cpus, format_cpu_list(cpus));
+}
+
+void startup_info_set_string(startup_string id, std::wstring_view value)
+{
+    std::scoped_lock lock(g_mutex);
+    if (!g_writable)
+        return;
+
+    set_string_locked(id, value);
+}
+
+void startup_info_record_phase(startup_phase phase, int64_t start, int64_t end)
+{
+    std::scoped_lock lock(g_mutex);
+    if (!g_writable)
+        return;
+
+    g_writable->m_phases[static_cast<uint32_t>(phase)] = { start, end };
+}
+
+void startup_info_log_phases()
+{
+    std::scoped_lock lock(g_mutex);
+    if (!g_writable)
+        return;
+
+    const int64_t frequency = g_writable->m_qpc_frequency;
+    const int64_t origin = g_writable->m_phases[static_cast<uint32_t>(startup_phase::dllmain)].m_start;
+
+    for (uint32_t i = 0; i < static_cast<uint32_t>(startup_phase::count); ++i)
+    {
+        const hookfxr_startup_phase& phase = g_writable->m_phases[i];
+        if (phase.m_start == 0)
+            continue;
+
+        const int64_t offset_us = (phase.m_start - origin) * 1'000'000 / frequency;
+        if (phase.m_end == 0)
+        {
+            HFXR_INFO("Startup phase {}: started at +{} us", phase_name(static_cast<startup_phase>(i)), offset_us);
+        }
+        else
+        {
+            HFXR_INFO("Startup phase {}: {} us, at +{} us", phase_name(static_cast<startup_phase>(i)),
+                (phase.m_end - phase.m_start) * 1'000'000 / frequency, offset_us);
+        }
+    }
+}
+
+int64_t startup_info_now()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+const hookfxr_startup_info* startup_info_get()
+{
+    return g_readonly;
+}
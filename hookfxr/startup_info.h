@@ -0,0 +1,136 @@
+#pragma once
+
+#include "affinity.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+struct hookfxr_config;
+
+// Shared-memory startup descriptor.
+// hookfxr publishes what it resolved while starting the host in a named, read-only file mapping called
+// Local\hookfxr-startup-<pid> (the name is also written to the HOOKFXR_STARTUP_INFO environment variable).
+// In-process, hookfxr_get_startup_info returns a pointer to the mapped view, so the managed loader can read it
+// zero-copy with a single P/Invoke.
+//
+// The layout below is part of the contract with the managed side. Fields are only ever appended to the header,
+// readers must check m_magic and m_version, must not read header fields at or past m_header_size and must not read
+// string data past m_size. The mapping only grants read access, hookfxr writes through the handle it created it with.
+
+#define HOOKFXR_STARTUP_INFO_MAGIC 0x52584648 // "HFXR"
+#define HOOKFXR_STARTUP_INFO_VERSION 2
+#define HOOKFXR_STARTUP_INFO_SIZE (64 * 1024)
+// Capacity of the string and phase tables. Fixed so that adding entries never moves the string data.
+#define HOOKFXR_STARTUP_STRING_MAX 16
+#define HOOKFXR_STARTUP_PHASE_MAX 16
+
+enum class startup_phase : uint32_t
+{
+    dllmain,         // DllMain(DLL_PROCESS_ATTACH), i.e. the time the loader lock was held.
+    initialize,      // Reading the config and installing hooks, on the first entrypoint call.
+    resolve_hostfxr, // Locating and loading the real hostfxr.
+    hostfxr,         // Real hostfxr, from its entrypoint until it hands over to hostpolicy (corehost_load).
+
+    // Only recorded with profile_startup.
+    hostpolicy,         // corehost_main until coreclr_initialize: deps resolution, TPA construction, loading coreclr.
+    load_coreclr,       // LoadLibraryExW of coreclr.dll, part of hostpolicy.
+    coreclr_initialize, // Runtime initialization.
+    execute_assembly,   // coreclr_execute_assembly, its start is when managed code first runs. The end is only
+                        // recorded once the managed main returns.
+    count,
+};
+
+enum class startup_string : uint32_t
+{
+    original_app_path, // App the apphost was built for.
+    app_path,          // App actually handed to hostfxr (the target assembly if redirected).
+    dotnet_root,       // Root of the resolved .NET installation.
+    hostfxr_path,      // Path of the real hostfxr.
+    deps_file,         // .deps.json of the app, as passed to hostpolicy.
+    additional_deps,   // Additional .deps.json files injected into hostpolicy, ';' separated.
+    log_file,
+    target_assembly,      // Resolved config, empty if not set.
+    dotnet_root_override, // Resolved config, empty if not set.
+    plugin_directory,     // Resolved config, empty if not set.
+    environment,          // Variables of the [environment] section and --hookfxr-env, one name=value per line.
+    cpus,                 // CPUs the process was restricted to, in the format of cpu_affinity. Empty if unchanged.
+    count,
+};
+
+#pragma pack(push, 8)
+// UTF-16 string stored in the block. Offset and length are in wchar_t units from the start of the block and do not
+// include a terminator, although one is always present.
+struct hookfxr_startup_string
+{
+    uint32_t m_offset;
+    uint32_t m_length;
+};
+
+// Start and end of a phase in QueryPerformanceCounter ticks. Both are zero if the phase did not run (yet).
+struct hookfxr_startup_phase
+{
+    int64_t m_start;
+    int64_t m_end;
+};
+
+struct hookfxr_startup_info
+{
+    uint32_t m_magic;
+    uint32_t m_version;
+    // Size of the header as written, the string data starts here.
+    uint32_t m_header_size;
+    // End of the string data in bytes from the start of the block, grows as strings are added.
+    uint32_t m_size;
+    uint32_t m_process_id;
+
+    // Resolved config, after the command line and hookfxr_run overrides. The strings are in m_strings.
+    uint32_t m_enable;
+    uint32_t m_merge_deps_json;
+    uint32_t m_host_trace;
+    uint32_t m_log_level;     // log_level
+    uint32_t m_profile_startup;
+    uint32_t m_validate_deps;
+    uint32_t m_fast_exit;
+    uint32_t m_prefetch;      // prefetch_mode
+
+    // Placement that was actually applied, which may differ from the config if part of it failed.
+    uint32_t m_priority;      // process_priority, unchanged if it was not changed.
+    int32_t m_numa_node;      // Preferred NUMA node, -1 if none.
+    uint32_t m_reserved;
+
+    int64_t m_qpc_frequency;
+
+    // Indexed by startup_string and startup_phase.
+    hookfxr_startup_string m_strings[HOOKFXR_STARTUP_STRING_MAX];
+    hookfxr_startup_phase m_phases[HOOKFXR_STARTUP_PHASE_MAX];
+
+    // String data follows.
+};
+#pragma pack(pop)
+
+static_assert(static_cast<uint32_t>(startup_string::count) <= HOOKFXR_STARTUP_STRING_MAX);
+static_assert(static_cast<uint32_t>(startup_phase::count) <= HOOKFXR_STARTUP_PHASE_MAX);
+
+// Creates the mapping. Called once at initialization, before anything is recorded.
+void startup_info_create();
+
+// Records the resolved config. Called again when hookfxr_run overrides part of it.
+void startup_info_set_config(const hookfxr_config& config);
+
+// Records the placement that was actually applied.
+void startup_info_set_placement(const std::vector<uint32_t>& cpus, int numa_node, process_priority priority);
+
+// Records a string. Strings are appended, a later call for the same string replaces the descriptor only.
+void startup_info_set_string(startup_string id, std::wstring_view value);
+
+void startup_info_record_phase(startup_phase phase, int64_t start, int64_t end);
+
+// Logs the duration of every recorded phase.
+void startup_info_log_phases();
+
+// Read-only view of the block, nullptr if it could not be created.
+const hookfxr_startup_info* startup_info_get();
+
+// Current QueryPerformanceCounter value, the unit of all phase timings.
+int64_t startup_info_now();
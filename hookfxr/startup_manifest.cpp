@@ -0,0 +1,229 @@
+#include "startup_manifest.h"
+
+#include "cache_file.h"
+#include "defines.h"
+#include "hostfxr_locator.h"
+
+#include <algorithm>
+#include <vector>
+
+#define HOOKFXR_MANIFEST_MAGIC 0x4D534648 // "HFSM"
+#define HOOKFXR_MANIFEST_VERSION 2
+// Upper bounds of a manifest, a larger file is treated as corrupt.
+#define HOOKFXR_MANIFEST_MAX_SIZE (256 * 1024)
+#define HOOKFXR_MANIFEST_MAX_RECORDS 256
+
+namespace
+{
+struct manifest_record
+{
+    manifest_entry m_kind;
+    std::wstring m_key;
+    std::wstring m_value;
+};
+
+std::wstring g_manifest_path;
+// Hash of the inputs that are known before any decision is made: the ini, the options and the environment.
+uint64_t g_input_hash{ 0 };
+std::vector<std::wstring> g_dependencies;
+std::vector<manifest_record> g_records;
+bool g_dirty{ false };
+
+// Environment variables the hostfxr location depends on. Variables set by hookfxr.ini are covered by its write time.
+constexpr const wchar_t* g_fingerprint_variables[] = {
+    L"DOTNET_ROOT", L"DOTNET_ROOT_X64", L"DOTNET_ROOT_X86", L"DOTNET_ROOT_ARM64", L"ProgramFiles",
+};
+
+constexpr uint64_t fnv_offset_basis = 0xCBF29CE484222325;
+constexpr uint64_t fnv_prime = 0x100000001B3;
+
+void fnv_add(uint64_t& hash, const void* data, size_t size)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * fnv_prime;
+    }
+}
+
+void fnv_add(uint64_t& hash, std::wstring_view text)
+{
+    // The length keeps adjacent strings from running into each other.
+    const uint64_t length = text.size();
+    fnv_add(hash, &length, sizeof(length));
+    fnv_add(hash, text.data(), text.size() * sizeof(wchar_t));
+}
+
+// Adds the size and write time of path, or zeros if it does not exist.
+void fnv_add_stamp(uint64_t& hash, const std::wstring& path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data{};
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+    {
+        data = {};
+    }
+
+    fnv_add(hash, path);
+    fnv_add(hash, &data.nFileSizeHigh, sizeof(data.nFileSizeHigh));
+    fnv_add(hash, &data.nFileSizeLow, sizeof(data.nFileSizeLow));
+    fnv_add(hash, &data.ftLastWriteTime, sizeof(data.ftLastWriteTime));
+}
+
+uint64_t get_input_hash(const std::wstring& ini_file, int argc, const wchar_t** argv)
+{
+    uint64_t hash = fnv_offset_basis;
+    fnv_add_stamp(hash, ini_file);
+
+    // The options and the value after each of them. Other arguments belong to the app and do not affect startup.
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::wstring_view(argv[i]).starts_with(L"--hookfxr-"))
+        {
+            fnv_add(hash, argv[i]);
+            fnv_add(hash, i + 1 < argc ? argv[i + 1] : L"");
+        }
+    }
+
+    wchar_t value[MAX_PATH];
+    for (const wchar_t* name : g_fingerprint_variables)
+    {
+        const DWORD length = GetEnvironmentVariableW(name, value, MAX_PATH);
+        fnv_add(hash, name);
+        fnv_add(hash, std::wstring_view(value, length < MAX_PATH ? length : 0));
+    }
+
+    // A reinstall to another location changes the registered one, while the host\fxr directory of the old one, the
+    // only dependency of the hostfxr decisions, may stay as it was.
+    fnv_add(hash, get_registered_location().native());
+
+    return hash;
+}
+
+uint64_t get_fingerprint(const std::vector<std::wstring>& dependencies)
+{
+    uint64_t hash = g_input_hash;
+    for (const std::wstring& dependency : dependencies)
+    {
+        fnv_add_stamp(hash, dependency);
+    }
+    return hash;
+}
+
+// The manifest is the fingerprint, the dependency count and the dependencies, then the record count and the records,
+// each a uint32_t kind and two strings.
+bool read_manifest(const std::wstring& path, uint64_t& fingerprint, std::vector<std::wstring>& dependencies,
+    std::vector<manifest_record>& records)
+{
+    cache_reader reader;
+    uint32_t dependency_count;
+    if (!reader.open(path, HOOKFXR_MANIFEST_MAGIC, HOOKFXR_MANIFEST_VERSION, HOOKFXR_MANIFEST_MAX_SIZE) ||
+        !reader.read(fingerprint) || !reader.read(dependency_count) || dependency_count > HOOKFXR_MANIFEST_MAX_RECORDS)
+    {
+        return false;
+    }
+
+    dependencies.resize(dependency_count);
+    for (std::wstring& dependency : dependencies)
+    {
+        if (!reader.read(dependency))
+            return false;
+    }
+
+    uint32_t record_count;
+    if (!reader.read(record_count) || record_count > HOOKFXR_MANIFEST_MAX_RECORDS)
+        return false;
+
+    records.resize(record_count);
+    for (manifest_record& record : records)
+    {
+        uint32_t kind;
+        if (!reader.read(kind) || kind > static_cast<uint32_t>(manifest_entry::deps_file) ||
+            !reader.read(record.m_key) || !reader.read(record.m_value))
+        {
+            return false;
+        }
+
+        record.m_kind = static_cast<manifest_entry>(kind);
+    }
+
+    return reader.at_end();
+}
+}
+
+void startup_manifest_load(const std::wstring& file, const std::wstring& ini_file, int argc, const wchar_t** argv)
+{
+    g_manifest_path = file;
+    g_input_hash = get_input_hash(ini_file, argc, argv);
+
+    uint64_t fingerprint;
+    std::vector<std::wstring> dependencies;
+    std::vector<manifest_record> records;
+    if (!read_manifest(file, fingerprint, dependencies, records))
+        return;
+
+    if (fingerprint != get_fingerprint(dependencies))
+    {
+        HFXR_TRACE(L"{} is out of date", file);
+        return;
+    }
+
+    g_dependencies = std::move(dependencies);
+    g_records = std::move(records);
+    HFXR_TRACE(L"Using {} startup decisions from {}", g_records.size(), file);
+}
+
+const std::wstring* startup_manifest_find(manifest_entry kind, std::wstring_view key)
+{
+    const auto it = std::ranges::find_if(g_records, [&](const manifest_record& record)
+    {
+        return record.m_kind == kind && record.m_key == key;
+    });
+
+    return it != g_records.end() ? &it->m_value : nullptr;
+}
+
+void startup_manifest_add(manifest_entry kind, std::wstring_view key, std::wstring value,
+    const std::wstring& dependency)
+{
+    if (g_manifest_path.empty() || g_records.size() >= HOOKFXR_MANIFEST_MAX_RECORDS)
+        return;
+
+    g_records.push_back({ kind, std::wstring(key), std::move(value) });
+    if (!dependency.empty() && std::ranges::find(g_dependencies, dependency) == g_dependencies.end() &&
+        g_dependencies.size() < HOOKFXR_MANIFEST_MAX_RECORDS)
+    {
+        g_dependencies.push_back(dependency);
+    }
+
+    g_dirty = true;
+}
+
+void startup_manifest_save()
+{
+    if (!g_dirty)
+        return;
+
+    g_dirty = false;
+
+    cache_writer writer(HOOKFXR_MANIFEST_MAGIC, HOOKFXR_MANIFEST_VERSION);
+    writer.write(get_fingerprint(g_dependencies));
+
+    writer.write(static_cast<uint32_t>(g_dependencies.size()));
+    for (const std::wstring& dependency : g_dependencies)
+    {
+        writer.write(dependency);
+    }
+
+    writer.write(static_cast<uint32_t>(g_records.size()));
+    for (const manifest_record& record : g_records)
+    {
+        writer.write(static_cast<uint32_t>(record.m_kind));
+        writer.write(record.m_key);
+        writer.write(record.m_value);
+    }
+
+    if (!cache_file_write(g_manifest_path, writer))
+    {
+        HFXR_TRACE(L"Failed to write {}", g_manifest_path);
+    }
+}
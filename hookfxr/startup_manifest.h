@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Startup manifest.
+// The paths hookfxr resolves during startup (absolute paths of the configured files, the dotnet root and hostfxr,
+// the original app's .deps.json) only depend on hookfxr.ini, the --hookfxr-* options, a few environment variables,
+// the registered .NET install location and the contents of a few directories. They are stored in
+// hookfxr.cache\hookfxr.manifest next to hookfxr.ini, under a fingerprint of those inputs: the ini's size and write
+// time, the options, the variables, the install location and the write time of every directory a decision depends on. Keeping the file in a directory of its own leaves the write time of the
+// exe directory alone when it is saved. A launch with the same fingerprint reads the decisions with one small read
+// instead of canonicalizing paths, probing for files and enumerating host\fxr.
+
+enum class manifest_entry : uint8_t
+{
+    absolute_path,  // make_absolute_path of the key.
+    dotnet_root,    // Key is DOTNET_ROOT at the time of the lookup, or '|' and the dotnet_root of hookfxr_run.
+    hostfxr_path,   // Same key as dotnet_root.
+    hostfxr_source, // Same key as dotnet_root, the value is the hostfxr_source as a number.
+    deps_file,      // .deps.json of the original app in the key, empty if there is none.
+};
+
+// Reads file and keeps its decisions if its fingerprint matches. Called once, before the first decision is looked up.
+void startup_manifest_load(const std::wstring& file, const std::wstring& ini_file, int argc, const wchar_t** argv);
+
+// Returns nullptr if the decision is not in the manifest.
+const std::wstring* startup_manifest_find(manifest_entry kind, std::wstring_view key);
+
+// Records a decision. dependency is a directory whose write time changes when the decision could change, it is added
+// to the fingerprint. It may be empty.
+void startup_manifest_add(manifest_entry kind, std::wstring_view key, std::wstring value,
+    const std::wstring& dependency);
+
+// Writes the manifest if decisions were added since it was loaded or last saved. Called once per launch, after the
+// last decision.
+void startup_manifest_save();
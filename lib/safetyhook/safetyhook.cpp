@@ -12,6 +12,8 @@
 #include <algorithm>
 #include <functional>
 #include <limits>
+#include <thread>
+#include <utility>
 
 
 
@@ -49,6 +51,16 @@ void Allocation::free() {
     }
 }
 
+void Allocation::leak() {
+    if (m_allocator) {
+        // The Allocator frees its memory blocks when it is destroyed, so our reference to it is leaked as well.
+        static_cast<void>(new std::shared_ptr<Allocator>{std::move(m_allocator)});
+    }
+
+    m_address = nullptr;
+    m_size = 0;
+}
+
 Allocation::Allocation(std::shared_ptr<Allocator> allocator, uint8_t* address, size_t size) noexcept
     : m_allocator{std::move(allocator)}, m_address{address}, m_size{size} {
 }
@@ -79,49 +91,71 @@ std::expected<Allocation, Allocator::Error> Allocator::allocate(size_t size) {
 }
 
 std::expected<Allocation, Allocator::Error> Allocator::allocate_near(
-    const std::vector<uint8_t*>& desired_addresses, size_t size, size_t max_distance) {
-    std::scoped_lock lock{m_mutex};
-    return internal_allocate_near(desired_addresses, size, max_distance);
-}
-
-void Allocator::free(uint8_t* address, size_t size) {
-    std::scoped_lock lock{m_mutex};
-    return internal_free(address, size);
-}
-
-std::expected<Allocation, Allocator::Error> Allocator::internal_allocate_near(
     const std::vector<uint8_t*>& desired_addresses, size_t size, size_t max_distance) {
     // Align to 2 bytes to pass MFP virtual method check
     // See https://itanium-cxx-abi.github.io/cxx-abi/abi.html#member-function-pointers
     size_t aligned_size = align_up(size, 2);
 
-    // First search through our list of allocations for a free block that is large
-    // enough.
-    for (const auto& allocation : m_memory) {
-        if (allocation->size < aligned_size) {
-            continue;
+    // Work out which 2GB regions can hold an address in range of every desired address.
+    auto first_region = std::numeric_limits<uintptr_t>::min();
+    auto last_region = std::numeric_limits<uintptr_t>::max();
+
+    if (!desired_addresses.empty()) {
+        auto lowest = std::numeric_limits<uintptr_t>::min();
+        auto highest = std::numeric_limits<uintptr_t>::max();
+
+        for (auto desired_address : desired_addresses) {
+            const auto address = reinterpret_cast<uintptr_t>(desired_address);
+
+            const auto upper = std::numeric_limits<uintptr_t>::max() - address > max_distance
+                                   ? address + max_distance
+                                   : std::numeric_limits<uintptr_t>::max();
+
+            lowest = std::max(lowest, address > max_distance ? address - max_distance : 0);
+            highest = std::min(highest, upper);
         }
 
-        for (auto node = allocation->freelist.get(); node != nullptr; node = node->next.get()) {
-            // Enough room?
-            if (static_cast<size_t>(node->end - node->start) < aligned_size) {
+        // A block starting in the region below can still reach into the range.
+        first_region = std::max<uintptr_t>(lowest >> SHARD_REGION_SHIFT, 1) - 1;
+        last_region = highest >> SHARD_REGION_SHIFT;
+    }
+
+    // First search the shards that can hold a free block in range. Only one shard lock is held at a time.
+    if (last_region < first_region) {
+        // The desired addresses are too far apart, nothing can be in range of all of them.
+    } else if (last_region - first_region < SHARD_COUNT) {
+        std::array<bool, SHARD_COUNT> searched{};
+
+        for (auto region = first_region; region <= last_region; ++region) {
+            const auto index = region % SHARD_COUNT;
+
+            if (std::exchange(searched[index], true)) {
                 continue;
             }
 
-            const auto address = node->start;
+            auto& shard = m_shards[index];
+            std::scoped_lock lock{shard.mutex};
 
-            // Close enough?
-            if (!in_range(address, desired_addresses, max_distance)) {
-                continue;
+            if (auto allocation = internal_allocate_near(shard, desired_addresses, size, aligned_size, max_distance)) {
+                return std::move(*allocation);
             }
+        }
+    } else {
+        // Any address will do. Start at a shard picked by the thread so concurrent callers spread out.
+        const auto start = std::hash<std::thread::id>{}(std::this_thread::get_id());
 
-            node->start += aligned_size;
+        for (size_t i = 0; i < SHARD_COUNT; ++i) {
+            auto& shard = m_shards[(start + i) % SHARD_COUNT];
+            std::scoped_lock lock{shard.mutex};
 
-            return Allocation{shared_from_this(), address, size};
+            if (auto allocation = internal_allocate_near(shard, desired_addresses, size, aligned_size, max_distance)) {
+                return std::move(*allocation);
+            }
         }
     }
 
-    // If we didn't find a free block, we need to allocate a new one.
+    // If we didn't find a free block, we need to allocate a new one. The search of the address space runs without
+    // holding any lock; concurrent searches that race for the same page simply move on to the next one.
     auto allocation_size = align_up(aligned_size, system_info().allocation_granularity);
     auto allocation_address = allocate_nearby_memory(desired_addresses, allocation_size, max_distance);
 
@@ -129,7 +163,7 @@ std::expected<Allocation, Allocator::Error> Allocator::internal_allocate_near(
         return std::unexpected{allocation_address.error()};
     }
 
-    auto& allocation = m_memory.emplace_back(new Memory);
+    auto allocation = std::make_unique<Memory>();
 
     allocation->address = *allocation_address;
     allocation->size = allocation_size;
@@ -137,15 +171,74 @@ std::expected<Allocation, Allocator::Error> Allocator::internal_allocate_near(
     allocation->freelist->start = *allocation_address + aligned_size;
     allocation->freelist->end = *allocation_address + allocation_size;
 
+    auto& shard = shard_for(reinterpret_cast<uintptr_t>(*allocation_address));
+    std::scoped_lock lock{shard.mutex};
+
+    shard.memory.emplace_back(std::move(allocation));
+    m_resident_bytes.fetch_add(allocation_size, std::memory_order_relaxed);
+    m_allocated_bytes.fetch_add(aligned_size, std::memory_order_relaxed);
+
     return Allocation{shared_from_this(), *allocation_address, size};
 }
 
-void Allocator::internal_free(uint8_t* address, size_t size) {
-    // See internal_allocate_near
+void Allocator::free(uint8_t* address, size_t size) {
+    const auto region = reinterpret_cast<uintptr_t>(address) >> SHARD_REGION_SHIFT;
+
+    // The block is registered in the shard of its start address, which is either the region of the allocation or,
+    // for a block straddling a region boundary, the one below it.
+    for (auto block_region : {region, region - 1}) {
+        auto& shard = m_shards[block_region % SHARD_COUNT];
+        std::scoped_lock lock{shard.mutex};
+
+        if (internal_free(shard, address, size)) {
+            return;
+        }
+    }
+}
+
+std::optional<Allocation> Allocator::internal_allocate_near(Shard& shard,
+    const std::vector<uint8_t*>& desired_addresses, size_t size, size_t aligned_size, size_t max_distance) {
+    // Search through the shard's allocations for a free block that is large enough.
+    for (const auto& allocation : shard.memory) {
+        if (allocation->size < aligned_size) {
+            continue;
+        }
+
+        for (auto node = allocation->freelist.get(); node != nullptr; node = node->next.get()) {
+            // Enough room?
+            if (static_cast<size_t>(node->end - node->start) < aligned_size) {
+                continue;
+            }
+
+            const auto address = node->start;
+
+            // Close enough?
+            if (!in_range(address, desired_addresses, max_distance)) {
+                continue;
+            }
+
+            if (is_unused(*allocation)) {
+                --shard.unused_blocks;
+            }
+
+            node->start += aligned_size;
+            m_allocated_bytes.fetch_add(aligned_size, std::memory_order_relaxed);
+
+            return Allocation{shared_from_this(), address, size};
+        }
+    }
+
+    return std::nullopt;
+}
+
+bool Allocator::internal_free(Shard& shard, uint8_t* address, size_t size) {
+    // See allocate_near
     size = align_up(size, 2);
 
-    for (const auto& allocation : m_memory) {
-        if (allocation->address > address || allocation->address + allocation->size < address) {
+    for (auto it = shard.memory.begin(); it != shard.memory.end(); ++it) {
+        auto& allocation = *it;
+
+        if (allocation->address > address || allocation->address + allocation->size <= address) {
             continue;
         }
 
@@ -173,8 +266,21 @@ void Allocator::internal_free(uint8_t* address, size_t size) {
         }
 
         combine_adjacent_freenodes(*allocation);
-        break;
+        m_allocated_bytes.fetch_sub(size, std::memory_order_relaxed);
+
+        if (is_unused(*allocation)) {
+            if (shard.unused_blocks < MAX_UNUSED_BLOCKS_PER_SHARD) {
+                ++shard.unused_blocks;
+            } else {
+                m_resident_bytes.fetch_sub(allocation->size, std::memory_order_relaxed);
+                shard.memory.erase(it);
+            }
+        }
+
+        return true;
     }
+
+    return false;
 }
 
 void Allocator::combine_adjacent_freenodes(Memory& memory) {
@@ -279,8 +385,14 @@ bool Allocator::in_range(uint8_t* address, const std::vector<uint8_t*>& desired_
     });
 }
 
+bool Allocator::is_unused(const Memory& memory) {
+    const auto* node = memory.freelist.get();
+    return node != nullptr && node->next == nullptr && node->start == memory.address &&
+           node->end == memory.address + memory.size;
+}
+
 Allocator::Memory::~Memory() {
-    vm_free(address);
+    vm_free(address, size);
 }
 } // namespace safetyhook
 
@@ -306,8 +418,8 @@ MidHook create_mid(void* target, MidHookFn destination, MidHook::Flags flags) {
     }
 }
 
-VmtHook create_vmt(void* object) {
-    if (auto hook = VmtHook::create(object)) {
+VmtHook create_vmt(void* object, VmtHook::Flags flags) {
+    if (auto hook = VmtHook::create(object, flags)) {
         return std::move(*hook);
     } else {
         return {};
@@ -316,809 +428,2436 @@ VmtHook create_vmt(void* object) {
 } // namespace safetyhook
 
 //
-// Source file: inline_hook.cpp
+// Source file: hook_plan.cpp
 //
 
+#include <fstream>
 #include <iterator>
-
-#if __has_include("Zydis/Zydis.h")
-#include "Zydis/Zydis.h"
-#elif __has_include("Zydis.h")
-#include "Zydis.h"
-#else
-#error "Zydis not found"
-#endif
+#include <system_error>
 
 
 
 namespace safetyhook {
+static constexpr uint32_t HOOK_PLAN_CACHE_MAGIC = 0x43504853; // "SHPC"
+static constexpr uint32_t HOOK_PLAN_CACHE_VERSION = 1;
 
-#pragma pack(push, 1)
-struct JmpE9 {
-    uint8_t opcode{0xE9};
-    uint32_t offset{0};
-};
+// Hook plans never displace more than a few instructions, anything larger is a corrupt file.
+static constexpr size_t HOOK_PLAN_MAX_BYTES = 64;
 
-#if SAFETYHOOK_ARCH_X86_64
-struct JmpFF {
-    uint8_t opcode0{0xFF};
-    uint8_t opcode1{0x25};
-    uint32_t offset{0};
-};
+static std::mutex g_global_cache_mutex{};
+static std::shared_ptr<HookPlanCache> g_global_cache{};
 
-struct TrampolineEpilogueE9 {
-    JmpE9 jmp_to_original{};
-    JmpFF jmp_to_destination{};
-    uint64_t destination_address{};
-};
+template <typename T> static void write_value(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
 
-struct TrampolineEpilogueFF {
-    JmpFF jmp_to_original{};
-    uint64_t original_address{};
-};
-#elif SAFETYHOOK_ARCH_X86_32
-struct TrampolineEpilogueE9 {
-    JmpE9 jmp_to_original{};
-    JmpE9 jmp_to_destination{};
-};
-#endif
-#pragma pack(pop)
+template <typename T> static bool read_value(std::ifstream& file, T& value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
 
-#if SAFETYHOOK_ARCH_X86_64
-static auto make_jmp_ff(uint8_t* src, uint8_t* dst, uint8_t* data) {
-    JmpFF jmp{};
+static bool is_valid_plan(const HookPlan& plan) {
+    size_t length = 0;
 
-    jmp.offset = static_cast<uint32_t>(data - src - sizeof(jmp));
-    store(data, dst);
+    for (const auto& instruction : plan.instructions) {
+        if (instruction.length == 0 || instruction.fixup > HookPlan::Fixup::ShortJmp ||
+            (instruction.fixup != HookPlan::Fixup::None && instruction.offset >= instruction.length)) {
+            return false;
+        }
 
-    return jmp;
+        length += instruction.length;
+    }
+
+    return length == plan.original_bytes.size();
 }
+size_t HookPlan::trampoline_code_size() const {
+    size_t size = 0;
 
-[[nodiscard]] static std::expected<void, InlineHook::Error> emit_jmp_ff(
-    uint8_t* src, uint8_t* dst, uint8_t* data, size_t size = sizeof(JmpFF)) {
-    if (size < sizeof(JmpFF)) {
-        return std::unexpected{InlineHook::Error::not_enough_space(dst)};
-    }
+    for (const auto& instruction : instructions) {
+        size += instruction.length;
 
-    if (size > sizeof(JmpFF)) {
-        std::fill_n(src, size, static_cast<uint8_t>(0x90));
+        // Near branches are larger than short ones: 4 bytes for conditional, 3 for unconditional.
+        if (instruction.fixup == Fixup::ShortJcc) {
+            size += 4;
+        } else if (instruction.fixup == Fixup::ShortJmp) {
+            size += 3;
+        }
     }
 
-    store(src, make_jmp_ff(src, dst, data));
-
-    return {};
+    return size;
 }
-#endif
 
-constexpr auto make_jmp_e9(uint8_t* src, uint8_t* dst) {
-    JmpE9 jmp{};
+std::shared_ptr<HookPlanCache> HookPlanCache::global() {
+    std::scoped_lock lock{g_global_cache_mutex};
+    return g_global_cache;
+}
 
-    jmp.offset = static_cast<uint32_t>(dst - src - sizeof(jmp));
+void HookPlanCache::set_global(std::shared_ptr<HookPlanCache> cache) {
+    std::scoped_lock lock{g_global_cache_mutex};
+    g_global_cache = std::move(cache);
+}
 
-    return jmp;
+std::shared_ptr<HookPlanCache> HookPlanCache::create() {
+    return std::shared_ptr<HookPlanCache>{new HookPlanCache{}};
 }
 
-[[nodiscard]] static std::expected<void, InlineHook::Error> emit_jmp_e9(
-    uint8_t* src, uint8_t* dst, size_t size = sizeof(JmpE9)) {
-    if (size < sizeof(JmpE9)) {
-        return std::unexpected{InlineHook::Error::not_enough_space(dst)};
+std::expected<void, HookPlanCache::Error> HookPlanCache::load(const std::filesystem::path& path) {
+    std::unique_lock lock{m_mutex};
+    m_plans.clear();
+
+    std::ifstream file{path, std::ios::binary};
+
+    if (!file) {
+        return std::unexpected{Error::FAILED_TO_OPEN};
     }
 
-    if (size > sizeof(JmpE9)) {
-        std::fill_n(src, size, static_cast<uint8_t>(0x90));
+    uint32_t magic{};
+    uint32_t version{};
+    uint32_t pointer_size{};
+    uint32_t count{};
+
+    if (!read_value(file, magic) || !read_value(file, version) || !read_value(file, pointer_size) ||
+        !read_value(file, count) || magic != HOOK_PLAN_CACHE_MAGIC || version != HOOK_PLAN_CACHE_VERSION ||
+        pointer_size != sizeof(void*)) {
+        return std::unexpected{Error::BAD_FORMAT};
     }
 
-    store(src, make_jmp_e9(src, dst));
+    for (uint32_t i = 0; i < count; ++i) {
+        Key key{};
+        uint8_t byte_count{};
+        uint8_t instruction_count{};
+        HookPlan plan{};
 
-    return {};
-}
+        if (!read_value(file, key.first) || !read_value(file, key.second) || !read_value(file, byte_count) ||
+            !read_value(file, instruction_count) || byte_count > HOOK_PLAN_MAX_BYTES ||
+            instruction_count > byte_count) {
+            m_plans.clear();
+            return std::unexpected{Error::BAD_FORMAT};
+        }
 
-static bool decode(ZydisDecodedInstruction* ix, uint8_t* ip) {
-    ZydisDecoder decoder{};
-    ZyanStatus status;
+        plan.original_bytes.resize(byte_count);
+        plan.instructions.resize(instruction_count);
 
-#if SAFETYHOOK_ARCH_X86_64
-    status = ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
-#elif SAFETYHOOK_ARCH_X86_32
-    status = ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LEGACY_32, ZYDIS_STACK_WIDTH_32);
-#endif
+        if (!file.read(reinterpret_cast<char*>(plan.original_bytes.data()), byte_count) ||
+            !file.read(reinterpret_cast<char*>(plan.instructions.data()),
+                static_cast<std::streamsize>(instruction_count * sizeof(HookPlan::Instruction))) ||
+            !is_valid_plan(plan)) {
+            m_plans.clear();
+            return std::unexpected{Error::BAD_FORMAT};
+        }
 
-    if (!ZYAN_SUCCESS(status)) {
-        return false;
+        m_plans.insert_or_assign(key, std::move(plan));
     }
 
-    return ZYAN_SUCCESS(ZydisDecoderDecodeInstruction(&decoder, nullptr, ip, 15, ix));
+    return {};
 }
 
-std::expected<InlineHook, InlineHook::Error> InlineHook::create(void* target, void* destination, Flags flags) {
-    return create(Allocator::global(), target, destination, flags);
-}
+std::expected<void, HookPlanCache::Error> HookPlanCache::save(const std::filesystem::path& path) const {
+    std::shared_lock lock{m_mutex};
 
-std::expected<InlineHook, InlineHook::Error> InlineHook::create(
-    const std::shared_ptr<Allocator>& allocator, void* target, void* destination, Flags flags) {
-    InlineHook hook{};
+    // Write next to the destination and rename over it, so that concurrent launches never read a partial file.
+    auto temp_path = path;
+    temp_path += ".tmp";
 
-    if (const auto setup_result =
-            hook.setup(allocator, reinterpret_cast<uint8_t*>(target), reinterpret_cast<uint8_t*>(destination));
-        !setup_result) {
-        return std::unexpected{setup_result.error()};
-    }
+    {
+        std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
 
-    if (!(flags & StartDisabled)) {
-        if (auto enable_result = hook.enable(); !enable_result) {
-            return std::unexpected{enable_result.error()};
+        if (!file) {
+            return std::unexpected{Error::FAILED_TO_OPEN};
+        }
+
+        write_value(file, HOOK_PLAN_CACHE_MAGIC);
+        write_value(file, HOOK_PLAN_CACHE_VERSION);
+        write_value(file, static_cast<uint32_t>(sizeof(void*)));
+        write_value(file, static_cast<uint32_t>(m_plans.size()));
+
+        for (const auto& [key, plan] : m_plans) {
+            write_value(file, key.first);
+            write_value(file, key.second);
+            write_value(file, static_cast<uint8_t>(plan.original_bytes.size()));
+            write_value(file, static_cast<uint8_t>(plan.instructions.size()));
+            file.write(reinterpret_cast<const char*>(plan.original_bytes.data()),
+                static_cast<std::streamsize>(plan.original_bytes.size()));
+            file.write(reinterpret_cast<const char*>(plan.instructions.data()),
+                static_cast<std::streamsize>(plan.instructions.size() * sizeof(HookPlan::Instruction)));
+        }
+
+        if (!file.flush()) {
+            return std::unexpected{Error::FAILED_TO_WRITE};
         }
     }
 
-    return hook;
-}
+    std::error_code ec{};
+    std::filesystem::rename(temp_path, path, ec);
 
-InlineHook::InlineHook(InlineHook&& other) noexcept {
-    *this = std::move(other);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        return std::unexpected{Error::FAILED_TO_WRITE};
+    }
+
+    return {};
 }
 
-InlineHook& InlineHook::operator=(InlineHook&& other) noexcept {
-    if (this != &other) {
-        destroy();
+std::optional<HookPlan> HookPlanCache::find(uint8_t* target) const {
+    const auto module = module_info(target);
 
-        std::scoped_lock lock{m_mutex, other.m_mutex};
+    if (!module) {
+        return std::nullopt;
+    }
 
-        m_target = other.m_target;
-        m_destination = other.m_destination;
-        m_trampoline = std::move(other.m_trampoline);
-        m_trampoline_size = other.m_trampoline_size;
-        m_original_bytes = std::move(other.m_original_bytes);
-        m_enabled = other.m_enabled;
-        m_type = other.m_type;
+    std::shared_lock lock{m_mutex};
 
-        other.m_target = nullptr;
-        other.m_destination = nullptr;
-        other.m_trampoline_size = 0;
-        other.m_enabled = false;
-        other.m_type = Type::Unset;
+    const auto it = m_plans.find(Key{module->build_id, static_cast<uintptr_t>(target - module->base)});
+
+    if (it == m_plans.end() ||
+        !std::equal(it->second.original_bytes.begin(), it->second.original_bytes.end(), target)) {
+        return std::nullopt;
     }
 
-    return *this;
+    return it->second;
 }
 
-InlineHook::~InlineHook() {
-    destroy();
+void HookPlanCache::insert(uint8_t* target, const HookPlan& plan) {
+    const auto module = module_info(target);
+
+    if (!module || plan.original_bytes.size() > HOOK_PLAN_MAX_BYTES) {
+        return;
+    }
+
+    std::unique_lock lock{m_mutex};
+    m_plans.insert_or_assign(Key{module->build_id, static_cast<uintptr_t>(target - module->base)}, plan);
 }
 
-void InlineHook::reset() {
-    *this = {};
+size_t HookPlanCache::size() const {
+    std::shared_lock lock{m_mutex};
+    return m_plans.size();
 }
+} // namespace safetyhook
 
-std::expected<void, InlineHook::Error> InlineHook::setup(
-    const std::shared_ptr<Allocator>& allocator, uint8_t* target, uint8_t* destination) {
-    m_target = target;
-    m_destination = destination;
+//
+// Source file: import_hook.cpp
+//
 
-    if (auto e9_result = e9_hook(allocator); !e9_result) {
-#if SAFETYHOOK_ARCH_X86_64
-        if (auto ff_result = ff_hook(allocator); !ff_result) {
-            return ff_result;
-        }
-#elif SAFETYHOOK_ARCH_X86_32
-        return e9_result;
-#endif
-    }
 
-    return {};
-}
+#if SAFETYHOOK_OS_LINUX
 
-std::expected<void, InlineHook::Error> InlineHook::e9_hook(const std::shared_ptr<Allocator>& allocator) {
-    m_original_bytes.clear();
-    m_trampoline_size = sizeof(TrampolineEpilogueE9);
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
 
-    std::vector<uint8_t*> desired_addresses{m_target};
-    ZydisDecodedInstruction ix{};
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
 
-    for (auto ip = m_target; ip < m_target + sizeof(JmpE9); ip += ix.length) {
-        if (!decode(&ix, ip)) {
-            return std::unexpected{Error::failed_to_decode_instruction(ip)};
-        }
 
-        m_trampoline_size += ix.length;
-        m_original_bytes.insert(m_original_bytes.end(), ip, ip + ix.length);
 
-        const auto is_relative = (ix.attributes & ZYDIS_ATTRIB_IS_RELATIVE) != 0;
+namespace safetyhook {
 
-        if (is_relative) {
-            if (ix.raw.disp.size == 32) {
-                const auto target_address = ip + ix.length + static_cast<int32_t>(ix.raw.disp.value);
-                desired_addresses.emplace_back(target_address);
-            } else if (ix.raw.imm[0].size == 32) {
-                const auto target_address = ip + ix.length + static_cast<int32_t>(ix.raw.imm[0].value.s);
-                desired_addresses.emplace_back(target_address);
-            } else if (ix.meta.category == ZYDIS_CATEGORY_COND_BR && ix.meta.branch_type == ZYDIS_BRANCH_TYPE_SHORT) {
-                const auto target_address = ip + ix.length + static_cast<int32_t>(ix.raw.imm[0].value.s);
-                desired_addresses.emplace_back(target_address);
-                m_trampoline_size += 4; // near conditional branches are 4 bytes larger.
-            } else if (ix.meta.category == ZYDIS_CATEGORY_UNCOND_BR && ix.meta.branch_type == ZYDIS_BRANCH_TYPE_SHORT) {
-                const auto target_address = ip + ix.length + static_cast<int32_t>(ix.raw.imm[0].value.s);
-                desired_addresses.emplace_back(target_address);
-                m_trampoline_size += 3; // near unconditional branches are 3 bytes larger.
-            } else {
-                return std::unexpected{Error::unsupported_instruction_in_trampoline(ip)};
-            }
+/// Dynamic section of a loaded ELF module.
+struct ElfModule {
+    uintptr_t base{};
+    const char* name{};
+    const ElfW(Sym)* symtab{};
+    const char* strtab{};
+    size_t strsz{};
+    const uint8_t* jmprel{};
+    size_t pltrelsz{};
+    bool plt_is_rela{};
+    const uint8_t* rel{};
+    size_t relsz{};
+    const uint8_t* rela{};
+    size_t relasz{};
+    const uint32_t* gnu_hash{};
+    const ElfW(Word)* sysv_hash{};
+    const ElfW(Half)* versym{};
+};
+
+static std::string_view elf_basename(std::string_view path) {
+    const auto slash = path.find_last_of('/');
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+static bool parse_elf_module(const dl_phdr_info* info, ElfModule& module) {
+    module = ElfModule{};
+    module.base = static_cast<uintptr_t>(info->dlpi_addr);
+    module.name = info->dlpi_name != nullptr ? info->dlpi_name : "";
+
+    const ElfW(Dyn)* dynamic{};
+    auto image_begin = UINTPTR_MAX;
+    uintptr_t image_end{};
+
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+        const auto& phdr = info->dlpi_phdr[i];
+
+        if (phdr.p_type == PT_DYNAMIC) {
+            dynamic = reinterpret_cast<const ElfW(Dyn)*>(module.base + phdr.p_vaddr);
+        } else if (phdr.p_type == PT_LOAD) {
+            image_begin = std::min<uintptr_t>(image_begin, module.base + phdr.p_vaddr);
+            image_end = std::max<uintptr_t>(image_end, module.base + phdr.p_vaddr + phdr.p_memsz);
         }
     }
 
-    auto trampoline_allocation = allocator->allocate_near(desired_addresses, m_trampoline_size);
+    if (dynamic == nullptr) {
+        return false;
+    }
 
-    if (!trampoline_allocation) {
-        return std::unexpected{Error::bad_allocation(trampoline_allocation.error())};
+    // glibc relocates the d_ptr entries of a writable dynamic section in place, musl never does and neither loader
+    // touches a read-only one such as the vDSO's. DT_STRTAB is present in every module that has a symbol table and
+    // is adjusted together with the other pointers, so it tells which of the two the whole section holds.
+    bool relocated = true;
+
+    for (auto dyn = dynamic; dyn->d_tag != DT_NULL; ++dyn) {
+        if (dyn->d_tag == DT_STRTAB) {
+            const auto value = static_cast<uintptr_t>(dyn->d_un.d_ptr);
+            relocated = value >= image_begin && value < image_end;
+            break;
+        }
     }
 
-    m_trampoline = std::move(*trampoline_allocation);
+    const auto ptr = [&module, relocated](ElfW(Addr) value) {
+        return relocated ? static_cast<uintptr_t>(value) : module.base + value;
+    };
 
-    for (auto ip = m_target, tramp_ip = m_trampoline.data(); ip < m_target + m_original_bytes.size(); ip += ix.length) {
-        if (!decode(&ix, ip)) {
-            m_trampoline.free();
-            return std::unexpected{Error::failed_to_decode_instruction(ip)};
+    for (auto dyn = dynamic; dyn->d_tag != DT_NULL; ++dyn) {
+        switch (dyn->d_tag) {
+        case DT_SYMTAB:
+            module.symtab = reinterpret_cast<const ElfW(Sym)*>(ptr(dyn->d_un.d_ptr));
+            break;
+        case DT_STRTAB:
+            module.strtab = reinterpret_cast<const char*>(ptr(dyn->d_un.d_ptr));
+            break;
+        case DT_STRSZ:
+            module.strsz = dyn->d_un.d_val;
+            break;
+        case DT_JMPREL:
+            module.jmprel = reinterpret_cast<const uint8_t*>(ptr(dyn->d_un.d_ptr));
+            break;
+        case DT_PLTRELSZ:
+            module.pltrelsz = dyn->d_un.d_val;
+            break;
+        case DT_PLTREL:
+            module.plt_is_rela = dyn->d_un.d_val == DT_RELA;
+            break;
+        case DT_REL:
+            module.rel = reinterpret_cast<const uint8_t*>(ptr(dyn->d_un.d_ptr));
+            break;
+        case DT_RELSZ:
+            module.relsz = dyn->d_un.d_val;
+            break;
+        case DT_RELA:
+            module.rela = reinterpret_cast<const uint8_t*>(ptr(dyn->d_un.d_ptr));
+            break;
+        case DT_RELASZ:
+            module.relasz = dyn->d_un.d_val;
+            break;
+        case DT_GNU_HASH:
+            module.gnu_hash = reinterpret_cast<const uint32_t*>(ptr(dyn->d_un.d_ptr));
+            break;
+        case DT_HASH:
+            module.sysv_hash = reinterpret_cast<const ElfW(Word)*>(ptr(dyn->d_un.d_ptr));
+            break;
+        case DT_VERSYM:
+            module.versym = reinterpret_cast<const ElfW(Half)*>(ptr(dyn->d_un.d_ptr));
+            break;
+        default:
+            break;
         }
+    }
 
-        const auto is_relative = (ix.attributes & ZYDIS_ATTRIB_IS_RELATIVE) != 0;
+    return module.symtab != nullptr && module.strtab != nullptr;
+}
 
-        if (is_relative && ix.raw.disp.size == 32) {
-            std::copy_n(ip, ix.length, tramp_ip);
-            const auto target_address = ip + ix.length + ix.raw.disp.value;
-            const auto new_disp = target_address - (tramp_ip + ix.length);
-            store(tramp_ip + ix.raw.disp.offset, static_cast<int32_t>(new_disp));
-            tramp_ip += ix.length;
-        } else if (is_relative && ix.raw.imm[0].size == 32) {
-            std::copy_n(ip, ix.length, tramp_ip);
-            const auto target_address = ip + ix.length + ix.raw.imm[0].value.s;
-            const auto new_disp = target_address - (tramp_ip + ix.length);
-            store(tramp_ip + ix.raw.imm[0].offset, static_cast<int32_t>(new_disp));
-            tramp_ip += ix.length;
-        } else if (ix.meta.category == ZYDIS_CATEGORY_COND_BR && ix.meta.branch_type == ZYDIS_BRANCH_TYPE_SHORT) {
-            const auto target_address = ip + ix.length + ix.raw.imm[0].value.s;
-            auto new_disp = target_address - (tramp_ip + 6);
+static bool is_import_relocation(uint32_t type) {
+#if SAFETYHOOK_ARCH_X86_64
+    return type == R_X86_64_JUMP_SLOT || type == R_X86_64_GLOB_DAT;
+#elif SAFETYHOOK_ARCH_X86_32
+    return type == R_386_JMP_SLOT || type == R_386_GLOB_DAT;
+#endif
+}
 
-            // Handle the case where the target is now in the trampoline.
-            if (target_address >= m_target && target_address < m_target + m_original_bytes.size()) {
-                new_disp = static_cast<ptrdiff_t>(ix.raw.imm[0].value.s);
+/// Calls fn with the GOT entry of every import relocation of symbol in the module.
+template <typename Fn> static void for_each_import(const ElfModule& module, std::string_view symbol, Fn&& fn) {
+    const auto visit = [&]<typename Rel>(const uint8_t* table, size_t size) {
+        if (table == nullptr) {
+            return;
+        }
+
+        const auto* begin = reinterpret_cast<const Rel*>(table);
+        const auto* end = reinterpret_cast<const Rel*>(table + size);
+
+        for (auto rel = begin; rel < end; ++rel) {
+#if SAFETYHOOK_ARCH_X86_64
+            const auto type = static_cast<uint32_t>(ELF64_R_TYPE(rel->r_info));
+            const auto sym = ELF64_R_SYM(rel->r_info);
+#elif SAFETYHOOK_ARCH_X86_32
+            const auto type = static_cast<uint32_t>(ELF32_R_TYPE(rel->r_info));
+            const auto sym = ELF32_R_SYM(rel->r_info);
+#endif
+
+            if (sym == 0 || !is_import_relocation(type)) {
+                continue;
             }
 
-            *tramp_ip = 0x0F;
-            *(tramp_ip + 1) = 0x10 + ix.opcode;
-            store(tramp_ip + 2, static_cast<int32_t>(new_disp));
-            tramp_ip += 6;
-        } else if (ix.meta.category == ZYDIS_CATEGORY_UNCOND_BR && ix.meta.branch_type == ZYDIS_BRANCH_TYPE_SHORT) {
-            const auto target_address = ip + ix.length + ix.raw.imm[0].value.s;
-            auto new_disp = target_address - (tramp_ip + 5);
+            const auto name_offset = module.symtab[sym].st_name;
 
-            // Handle the case where the target is now in the trampoline.
-            if (target_address >= m_target && target_address < m_target + m_original_bytes.size()) {
-                new_disp = static_cast<ptrdiff_t>(ix.raw.imm[0].value.s);
+            if (module.strsz != 0 && name_offset >= module.strsz) {
+                continue;
             }
 
-            *tramp_ip = 0xE9;
-            store(tramp_ip + 1, static_cast<int32_t>(new_disp));
-            tramp_ip += 5;
-        } else {
-            std::copy_n(ip, ix.length, tramp_ip);
-            tramp_ip += ix.length;
+            if (std::string_view{module.strtab + name_offset} != symbol) {
+                continue;
+            }
+
+            fn(reinterpret_cast<uint8_t**>(module.base + rel->r_offset));
         }
+    };
+
+    if (module.plt_is_rela) {
+        visit.template operator()<ElfW(Rela)>(module.jmprel, module.pltrelsz);
+    } else {
+        visit.template operator()<ElfW(Rel)>(module.jmprel, module.pltrelsz);
     }
 
-    auto trampoline_epilogue = reinterpret_cast<TrampolineEpilogueE9*>(
-        m_trampoline.address() + m_trampoline_size - sizeof(TrampolineEpilogueE9));
+    visit.template operator()<ElfW(Rela)>(module.rela, module.relasz);
+    visit.template operator()<ElfW(Rel)>(module.rel, module.relsz);
+}
 
-    // jmp from trampoline to original.
-    auto src = reinterpret_cast<uint8_t*>(&trampoline_epilogue->jmp_to_original);
-    auto dst = m_target + m_original_bytes.size();
+/// Calls fn for every loaded ELF module that has a usable dynamic section.
+template <typename Fn> static void for_each_elf_module(Fn&& fn) {
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, size_t, void* data) -> int {
+            ElfModule module{};
 
-    if (auto result = emit_jmp_e9(src, dst); !result) {
-        return std::unexpected{result.error()};
+            if (parse_elf_module(info, module)) {
+                (*static_cast<Fn*>(data))(module);
+            }
+
+            return 0;
+        },
+        &fn);
+}
+
+std::expected<ImportHook, ImportHook::Error> ImportHook::create(std::string_view symbol, void* destination) {
+    ImportHook hook{};
+
+    if (auto setup_result = hook.setup(nullptr, symbol, reinterpret_cast<uint8_t*>(destination)); !setup_result) {
+        return std::unexpected{setup_result.error()};
     }
 
-    // jmp from trampoline to destination.
-    src = reinterpret_cast<uint8_t*>(&trampoline_epilogue->jmp_to_destination);
-    dst = m_destination;
+    return hook;
+}
 
-#if SAFETYHOOK_ARCH_X86_64
-    auto data = reinterpret_cast<uint8_t*>(&trampoline_epilogue->destination_address);
+std::expected<ImportHook, ImportHook::Error> ImportHook::create(
+    std::string_view module, std::string_view symbol, void* destination) {
+    ImportHook hook{};
 
-    if (auto result = emit_jmp_ff(src, dst, data); !result) {
-        return std::unexpected{result.error()};
+    if (auto setup_result = hook.setup(&module, symbol, reinterpret_cast<uint8_t*>(destination)); !setup_result) {
+        return std::unexpected{setup_result.error()};
     }
-#elif SAFETYHOOK_ARCH_X86_32
-    if (auto result = emit_jmp_e9(src, dst); !result) {
-        return std::unexpected{result.error()};
+
+    return hook;
+}
+
+ImportHook::ImportHook(ImportHook&& other) noexcept {
+    *this = std::move(other);
+}
+
+ImportHook& ImportHook::operator=(ImportHook&& other) noexcept {
+    if (this != &other) {
+        destroy();
+
+        m_entries = std::move(other.m_entries);
+        m_original = other.m_original;
+        m_destination = other.m_destination;
+
+        other.m_entries.clear();
+        other.m_original = nullptr;
+        other.m_destination = nullptr;
     }
-#endif
 
-    m_type = Type::E9;
+    return *this;
+}
 
-    return {};
+ImportHook::~ImportHook() {
+    destroy();
 }
 
-#if SAFETYHOOK_ARCH_X86_64
-std::expected<void, InlineHook::Error> InlineHook::ff_hook(const std::shared_ptr<Allocator>& allocator) {
-    m_original_bytes.clear();
-    m_trampoline_size = sizeof(TrampolineEpilogueFF);
-    ZydisDecodedInstruction ix{};
+void ImportHook::reset() {
+    *this = {};
+}
 
-    for (auto ip = m_target; ip < m_target + sizeof(JmpFF) + sizeof(uintptr_t); ip += ix.length) {
-        if (!decode(&ix, ip)) {
-            return std::unexpected{Error::failed_to_decode_instruction(ip)};
-        }
+std::expected<void, ImportHook::Error> ImportHook::setup(
+    const std::string_view* module, std::string_view symbol, uint8_t* destination) {
+    m_destination = destination;
 
-        // We can't support any instruction that is IP relative here because
-        // ff_hook should only be called if e9_hook failed indicating that
-        // we're likely outside the +- 2GB range.
-        if (ix.attributes & ZYDIS_ATTRIB_IS_RELATIVE) {
-            return std::unexpected{Error::ip_relative_instruction_out_of_range(ip)};
+    bool module_found = module == nullptr;
+
+    // Only collect the entries while the dynamic linker lock is held, the protection changes happen afterwards.
+    for_each_elf_module([&](const ElfModule& elf) {
+        if (module != nullptr) {
+            const std::string_view name{elf.name};
+
+            if (module->empty() ? !name.empty() : (name != *module && elf_basename(name) != *module)) {
+                return;
+            }
+
+            module_found = true;
         }
 
-        m_original_bytes.insert(m_original_bytes.end(), ip, ip + ix.length);
-        m_trampoline_size += ix.length;
-    }
+        for_each_import(elf, symbol, [&](uint8_t** address) {
+            m_entries.emplace_back(Entry{elf.base, address, nullptr});
+        });
+    });
 
-    auto trampoline_allocation = allocator->allocate(m_trampoline_size);
+    if (!module_found) {
+        return std::unexpected{Error::module_not_found()};
+    }
 
-    if (!trampoline_allocation) {
-        return std::unexpected{Error::bad_allocation(trampoline_allocation.error())};
+    if (m_entries.empty()) {
+        return std::unexpected{Error::symbol_not_found()};
     }
 
-    m_trampoline = std::move(*trampoline_allocation);
+    // With lazy binding a GOT entry may still point at its PLT stub, so resolve the original function by name.
+    const std::string symbol_name{symbol};
+    m_original = static_cast<uint8_t*>(dlsym(RTLD_DEFAULT, symbol_name.c_str()));
 
-    std::copy(m_original_bytes.begin(), m_original_bytes.end(), m_trampoline.data());
+    for (auto& entry : m_entries) {
+        auto unprotect_guard = unprotect(reinterpret_cast<uint8_t*>(entry.address), sizeof(uint8_t*));
 
-    const auto trampoline_epilogue =
-        reinterpret_cast<TrampolineEpilogueFF*>(m_trampoline.data() + m_trampoline_size - sizeof(TrampolineEpilogueFF));
+        if (!unprotect_guard) {
+            const auto address = reinterpret_cast<uint8_t*>(entry.address);
+            m_entries.erase(m_entries.begin() + (&entry - m_entries.data()), m_entries.end());
+            destroy();
+            return std::unexpected{Error::failed_to_unprotect(address)};
+        }
 
-    // jmp from trampoline to original.
-    auto src = reinterpret_cast<uint8_t*>(&trampoline_epilogue->jmp_to_original);
-    auto dst = m_target + m_original_bytes.size();
-    auto data = reinterpret_cast<uint8_t*>(&trampoline_epilogue->original_address);
+        entry.original = std::atomic_ref{*entry.address}.exchange(m_destination, std::memory_order_acq_rel);
 
-    if (auto result = emit_jmp_ff(src, dst, data); !result) {
-        return std::unexpected{result.error()};
+        if (m_original == nullptr) {
+            m_original = entry.original;
+        }
     }
 
-    m_type = Type::FF;
-
     return {};
 }
-#endif
 
-std::expected<void, InlineHook::Error> InlineHook::enable() {
-    std::scoped_lock lock{m_mutex};
+void ImportHook::destroy() {
+    if (m_entries.empty()) {
+        return;
+    }
 
-    if (m_enabled) {
-        return {};
+    if (leak_on_destroy()) {
+        m_entries.clear();
+        m_original = nullptr;
+        m_destination = nullptr;
+        return;
     }
 
-    std::optional<Error> error;
+    // Skip the entries of modules that have been unloaded since the hook was created.
+    std::vector<uintptr_t> loaded_modules{};
+    for_each_elf_module([&](const ElfModule& elf) { loaded_modules.emplace_back(elf.base); });
 
-    // jmp from original to trampoline.
-    trap_threads(m_target, m_trampoline.data(), m_original_bytes.size(), [this, &error] {
-        if (m_type == Type::E9) {
-            auto trampoline_epilogue = reinterpret_cast<TrampolineEpilogueE9*>(
-                m_trampoline.address() + m_trampoline_size - sizeof(TrampolineEpilogueE9));
+    for (const auto& entry : m_entries) {
+        if (std::find(loaded_modules.begin(), loaded_modules.end(), entry.module_base) == loaded_modules.end()) {
+            continue;
+        }
 
-            if (auto result = emit_jmp_e9(m_target,
-                    reinterpret_cast<uint8_t*>(&trampoline_epilogue->jmp_to_destination), m_original_bytes.size());
-                !result) {
-                error = result.error();
-            }
+        if (auto unprotect_guard = unprotect(reinterpret_cast<uint8_t*>(entry.address), sizeof(uint8_t*))) {
+            auto expected = m_destination;
+            std::atomic_ref{*entry.address}.compare_exchange_strong(
+                expected, entry.original, std::memory_order_acq_rel);
         }
+    }
+
+    m_entries.clear();
+    m_original = nullptr;
+    m_destination = nullptr;
+}
+
+static uint32_t elf_gnu_hash(std::string_view name) {
+    uint32_t hash = 5381;
+
+    for (const auto c : name) {
+        hash = hash * 33 + static_cast<uint8_t>(c);
+    }
 
+    return hash;
+}
+
+static uint32_t elf_sysv_hash(std::string_view name) {
+    uint32_t hash = 0;
+
+    for (const auto c : name) {
+        hash = (hash << 4) + static_cast<uint8_t>(c);
+        const auto high = hash & 0xF0000000;
+        hash ^= high >> 24;
+        hash &= ~high;
+    }
+
+    return hash;
+}
+
+/// Returns the address of symbol index if it is a default, defined symbol called name.
+static void* elf_symbol_address(const ElfModule& module, uint32_t index, std::string_view name) {
+    const auto& sym = module.symtab[index];
 #if SAFETYHOOK_ARCH_X86_64
-        if (m_type == Type::FF) {
-            if (auto result = emit_jmp_ff(m_target, m_destination, m_target + sizeof(JmpFF), m_original_bytes.size());
-                !result) {
-                error = result.error();
-            }
-        }
+    const auto type = ELF64_ST_TYPE(sym.st_info);
+#elif SAFETYHOOK_ARCH_X86_32
+    const auto type = ELF32_ST_TYPE(sym.st_info);
 #endif
-    });
 
-    if (error) {
-        return std::unexpected{*error};
+    // Version definitions are absolute symbols with a value of 0, the dynamic linker skips them as well.
+    if (sym.st_shndx == SHN_UNDEF || sym.st_value == 0 || type == STT_TLS) {
+        return nullptr;
     }
 
-    m_enabled = true;
+    // Local and hidden (non-default) versions are not visible to an unversioned lookup.
+    if (module.versym != nullptr && ((module.versym[index] & 0x7FFF) == 0 || (module.versym[index] & 0x8000) != 0)) {
+        return nullptr;
+    }
 
-    return {};
-}
+    if (module.strsz != 0 && (sym.st_name >= module.strsz || module.strsz - sym.st_name <= name.size())) {
+        return nullptr;
+    }
 
-std::expected<void, InlineHook::Error> InlineHook::disable() {
-    std::scoped_lock lock{m_mutex};
+    const auto str = module.strtab + sym.st_name;
 
-    if (!m_enabled) {
-        return {};
+    if (std::memcmp(str, name.data(), name.size()) != 0 || str[name.size()] != '\0') {
+        return nullptr;
     }
 
-    trap_threads(m_trampoline.data(), m_target, m_original_bytes.size(),
-        [this] { std::copy(m_original_bytes.begin(), m_original_bytes.end(), m_target); });
+    const auto address = reinterpret_cast<void*>(module.base + sym.st_value);
 
-    m_enabled = false;
+    // Like dlsym, return what the resolver of an indirect function selects rather than the resolver itself.
+    if (type == STT_GNU_IFUNC) {
+        return reinterpret_cast<void* (*)()>(address)();
+    }
 
-    return {};
+    return address;
 }
 
-void InlineHook::destroy() {
-    [[maybe_unused]] auto disable_result = disable();
+static void* elf_find_gnu_hash(const ElfModule& module, std::string_view name) {
+    const auto table = module.gnu_hash;
+    const auto bucket_count = table[0];
+    const auto symbol_offset = table[1];
+    const auto bloom_size = table[2];
+    const auto bloom_shift = table[3];
 
-    std::scoped_lock lock{m_mutex};
+    if (bucket_count == 0 || bloom_size == 0) {
+        return nullptr;
+    }
 
-    if (!m_trampoline) {
-        return;
+    const auto bloom = reinterpret_cast<const ElfW(Addr)*>(table + 4);
+    const auto buckets = reinterpret_cast<const uint32_t*>(bloom + bloom_size);
+    const auto chain = buckets + bucket_count;
+    constexpr uint32_t bloom_bits = sizeof(ElfW(Addr)) * 8;
+
+    const auto hash = elf_gnu_hash(name);
+    const auto word = bloom[(hash / bloom_bits) % bloom_size];
+    const auto mask = (ElfW(Addr){1} << (hash % bloom_bits)) | (ElfW(Addr){1} << ((hash >> bloom_shift) % bloom_bits));
+
+    // Most misses end here, without touching the hash chains or the string table.
+    if ((word & mask) != mask) {
+        return nullptr;
     }
 
-    m_trampoline.free();
-}
-} // namespace safetyhook
+    auto index = buckets[hash % bucket_count];
 
-//
-// Source file: mid_hook.cpp
-//
+    if (index < symbol_offset) {
+        return nullptr;
+    }
 
-#include <algorithm>
-#include <array>
+    for (;; ++index) {
+        const auto chain_hash = chain[index - symbol_offset];
 
+        if ((chain_hash | 1) == (hash | 1)) {
+            if (const auto address = elf_symbol_address(module, index, name)) {
+                return address;
+            }
+        }
 
+        // The lowest bit marks the end of the chain.
+        if (chain_hash & 1) {
+            return nullptr;
+        }
+    }
+}
 
-namespace safetyhook {
+static void* elf_find_sysv_hash(const ElfModule& module, std::string_view name) {
+    const auto table = module.sysv_hash;
+    const auto bucket_count = table[0];
+    const auto chain_count = table[1];
 
-#if SAFETYHOOK_ARCH_X86_64
-#if SAFETYHOOK_OS_WINDOWS
-constexpr std::array<uint8_t, 391> asm_data = {0xFF, 0x35, 0x79, 0x01, 0x00, 0x00, 0x54, 0x54, 0x55, 0x50, 0x53, 0x51,
-    0x52, 0x56, 0x57, 0x41, 0x50, 0x41, 0x51, 0x41, 0x52, 0x41, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57,
-    0x9C, 0x48, 0x81, 0xEC, 0x00, 0x01, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0xBC, 0x24, 0xF0, 0x00, 0x00, 0x00, 0xF3,
-    0x44, 0x0F, 0x7F, 0xB4, 0x24, 0xE0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0xAC, 0x24, 0xD0, 0x00, 0x00, 0x00,
-    0xF3, 0x44, 0x0F, 0x7F, 0xA4, 0x24, 0xC0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x9C, 0x24, 0xB0, 0x00, 0x00,
-    0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x94, 0x24, 0xA0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x8C, 0x24, 0x90, 0x00,
-    0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x84, 0x24, 0x80, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x7F, 0x7C, 0x24, 0x70, 0xF3,
-    0x0F, 0x7F, 0x74, 0x24, 0x60, 0xF3, 0x0F, 0x7F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x7F, 0x64, 0x24, 0x40, 0xF3, 0x0F,
-    0x7F, 0x5C, 0x24, 0x30, 0xF3, 0x0F, 0x7F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x7F, 0x4C, 0x24, 0x10, 0xF3, 0x0F, 0x7F,
-    0x04, 0x24, 0x48, 0x8B, 0x8C, 0x24, 0x80, 0x01, 0x00, 0x00, 0x48, 0x83, 0xC1, 0x10, 0x48, 0x89, 0x8C, 0x24, 0x80,
-    0x01, 0x00, 0x00, 0x48, 0x8D, 0x0C, 0x24, 0x48, 0x89, 0xE3, 0x48, 0x83, 0xEC, 0x30, 0x48, 0x83, 0xE4, 0xF0, 0xFF,
-    0x15, 0xA8, 0x00, 0x00, 0x00, 0x48, 0x89, 0xDC, 0xF3, 0x0F, 0x6F, 0x04, 0x24, 0xF3, 0x0F, 0x6F, 0x4C, 0x24, 0x10,
-    0xF3, 0x0F, 0x6F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x6F, 0x5C, 0x24, 0x30, 0xF3, 0x0F, 0x6F, 0x64, 0x24, 0x40, 0xF3,
-    0x0F, 0x6F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x6F, 0x74, 0x24, 0x60, 0xF3, 0x0F, 0x6F, 0x7C, 0x24, 0x70, 0xF3, 0x44,
-    0x0F, 0x6F, 0x84, 0x24, 0x80, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0x8C, 0x24, 0x90, 0x00, 0x00, 0x00, 0xF3,
-    0x44, 0x0F, 0x6F, 0x94, 0x24, 0xA0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0x9C, 0x24, 0xB0, 0x00, 0x00, 0x00,
-    0xF3, 0x44, 0x0F, 0x6F, 0xA4, 0x24, 0xC0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xAC, 0x24, 0xD0, 0x00, 0x00,
-    0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xB4, 0x24, 0xE0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xBC, 0x24, 0xF0, 0x00,
-    0x00, 0x00, 0x48, 0x81, 0xC4, 0x00, 0x01, 0x00, 0x00, 0x9D, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x41,
-    0x5B, 0x41, 0x5A, 0x41, 0x59, 0x41, 0x58, 0x5F, 0x5E, 0x5A, 0x59, 0x5B, 0x58, 0x5D, 0x48, 0x8D, 0x64, 0x24, 0x08,
-    0x5C, 0xC3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-#elif SAFETYHOOK_OS_LINUX
-constexpr std::array<uint8_t, 391> asm_data = {0xFF, 0x35, 0x79, 0x01, 0x00, 0x00, 0x54, 0x54, 0x55, 0x50, 0x53, 0x51,
-    0x52, 0x56, 0x57, 0x41, 0x50, 0x41, 0x51, 0x41, 0x52, 0x41, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57,
-    0x9C, 0x48, 0x81, 0xEC, 0x00, 0x01, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0xBC, 0x24, 0xF0, 0x00, 0x00, 0x00, 0xF3,
-    0x44, 0x0F, 0x7F, 0xB4, 0x24, 0xE0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0xAC, 0x24, 0xD0, 0x00, 0x00, 0x00,
-    0xF3, 0x44, 0x0F, 0x7F, 0xA4, 0x24, 0xC0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x9C, 0x24, 0xB0, 0x00, 0x00,
-    0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x94, 0x24, 0xA0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x8C, 0x24, 0x90, 0x00,
-    0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x84, 0x24, 0x80, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x7F, 0x7C, 0x24, 0x70, 0xF3,
-    0x0F, 0x7F, 0x74, 0x24, 0x60, 0xF3, 0x0F, 0x7F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x7F, 0x64, 0x24, 0x40, 0xF3, 0x0F,
-    0x7F, 0x5C, 0x24, 0x30, 0xF3, 0x0F, 0x7F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x7F, 0x4C, 0x24, 0x10, 0xF3, 0x0F, 0x7F,
-    0x04, 0x24, 0x48, 0x8B, 0xBC, 0x24, 0x80, 0x01, 0x00, 0x00, 0x48, 0x83, 0xC7, 0x10, 0x48, 0x89, 0xBC, 0x24, 0x80,
-    0x01, 0x00, 0x00, 0x48, 0x8D, 0x3C, 0x24, 0x48, 0x89, 0xE3, 0x48, 0x83, 0xEC, 0x30, 0x48, 0x83, 0xE4, 0xF0, 0xFF,
-    0x15, 0xA8, 0x00, 0x00, 0x00, 0x48, 0x89, 0xDC, 0xF3, 0x0F, 0x6F, 0x04, 0x24, 0xF3, 0x0F, 0x6F, 0x4C, 0x24, 0x10,
-    0xF3, 0x0F, 0x6F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x6F, 0x5C, 0x24, 0x30, 0xF3, 0x0F, 0x6F, 0x64, 0x24, 0x40, 0xF3,
-    0x0F, 0x6F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x6F, 0x74, 0x24, 0x60, 0xF3, 0x0F, 0x6F, 0x7C, 0x24, 0x70, 0xF3, 0x44,
-    0x0F, 0x6F, 0x84, 0x24, 0x80, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0x8C, 0x24, 0x90, 0x00, 0x00, 0x00, 0xF3,
-    0x44, 0x0F, 0x6F, 0x94, 0x24, 0xA0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0x9C, 0x24, 0xB0, 0x00, 0x00, 0x00,
-    0xF3, 0x44, 0x0F, 0x6F, 0xA4, 0x24, 0xC0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xAC, 0x24, 0xD0, 0x00, 0x00,
-    0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xB4, 0x24, 0xE0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xBC, 0x24, 0xF0, 0x00,
-    0x00, 0x00, 0x48, 0x81, 0xC4, 0x00, 0x01, 0x00, 0x00, 0x9D, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x41,
-    0x5B, 0x41, 0x5A, 0x41, 0x59, 0x41, 0x58, 0x5F, 0x5E, 0x5A, 0x59, 0x5B, 0x58, 0x5D, 0x48, 0x8D, 0x64, 0x24, 0x08,
-    0x5C, 0xC3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-#endif
-#elif SAFETYHOOK_ARCH_X86_32
-constexpr std::array<uint8_t, 171> asm_data = {0xFF, 0x35, 0xA7, 0x00, 0x00, 0x00, 0x54, 0x54, 0x55, 0x50, 0x53, 0x51,
-    0x52, 0x56, 0x57, 0x9C, 0x81, 0xEC, 0x80, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x7F, 0x7C, 0x24, 0x70, 0xF3, 0x0F, 0x7F,
-    0x74, 0x24, 0x60, 0xF3, 0x0F, 0x7F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x7F, 0x64, 0x24, 0x40, 0xF3, 0x0F, 0x7F, 0x5C,
-    0x24, 0x30, 0xF3, 0x0F, 0x7F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x7F, 0x4C, 0x24, 0x10, 0xF3, 0x0F, 0x7F, 0x04, 0x24,
-    0x8B, 0x8C, 0x24, 0xA0, 0x00, 0x00, 0x00, 0x83, 0xC1, 0x08, 0x89, 0x8C, 0x24, 0xA0, 0x00, 0x00, 0x00, 0x54, 0xFF,
-    0x15, 0xA3, 0x00, 0x00, 0x00, 0x83, 0xC4, 0x04, 0xF3, 0x0F, 0x6F, 0x04, 0x24, 0xF3, 0x0F, 0x6F, 0x4C, 0x24, 0x10,
-    0xF3, 0x0F, 0x6F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x6F, 0x5C, 0x24, 0x30, 0xF3, 0x0F, 0x6F, 0x64, 0x24, 0x40, 0xF3,
-    0x0F, 0x6F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x6F, 0x74, 0x24, 0x60, 0xF3, 0x0F, 0x6F, 0x7C, 0x24, 0x70, 0x81, 0xC4,
-    0x80, 0x00, 0x00, 0x00, 0x9D, 0x5F, 0x5E, 0x5A, 0x59, 0x5B, 0x58, 0x5D, 0x8D, 0x64, 0x24, 0x04, 0x5C, 0xC3, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-#endif
-
-std::expected<MidHook, MidHook::Error> MidHook::create(void* target, MidHookFn destination, Flags flags) {
-    return create(Allocator::global(), target, destination, flags);
-}
-
-std::expected<MidHook, MidHook::Error> MidHook::create(
-    const std::shared_ptr<Allocator>& allocator, void* target, MidHookFn destination, Flags flags) {
-    MidHook hook{};
-
-    if (const auto setup_result = hook.setup(allocator, reinterpret_cast<uint8_t*>(target), destination);
-        !setup_result) {
-        return std::unexpected{setup_result.error()};
+    if (bucket_count == 0) {
+        return nullptr;
     }
 
-    if (!(flags & StartDisabled)) {
-        if (auto enable_result = hook.enable(); !enable_result) {
-            return std::unexpected{enable_result.error()};
+    const auto buckets = table + 2;
+    const auto chain = buckets + bucket_count;
+
+    for (auto index = buckets[elf_sysv_hash(name) % bucket_count]; index != STN_UNDEF && index < chain_count;
+        index = chain[index]) {
+        if (const auto address = elf_symbol_address(module, index, name)) {
+            return address;
         }
     }
 
-    return hook;
-}
-
-MidHook::MidHook(MidHook&& other) noexcept {
-    *this = std::move(other);
+    return nullptr;
 }
 
-MidHook& MidHook::operator=(MidHook&& other) noexcept {
-    if (this != &other) {
-        m_hook = std::move(other.m_hook);
-        m_target = other.m_target;
-        m_stub = std::move(other.m_stub);
-        m_destination = other.m_destination;
+static void* elf_find_symbol(const ElfModule& module, std::string_view name) {
+    if (module.gnu_hash != nullptr) {
+        return elf_find_gnu_hash(module, name);
+    }
 
-        other.m_target = 0;
-        other.m_destination = nullptr;
+    if (module.sysv_hash != nullptr) {
+        return elf_find_sysv_hash(module, name);
     }
 
-    return *this;
+    return nullptr;
 }
 
-void MidHook::reset() {
-    *this = {};
-}
+/// Returns how many modules the dynamic linker has loaded and unloaded so far, if it reports it.
+static std::optional<std::pair<unsigned long long, unsigned long long>> elf_loader_generation() {
+    std::optional<std::pair<unsigned long long, unsigned long long>> generation{};
 
-std::expected<void, MidHook::Error> MidHook::setup(
-    const std::shared_ptr<Allocator>& allocator, uint8_t* target, MidHookFn destination_fn) {
-    m_target = target;
-    m_destination = destination_fn;
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, size_t size, void* data) -> int {
+            if (size >= offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+                *static_cast<decltype(generation)*>(data) = std::pair{info->dlpi_adds, info->dlpi_subs};
+            }
 
-    auto stub_allocation = allocator->allocate(asm_data.size());
+            // The counters are the same for every module, the first one is enough.
+            return 1;
+        },
+        &generation);
 
-    if (!stub_allocation) {
-        return std::unexpected{Error::bad_allocation(stub_allocation.error())};
-    }
+    return generation;
+}
 
-    m_stub = std::move(*stub_allocation);
+struct SymbolResolver::Module {
+    ElfModule elf{};
+    std::string name{};
+};
 
-    std::copy(asm_data.begin(), asm_data.end(), m_stub.data());
+std::shared_ptr<SymbolResolver> SymbolResolver::global() {
+    static const auto resolver = create();
+    return resolver;
+}
 
-#if SAFETYHOOK_ARCH_X86_64
-    store(m_stub.data() + sizeof(asm_data) - 16, m_destination);
-#elif SAFETYHOOK_ARCH_X86_32
-    store(m_stub.data() + sizeof(asm_data) - 8, m_destination);
+std::shared_ptr<SymbolResolver> SymbolResolver::create() {
+    return std::shared_ptr<SymbolResolver>{new SymbolResolver{}};
+}
 
-    // 32-bit has some relocations we need to fix up as well.
-    store(m_stub.data() + 0x02, m_stub.data() + m_stub.size() - 4);
-    store(m_stub.data() + 0x59, m_stub.data() + m_stub.size() - 8);
-#endif
+SymbolResolver::SymbolResolver() = default;
+SymbolResolver::~SymbolResolver() = default;
 
-    auto hook_result = InlineHook::create(allocator, m_target, m_stub.data(), InlineHook::StartDisabled);
+std::expected<void*, SymbolResolver::Error> SymbolResolver::find(std::string_view module, std::string_view symbol) {
+    void* address{};
 
-    if (!hook_result) {
-        m_stub.free();
-        return std::unexpected{Error::bad_inline_hook(hook_result.error())};
+    if (auto result = find(module, std::span{&symbol, 1}, std::span{&address, 1}); !result) {
+        return std::unexpected{result.error()};
     }
 
-    m_hook = std::move(*hook_result);
+    return address;
+}
 
-#if SAFETYHOOK_ARCH_X86_64
-    store(m_stub.data() + sizeof(asm_data) - 8, m_hook.trampoline().data());
-#elif SAFETYHOOK_ARCH_X86_32
-    store(m_stub.data() + sizeof(asm_data) - 4, m_hook.trampoline().data());
-#endif
+std::expected<size_t, SymbolResolver::Error> SymbolResolver::find(
+    std::string_view module, std::span<const std::string_view> symbols, std::span<void*> addresses) {
+    const auto lock = sync();
+    const auto entry = find_module(module);
 
-    return {};
-}
+    if (entry == nullptr) {
+        return std::unexpected{Error::MODULE_NOT_FOUND};
+    }
 
-std::expected<void, MidHook::Error> MidHook::enable() {
-    if (auto enable_result = m_hook.enable(); !enable_result) {
-        return std::unexpected{Error::bad_inline_hook(enable_result.error())};
+    if (entry->elf.gnu_hash == nullptr && entry->elf.sysv_hash == nullptr) {
+        return std::unexpected{Error::NO_HASH_TABLE};
     }
 
-    return {};
-}
+    size_t found = 0;
 
-std::expected<void, MidHook::Error> MidHook::disable() {
-    if (auto disable_result = m_hook.disable(); !disable_result) {
-        return std::unexpected{Error::bad_inline_hook(disable_result.error())};
+    for (size_t i = 0; i < symbols.size() && i < addresses.size(); ++i) {
+        addresses[i] = elf_find_symbol(entry->elf, symbols[i]);
+        found += addresses[i] != nullptr;
     }
 
-    return {};
+    return found;
 }
-} // namespace safetyhook
-
-//
-// Source file: os.linux.cpp
-//
 
+void* SymbolResolver::find(std::string_view symbol) {
+    const auto lock = sync();
 
-#if SAFETYHOOK_OS_LINUX
-
-#include <cstdio>
+    for (const auto module : m_load_order) {
+        if (const auto address = elf_find_symbol(module->elf, symbol)) {
+            return address;
+        }
+    }
 
-#include <sys/mman.h>
-#include <unistd.h>
+    return nullptr;
+}
 
+size_t SymbolResolver::size() const {
+    std::shared_lock lock{m_mutex};
+    return m_modules.size();
+}
 
+std::shared_lock<std::shared_mutex> SymbolResolver::sync() {
+    const auto generation = elf_loader_generation();
+    const auto is_current = [this, &generation] {
+        return m_synced && generation && generation->first == m_adds && generation->second == m_subs;
+    };
 
-namespace safetyhook {
-std::expected<uint8_t*, OsError> vm_allocate(uint8_t* address, size_t size, VmAccess access) {
-    int prot = 0;
-    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    {
+        std::shared_lock lock{m_mutex};
 
-    if (access == VM_ACCESS_R) {
-        prot = PROT_READ;
-    } else if (access == VM_ACCESS_RW) {
-        prot = PROT_READ | PROT_WRITE;
-    } else if (access == VM_ACCESS_RX) {
-        prot = PROT_READ | PROT_EXEC;
-    } else if (access == VM_ACCESS_RWX) {
-        prot = PROT_READ | PROT_WRITE | PROT_EXEC;
-    } else {
-        return std::unexpected{OsError::FAILED_TO_ALLOCATE};
+        if (is_current()) {
+            return lock;
+        }
     }
 
-    auto* result = mmap(address, size, prot, flags, -1, 0);
+    {
+        std::unique_lock lock{m_mutex};
 
-    if (result == MAP_FAILED) {
-        return std::unexpected{OsError::FAILED_TO_ALLOCATE};
+        if (!is_current()) {
+            rebuild();
+            m_adds = generation ? generation->first : 0;
+            m_subs = generation ? generation->second : 0;
+            m_synced = generation.has_value();
+        }
     }
 
-    return static_cast<uint8_t*>(result);
+    return std::shared_lock{m_mutex};
 }
 
-void vm_free(uint8_t* address) {
-    munmap(address, 0);
-}
+void SymbolResolver::rebuild() {
+    std::map<uintptr_t, std::unique_ptr<Module>> modules{};
+    m_load_order.clear();
+    m_names.clear();
 
-std::expected<uint32_t, OsError> vm_protect(uint8_t* address, size_t size, VmAccess access) {
-    int prot = 0;
+    for_each_elf_module([&](const ElfModule& elf) {
+        // Modules that are still loaded at the same address keep their entry.
+        auto& module = modules[elf.base];
 
-    if (access == VM_ACCESS_R) {
-        prot = PROT_READ;
-    } else if (access == VM_ACCESS_RW) {
-        prot = PROT_READ | PROT_WRITE;
-    } else if (access == VM_ACCESS_RX) {
-        prot = PROT_READ | PROT_EXEC;
-    } else if (access == VM_ACCESS_RWX) {
-        prot = PROT_READ | PROT_WRITE | PROT_EXEC;
-    } else {
-        return std::unexpected{OsError::FAILED_TO_PROTECT};
-    }
+        if (auto it = m_modules.find(elf.base); it != m_modules.end() && it->second->name == elf.name) {
+            module = std::move(it->second);
+        } else {
+            module = std::make_unique<Module>(Module{elf, elf.name});
+        }
 
-    return vm_protect(address, size, prot);
-}
+        module->elf.name = module->name.c_str();
+        m_load_order.emplace_back(module.get());
+        m_names.try_emplace(module->name, module.get());
+        m_names.try_emplace(std::string{elf_basename(module->name)}, module.get());
+    });
 
-std::expected<uint32_t, OsError> vm_protect(uint8_t* address, size_t size, uint32_t protect) {
-    auto mbi = vm_query(address);
+    m_modules = std::move(modules);
+}
 
-    if (!mbi.has_value()) {
-        return std::unexpected{OsError::FAILED_TO_PROTECT};
+const SymbolResolver::Module* SymbolResolver::find_module(std::string_view module) const {
+    if (const auto it = m_names.find(module); it != m_names.end()) {
+        return it->second;
     }
 
-    uint32_t old_protect = 0;
+    return nullptr;
+}
+} // namespace safetyhook
 
-    if (mbi->access.read) {
-        old_protect |= PROT_READ;
-    }
+#endif
 
-    if (mbi->access.write) {
-        old_protect |= PROT_WRITE;
-    }
+//
+// Source file: inline_hook.cpp
+//
 
-    if (mbi->access.execute) {
-        old_protect |= PROT_EXEC;
-    }
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <new>
 
-    auto* addr = align_down(address, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+#if __has_include("Zydis/Zydis.h")
+#include "Zydis/Zydis.h"
+#elif __has_include("Zydis.h")
+#include "Zydis.h"
+#else
+#error "Zydis not found"
+#endif
 
-    if (mprotect(addr, size, static_cast<int>(protect)) == -1) {
-        return std::unexpected{OsError::FAILED_TO_PROTECT};
-    }
 
-    return old_protect;
-}
 
-std::expected<VmBasicInfo, OsError> vm_query(uint8_t* address) {
-    auto* maps = fopen("/proc/self/maps", "r");
+namespace safetyhook {
 
-    if (maps == nullptr) {
-        return std::unexpected{OsError::FAILED_TO_QUERY};
-    }
+#pragma pack(push, 1)
+struct JmpE9 {
+    uint8_t opcode{0xE9};
+    uint32_t offset{0};
+};
 
-    char line[512];
-    unsigned long start;
-    unsigned long end;
-    char perms[5];
-    unsigned long offset;
-    int dev_major;
-    int dev_minor;
-    unsigned long inode;
-    char path[256];
-    unsigned long last_end =
-        reinterpret_cast<unsigned long>(system_info().min_address); // Track the end address of the last mapping.
-    auto addr = reinterpret_cast<unsigned long>(address);
-    std::optional<VmBasicInfo> info = std::nullopt;
+#if SAFETYHOOK_ARCH_X86_64
+struct JmpFF {
+    uint8_t opcode0{0xFF};
+    uint8_t opcode1{0x25};
+    uint32_t offset{0};
+};
+
+struct TrampolineEpilogueE9 {
+    JmpE9 jmp_to_original{};
+    JmpFF jmp_to_destination{};
+    uint64_t destination_address{};
+};
+
+struct TrampolineEpilogueFF {
+    JmpFF jmp_to_original{};
+    uint64_t original_address{};
+};
+#elif SAFETYHOOK_ARCH_X86_32
+struct TrampolineEpilogueE9 {
+    JmpE9 jmp_to_original{};
+    JmpE9 jmp_to_destination{};
+};
+#endif
+
+// Entry of a SoftToggle hook, placed after the trampoline. The target stays patched to jump here and the mode in
+// SoftState decides whether a call goes on to the destination or back through the trampoline to the original.
+// The memory operands are RIP relative on x86-64 and absolute on x86-32, the encodings are otherwise the same.
+struct SoftGate {
+    uint8_t cmp_mode[2]{0x80, 0x3D}; // cmp byte [mode], 1
+    uint32_t mode_operand{};
+    uint8_t cmp_mode_imm{1};
+    uint8_t jb_original[2]{0x0F, 0x82}; // jb original (off)
+    int32_t jb_original_offset{};
+    uint8_t je_destination[2]{0x0F, 0x84}; // je to_destination (every call)
+    int32_t je_destination_offset{};
+    uint8_t sub_countdown[3]{0xF0, 0x83, 0x2D}; // lock sub dword [countdown], 1
+    uint32_t countdown_operand{};
+    uint8_t sub_countdown_imm{1};
+    uint8_t jg_original[2]{0x0F, 0x8F}; // jg original (not sampled)
+    int32_t jg_original_offset{};
+    uint8_t push_ax{0x50};             // push rax
+    uint8_t load_period[2]{0x8B, 0x05}; // mov eax, [period]
+    uint32_t period_operand{};
+    uint8_t add_countdown[3]{0xF0, 0x01, 0x05}; // lock add [countdown], eax
+    uint32_t add_countdown_operand{};
+    uint8_t pop_ax{0x58};                       // pop rax
+    uint8_t jmp_destination[2]{0xFF, 0x25}; // to_destination: jmp [destination]
+    uint32_t destination_operand{};
+    uintptr_t destination{};
+};
+#pragma pack(pop)
+
+// Kept on its own cache line so that the countdown written by sampled calls does not share a line with code.
+struct alignas(64) InlineHook::SoftState {
+    uint8_t mode{};
+    int32_t countdown{};
+    int32_t period{};
+};
+
+enum SoftMode : uint8_t {
+    SOFT_MODE_OFF = 0,
+    SOFT_MODE_ALWAYS = 1,
+    SOFT_MODE_SAMPLED = 2,
+};
+
+static uint32_t gate_operand(const uint8_t* next_ip, const void* address) {
+#if SAFETYHOOK_ARCH_X86_64
+    return static_cast<uint32_t>(reinterpret_cast<const uint8_t*>(address) - next_ip);
+#elif SAFETYHOOK_ARCH_X86_32
+    (void)next_ip;
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(address));
+#endif
+}
+
+#if SAFETYHOOK_ARCH_X86_64
+static auto make_jmp_ff(uint8_t* src, uint8_t* dst, uint8_t* data) {
+    JmpFF jmp{};
+
+    jmp.offset = static_cast<uint32_t>(data - src - sizeof(jmp));
+    store(data, dst);
+
+    return jmp;
+}
+
+[[nodiscard]] static std::expected<void, InlineHook::Error> emit_jmp_ff(
+    uint8_t* src, uint8_t* dst, uint8_t* data, size_t size = sizeof(JmpFF)) {
+    if (size < sizeof(JmpFF)) {
+        return std::unexpected{InlineHook::Error::not_enough_space(dst)};
+    }
+
+    if (size > sizeof(JmpFF)) {
+        std::fill_n(src, size, static_cast<uint8_t>(0x90));
+    }
+
+    store(src, make_jmp_ff(src, dst, data));
+
+    return {};
+}
+#endif
+
+constexpr auto make_jmp_e9(uint8_t* src, uint8_t* dst) {
+    JmpE9 jmp{};
+
+    jmp.offset = static_cast<uint32_t>(dst - src - sizeof(jmp));
+
+    return jmp;
+}
+
+[[nodiscard]] static std::expected<void, InlineHook::Error> emit_jmp_e9(
+    uint8_t* src, uint8_t* dst, size_t size = sizeof(JmpE9)) {
+    if (size < sizeof(JmpE9)) {
+        return std::unexpected{InlineHook::Error::not_enough_space(dst)};
+    }
+
+    if (size > sizeof(JmpE9)) {
+        std::fill_n(src, size, static_cast<uint8_t>(0x90));
+    }
+
+    store(src, make_jmp_e9(src, dst));
+
+    return {};
+}
+
+static bool decode(ZydisDecodedInstruction* ix, uint8_t* ip) {
+    ZydisDecoder decoder{};
+    ZyanStatus status;
+
+#if SAFETYHOOK_ARCH_X86_64
+    status = ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+#elif SAFETYHOOK_ARCH_X86_32
+    status = ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LEGACY_32, ZYDIS_STACK_WIDTH_32);
+#endif
+
+    if (!ZYAN_SUCCESS(status)) {
+        return false;
+    }
+
+    return ZYAN_SUCCESS(ZydisDecoderDecodeInstruction(&decoder, nullptr, ip, 15, ix));
+}
+
+// Decodes the instructions an e9 hook displaces from target.
+[[nodiscard]] static std::expected<HookPlan, InlineHook::Error> make_e9_plan(uint8_t* target) {
+    HookPlan plan{};
+    ZydisDecodedInstruction ix{};
+
+    for (auto ip = target; ip < target + sizeof(JmpE9); ip += ix.length) {
+        if (!decode(&ix, ip)) {
+            return std::unexpected{InlineHook::Error::failed_to_decode_instruction(ip)};
+        }
+
+        HookPlan::Instruction instruction{};
+        instruction.length = ix.length;
+
+        const auto is_relative = (ix.attributes & ZYDIS_ATTRIB_IS_RELATIVE) != 0;
+
+        if (is_relative) {
+            if (ix.raw.disp.size == 32) {
+                instruction.fixup = HookPlan::Fixup::Disp32;
+                instruction.offset = ix.raw.disp.offset;
+            } else if (ix.raw.imm[0].size == 32) {
+                instruction.fixup = HookPlan::Fixup::Imm32;
+                instruction.offset = ix.raw.imm[0].offset;
+            } else if (ix.meta.category == ZYDIS_CATEGORY_COND_BR && ix.meta.branch_type == ZYDIS_BRANCH_TYPE_SHORT) {
+                instruction.fixup = HookPlan::Fixup::ShortJcc;
+                instruction.offset = ix.raw.imm[0].offset;
+                instruction.opcode = static_cast<uint8_t>(ix.opcode);
+            } else if (ix.meta.category == ZYDIS_CATEGORY_UNCOND_BR && ix.meta.branch_type == ZYDIS_BRANCH_TYPE_SHORT) {
+                instruction.fixup = HookPlan::Fixup::ShortJmp;
+                instruction.offset = ix.raw.imm[0].offset;
+            } else {
+                return std::unexpected{InlineHook::Error::unsupported_instruction_in_trampoline(ip)};
+            }
+        }
+
+        plan.original_bytes.insert(plan.original_bytes.end(), ip, ip + ix.length);
+        plan.instructions.push_back(instruction);
+    }
+
+    return plan;
+}
+
+// Reads the displacement of a planned IP-relative instruction at ip.
+static int32_t relative_offset(const uint8_t* ip, const HookPlan::Instruction& ix) {
+    if (ix.fixup == HookPlan::Fixup::ShortJcc || ix.fixup == HookPlan::Fixup::ShortJmp) {
+        return static_cast<int8_t>(ip[ix.offset]);
+    }
+
+    int32_t value{};
+    std::copy_n(ip + ix.offset, sizeof(value), reinterpret_cast<uint8_t*>(&value));
+    return value;
+}
+
+std::expected<InlineHook, InlineHook::Error> InlineHook::create(void* target, void* destination, Flags flags) {
+    return create(Allocator::global(), target, destination, flags);
+}
+
+std::expected<InlineHook, InlineHook::Error> InlineHook::create(
+    const std::shared_ptr<Allocator>& allocator, void* target, void* destination, Flags flags) {
+    InlineHook hook{};
+
+    if (const auto setup_result =
+            hook.setup(allocator, reinterpret_cast<uint8_t*>(target), reinterpret_cast<uint8_t*>(destination), flags);
+        !setup_result) {
+        return std::unexpected{setup_result.error()};
+    }
+
+    if (!(flags & StartDisabled)) {
+        if (auto enable_result = hook.enable(); !enable_result) {
+            return std::unexpected{enable_result.error()};
+        }
+    }
+
+    return hook;
+}
+
+InlineHook::InlineHook(InlineHook&& other) noexcept {
+    *this = std::move(other);
+}
+
+InlineHook& InlineHook::operator=(InlineHook&& other) noexcept {
+    if (this != &other) {
+        destroy();
+
+        std::scoped_lock lock{m_mutex, other.m_mutex};
+
+        m_target = other.m_target;
+        m_destination = other.m_destination;
+        m_trampoline = std::move(other.m_trampoline);
+        m_trampoline_size = other.m_trampoline_size;
+        m_original_bytes = std::move(other.m_original_bytes);
+        m_enabled = other.m_enabled;
+        m_type = other.m_type;
+        m_flags = other.m_flags;
+        m_soft_state = other.m_soft_state;
+        m_sample_period = other.m_sample_period;
+
+        other.m_target = nullptr;
+        other.m_destination = nullptr;
+        other.m_trampoline_size = 0;
+        other.m_enabled = false;
+        other.m_type = Type::Unset;
+        other.m_flags = Default;
+        other.m_soft_state = nullptr;
+        other.m_sample_period = 1;
+    }
+
+    return *this;
+}
+
+InlineHook::~InlineHook() {
+    destroy();
+}
+
+void InlineHook::reset() {
+    *this = {};
+}
+
+std::expected<void, InlineHook::Error> InlineHook::setup(
+    const std::shared_ptr<Allocator>& allocator, uint8_t* target, uint8_t* destination, Flags flags) {
+    m_target = target;
+    m_destination = destination;
+    m_flags = flags;
+
+    if (auto e9_result = e9_hook(allocator); !e9_result) {
+#if SAFETYHOOK_ARCH_X86_64
+        if (auto ff_result = ff_hook(allocator); !ff_result) {
+            return ff_result;
+        }
+#elif SAFETYHOOK_ARCH_X86_32
+        return e9_result;
+#endif
+    }
+
+    if (m_flags & SoftToggle) {
+        // The target is patched once, enable() and disable() only switch the gate's mode from here on.
+        emit_soft_gate();
+
+        if (auto patch_result = patch(); !patch_result) {
+            m_soft_state = nullptr;
+            return patch_result;
+        }
+    }
+
+    return {};
+}
+
+size_t InlineHook::gate_allocation_size() const {
+    if (!(m_flags & SoftToggle)) {
+        return 0;
+    }
+
+    return sizeof(SoftGate) + alignof(SoftState) - 1 + sizeof(SoftState);
+}
+
+void InlineHook::emit_soft_gate() {
+    const auto gate_ip = m_trampoline.data() + m_trampoline_size;
+    const auto state_address =
+        align_up(reinterpret_cast<uintptr_t>(gate_ip) + sizeof(SoftGate), alignof(SoftState));
+
+    m_soft_state = new (reinterpret_cast<void*>(state_address)) SoftState{};
+    m_soft_state->countdown = static_cast<int32_t>(m_sample_period);
+    m_soft_state->period = static_cast<int32_t>(m_sample_period);
+
+    // The trampoline starts with the relocated prologue, jumping there runs the original.
+    const auto original = m_trampoline.data();
+    const auto to_destination = gate_ip + offsetof(SoftGate, jmp_destination);
+    const auto next_ip = [gate_ip](size_t offset, size_t size) { return gate_ip + offset + size; };
+
+    SoftGate gate{};
+    gate.mode_operand = gate_operand(next_ip(offsetof(SoftGate, cmp_mode_imm), 1), &m_soft_state->mode);
+    gate.jb_original_offset =
+        static_cast<int32_t>(original - next_ip(offsetof(SoftGate, jb_original_offset), sizeof(int32_t)));
+    gate.je_destination_offset = static_cast<int32_t>(
+        to_destination - next_ip(offsetof(SoftGate, je_destination_offset), sizeof(int32_t)));
+    gate.countdown_operand =
+        gate_operand(next_ip(offsetof(SoftGate, sub_countdown_imm), 1), &m_soft_state->countdown);
+    // Every call that takes the countdown to 0 or below is sampled and adds the period back. Several threads can get
+    // there before the first of them has added it, each one adds it, so the countdown never stalls and the number
+    // of sampled calls never falls behind the number of calls divided by the period.
+    gate.jg_original_offset =
+        static_cast<int32_t>(original - next_ip(offsetof(SoftGate, jg_original_offset), sizeof(int32_t)));
+    gate.period_operand =
+        gate_operand(next_ip(offsetof(SoftGate, period_operand), sizeof(uint32_t)), &m_soft_state->period);
+    gate.add_countdown_operand =
+        gate_operand(next_ip(offsetof(SoftGate, add_countdown_operand), sizeof(uint32_t)), &m_soft_state->countdown);
+    gate.destination_operand = gate_operand(
+        next_ip(offsetof(SoftGate, destination_operand), sizeof(uint32_t)), gate_ip + offsetof(SoftGate, destination));
+    gate.destination = reinterpret_cast<uintptr_t>(m_destination);
+
+    store(gate_ip, gate);
+}
+
+void InlineHook::store_soft_mode() const {
+    SoftMode mode = SOFT_MODE_OFF;
+
+    if (m_enabled) {
+        mode = m_sample_period > 1 ? SOFT_MODE_SAMPLED : SOFT_MODE_ALWAYS;
+    }
+
+    std::atomic_ref{m_soft_state->mode}.store(mode, std::memory_order_release);
+}
+
+uint8_t* InlineHook::entry() const {
+    if (m_soft_state != nullptr) {
+        return m_trampoline.data() + m_trampoline_size;
+    }
+
+    if (m_type == Type::E9) {
+        auto trampoline_epilogue = reinterpret_cast<TrampolineEpilogueE9*>(
+            m_trampoline.address() + m_trampoline_size - sizeof(TrampolineEpilogueE9));
+
+        return reinterpret_cast<uint8_t*>(&trampoline_epilogue->jmp_to_destination);
+    }
+
+    return m_destination;
+}
+
+std::expected<void, InlineHook::Error> InlineHook::e9_hook(const std::shared_ptr<Allocator>& allocator) {
+    const auto cache = HookPlanCache::global();
+
+    if (cache) {
+        if (const auto plan = cache->find(m_target)) {
+            return e9_hook(allocator, *plan);
+        }
+    }
+
+    auto plan = make_e9_plan(m_target);
+
+    if (!plan) {
+        return std::unexpected{plan.error()};
+    }
+
+    if (cache) {
+        cache->insert(m_target, *plan);
+    }
+
+    return e9_hook(allocator, *plan);
+}
+
+std::expected<void, InlineHook::Error> InlineHook::e9_hook(
+    const std::shared_ptr<Allocator>& allocator, const HookPlan& plan) {
+    m_original_bytes = plan.original_bytes;
+    m_trampoline_size = plan.trampoline_code_size() + sizeof(TrampolineEpilogueE9);
+
+    std::vector<uint8_t*> desired_addresses{m_target};
+
+    for (auto ip = m_target; const auto& ix : plan.instructions) {
+        if (ix.fixup != HookPlan::Fixup::None) {
+            desired_addresses.emplace_back(ip + ix.length + relative_offset(ip, ix));
+        }
+
+        ip += ix.length;
+    }
+
+    auto trampoline_allocation =
+        allocator->allocate_near(desired_addresses, m_trampoline_size + gate_allocation_size());
+
+    if (!trampoline_allocation) {
+        return std::unexpected{Error::bad_allocation(trampoline_allocation.error())};
+    }
+
+    m_trampoline = std::move(*trampoline_allocation);
+
+    auto ip = m_target;
+    auto tramp_ip = m_trampoline.data();
+
+    for (const auto& ix : plan.instructions) {
+        if (ix.fixup == HookPlan::Fixup::Disp32 || ix.fixup == HookPlan::Fixup::Imm32) {
+            std::copy_n(ip, ix.length, tramp_ip);
+            const auto target_address = ip + ix.length + relative_offset(ip, ix);
+            const auto new_disp = target_address - (tramp_ip + ix.length);
+            store(tramp_ip + ix.offset, static_cast<int32_t>(new_disp));
+            tramp_ip += ix.length;
+        } else if (ix.fixup == HookPlan::Fixup::ShortJcc) {
+            const auto target_address = ip + ix.length + relative_offset(ip, ix);
+            auto new_disp = target_address - (tramp_ip + 6);
+
+            // Handle the case where the target is now in the trampoline.
+            if (target_address >= m_target && target_address < m_target + m_original_bytes.size()) {
+                new_disp = static_cast<ptrdiff_t>(relative_offset(ip, ix));
+            }
+
+            *tramp_ip = 0x0F;
+            *(tramp_ip + 1) = 0x10 + ix.opcode;
+            store(tramp_ip + 2, static_cast<int32_t>(new_disp));
+            tramp_ip += 6;
+        } else if (ix.fixup == HookPlan::Fixup::ShortJmp) {
+            const auto target_address = ip + ix.length + relative_offset(ip, ix);
+            auto new_disp = target_address - (tramp_ip + 5);
+
+            // Handle the case where the target is now in the trampoline.
+            if (target_address >= m_target && target_address < m_target + m_original_bytes.size()) {
+                new_disp = static_cast<ptrdiff_t>(relative_offset(ip, ix));
+            }
+
+            *tramp_ip = 0xE9;
+            store(tramp_ip + 1, static_cast<int32_t>(new_disp));
+            tramp_ip += 5;
+        } else {
+            std::copy_n(ip, ix.length, tramp_ip);
+            tramp_ip += ix.length;
+        }
+
+        ip += ix.length;
+    }
+
+    auto trampoline_epilogue = reinterpret_cast<TrampolineEpilogueE9*>(
+        m_trampoline.address() + m_trampoline_size - sizeof(TrampolineEpilogueE9));
+
+    // jmp from trampoline to original.
+    auto src = reinterpret_cast<uint8_t*>(&trampoline_epilogue->jmp_to_original);
+    auto dst = m_target + m_original_bytes.size();
+
+    if (auto result = emit_jmp_e9(src, dst); !result) {
+        return std::unexpected{result.error()};
+    }
+
+    // jmp from trampoline to destination.
+    src = reinterpret_cast<uint8_t*>(&trampoline_epilogue->jmp_to_destination);
+    dst = m_destination;
+
+#if SAFETYHOOK_ARCH_X86_64
+    auto data = reinterpret_cast<uint8_t*>(&trampoline_epilogue->destination_address);
+
+    if (auto result = emit_jmp_ff(src, dst, data); !result) {
+        return std::unexpected{result.error()};
+    }
+#elif SAFETYHOOK_ARCH_X86_32
+    if (auto result = emit_jmp_e9(src, dst); !result) {
+        return std::unexpected{result.error()};
+    }
+#endif
+
+    m_type = Type::E9;
+
+    return {};
+}
+
+#if SAFETYHOOK_ARCH_X86_64
+std::expected<void, InlineHook::Error> InlineHook::ff_hook(const std::shared_ptr<Allocator>& allocator) {
+    m_original_bytes.clear();
+    m_trampoline_size = sizeof(TrampolineEpilogueFF);
+    ZydisDecodedInstruction ix{};
+
+    for (auto ip = m_target; ip < m_target + sizeof(JmpFF) + sizeof(uintptr_t); ip += ix.length) {
+        if (!decode(&ix, ip)) {
+            return std::unexpected{Error::failed_to_decode_instruction(ip)};
+        }
+
+        // We can't support any instruction that is IP relative here because
+        // ff_hook should only be called if e9_hook failed indicating that
+        // we're likely outside the +- 2GB range.
+        if (ix.attributes & ZYDIS_ATTRIB_IS_RELATIVE) {
+            return std::unexpected{Error::ip_relative_instruction_out_of_range(ip)};
+        }
+
+        m_original_bytes.insert(m_original_bytes.end(), ip, ip + ix.length);
+        m_trampoline_size += ix.length;
+    }
+
+    auto trampoline_allocation = allocator->allocate(m_trampoline_size + gate_allocation_size());
+
+    if (!trampoline_allocation) {
+        return std::unexpected{Error::bad_allocation(trampoline_allocation.error())};
+    }
+
+    m_trampoline = std::move(*trampoline_allocation);
+
+    std::copy(m_original_bytes.begin(), m_original_bytes.end(), m_trampoline.data());
+
+    const auto trampoline_epilogue =
+        reinterpret_cast<TrampolineEpilogueFF*>(m_trampoline.data() + m_trampoline_size - sizeof(TrampolineEpilogueFF));
+
+    // jmp from trampoline to original.
+    auto src = reinterpret_cast<uint8_t*>(&trampoline_epilogue->jmp_to_original);
+    auto dst = m_target + m_original_bytes.size();
+    auto data = reinterpret_cast<uint8_t*>(&trampoline_epilogue->original_address);
+
+    if (auto result = emit_jmp_ff(src, dst, data); !result) {
+        return std::unexpected{result.error()};
+    }
+
+    m_type = Type::FF;
+
+    return {};
+}
+#endif
+
+std::expected<void, InlineHook::Error> InlineHook::enable() {
+    std::scoped_lock lock{m_mutex};
+
+    if (m_enabled) {
+        return {};
+    }
+
+    if (m_soft_state != nullptr) {
+        m_enabled = true;
+        store_soft_mode();
+        return {};
+    }
+
+    if (auto patch_result = patch(); !patch_result) {
+        return patch_result;
+    }
+
+    m_enabled = true;
+
+    return {};
+}
+
+std::expected<void, InlineHook::Error> InlineHook::disable() {
+    std::scoped_lock lock{m_mutex};
+
+    if (!m_enabled) {
+        return {};
+    }
+
+    if (m_soft_state != nullptr) {
+        m_enabled = false;
+        store_soft_mode();
+        return {};
+    }
+
+    unpatch();
+
+    m_enabled = false;
+
+    return {};
+}
+
+bool InlineHook::set_sample_period(uint32_t period) {
+    std::scoped_lock lock{m_mutex};
+
+    if (m_soft_state == nullptr) {
+        return false;
+    }
+
+    m_sample_period = std::clamp<uint32_t>(period, 1, std::numeric_limits<int32_t>::max());
+
+    // Publish the period before the mode, a gate that sees the sampled mode always finds a valid period.
+    std::atomic_ref{m_soft_state->period}.store(static_cast<int32_t>(m_sample_period), std::memory_order_relaxed);
+    std::atomic_ref{m_soft_state->countdown}.store(static_cast<int32_t>(m_sample_period), std::memory_order_relaxed);
+    store_soft_mode();
+
+    return true;
+}
+
+std::expected<void, InlineHook::Error> InlineHook::patch() {
+    std::optional<Error> error;
+    const auto entry_ip = entry();
+
+    // jmp from original to trampoline.
+    trap_threads(m_target, m_trampoline.data(), m_original_bytes.size(), [this, entry_ip, &error] {
+        if (m_type == Type::E9) {
+            if (auto result = emit_jmp_e9(m_target, entry_ip, m_original_bytes.size()); !result) {
+                error = result.error();
+            }
+        }
+
+#if SAFETYHOOK_ARCH_X86_64
+        if (m_type == Type::FF) {
+            if (auto result = emit_jmp_ff(m_target, entry_ip, m_target + sizeof(JmpFF), m_original_bytes.size());
+                !result) {
+                error = result.error();
+            }
+        }
+#endif
+    });
+
+    if (error) {
+        return std::unexpected{*error};
+    }
+
+    return {};
+}
+
+void InlineHook::unpatch() {
+    trap_threads(m_trampoline.data(), m_target, m_original_bytes.size(),
+        [this] { std::copy(m_original_bytes.begin(), m_original_bytes.end(), m_target); });
+}
+
+void InlineHook::destroy() {
+    if (leak_on_destroy()) {
+        std::scoped_lock lock{m_mutex};
+
+        // Leave the target patched, threads may still be running through the trampoline.
+        m_trampoline.leak();
+        m_enabled = false;
+        m_soft_state = nullptr;
+        return;
+    }
+
+    [[maybe_unused]] auto disable_result = disable();
+
+    std::scoped_lock lock{m_mutex};
+
+    if (!m_trampoline) {
+        return;
+    }
+
+    if (m_soft_state != nullptr) {
+        // A soft hook stays patched while disabled, restore the target before its gate goes away.
+        unpatch();
+        m_soft_state = nullptr;
+    }
+
+    m_trampoline.free();
+}
+} // namespace safetyhook
+
+//
+// Source file: mid_hook.cpp
+//
+
+#include <algorithm>
+#include <array>
+
+
+
+namespace safetyhook {
+
+#if SAFETYHOOK_ARCH_X86_64
+#if SAFETYHOOK_OS_WINDOWS
+constexpr std::array<uint8_t, 391> asm_data = {0xFF, 0x35, 0x79, 0x01, 0x00, 0x00, 0x54, 0x54, 0x55, 0x50, 0x53, 0x51,
+    0x52, 0x56, 0x57, 0x41, 0x50, 0x41, 0x51, 0x41, 0x52, 0x41, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57,
+    0x9C, 0x48, 0x81, 0xEC, 0x00, 0x01, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0xBC, 0x24, 0xF0, 0x00, 0x00, 0x00, 0xF3,
+    0x44, 0x0F, 0x7F, 0xB4, 0x24, 0xE0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0xAC, 0x24, 0xD0, 0x00, 0x00, 0x00,
+    0xF3, 0x44, 0x0F, 0x7F, 0xA4, 0x24, 0xC0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x9C, 0x24, 0xB0, 0x00, 0x00,
+    0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x94, 0x24, 0xA0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x8C, 0x24, 0x90, 0x00,
+    0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x84, 0x24, 0x80, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x7F, 0x7C, 0x24, 0x70, 0xF3,
+    0x0F, 0x7F, 0x74, 0x24, 0x60, 0xF3, 0x0F, 0x7F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x7F, 0x64, 0x24, 0x40, 0xF3, 0x0F,
+    0x7F, 0x5C, 0x24, 0x30, 0xF3, 0x0F, 0x7F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x7F, 0x4C, 0x24, 0x10, 0xF3, 0x0F, 0x7F,
+    0x04, 0x24, 0x48, 0x8B, 0x8C, 0x24, 0x80, 0x01, 0x00, 0x00, 0x48, 0x83, 0xC1, 0x10, 0x48, 0x89, 0x8C, 0x24, 0x80,
+    0x01, 0x00, 0x00, 0x48, 0x8D, 0x0C, 0x24, 0x48, 0x89, 0xE3, 0x48, 0x83, 0xEC, 0x30, 0x48, 0x83, 0xE4, 0xF0, 0xFF,
+    0x15, 0xA8, 0x00, 0x00, 0x00, 0x48, 0x89, 0xDC, 0xF3, 0x0F, 0x6F, 0x04, 0x24, 0xF3, 0x0F, 0x6F, 0x4C, 0x24, 0x10,
+    0xF3, 0x0F, 0x6F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x6F, 0x5C, 0x24, 0x30, 0xF3, 0x0F, 0x6F, 0x64, 0x24, 0x40, 0xF3,
+    0x0F, 0x6F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x6F, 0x74, 0x24, 0x60, 0xF3, 0x0F, 0x6F, 0x7C, 0x24, 0x70, 0xF3, 0x44,
+    0x0F, 0x6F, 0x84, 0x24, 0x80, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0x8C, 0x24, 0x90, 0x00, 0x00, 0x00, 0xF3,
+    0x44, 0x0F, 0x6F, 0x94, 0x24, 0xA0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0x9C, 0x24, 0xB0, 0x00, 0x00, 0x00,
+    0xF3, 0x44, 0x0F, 0x6F, 0xA4, 0x24, 0xC0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xAC, 0x24, 0xD0, 0x00, 0x00,
+    0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xB4, 0x24, 0xE0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xBC, 0x24, 0xF0, 0x00,
+    0x00, 0x00, 0x48, 0x81, 0xC4, 0x00, 0x01, 0x00, 0x00, 0x9D, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x41,
+    0x5B, 0x41, 0x5A, 0x41, 0x59, 0x41, 0x58, 0x5F, 0x5E, 0x5A, 0x59, 0x5B, 0x58, 0x5D, 0x48, 0x8D, 0x64, 0x24, 0x08,
+    0x5C, 0xC3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+#elif SAFETYHOOK_OS_LINUX
+constexpr std::array<uint8_t, 391> asm_data = {0xFF, 0x35, 0x79, 0x01, 0x00, 0x00, 0x54, 0x54, 0x55, 0x50, 0x53, 0x51,
+    0x52, 0x56, 0x57, 0x41, 0x50, 0x41, 0x51, 0x41, 0x52, 0x41, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57,
+    0x9C, 0x48, 0x81, 0xEC, 0x00, 0x01, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0xBC, 0x24, 0xF0, 0x00, 0x00, 0x00, 0xF3,
+    0x44, 0x0F, 0x7F, 0xB4, 0x24, 0xE0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0xAC, 0x24, 0xD0, 0x00, 0x00, 0x00,
+    0xF3, 0x44, 0x0F, 0x7F, 0xA4, 0x24, 0xC0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x9C, 0x24, 0xB0, 0x00, 0x00,
+    0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x94, 0x24, 0xA0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x8C, 0x24, 0x90, 0x00,
+    0x00, 0x00, 0xF3, 0x44, 0x0F, 0x7F, 0x84, 0x24, 0x80, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x7F, 0x7C, 0x24, 0x70, 0xF3,
+    0x0F, 0x7F, 0x74, 0x24, 0x60, 0xF3, 0x0F, 0x7F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x7F, 0x64, 0x24, 0x40, 0xF3, 0x0F,
+    0x7F, 0x5C, 0x24, 0x30, 0xF3, 0x0F, 0x7F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x7F, 0x4C, 0x24, 0x10, 0xF3, 0x0F, 0x7F,
+    0x04, 0x24, 0x48, 0x8B, 0xBC, 0x24, 0x80, 0x01, 0x00, 0x00, 0x48, 0x83, 0xC7, 0x10, 0x48, 0x89, 0xBC, 0x24, 0x80,
+    0x01, 0x00, 0x00, 0x48, 0x8D, 0x3C, 0x24, 0x48, 0x89, 0xE3, 0x48, 0x83, 0xEC, 0x30, 0x48, 0x83, 0xE4, 0xF0, 0xFF,
+    0x15, 0xA8, 0x00, 0x00, 0x00, 0x48, 0x89, 0xDC, 0xF3, 0x0F, 0x6F, 0x04, 0x24, 0xF3, 0x0F, 0x6F, 0x4C, 0x24, 0x10,
+    0xF3, 0x0F, 0x6F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x6F, 0x5C, 0x24, 0x30, 0xF3, 0x0F, 0x6F, 0x64, 0x24, 0x40, 0xF3,
+    0x0F, 0x6F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x6F, 0x74, 0x24, 0x60, 0xF3, 0x0F, 0x6F, 0x7C, 0x24, 0x70, 0xF3, 0x44,
+    0x0F, 0x6F, 0x84, 0x24, 0x80, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0x8C, 0x24, 0x90, 0x00, 0x00, 0x00, 0xF3,
+    0x44, 0x0F, 0x6F, 0x94, 0x24, 0xA0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0x9C, 0x24, 0xB0, 0x00, 0x00, 0x00,
+    0xF3, 0x44, 0x0F, 0x6F, 0xA4, 0x24, 0xC0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xAC, 0x24, 0xD0, 0x00, 0x00,
+    0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xB4, 0x24, 0xE0, 0x00, 0x00, 0x00, 0xF3, 0x44, 0x0F, 0x6F, 0xBC, 0x24, 0xF0, 0x00,
+    0x00, 0x00, 0x48, 0x81, 0xC4, 0x00, 0x01, 0x00, 0x00, 0x9D, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x41,
+    0x5B, 0x41, 0x5A, 0x41, 0x59, 0x41, 0x58, 0x5F, 0x5E, 0x5A, 0x59, 0x5B, 0x58, 0x5D, 0x48, 0x8D, 0x64, 0x24, 0x08,
+    0x5C, 0xC3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+#endif
+#elif SAFETYHOOK_ARCH_X86_32
+constexpr std::array<uint8_t, 171> asm_data = {0xFF, 0x35, 0xA7, 0x00, 0x00, 0x00, 0x54, 0x54, 0x55, 0x50, 0x53, 0x51,
+    0x52, 0x56, 0x57, 0x9C, 0x81, 0xEC, 0x80, 0x00, 0x00, 0x00, 0xF3, 0x0F, 0x7F, 0x7C, 0x24, 0x70, 0xF3, 0x0F, 0x7F,
+    0x74, 0x24, 0x60, 0xF3, 0x0F, 0x7F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x7F, 0x64, 0x24, 0x40, 0xF3, 0x0F, 0x7F, 0x5C,
+    0x24, 0x30, 0xF3, 0x0F, 0x7F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x7F, 0x4C, 0x24, 0x10, 0xF3, 0x0F, 0x7F, 0x04, 0x24,
+    0x8B, 0x8C, 0x24, 0xA0, 0x00, 0x00, 0x00, 0x83, 0xC1, 0x08, 0x89, 0x8C, 0x24, 0xA0, 0x00, 0x00, 0x00, 0x54, 0xFF,
+    0x15, 0xA3, 0x00, 0x00, 0x00, 0x83, 0xC4, 0x04, 0xF3, 0x0F, 0x6F, 0x04, 0x24, 0xF3, 0x0F, 0x6F, 0x4C, 0x24, 0x10,
+    0xF3, 0x0F, 0x6F, 0x54, 0x24, 0x20, 0xF3, 0x0F, 0x6F, 0x5C, 0x24, 0x30, 0xF3, 0x0F, 0x6F, 0x64, 0x24, 0x40, 0xF3,
+    0x0F, 0x6F, 0x6C, 0x24, 0x50, 0xF3, 0x0F, 0x6F, 0x74, 0x24, 0x60, 0xF3, 0x0F, 0x6F, 0x7C, 0x24, 0x70, 0x81, 0xC4,
+    0x80, 0x00, 0x00, 0x00, 0x9D, 0x5F, 0x5E, 0x5A, 0x59, 0x5B, 0x58, 0x5D, 0x8D, 0x64, 0x24, 0x04, 0x5C, 0xC3, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+#endif
+
+std::expected<MidHook, MidHook::Error> MidHook::create(void* target, MidHookFn destination, Flags flags) {
+    return create(Allocator::global(), target, destination, flags);
+}
+
+std::expected<MidHook, MidHook::Error> MidHook::create(
+    const std::shared_ptr<Allocator>& allocator, void* target, MidHookFn destination, Flags flags) {
+    MidHook hook{};
+
+    if (const auto setup_result = hook.setup(allocator, reinterpret_cast<uint8_t*>(target), destination);
+        !setup_result) {
+        return std::unexpected{setup_result.error()};
+    }
+
+    if (!(flags & StartDisabled)) {
+        if (auto enable_result = hook.enable(); !enable_result) {
+            return std::unexpected{enable_result.error()};
+        }
+    }
+
+    return hook;
+}
+
+MidHook::MidHook(MidHook&& other) noexcept {
+    *this = std::move(other);
+}
+
+MidHook::~MidHook() {
+    // The inline hook stays patched to the stub when it is leaked, so the stub has to stay as well.
+    if (leak_on_destroy()) {
+        m_stub.leak();
+    }
+}
+
+MidHook& MidHook::operator=(MidHook&& other) noexcept {
+    if (this != &other) {
+        if (leak_on_destroy()) {
+            m_stub.leak();
+        }
+
+        m_hook = std::move(other.m_hook);
+        m_target = other.m_target;
+        m_stub = std::move(other.m_stub);
+        m_destination = other.m_destination;
+
+        other.m_target = 0;
+        other.m_destination = nullptr;
+    }
+
+    return *this;
+}
+
+void MidHook::reset() {
+    *this = {};
+}
+
+std::expected<void, MidHook::Error> MidHook::setup(
+    const std::shared_ptr<Allocator>& allocator, uint8_t* target, MidHookFn destination_fn) {
+    m_target = target;
+    m_destination = destination_fn;
+
+    auto stub_allocation = allocator->allocate(asm_data.size());
+
+    if (!stub_allocation) {
+        return std::unexpected{Error::bad_allocation(stub_allocation.error())};
+    }
+
+    m_stub = std::move(*stub_allocation);
+
+    std::copy(asm_data.begin(), asm_data.end(), m_stub.data());
+
+#if SAFETYHOOK_ARCH_X86_64
+    store(m_stub.data() + sizeof(asm_data) - 16, m_destination);
+#elif SAFETYHOOK_ARCH_X86_32
+    store(m_stub.data() + sizeof(asm_data) - 8, m_destination);
+
+    // 32-bit has some relocations we need to fix up as well.
+    store(m_stub.data() + 0x02, m_stub.data() + m_stub.size() - 4);
+    store(m_stub.data() + 0x59, m_stub.data() + m_stub.size() - 8);
+#endif
+
+    auto hook_result = InlineHook::create(allocator, m_target, m_stub.data(), InlineHook::StartDisabled);
+
+    if (!hook_result) {
+        m_stub.free();
+        return std::unexpected{Error::bad_inline_hook(hook_result.error())};
+    }
+
+    m_hook = std::move(*hook_result);
+
+#if SAFETYHOOK_ARCH_X86_64
+    store(m_stub.data() + sizeof(asm_data) - 8, m_hook.trampoline().data());
+#elif SAFETYHOOK_ARCH_X86_32
+    store(m_stub.data() + sizeof(asm_data) - 4, m_hook.trampoline().data());
+#endif
+
+    return {};
+}
+
+std::expected<void, MidHook::Error> MidHook::enable() {
+    if (auto enable_result = m_hook.enable(); !enable_result) {
+        return std::unexpected{Error::bad_inline_hook(enable_result.error())};
+    }
+
+    return {};
+}
+
+std::expected<void, MidHook::Error> MidHook::disable() {
+    if (auto disable_result = m_hook.disable(); !disable_result) {
+        return std::unexpected{Error::bad_inline_hook(disable_result.error())};
+    }
+
+    return {};
+}
+} // namespace safetyhook
+
+//
+// Source file: os.linux.cpp
+//
+
+
+#if SAFETYHOOK_OS_LINUX
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+
+namespace safetyhook {
+std::expected<uint8_t*, OsError> vm_allocate(uint8_t* address, size_t size, VmAccess access) {
+    int prot = 0;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    if (access == VM_ACCESS_R) {
+        prot = PROT_READ;
+    } else if (access == VM_ACCESS_RW) {
+        prot = PROT_READ | PROT_WRITE;
+    } else if (access == VM_ACCESS_RX) {
+        prot = PROT_READ | PROT_EXEC;
+    } else if (access == VM_ACCESS_RWX) {
+        prot = PROT_READ | PROT_WRITE | PROT_EXEC;
+    } else {
+        return std::unexpected{OsError::FAILED_TO_ALLOCATE};
+    }
+
+    auto* result = mmap(address, size, prot, flags, -1, 0);
+
+    if (result == MAP_FAILED) {
+        return std::unexpected{OsError::FAILED_TO_ALLOCATE};
+    }
+
+    return static_cast<uint8_t*>(result);
+}
+
+void vm_free(uint8_t* address, size_t size) {
+    munmap(address, size);
+}
+
+std::expected<uint32_t, OsError> vm_protect(uint8_t* address, size_t size, VmAccess access) {
+    int prot = 0;
+
+    if (access == VM_ACCESS_R) {
+        prot = PROT_READ;
+    } else if (access == VM_ACCESS_RW) {
+        prot = PROT_READ | PROT_WRITE;
+    } else if (access == VM_ACCESS_RX) {
+        prot = PROT_READ | PROT_EXEC;
+    } else if (access == VM_ACCESS_RWX) {
+        prot = PROT_READ | PROT_WRITE | PROT_EXEC;
+    } else {
+        return std::unexpected{OsError::FAILED_TO_PROTECT};
+    }
+
+    return vm_protect(address, size, prot);
+}
+
+std::expected<uint32_t, OsError> vm_protect(uint8_t* address, size_t size, uint32_t protect) {
+    auto mbi = vm_query(address);
+
+    if (!mbi.has_value()) {
+        return std::unexpected{OsError::FAILED_TO_PROTECT};
+    }
+
+    uint32_t old_protect = 0;
+
+    if (mbi->access.read) {
+        old_protect |= PROT_READ;
+    }
+
+    if (mbi->access.write) {
+        old_protect |= PROT_WRITE;
+    }
+
+    if (mbi->access.execute) {
+        old_protect |= PROT_EXEC;
+    }
+
+    auto* addr = align_down(address, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+
+    if (mprotect(addr, size, static_cast<int>(protect)) == -1) {
+        return std::unexpected{OsError::FAILED_TO_PROTECT};
+    }
+
+    return old_protect;
+}
+
+std::expected<VmBasicInfo, OsError> vm_query(uint8_t* address) {
+    auto* maps = fopen("/proc/self/maps", "r");
+
+    if (maps == nullptr) {
+        return std::unexpected{OsError::FAILED_TO_QUERY};
+    }
+
+    char line[512];
+    unsigned long start;
+    unsigned long end;
+    char perms[5];
+    unsigned long offset;
+    int dev_major;
+    int dev_minor;
+    unsigned long inode;
+    char path[256];
+    unsigned long last_end =
+        reinterpret_cast<unsigned long>(system_info().min_address); // Track the end address of the last mapping.
+    auto addr = reinterpret_cast<unsigned long>(address);
+    std::optional<VmBasicInfo> info = std::nullopt;
 
     while (fgets(line, sizeof(line), maps) != nullptr) {
         path[0] = '\0';
 
-        sscanf(line, "%lx-%lx %4s %lx %x:%x %lu %255[^\n]", &start, &end, perms, &offset, &dev_major, &dev_minor,
-            &inode, path);
+        sscanf(line, "%lx-%lx %4s %lx %x:%x %lu %255[^\n]", &start, &end, perms, &offset, &dev_major, &dev_minor,
+            &inode, path);
+
+        if (last_end < start && addr >= last_end && addr < start) {
+            info = std::make_optional<VmBasicInfo>(
+                {reinterpret_cast<uint8_t*>(last_end), start - last_end, VmAccess{}, true});
+
+            break;
+        }
+
+        last_end = end;
+
+        if (addr >= start && addr < end) {
+            info = std::make_optional<VmBasicInfo>({reinterpret_cast<uint8_t*>(start), end - start, VmAccess{}, false});
+
+            if (perms[0] == 'r') {
+                info->access.read = true;
+            }
+
+            if (perms[1] == 'w') {
+                info->access.write = true;
+            }
+
+            if (perms[2] == 'x') {
+                info->access.execute = true;
+            }
+
+            break;
+        }
+    }
+
+    fclose(maps);
+
+    if (!info.has_value()) {
+        return std::unexpected{OsError::FAILED_TO_QUERY};
+    }
+
+    return info.value();
+}
+
+bool vm_is_readable(uint8_t* address, [[maybe_unused]] size_t size) {
+    return vm_query(address).value_or(VmBasicInfo{}).access.read;
+}
+
+bool vm_is_writable(uint8_t* address, [[maybe_unused]] size_t size) {
+    return vm_query(address).value_or(VmBasicInfo{}).access.write;
+}
+
+bool vm_is_executable(uint8_t* address) {
+    return vm_query(address).value_or(VmBasicInfo{}).access.execute;
+}
+
+SystemInfo system_info() {
+    auto page_size = static_cast<uint32_t>(sysconf(_SC_PAGESIZE));
+
+    SystemInfo info{};
+    info.page_size = page_size;
+    info.allocation_granularity = page_size;
+    info.min_address = reinterpret_cast<uint8_t*>(0x10000);
+    info.max_address = reinterpret_cast<uint8_t*>(1ull << 47);
+
+    return info;
+}
+
+void trap_threads([[maybe_unused]] uint8_t* from, [[maybe_unused]] uint8_t* to, [[maybe_unused]] size_t len,
+    const std::function<void()>& run_fn) {
+    auto from_protect = vm_protect(from, len, VM_ACCESS_RWX).value_or(0);
+    auto to_protect = vm_protect(to, len, VM_ACCESS_RWX).value_or(0);
+    run_fn();
+    vm_protect(to, len, to_protect);
+    vm_protect(from, len, from_protect);
+}
+
+void fix_ip([[maybe_unused]] ThreadContext ctx, [[maybe_unused]] uint8_t* old_ip, [[maybe_unused]] uint8_t* new_ip) {
+}
+
+// Calls fn with the dl_phdr_info of the module containing address. Returns false if there is none.
+template <typename Fn> static bool with_module(uint8_t* address, Fn&& fn) {
+    struct Search {
+        uintptr_t address;
+        Fn& fn;
+        bool found;
+    } search{reinterpret_cast<uintptr_t>(address), fn, false};
+
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, size_t, void* data) {
+            auto& search = *static_cast<Search*>(data);
+
+            for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+                const auto& phdr = info->dlpi_phdr[i];
+                const auto start = static_cast<uintptr_t>(info->dlpi_addr + phdr.p_vaddr);
+
+                if (phdr.p_type == PT_LOAD && search.address >= start && search.address < start + phdr.p_memsz) {
+                    search.fn(info);
+                    search.found = true;
+                    return 1;
+                }
+            }
+
+            return 0;
+        },
+        &search);
+
+    return search.found;
+}
+
+static std::atomic<bool> g_exit_started{};
+
+bool process_is_exiting() {
+    return g_exit_started.load(std::memory_order_relaxed);
+}
+
+void watch_process_exit() {
+    // A handler registered from a shared library also runs when the library is unloaded with dlclose, which is not
+    // an exit, so it is only registered when safetyhook is linked into the executable.
+    static const auto registered = [] {
+        auto in_executable = false;
+
+        with_module(reinterpret_cast<uint8_t*>(&watch_process_exit), [&in_executable](const dl_phdr_info* info) {
+            in_executable = info->dlpi_name == nullptr || info->dlpi_name[0] == '\0';
+        });
+
+        return in_executable && std::atexit([] { g_exit_started.store(true, std::memory_order_relaxed); }) == 0;
+    }();
+
+    (void)registered;
+}
+
+std::expected<ModuleInfo, OsError> module_info(uint8_t* address) {
+    std::optional<ModuleInfo> result{};
+
+    with_module(address, [&result](const dl_phdr_info* info) {
+        // Hash the GNU build ID note down to 64 bits (FNV-1a).
+        for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+            const auto& phdr = info->dlpi_phdr[i];
+
+            if (phdr.p_type != PT_NOTE) {
+                continue;
+            }
+
+            auto note = reinterpret_cast<const uint8_t*>(info->dlpi_addr + phdr.p_vaddr);
+            const auto end = note + phdr.p_memsz;
+
+            while (note + sizeof(ElfW(Nhdr)) <= end) {
+                const auto* nhdr = reinterpret_cast<const ElfW(Nhdr)*>(note);
+                const auto name = note + sizeof(ElfW(Nhdr));
+                const auto desc = name + align_up(nhdr->n_namesz, 4);
+
+                if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && desc + nhdr->n_descsz <= end) {
+                    uint64_t hash = 0xCBF29CE484222325;
+
+                    for (auto p = desc; p < desc + nhdr->n_descsz; ++p) {
+                        hash = (hash ^ *p) * 0x100000001B3;
+                    }
+
+                    result = ModuleInfo{reinterpret_cast<uint8_t*>(info->dlpi_addr), hash};
+                    return;
+                }
+
+                note = desc + align_up(nhdr->n_descsz, 4);
+            }
+        }
+    });
+
+    if (!result) {
+        return std::unexpected{OsError::FAILED_TO_QUERY};
+    }
+
+    return *result;
+}
+
+std::expected<std::vector<std::span<uint8_t>>, OsError> module_executable_sections(uint8_t* address) {
+    std::vector<std::span<uint8_t>> sections{};
+
+    const auto found = with_module(address, [&sections](const dl_phdr_info* info) {
+        for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+            const auto& phdr = info->dlpi_phdr[i];
+
+            if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_X) != 0) {
+                sections.emplace_back(reinterpret_cast<uint8_t*>(info->dlpi_addr + phdr.p_vaddr), phdr.p_memsz);
+            }
+        }
+    });
+
+    if (!found) {
+        return std::unexpected{OsError::FAILED_TO_QUERY};
+    }
+
+    return sections;
+}
+
+} // namespace safetyhook
+
+#endif
+
+//
+// Source file: os.windows.cpp
+//
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+
+#if SAFETYHOOK_OS_WINDOWS
+
+#define NOMINMAX
+#if __has_include(<Windows.h>)
+#include <Windows.h>
+#elif __has_include(<windows.h>)
+#include <windows.h>
+#else
+#error "Windows.h not found"
+#endif
+
+
+namespace safetyhook {
+std::expected<uint8_t*, OsError> vm_allocate(uint8_t* address, size_t size, VmAccess access) {
+    DWORD protect = 0;
+
+    if (access == VM_ACCESS_R) {
+        protect = PAGE_READONLY;
+    } else if (access == VM_ACCESS_RW) {
+        protect = PAGE_READWRITE;
+    } else if (access == VM_ACCESS_RX) {
+        protect = PAGE_EXECUTE_READ;
+    } else if (access == VM_ACCESS_RWX) {
+        protect = PAGE_EXECUTE_READWRITE;
+    } else {
+        return std::unexpected{OsError::FAILED_TO_ALLOCATE};
+    }
+
+    auto* result = VirtualAlloc(address, size, MEM_COMMIT | MEM_RESERVE, protect);
+
+    if (result == nullptr) {
+        return std::unexpected{OsError::FAILED_TO_ALLOCATE};
+    }
+
+    return static_cast<uint8_t*>(result);
+}
+
+void vm_free(uint8_t* address, [[maybe_unused]] size_t size) {
+    // MEM_RELEASE always releases the whole reservation and requires a size of 0.
+    VirtualFree(address, 0, MEM_RELEASE);
+}
+
+std::expected<uint32_t, OsError> vm_protect(uint8_t* address, size_t size, VmAccess access) {
+    DWORD protect = 0;
+
+    if (access == VM_ACCESS_R) {
+        protect = PAGE_READONLY;
+    } else if (access == VM_ACCESS_RW) {
+        protect = PAGE_READWRITE;
+    } else if (access == VM_ACCESS_RX) {
+        protect = PAGE_EXECUTE_READ;
+    } else if (access == VM_ACCESS_RWX) {
+        protect = PAGE_EXECUTE_READWRITE;
+    } else {
+        return std::unexpected{OsError::FAILED_TO_PROTECT};
+    }
+
+    return vm_protect(address, size, protect);
+}
+
+std::expected<uint32_t, OsError> vm_protect(uint8_t* address, size_t size, uint32_t protect) {
+    DWORD old_protect = 0;
+
+    if (VirtualProtect(address, size, protect, &old_protect) == FALSE) {
+        return std::unexpected{OsError::FAILED_TO_PROTECT};
+    }
+
+    return old_protect;
+}
+
+std::expected<VmBasicInfo, OsError> vm_query(uint8_t* address) {
+    MEMORY_BASIC_INFORMATION mbi{};
+    auto result = VirtualQuery(address, &mbi, sizeof(mbi));
+
+    if (result == 0) {
+        return std::unexpected{OsError::FAILED_TO_QUERY};
+    }
+
+    VmAccess access{};
+    access.read = (mbi.Protect & (PAGE_READONLY | PAGE_READWRITE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE)) != 0;
+    access.write = (mbi.Protect & (PAGE_READWRITE | PAGE_EXECUTE_READWRITE)) != 0;
+    access.execute = (mbi.Protect & (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE)) != 0;
 
-        if (last_end < start && addr >= last_end && addr < start) {
-            info = std::make_optional<VmBasicInfo>(
-                {reinterpret_cast<uint8_t*>(last_end), start - last_end, VmAccess{}, true});
+    VmBasicInfo info{};
+    info.address = static_cast<uint8_t*>(mbi.AllocationBase);
+    info.size = mbi.RegionSize;
+    info.access = access;
+    info.is_free = mbi.State == MEM_FREE;
 
-            break;
+    return info;
+}
+
+bool vm_is_readable(uint8_t* address, size_t size) {
+    return IsBadReadPtr(address, size) == FALSE;
+}
+
+bool vm_is_writable(uint8_t* address, size_t size) {
+    return IsBadWritePtr(address, size) == FALSE;
+}
+
+bool vm_is_executable(uint8_t* address) {
+    // Check if the address is in a valid module allowing us to potentially skip a heavier memory query.
+    HMODULE image{};
+    if (!GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+            reinterpret_cast<LPTSTR>(address), &image) ||
+        image == nullptr) {
+        return vm_query(address).value_or(VmBasicInfo{}).access.execute;
+    }
+
+    // Just check if the section is executable.
+    const auto* image_base = reinterpret_cast<uint8_t*>(image);
+    const auto* dos_hdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(image_base);
+
+    if (dos_hdr->e_magic != IMAGE_DOS_SIGNATURE) {
+        return vm_query(address).value_or(VmBasicInfo{}).access.execute;
+    }
+
+    const auto* nt_hdr = reinterpret_cast<const IMAGE_NT_HEADERS*>(image_base + dos_hdr->e_lfanew);
+
+    if (nt_hdr->Signature != IMAGE_NT_SIGNATURE) {
+        return vm_query(address).value_or(VmBasicInfo{}).access.execute;
+    }
+
+    const auto* section = IMAGE_FIRST_SECTION(nt_hdr);
+
+    for (auto i = 0; i < nt_hdr->FileHeader.NumberOfSections; ++i, ++section) {
+        if (address >= image_base + section->VirtualAddress &&
+            address < image_base + section->VirtualAddress + section->Misc.VirtualSize) {
+            return (section->Characteristics & IMAGE_SCN_MEM_EXECUTE) != 0;
         }
+    }
 
-        last_end = end;
+    return vm_query(address).value_or(VmBasicInfo{}).access.execute;
+}
 
-        if (addr >= start && addr < end) {
-            info = std::make_optional<VmBasicInfo>({reinterpret_cast<uint8_t*>(start), end - start, VmAccess{}, false});
+SystemInfo system_info() {
+    SystemInfo info{};
 
-            if (perms[0] == 'r') {
-                info->access.read = true;
-            }
+    SYSTEM_INFO si{};
+    GetSystemInfo(&si);
 
-            if (perms[1] == 'w') {
-                info->access.write = true;
-            }
+    info.page_size = si.dwPageSize;
+    info.allocation_granularity = si.dwAllocationGranularity;
+    info.min_address = static_cast<uint8_t*>(si.lpMinimumApplicationAddress);
+    info.max_address = static_cast<uint8_t*>(si.lpMaximumApplicationAddress);
 
-            if (perms[2] == 'x') {
-                info->access.execute = true;
+    return info;
+}
+
+struct TrapInfo {
+    uint8_t* from_page_start;
+    uint8_t* from_page_end;
+    uint8_t* from;
+    uint8_t* to_page_start;
+    uint8_t* to_page_end;
+    uint8_t* to;
+    size_t len;
+};
+
+class TrapManager final {
+public:
+    static std::mutex mutex;
+    static std::unique_ptr<TrapManager> instance;
+    static bool is_destructed;
+
+    TrapManager() { m_trap_veh = AddVectoredExceptionHandler(1, trap_handler); }
+    ~TrapManager() {
+        if (m_trap_veh != nullptr) {
+            RemoveVectoredExceptionHandler(m_trap_veh);
+        }
+        is_destructed = true;
+    }
+
+    TrapInfo* find_trap(uint8_t* address) {
+        auto search = std::find_if(m_traps.begin(), m_traps.end(), [address](auto& trap) {
+            return address >= trap.second.from && address < trap.second.from + trap.second.len;
+        });
+
+        if (search == m_traps.end()) {
+            return nullptr;
+        }
+
+        return &search->second;
+    }
+
+    TrapInfo* find_trap_page(uint8_t* address) {
+        auto search = std::find_if(m_traps.begin(), m_traps.end(), [address](auto& trap) {
+            return address >= trap.second.from_page_start && address < trap.second.from_page_end;
+        });
+
+        if (search != m_traps.end()) {
+            return &search->second;
+        }
+
+        search = std::find_if(m_traps.begin(), m_traps.end(), [address](auto& trap) {
+            return address >= trap.second.to_page_start && address < trap.second.to_page_end;
+        });
+
+        if (search != m_traps.end()) {
+            return &search->second;
+        }
+
+        return nullptr;
+    }
+
+    void add_trap(uint8_t* from, uint8_t* to, size_t len) {
+        TrapInfo info{};
+        info.from_page_start = align_down(from, 0x1000);
+        info.from_page_end = align_up(from + len, 0x1000);
+        info.from = from;
+        info.to_page_start = align_down(to, 0x1000);
+        info.to_page_end = align_up(to + len, 0x1000);
+        info.to = to;
+        info.len = len;
+
+        m_traps.insert_or_assign(from, std::move(info));
+    }
+
+private:
+    std::map<uint8_t*, TrapInfo> m_traps;
+    PVOID m_trap_veh{};
+
+    static LONG CALLBACK trap_handler(PEXCEPTION_POINTERS exp) {
+        auto exception_code = exp->ExceptionRecord->ExceptionCode;
+
+        if (exception_code != EXCEPTION_ACCESS_VIOLATION) {
+            return EXCEPTION_CONTINUE_SEARCH;
+        }
+
+        std::scoped_lock lock{mutex};
+        auto* faulting_address = reinterpret_cast<uint8_t*>(exp->ExceptionRecord->ExceptionInformation[1]);
+        auto* trap = instance->find_trap(faulting_address);
+
+        if (trap == nullptr) {
+            if (instance->find_trap_page(faulting_address) != nullptr) {
+                return EXCEPTION_CONTINUE_EXECUTION;
+            } else {
+                return EXCEPTION_CONTINUE_SEARCH;
             }
+        }
+
+        auto* ctx = exp->ContextRecord;
+
+        for (size_t i = 0; i < trap->len; i++) {
+            fix_ip(ctx, trap->from + i, trap->to + i);
+        }
+
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+};
+
+std::mutex TrapManager::mutex;
+std::unique_ptr<TrapManager> TrapManager::instance;
+bool TrapManager::is_destructed = false;
+
+void find_me() {
+}
+
+static std::mutex virtual_protect_mutex;
+
+void trap_threads(uint8_t* from, uint8_t* to, size_t len, const std::function<void()>& run_fn) {
+    MEMORY_BASIC_INFORMATION find_me_mbi{};
+    MEMORY_BASIC_INFORMATION from_mbi{};
+    MEMORY_BASIC_INFORMATION to_mbi{};
+
+    VirtualQuery(reinterpret_cast<void*>(find_me), &find_me_mbi, sizeof(find_me_mbi));
+    VirtualQuery(from, &from_mbi, sizeof(from_mbi));
+    VirtualQuery(to, &to_mbi, sizeof(to_mbi));
+
+    auto new_protect = PAGE_READWRITE;
+
+    if (from_mbi.AllocationBase == find_me_mbi.AllocationBase || to_mbi.AllocationBase == find_me_mbi.AllocationBase) {
+        new_protect = PAGE_EXECUTE_READWRITE;
+    }
+
+    auto si = system_info();
+    auto* from_page_start = align_down(from, si.page_size);
+    auto* from_page_end = align_up(from + len, si.page_size);
+    auto* vp_start = reinterpret_cast<uint8_t*>(&VirtualProtect);
+    auto* vp_end = vp_start + 0x20;
+
+    if (!(from_page_end < vp_start || vp_end < from_page_start)) {
+        new_protect = PAGE_EXECUTE_READWRITE;
+    }
+
+    if (!TrapManager::is_destructed) {
+        std::scoped_lock lock{TrapManager::mutex};
+
+        if (TrapManager::instance == nullptr) {
+            TrapManager::instance = std::make_unique<TrapManager>();
+        }
+
+        TrapManager::instance->add_trap(from, to, len);
+    }
+
+    // Make sure we aren't working on a different address in the same memory page on a different thread.
+    std::scoped_lock vp_lock{virtual_protect_mutex};
+
+    DWORD from_protect;
+    DWORD to_protect;
+
+    VirtualProtect(from, len, new_protect, &from_protect);
+    VirtualProtect(to, len, new_protect, &to_protect);
+
+    if (run_fn) {
+        run_fn();
+    }
+
+    VirtualProtect(to, len, to_protect, &to_protect);
+    VirtualProtect(from, len, from_protect, &from_protect);
+}
+
+// Returns the NT headers of the module containing address, or nullptr if there is none.
+static const IMAGE_NT_HEADERS* module_nt_headers(uint8_t* address, uint8_t*& image_base) {
+    HMODULE image{};
+    if (!GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+            reinterpret_cast<LPTSTR>(address), &image) ||
+        image == nullptr) {
+        return nullptr;
+    }
+
+    image_base = reinterpret_cast<uint8_t*>(image);
+    const auto* dos_hdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(image_base);
+
+    if (dos_hdr->e_magic != IMAGE_DOS_SIGNATURE) {
+        return nullptr;
+    }
+
+    const auto* nt_hdr = reinterpret_cast<const IMAGE_NT_HEADERS*>(image_base + dos_hdr->e_lfanew);
 
-            break;
-        }
+    if (nt_hdr->Signature != IMAGE_NT_SIGNATURE) {
+        return nullptr;
     }
 
-    fclose(maps);
+    return nt_hdr;
+}
 
-    if (!info.has_value()) {
+std::expected<ModuleInfo, OsError> module_info(uint8_t* address) {
+    uint8_t* image_base{};
+    const auto* nt_hdr = module_nt_headers(address, image_base);
+
+    if (nt_hdr == nullptr) {
         return std::unexpected{OsError::FAILED_TO_QUERY};
     }
 
-    return info.value();
-}
+    // Deterministic builds store a hash of the image in TimeDateStamp, so this still changes with every rebuild.
+    const auto build_id = (static_cast<uint64_t>(nt_hdr->FileHeader.TimeDateStamp) << 32) |
+                          nt_hdr->OptionalHeader.SizeOfImage;
 
-bool vm_is_readable(uint8_t* address, [[maybe_unused]] size_t size) {
-    return vm_query(address).value_or(VmBasicInfo{}).access.read;
+    return ModuleInfo{image_base, build_id};
 }
 
-bool vm_is_writable(uint8_t* address, [[maybe_unused]] size_t size) {
-    return vm_query(address).value_or(VmBasicInfo{}).access.write;
-}
+std::expected<std::vector<std::span<uint8_t>>, OsError> module_executable_sections(uint8_t* address) {
+    uint8_t* image_base{};
+    const auto* nt_hdr = module_nt_headers(address, image_base);
 
-bool vm_is_executable(uint8_t* address) {
-    return vm_query(address).value_or(VmBasicInfo{}).access.execute;
+    if (nt_hdr == nullptr) {
+        return std::unexpected{OsError::FAILED_TO_QUERY};
+    }
+
+    std::vector<std::span<uint8_t>> sections{};
+    const auto* section = IMAGE_FIRST_SECTION(nt_hdr);
+
+    for (auto i = 0; i < nt_hdr->FileHeader.NumberOfSections; ++i, ++section) {
+        if ((section->Characteristics & IMAGE_SCN_MEM_EXECUTE) != 0) {
+            sections.emplace_back(image_base + section->VirtualAddress, section->Misc.VirtualSize);
+        }
+    }
+
+    return sections;
 }
 
-SystemInfo system_info() {
-    auto page_size = static_cast<uint32_t>(sysconf(_SC_PAGESIZE));
+bool process_is_exiting() {
+    using RtlDllShutdownInProgressFn = BOOLEAN(NTAPI*)();
 
-    SystemInfo info{};
-    info.page_size = page_size;
-    info.allocation_granularity = page_size;
-    info.min_address = reinterpret_cast<uint8_t*>(0x10000);
-    info.max_address = reinterpret_cast<uint8_t*>(1ull << 47);
+    static const auto rtl_dll_shutdown_in_progress = reinterpret_cast<RtlDllShutdownInProgressFn>(
+        GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "RtlDllShutdownInProgress"));
 
-    return info;
+    return rtl_dll_shutdown_in_progress != nullptr && rtl_dll_shutdown_in_progress() != FALSE;
 }
 
-void trap_threads([[maybe_unused]] uint8_t* from, [[maybe_unused]] uint8_t* to, [[maybe_unused]] size_t len,
-    const std::function<void()>& run_fn) {
-    auto from_protect = vm_protect(from, len, VM_ACCESS_RWX).value_or(0);
-    auto to_protect = vm_protect(to, len, VM_ACCESS_RWX).value_or(0);
-    run_fn();
-    vm_protect(to, len, to_protect);
-    vm_protect(from, len, from_protect);
+void watch_process_exit() {
+    // The loader already knows, see process_is_exiting.
 }
 
-void fix_ip([[maybe_unused]] ThreadContext ctx, [[maybe_unused]] uint8_t* old_ip, [[maybe_unused]] uint8_t* new_ip) {
+void fix_ip(ThreadContext thread_ctx, uint8_t* old_ip, uint8_t* new_ip) {
+    auto* ctx = reinterpret_cast<CONTEXT*>(thread_ctx);
+
+#if SAFETYHOOK_ARCH_X86_64
+    auto ip = ctx->Rip;
+#elif SAFETYHOOK_ARCH_X86_32
+    auto ip = ctx->Eip;
+#endif
+
+    if (ip == reinterpret_cast<uintptr_t>(old_ip)) {
+        ip = reinterpret_cast<uintptr_t>(new_ip);
+    }
+
+#if SAFETYHOOK_ARCH_X86_64
+    ctx->Rip = ip;
+#elif SAFETYHOOK_ARCH_X86_32
+    ctx->Eip = ip;
+#endif
 }
 
 } // namespace safetyhook
@@ -1126,353 +2865,448 @@ void fix_ip([[maybe_unused]] ThreadContext ctx, [[maybe_unused]] uint8_t* old_ip
 #endif
 
 //
-// Source file: os.windows.cpp
+// Source file: scanner.cpp
 //
 
-#include <map>
-#include <memory>
-#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <thread>
+#include <vector>
 
+#if SAFETYHOOK_COMPILER_MSVC
+#include <intrin.h>
+#endif
 
-#if SAFETYHOOK_OS_WINDOWS
+#include <immintrin.h>
 
-#define NOMINMAX
-#if __has_include(<Windows.h>)
-#include <Windows.h>
-#elif __has_include(<windows.h>)
-#include <windows.h>
+
+
+#if SAFETYHOOK_COMPILER_MSVC
+#define SAFETYHOOK_TARGET_SSE2
+#define SAFETYHOOK_TARGET_AVX2
 #else
-#error "Windows.h not found"
+#define SAFETYHOOK_TARGET_SSE2 __attribute__((target("sse2")))
+#define SAFETYHOOK_TARGET_AVX2 __attribute__((target("avx2")))
 #endif
 
-
 namespace safetyhook {
-std::expected<uint8_t*, OsError> vm_allocate(uint8_t* address, size_t size, VmAccess access) {
-    DWORD protect = 0;
-
-    if (access == VM_ACCESS_R) {
-        protect = PAGE_READONLY;
-    } else if (access == VM_ACCESS_RW) {
-        protect = PAGE_READWRITE;
-    } else if (access == VM_ACCESS_RX) {
-        protect = PAGE_EXECUTE_READ;
-    } else if (access == VM_ACCESS_RWX) {
-        protect = PAGE_EXECUTE_READWRITE;
-    } else {
-        return std::unexpected{OsError::FAILED_TO_ALLOCATE};
-    }
+// Patterns sharing the same anchor bytes, so the anchors are compared once for all of them.
+struct AnchorGroup {
+    uint8_t first{};
+    uint8_t second{};
+    bool pair{};
+    std::vector<size_t> patterns{};
+};
 
-    auto* result = VirtualAlloc(address, size, MEM_COMMIT | MEM_RESERVE, protect);
+struct ScanContext {
+    std::span<const uint8_t> data{};
+    std::span<const Pattern> patterns{};
+    const std::vector<AnchorGroup>& groups;
+};
 
-    if (result == nullptr) {
-        return std::unexpected{OsError::FAILED_TO_ALLOCATE};
+// Bytes that are common in x86 code (opcodes, REX prefixes, ModRM/SIB of stack accesses, padding). Anchors avoid them
+// so that fewer candidates have to be verified.
+static bool is_common_code_byte(uint8_t byte) {
+    switch (byte) {
+    case 0x00:
+    case 0x01:
+    case 0x0F:
+    case 0x24:
+    case 0x41:
+    case 0x44:
+    case 0x45:
+    case 0x48:
+    case 0x49:
+    case 0x4C:
+    case 0x74:
+    case 0x75:
+    case 0x83:
+    case 0x84:
+    case 0x85:
+    case 0x89:
+    case 0x8B:
+    case 0x8D:
+    case 0x90:
+    case 0xC0:
+    case 0xC3:
+    case 0xCC:
+    case 0xE8:
+    case 0xEB:
+    case 0xFF:
+        return true;
+    default:
+        return false;
     }
-
-    return static_cast<uint8_t*>(result);
 }
 
-void vm_free(uint8_t* address) {
-    VirtualFree(address, 0, MEM_RELEASE);
-}
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
 
-std::expected<uint32_t, OsError> vm_protect(uint8_t* address, size_t size, VmAccess access) {
-    DWORD protect = 0;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
 
-    if (access == VM_ACCESS_R) {
-        protect = PAGE_READONLY;
-    } else if (access == VM_ACCESS_RW) {
-        protect = PAGE_READWRITE;
-    } else if (access == VM_ACCESS_RX) {
-        protect = PAGE_EXECUTE_READ;
-    } else if (access == VM_ACCESS_RWX) {
-        protect = PAGE_EXECUTE_READWRITE;
-    } else {
-        return std::unexpected{OsError::FAILED_TO_PROTECT};
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
     }
 
-    return vm_protect(address, size, protect);
+    return -1;
 }
 
-std::expected<uint32_t, OsError> vm_protect(uint8_t* address, size_t size, uint32_t protect) {
-    DWORD old_protect = 0;
+std::expected<Pattern, Pattern::Error> Pattern::parse(std::string_view text) {
+    Pattern pattern{};
 
-    if (VirtualProtect(address, size, protect, &old_protect) == FALSE) {
-        return std::unexpected{OsError::FAILED_TO_PROTECT};
-    }
+    while (!text.empty()) {
+        const auto token_start = text.find_first_not_of(" \t");
 
-    return old_protect;
-}
+        if (token_start == std::string_view::npos) {
+            break;
+        }
 
-std::expected<VmBasicInfo, OsError> vm_query(uint8_t* address) {
-    MEMORY_BASIC_INFORMATION mbi{};
-    auto result = VirtualQuery(address, &mbi, sizeof(mbi));
+        text.remove_prefix(token_start);
+        const auto token = text.substr(0, text.find_first_of(" \t"));
+        text.remove_prefix(token.size());
 
-    if (result == 0) {
-        return std::unexpected{OsError::FAILED_TO_QUERY};
-    }
+        if (token == "?" || token == "??") {
+            pattern.m_bytes.push_back(0);
+            pattern.m_mask.push_back(0);
+            continue;
+        }
 
-    VmAccess access{};
-    access.read = (mbi.Protect & (PAGE_READONLY | PAGE_READWRITE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE)) != 0;
-    access.write = (mbi.Protect & (PAGE_READWRITE | PAGE_EXECUTE_READWRITE)) != 0;
-    access.execute = (mbi.Protect & (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE)) != 0;
+        if (token.size() != 2 || hex_digit(token[0]) < 0 || hex_digit(token[1]) < 0) {
+            return std::unexpected{Error::BAD_TOKEN};
+        }
 
-    VmBasicInfo info{};
-    info.address = static_cast<uint8_t*>(mbi.AllocationBase);
-    info.size = mbi.RegionSize;
-    info.access = access;
-    info.is_free = mbi.State == MEM_FREE;
+        pattern.m_bytes.push_back(static_cast<uint8_t>(hex_digit(token[0]) << 4 | hex_digit(token[1])));
+        pattern.m_mask.push_back(0xFF);
+    }
 
-    return info;
-}
+    if (std::ranges::find(pattern.m_mask, 0xFF) == pattern.m_mask.end()) {
+        return std::unexpected{Error::NO_FIXED_BYTE};
+    }
 
-bool vm_is_readable(uint8_t* address, size_t size) {
-    return IsBadReadPtr(address, size) == FALSE;
-}
+    pattern.choose_anchor();
 
-bool vm_is_writable(uint8_t* address, size_t size) {
-    return IsBadWritePtr(address, size) == FALSE;
+    return pattern;
 }
 
-bool vm_is_executable(uint8_t* address) {
-    // Check if the address is in a valid module allowing us to potentially skip a heavier memory query.
-    HMODULE image{};
-    if (!GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
-            reinterpret_cast<LPTSTR>(address), &image) ||
-        image == nullptr) {
-        return vm_query(address).value_or(VmBasicInfo{}).access.execute;
-    }
-
-    // Just check if the section is executable.
-    const auto* image_base = reinterpret_cast<uint8_t*>(image);
-    const auto* dos_hdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(image_base);
+std::expected<Pattern, Pattern::Error> Pattern::create(std::span<const uint8_t> bytes, std::span<const uint8_t> mask) {
+    Pattern pattern{};
 
-    if (dos_hdr->e_magic != IMAGE_DOS_SIGNATURE) {
-        return vm_query(address).value_or(VmBasicInfo{}).access.execute;
+    for (size_t i = 0; i < bytes.size() && i < mask.size(); ++i) {
+        pattern.m_mask.push_back(mask[i] != 0 ? 0xFF : 0x00);
+        pattern.m_bytes.push_back(bytes[i] & pattern.m_mask.back());
     }
 
-    const auto* nt_hdr = reinterpret_cast<const IMAGE_NT_HEADERS*>(image_base + dos_hdr->e_lfanew);
-
-    if (nt_hdr->Signature != IMAGE_NT_SIGNATURE) {
-        return vm_query(address).value_or(VmBasicInfo{}).access.execute;
+    if (std::ranges::find(pattern.m_mask, 0xFF) == pattern.m_mask.end()) {
+        return std::unexpected{Error::NO_FIXED_BYTE};
     }
 
-    const auto* section = IMAGE_FIRST_SECTION(nt_hdr);
+    pattern.choose_anchor();
 
-    for (auto i = 0; i < nt_hdr->FileHeader.NumberOfSections; ++i, ++section) {
-        if (address >= image_base + section->VirtualAddress &&
-            address < image_base + section->VirtualAddress + section->Misc.VirtualSize) {
-            return (section->Characteristics & IMAGE_SCN_MEM_EXECUTE) != 0;
+    return pattern;
+}
+
+bool Pattern::matches(const uint8_t* address) const {
+    for (size_t i = 0; i < m_bytes.size(); ++i) {
+        if ((address[i] & m_mask[i]) != m_bytes[i]) {
+            return false;
         }
     }
 
-    return vm_query(address).value_or(VmBasicInfo{}).access.execute;
+    return true;
 }
 
-SystemInfo system_info() {
-    SystemInfo info{};
+void Pattern::choose_anchor() {
+    // Prefer a pair of adjacent fixed bytes, it filters far better than any single byte.
+    auto best_score = 3;
 
-    SYSTEM_INFO si{};
-    GetSystemInfo(&si);
+    for (size_t i = 0; i + 1 < m_bytes.size(); ++i) {
+        if (m_mask[i] == 0 || m_mask[i + 1] == 0) {
+            continue;
+        }
 
-    info.page_size = si.dwPageSize;
-    info.allocation_granularity = si.dwAllocationGranularity;
-    info.min_address = static_cast<uint8_t*>(si.lpMinimumApplicationAddress);
-    info.max_address = static_cast<uint8_t*>(si.lpMaximumApplicationAddress);
+        const auto score = static_cast<int>(is_common_code_byte(m_bytes[i])) +
+                           static_cast<int>(is_common_code_byte(m_bytes[i + 1]));
 
-    return info;
-}
+        if (score < best_score) {
+            best_score = score;
+            m_anchor = i;
+            m_anchor_pair = true;
+        }
+    }
 
-struct TrapInfo {
-    uint8_t* from_page_start;
-    uint8_t* from_page_end;
-    uint8_t* from;
-    uint8_t* to_page_start;
-    uint8_t* to_page_end;
-    uint8_t* to;
-    size_t len;
-};
+    if (m_anchor_pair) {
+        return;
+    }
 
-class TrapManager final {
-public:
-    static std::mutex mutex;
-    static std::unique_ptr<TrapManager> instance;
-    static bool is_destructed;
+    best_score = 2;
 
-    TrapManager() { m_trap_veh = AddVectoredExceptionHandler(1, trap_handler); }
-    ~TrapManager() {
-        if (m_trap_veh != nullptr) {
-            RemoveVectoredExceptionHandler(m_trap_veh);
+    for (size_t i = 0; i < m_bytes.size(); ++i) {
+        if (m_mask[i] == 0) {
+            continue;
+        }
+
+        const auto score = static_cast<int>(is_common_code_byte(m_bytes[i]));
+
+        if (score < best_score) {
+            best_score = score;
+            m_anchor = i;
         }
-        is_destructed = true;
     }
+}
 
-    TrapInfo* find_trap(uint8_t* address) {
-        auto search = std::find_if(m_traps.begin(), m_traps.end(), [address](auto& trap) {
-            return address >= trap.second.from && address < trap.second.from + trap.second.len;
+static std::vector<AnchorGroup> make_anchor_groups(std::span<const Pattern> patterns) {
+    std::vector<AnchorGroup> groups{};
+
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        const auto& pattern = patterns[i];
+        const auto first = pattern.bytes()[pattern.anchor()];
+        const auto pair = pattern.has_anchor_pair();
+        const uint8_t second = pair ? pattern.bytes()[pattern.anchor() + 1] : 0;
+
+        auto group = std::ranges::find_if(groups, [&](const AnchorGroup& group) {
+            return group.first == first && group.pair == pair && group.second == second;
         });
 
-        if (search == m_traps.end()) {
-            return nullptr;
+        if (group == groups.end()) {
+            group = groups.insert(groups.end(), AnchorGroup{first, second, pair, {}});
         }
 
-        return &search->second;
+        group->patterns.push_back(i);
     }
 
-    TrapInfo* find_trap_page(uint8_t* address) {
-        auto search = std::find_if(m_traps.begin(), m_traps.end(), [address](auto& trap) {
-            return address >= trap.second.from_page_start && address < trap.second.from_page_end;
-        });
+    return groups;
+}
 
-        if (search != m_traps.end()) {
-            return &search->second;
+// Verifies the patterns of a group whose anchor matched at position.
+static void verify_candidates(
+    const ScanContext& ctx, const AnchorGroup& group, size_t position, std::vector<ScanMatch>& matches) {
+    for (const auto index : group.patterns) {
+        const auto& pattern = ctx.patterns[index];
+
+        if (position < pattern.anchor()) {
+            continue;
         }
 
-        search = std::find_if(m_traps.begin(), m_traps.end(), [address](auto& trap) {
-            return address >= trap.second.to_page_start && address < trap.second.to_page_end;
-        });
+        const auto start = position - pattern.anchor();
 
-        if (search != m_traps.end()) {
-            return &search->second;
+        if (start + pattern.size() > ctx.data.size() || !pattern.matches(ctx.data.data() + start)) {
+            continue;
         }
 
-        return nullptr;
+        matches.push_back(ScanMatch{index, const_cast<uint8_t*>(ctx.data.data() + start)});
     }
+}
 
-    void add_trap(uint8_t* from, uint8_t* to, size_t len) {
-        TrapInfo info{};
-        info.from_page_start = align_down(from, 0x1000);
-        info.from_page_end = align_up(from + len, 0x1000);
-        info.from = from;
-        info.to_page_start = align_down(to, 0x1000);
-        info.to_page_end = align_up(to + len, 0x1000);
-        info.to = to;
-        info.len = len;
+static void scan_range_scalar(const ScanContext& ctx, size_t begin, size_t end, std::vector<ScanMatch>& matches) {
+    const auto* data = ctx.data.data();
+
+    for (auto position = begin; position < end; ++position) {
+        for (const auto& group : ctx.groups) {
+            if (data[position] != group.first) {
+                continue;
+            }
+
+            if (group.pair && (position + 1 >= ctx.data.size() || data[position + 1] != group.second)) {
+                continue;
+            }
 
-        m_traps.insert_or_assign(from, std::move(info));
+            verify_candidates(ctx, group, position, matches);
+        }
     }
+}
 
-private:
-    std::map<uint8_t*, TrapInfo> m_traps;
-    PVOID m_trap_veh{};
+SAFETYHOOK_TARGET_SSE2 static void scan_range_sse2(
+    const ScanContext& ctx, size_t begin, size_t end, std::vector<ScanMatch>& matches) {
+    const auto* data = ctx.data.data();
+    auto position = begin;
 
-    static LONG CALLBACK trap_handler(PEXCEPTION_POINTERS exp) {
-        auto exception_code = exp->ExceptionRecord->ExceptionCode;
+    // The second anchor byte is read one past the block.
+    for (; position + 16 <= end && position + 17 <= ctx.data.size(); position += 16) {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+        const auto next_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position + 1));
 
-        if (exception_code != EXCEPTION_ACCESS_VIOLATION) {
-            return EXCEPTION_CONTINUE_SEARCH;
-        }
+        for (const auto& group : ctx.groups) {
+            auto eq = _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(group.first)));
 
-        std::scoped_lock lock{mutex};
-        auto* faulting_address = reinterpret_cast<uint8_t*>(exp->ExceptionRecord->ExceptionInformation[1]);
-        auto* trap = instance->find_trap(faulting_address);
+            if (group.pair) {
+                eq = _mm_and_si128(eq, _mm_cmpeq_epi8(next_block, _mm_set1_epi8(static_cast<char>(group.second))));
+            }
 
-        if (trap == nullptr) {
-            if (instance->find_trap_page(faulting_address) != nullptr) {
-                return EXCEPTION_CONTINUE_EXECUTION;
-            } else {
-                return EXCEPTION_CONTINUE_SEARCH;
+            for (auto bits = static_cast<uint32_t>(_mm_movemask_epi8(eq)); bits != 0; bits &= bits - 1) {
+                verify_candidates(ctx, group, position + std::countr_zero(bits), matches);
             }
         }
+    }
 
-        auto* ctx = exp->ContextRecord;
+    scan_range_scalar(ctx, position, end, matches);
+}
 
-        for (size_t i = 0; i < trap->len; i++) {
-            fix_ip(ctx, trap->from + i, trap->to + i);
+SAFETYHOOK_TARGET_AVX2 static void scan_range_avx2(
+    const ScanContext& ctx, size_t begin, size_t end, std::vector<ScanMatch>& matches) {
+    const auto* data = ctx.data.data();
+    auto position = begin;
+
+    // The second anchor byte is read one past the block.
+    for (; position + 32 <= end && position + 33 <= ctx.data.size(); position += 32) {
+        const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position));
+        const auto next_block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position + 1));
+
+        for (const auto& group : ctx.groups) {
+            auto eq = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(static_cast<char>(group.first)));
+
+            if (group.pair) {
+                eq = _mm256_and_si256(
+                    eq, _mm256_cmpeq_epi8(next_block, _mm256_set1_epi8(static_cast<char>(group.second))));
+            }
+
+            for (auto bits = static_cast<uint32_t>(_mm256_movemask_epi8(eq)); bits != 0; bits &= bits - 1) {
+                verify_candidates(ctx, group, position + std::countr_zero(bits), matches);
+            }
         }
+    }
 
-        return EXCEPTION_CONTINUE_EXECUTION;
+    scan_range_scalar(ctx, position, end, matches);
+}
+
+using ScanRangeFn = void (*)(const ScanContext&, size_t, size_t, std::vector<ScanMatch>&);
+
+static ScanRangeFn select_scan_range() {
+#if SAFETYHOOK_COMPILER_MSVC
+    int info[4]{};
+    __cpuid(info, 0);
+    const auto max_leaf = info[0];
+
+    __cpuid(info, 1);
+    const auto has_sse2 = (info[3] & (1 << 26)) != 0;
+    const auto has_osxsave = (info[2] & (1 << 27)) != 0;
+    auto has_avx2 = false;
+
+    if (max_leaf >= 7 && has_osxsave && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        has_avx2 = (info[1] & (1 << 5)) != 0;
     }
-};
+#else
+    __builtin_cpu_init();
+    const auto has_sse2 = __builtin_cpu_supports("sse2") != 0;
+    const auto has_avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
 
-std::mutex TrapManager::mutex;
-std::unique_ptr<TrapManager> TrapManager::instance;
-bool TrapManager::is_destructed = false;
+    if (has_avx2) {
+        return scan_range_avx2;
+    }
 
-void find_me() {
-}
+    if (has_sse2) {
+        return scan_range_sse2;
+    }
 
-static std::mutex virtual_protect_mutex;
+    return scan_range_scalar;
+}
 
-void trap_threads(uint8_t* from, uint8_t* to, size_t len, const std::function<void()>& run_fn) {
-    MEMORY_BASIC_INFORMATION find_me_mbi{};
-    MEMORY_BASIC_INFORMATION from_mbi{};
-    MEMORY_BASIC_INFORMATION to_mbi{};
+static std::vector<ScanMatch> scan_ranges(
+    std::span<const std::span<const uint8_t>> ranges, std::span<const Pattern> patterns, const ScanOptions& options) {
+    static const auto scan_range = select_scan_range();
 
-    VirtualQuery(reinterpret_cast<void*>(find_me), &find_me_mbi, sizeof(find_me_mbi));
-    VirtualQuery(from, &from_mbi, sizeof(from_mbi));
-    VirtualQuery(to, &to_mbi, sizeof(to_mbi));
+    struct WorkItem {
+        size_t range;
+        size_t begin;
+        size_t end;
+    };
 
-    auto new_protect = PAGE_READWRITE;
+    const auto groups = make_anchor_groups(patterns);
+    size_t total_size = 0;
 
-    if (from_mbi.AllocationBase == find_me_mbi.AllocationBase || to_mbi.AllocationBase == find_me_mbi.AllocationBase) {
-        new_protect = PAGE_EXECUTE_READWRITE;
+    for (const auto& range : ranges) {
+        total_size += range.size();
     }
 
-    auto si = system_info();
-    auto* from_page_start = align_down(from, si.page_size);
-    auto* from_page_end = align_up(from + len, si.page_size);
-    auto* vp_start = reinterpret_cast<uint8_t*>(&VirtualProtect);
-    auto* vp_end = vp_start + 0x20;
+    auto thread_count = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    thread_count = std::min(thread_count, std::max<size_t>(1, total_size / std::max<size_t>(options.min_chunk_size, 1)));
 
-    if (!(from_page_end < vp_start || vp_end < from_page_start)) {
-        new_protect = PAGE_EXECUTE_READWRITE;
+    // A few chunks per thread, so one slow chunk (e.g. dense with candidates) doesn't hold up the rest.
+    const auto chunk_size = std::max(options.min_chunk_size, total_size / (thread_count * 4) + 1);
+    std::vector<WorkItem> work{};
+
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        for (size_t begin = 0; begin < ranges[i].size(); begin += chunk_size) {
+            work.push_back(WorkItem{i, begin, std::min(begin + chunk_size, ranges[i].size())});
+        }
     }
 
-    if (!TrapManager::is_destructed) {
-        std::scoped_lock lock{TrapManager::mutex};
+    thread_count = std::min(thread_count, work.size());
 
-        if (TrapManager::instance == nullptr) {
-            TrapManager::instance = std::make_unique<TrapManager>();
+    std::vector<std::vector<ScanMatch>> results(std::max<size_t>(thread_count, 1));
+    std::atomic<size_t> next_item{0};
+
+    // Chunks only split the positions the anchors are compared at, verification reads across chunk boundaries.
+    auto worker = [&](std::vector<ScanMatch>& matches) {
+        for (auto i = next_item.fetch_add(1, std::memory_order_relaxed); i < work.size();
+             i = next_item.fetch_add(1, std::memory_order_relaxed)) {
+            const ScanContext ctx{ranges[work[i].range], patterns, groups};
+            scan_range(ctx, work[i].begin, work[i].end, matches);
         }
+    };
 
-        TrapManager::instance->add_trap(from, to, len);
-    }
+    if (thread_count <= 1) {
+        worker(results[0]);
+    } else {
+        std::vector<std::thread> threads{};
 
-    // Make sure we aren't working on a different address in the same memory page on a different thread.
-    std::scoped_lock vp_lock{virtual_protect_mutex};
+        for (size_t i = 1; i < thread_count; ++i) {
+            threads.emplace_back(worker, std::ref(results[i]));
+        }
 
-    DWORD from_protect;
-    DWORD to_protect;
+        worker(results[0]);
 
-    VirtualProtect(from, len, new_protect, &from_protect);
-    VirtualProtect(to, len, new_protect, &to_protect);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
 
-    if (run_fn) {
-        run_fn();
+    std::vector<ScanMatch> matches{};
+
+    for (auto& result : results) {
+        matches.insert(matches.end(), result.begin(), result.end());
     }
 
-    VirtualProtect(to, len, to_protect, &to_protect);
-    VirtualProtect(from, len, from_protect, &from_protect);
+    std::ranges::sort(matches, [](const ScanMatch& a, const ScanMatch& b) {
+        return a.pattern != b.pattern ? a.pattern < b.pattern : a.address < b.address;
+    });
+
+    return matches;
 }
 
-void fix_ip(ThreadContext thread_ctx, uint8_t* old_ip, uint8_t* new_ip) {
-    auto* ctx = reinterpret_cast<CONTEXT*>(thread_ctx);
+std::vector<ScanMatch> scan(std::span<const uint8_t> data, std::span<const Pattern> patterns, const ScanOptions& options) {
+    return scan_ranges({&data, 1}, patterns, options);
+}
 
-#if SAFETYHOOK_ARCH_X86_64
-    auto ip = ctx->Rip;
-#elif SAFETYHOOK_ARCH_X86_32
-    auto ip = ctx->Eip;
-#endif
+std::expected<std::vector<ScanMatch>, OsError> scan_module(
+    uint8_t* module, std::span<const Pattern> patterns, const ScanOptions& options) {
+    const auto sections = module_executable_sections(module);
 
-    if (ip == reinterpret_cast<uintptr_t>(old_ip)) {
-        ip = reinterpret_cast<uintptr_t>(new_ip);
+    if (!sections) {
+        return std::unexpected{sections.error()};
     }
 
-#if SAFETYHOOK_ARCH_X86_64
-    ctx->Rip = ip;
-#elif SAFETYHOOK_ARCH_X86_32
-    ctx->Eip = ip;
-#endif
-}
+    const std::vector<std::span<const uint8_t>> ranges{sections->begin(), sections->end()};
 
+    return scan_ranges(ranges, patterns, options);
+}
 } // namespace safetyhook
 
-#endif
+#undef SAFETYHOOK_TARGET_SSE2
+#undef SAFETYHOOK_TARGET_AVX2
 
 //
 // Source file: utility.cpp
 //
 
+#include <atomic>
+
 
 
 namespace safetyhook {
@@ -1513,12 +3347,37 @@ std::optional<UnprotectMemory> unprotect(uint8_t* address, size_t size) {
     return UnprotectMemory{address, size, old_protection.value()};
 }
 
+static std::atomic<bool> g_fast_exit{};
+static std::atomic<bool> g_process_exiting{};
+
+void set_fast_exit(bool enabled) {
+    if (enabled) {
+        watch_process_exit();
+    }
+
+    g_fast_exit.store(enabled, std::memory_order_relaxed);
+}
+
+void notify_process_exit() {
+    g_process_exiting.store(true, std::memory_order_relaxed);
+}
+
+bool leak_on_destroy() {
+    return g_fast_exit.load(std::memory_order_relaxed) &&
+           (g_process_exiting.load(std::memory_order_relaxed) || process_is_exiting());
+}
+
 } // namespace safetyhook
 
 //
 // Source file: vmt_hook.cpp
 //
 
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <unordered_set>
+
 
 
 namespace safetyhook {
@@ -1532,12 +3391,32 @@ VmHook& VmHook::operator=(VmHook&& other) noexcept {
     m_new_vm = other.m_new_vm;
     m_vmt_entry = other.m_vmt_entry;
     m_new_vmt_allocation = std::move(other.m_new_vmt_allocation);
+    m_in_place = other.m_in_place;
     other.m_original_vm = nullptr;
     other.m_new_vm = nullptr;
     other.m_vmt_entry = nullptr;
+    other.m_in_place = false;
     return *this;
 }
 
+std::expected<VmHook, VmHook::Error> VmHook::in_place(uint8_t** vmt_entry, uint8_t* new_vm) {
+    VmHook hook{};
+
+    // Only the page holding the entry is made writable, and only for the duration of the swap.
+    auto unprotect_guard = unprotect(reinterpret_cast<uint8_t*>(vmt_entry), sizeof(uint8_t*));
+
+    if (!unprotect_guard) {
+        return std::unexpected{Error::failed_to_unprotect(reinterpret_cast<uint8_t*>(vmt_entry))};
+    }
+
+    hook.m_original_vm = std::atomic_ref{*vmt_entry}.exchange(new_vm, std::memory_order_acq_rel);
+    hook.m_new_vm = new_vm;
+    hook.m_vmt_entry = vmt_entry;
+    hook.m_in_place = true;
+
+    return hook;
+}
+
 VmHook::~VmHook() {
     destroy();
 }
@@ -1547,7 +3426,32 @@ void VmHook::reset() {
 }
 
 void VmHook::destroy() {
-    if (m_original_vm != nullptr) {
+    if (leak_on_destroy()) {
+        // Leave the entry pointing at our method, and the cloned VMT (if any) allocated.
+        if (m_new_vmt_allocation) {
+            m_new_vmt_allocation->leak();
+        }
+
+        m_original_vm = nullptr;
+        m_new_vm = nullptr;
+        m_vmt_entry = nullptr;
+        m_in_place = false;
+        m_new_vmt_allocation.reset();
+        return;
+    }
+
+    if (m_original_vm != nullptr && m_in_place) {
+        // Only restore the entry if nothing has replaced our method since, otherwise we'd unhook someone else.
+        if (auto unprotect_guard = unprotect(reinterpret_cast<uint8_t*>(m_vmt_entry), sizeof(uint8_t*))) {
+            auto expected = m_new_vm;
+            std::atomic_ref{*m_vmt_entry}.compare_exchange_strong(expected, m_original_vm, std::memory_order_acq_rel);
+        }
+
+        m_original_vm = nullptr;
+        m_new_vm = nullptr;
+        m_vmt_entry = nullptr;
+        m_in_place = false;
+    } else if (m_original_vm != nullptr) {
         *m_vmt_entry = m_original_vm;
         m_original_vm = nullptr;
         m_new_vm = nullptr;
@@ -1556,12 +3460,13 @@ void VmHook::destroy() {
     }
 }
 
-std::expected<VmtHook, VmtHook::Error> VmtHook::create(void* object) {
-    VmtHook hook{};
+static std::mutex g_class_vmts_mutex{};
 
-    const auto original_vmt = *reinterpret_cast<uint8_t***>(object);
-    hook.m_objects.emplace(object, original_vmt);
+// Original VMTs that currently have a ClassLevel hook. Two hooks sharing a class would both patch the slots of
+// the objects they track and restore them independently, undoing each other, so only one is allowed at a time.
+static std::unordered_set<uint8_t**> g_class_vmts{};
 
+static std::expected<std::shared_ptr<Allocation>, VmtHook::Error> clone_vmt(uint8_t** original_vmt) {
     // Count the number of virtual method pointers. We start at one to account for the RTTI pointer.
     auto num_vmt_entries = 1;
 
@@ -1573,20 +3478,58 @@ std::expected<VmtHook, VmtHook::Error> VmtHook::create(void* object) {
     auto allocation = Allocator::global()->allocate(num_vmt_entries * sizeof(uint8_t*));
 
     if (!allocation) {
-        return std::unexpected{Error::bad_allocation(allocation.error())};
+        return std::unexpected{VmtHook::Error::bad_allocation(allocation.error())};
     }
 
-    hook.m_new_vmt_allocation = std::make_shared<Allocation>(std::move(*allocation));
-    hook.m_new_vmt = reinterpret_cast<uint8_t**>(hook.m_new_vmt_allocation->data());
+    auto new_vmt_allocation = std::make_shared<Allocation>(std::move(*allocation));
+    auto new_vmt = reinterpret_cast<uint8_t**>(new_vmt_allocation->data());
 
     // Copy pointer to RTTI.
-    hook.m_new_vmt[0] = original_vmt[-1];
+    new_vmt[0] = original_vmt[-1];
 
     // Copy virtual method pointers.
     for (auto i = 0; i < num_vmt_entries - 1; ++i) {
-        hook.m_new_vmt[i + 1] = original_vmt[i];
+        new_vmt[i + 1] = original_vmt[i];
+    }
+
+    return new_vmt_allocation;
+}
+
+std::expected<VmtHook, VmtHook::Error> VmtHook::create(void* object, Flags flags) {
+    VmtHook hook{};
+
+    const auto original_vmt = *reinterpret_cast<uint8_t***>(object);
+
+    if (flags & ClassLevel) {
+        std::scoped_lock lock{g_class_vmts_mutex};
+
+        if (g_class_vmts.contains(original_vmt)) {
+            return std::unexpected{Error::class_already_hooked()};
+        }
+    }
+
+    auto new_vmt_allocation = clone_vmt(original_vmt);
+
+    if (!new_vmt_allocation) {
+        return std::unexpected{new_vmt_allocation.error()};
+    }
+
+    hook.m_new_vmt_allocation = std::move(*new_vmt_allocation);
+
+    if (flags & ClassLevel) {
+        std::scoped_lock lock{g_class_vmts_mutex};
+
+        // Another thread may have hooked the class while we were cloning.
+        if (!g_class_vmts.insert(original_vmt).second) {
+            return std::unexpected{Error::class_already_hooked()};
+        }
+
+        hook.m_original_vmt = original_vmt;
     }
 
+    hook.m_new_vmt = reinterpret_cast<uint8_t**>(hook.m_new_vmt_allocation->data());
+    hook.m_objects.insert(object, original_vmt);
+
     *reinterpret_cast<uint8_t***>(object) = &hook.m_new_vmt[1];
 
     return hook;
@@ -1601,7 +3544,9 @@ VmtHook& VmtHook::operator=(VmtHook&& other) noexcept {
     m_objects = std::move(other.m_objects);
     m_new_vmt_allocation = std::move(other.m_new_vmt_allocation);
     m_new_vmt = other.m_new_vmt;
+    m_original_vmt = other.m_original_vmt;
     other.m_new_vmt = nullptr;
+    other.m_original_vmt = nullptr;
     return *this;
 }
 
@@ -1610,32 +3555,56 @@ VmtHook::~VmtHook() {
 }
 
 void VmtHook::apply(void* object) {
-    m_objects.emplace(object, *reinterpret_cast<uint8_t***>(object));
-    *reinterpret_cast<uint8_t***>(object) = &m_new_vmt[1];
+    auto& vmt = *reinterpret_cast<uint8_t***>(object);
+
+    if (m_original_vmt != nullptr && vmt != m_original_vmt) {
+        return;
+    }
+
+    m_objects.insert(object, vmt);
+    vmt = &m_new_vmt[1];
+}
+
+void VmtHook::apply(std::span<void* const> objects) {
+    m_objects.reserve(m_objects.size() + objects.size());
+
+    for (const auto object : objects) {
+        apply(object);
+    }
 }
 
 void VmtHook::remove(void* object) {
-    const auto search = m_objects.find(object);
+    const auto original_vmt = m_objects.erase(object);
 
-    if (search == m_objects.end()) {
+    if (original_vmt == nullptr) {
         return;
     }
 
-    const auto original_vmt = search->second;
-
     if (!vm_is_writable(reinterpret_cast<uint8_t*>(object), sizeof(void*))) {
-        m_objects.erase(search);
         return;
     }
 
     if (*reinterpret_cast<uint8_t***>(object) != &m_new_vmt[1]) {
-        m_objects.erase(search);
         return;
     }
 
     *reinterpret_cast<uint8_t***>(object) = original_vmt;
+}
+
+void VmtHook::remove(std::span<void* const> objects) {
+    for (const auto object : objects) {
+        const auto original_vmt = m_objects.erase(object);
 
-    m_objects.erase(search);
+        if (original_vmt == nullptr) {
+            continue;
+        }
+
+        if (*reinterpret_cast<uint8_t***>(object) != &m_new_vmt[1]) {
+            continue;
+        }
+
+        *reinterpret_cast<uint8_t***>(object) = original_vmt;
+    }
 }
 
 void VmtHook::reset() {
@@ -1643,20 +3612,147 @@ void VmtHook::reset() {
 }
 
 void VmtHook::destroy() {
-    for (const auto [object, original_vmt] : m_objects) {
+    if (m_original_vmt != nullptr) {
+        std::scoped_lock lock{g_class_vmts_mutex};
+        g_class_vmts.erase(m_original_vmt);
+    }
+
+    if (leak_on_destroy()) {
+        // Objects keep pointing at the cloned VMT, so it must not be freed.
+        if (m_new_vmt_allocation) {
+            m_new_vmt_allocation->leak();
+        }
+
+        m_objects.clear();
+        m_new_vmt_allocation.reset();
+        m_new_vmt = nullptr;
+        m_original_vmt = nullptr;
+        return;
+    }
+
+    m_objects.for_each([this](void* object, uint8_t** original_vmt) {
         if (!vm_is_writable(reinterpret_cast<uint8_t*>(object), sizeof(void*))) {
-            continue;
+            return;
         }
 
         if (*reinterpret_cast<uint8_t***>(object) != &m_new_vmt[1]) {
-            continue;
+            return;
         }
 
         *reinterpret_cast<uint8_t***>(object) = original_vmt;
-    }
+    });
 
     m_objects.clear();
     m_new_vmt_allocation.reset();
     m_new_vmt = nullptr;
+    m_original_vmt = nullptr;
+}
+
+VmtHook::ObjectTable::ObjectTable(ObjectTable&& other) noexcept {
+    *this = std::move(other);
+}
+
+VmtHook::ObjectTable& VmtHook::ObjectTable::operator=(ObjectTable&& other) noexcept {
+    if (this != &other) {
+        m_entries = std::move(other.m_entries);
+        m_size = std::exchange(other.m_size, 0);
+        m_shift = std::exchange(other.m_shift, 64);
+        other.m_entries.clear();
+    }
+
+    return *this;
+}
+
+size_t VmtHook::ObjectTable::index_of(void* object) const {
+    // Fibonacci hashing. Object addresses are heavily aligned, so the multiply spreads them over the high bits
+    // which we then use as the index.
+    const auto key = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(object));
+    return static_cast<size_t>((key * 0x9E37'79B9'7F4A'7C15ull) >> m_shift);
+}
+
+bool VmtHook::ObjectTable::insert(void* object, uint8_t** original_vmt) {
+    reserve(m_size + 1);
+
+    const auto mask = m_entries.size() - 1;
+
+    for (auto i = index_of(object);; i = (i + 1) & mask) {
+        auto& entry = m_entries[i];
+
+        if (entry.object == object) {
+            return false;
+        }
+
+        if (entry.object == nullptr) {
+            entry.object = object;
+            entry.original_vmt = original_vmt;
+            ++m_size;
+            return true;
+        }
+    }
+}
+
+uint8_t** VmtHook::ObjectTable::erase(void* object) {
+    if (m_size == 0) {
+        return nullptr;
+    }
+
+    const auto mask = m_entries.size() - 1;
+    auto hole = index_of(object);
+
+    for (; m_entries[hole].object != object; hole = (hole + 1) & mask) {
+        if (m_entries[hole].object == nullptr) {
+            return nullptr;
+        }
+    }
+
+    const auto original_vmt = m_entries[hole].original_vmt;
+
+    // Shift back every following entry of the probe run that can no longer be reached across the hole.
+    for (auto i = (hole + 1) & mask; m_entries[i].object != nullptr; i = (i + 1) & mask) {
+        const auto home = index_of(m_entries[i].object);
+
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            m_entries[hole] = m_entries[i];
+            hole = i;
+        }
+    }
+
+    m_entries[hole] = Entry{};
+    --m_size;
+
+    return original_vmt;
+}
+
+void VmtHook::ObjectTable::reserve(size_t count) {
+    // Keep the load factor at or below 3/4 so probe runs stay short.
+    size_t capacity = 16;
+
+    while (capacity - capacity / 4 < count) {
+        capacity *= 2;
+    }
+
+    if (capacity > m_entries.size()) {
+        rehash(capacity);
+    }
+}
+
+void VmtHook::ObjectTable::rehash(size_t capacity) {
+    auto entries = std::move(m_entries);
+
+    m_entries.assign(capacity, Entry{});
+    m_shift = 64 - static_cast<uint32_t>(std::countr_zero(capacity));
+    m_size = 0;
+
+    for (const auto& entry : entries) {
+        if (entry.object != nullptr) {
+            insert(entry.object, entry.original_vmt);
+        }
+    }
+}
+
+void VmtHook::ObjectTable::clear() {
+    m_entries.clear();
+    m_size = 0;
+    m_shift = 64;
 }
-} // namespace safetyhook
\ No newline at end of file
+} // namespace safetyhook
@@ -22,6 +22,8 @@
 #include <cstdint>
 #include <expected>
 #include <functional>
+#include <span>
+#include <vector>
 #else
 import std.compat;
 #endif
@@ -163,7 +165,7 @@ struct VmBasicInfo {
 };
 
 std::expected<uint8_t*, OsError> SAFETYHOOK_API vm_allocate(uint8_t* address, size_t size, VmAccess access);
-void SAFETYHOOK_API vm_free(uint8_t* address);
+void SAFETYHOOK_API vm_free(uint8_t* address, size_t size);
 std::expected<uint32_t, OsError> SAFETYHOOK_API vm_protect(uint8_t* address, size_t size, VmAccess access);
 std::expected<uint32_t, OsError> SAFETYHOOK_API vm_protect(uint8_t* address, size_t size, uint32_t access);
 std::expected<VmBasicInfo, OsError> SAFETYHOOK_API vm_query(uint8_t* address);
@@ -180,6 +182,36 @@ struct SystemInfo {
 
 SystemInfo SAFETYHOOK_API system_info();
 
+struct ModuleInfo {
+    uint8_t* base;
+    uint64_t build_id; ///< Changes whenever the module is rebuilt: the PE timestamp and image size, or the GNU build ID.
+};
+
+/// @brief Finds the module containing an address.
+/// @param address An address inside the module.
+/// @return The ModuleInfo, or an OsError if the address is not inside a module or the module has no build ID.
+std::expected<ModuleInfo, OsError> SAFETYHOOK_API module_info(uint8_t* address);
+
+/// @brief Finds the executable sections (PE) or segments (ELF) of the module containing an address.
+/// @param address An address inside the module.
+/// @return The sections, or an OsError if the address is not inside a module.
+std::expected<std::vector<std::span<uint8_t>>, OsError> SAFETYHOOK_API module_executable_sections(uint8_t* address);
+
+/// @brief Tests if the process is shutting down.
+/// @return True once ExitProcess has started unloading DLLs (Windows), or once exit() has run the handler that
+/// watch_process_exit registers (Linux).
+/// @note On Linux, exit() runs atexit handlers and static destructors in the reverse order they were registered.
+/// Destructors registered before the handler (e.g. of globals constructed before set_fast_exit(true) was called) see
+/// true, destructors registered after it (e.g. of function-local statics constructed later) still see false. Without
+/// the handler, e.g. when safetyhook is linked into a shared library, this is always false. Such hosts have to call
+/// notify_process_exit() from their own exit path.
+bool SAFETYHOOK_API process_is_exiting();
+
+/// @brief Starts watching for the process exit where process_is_exiting needs it. Called by set_fast_exit(true).
+/// @details On Linux, registers an atexit handler once, but only when safetyhook is part of the executable: the
+/// handlers of a shared library also run when it is unloaded with dlclose. Does nothing on Windows.
+void SAFETYHOOK_API watch_process_exit();
+
 using ThreadContext = void*;
 
 void SAFETYHOOK_API trap_threads(uint8_t* from, uint8_t* to, size_t len, const std::function<void()>& run_fn);
@@ -245,10 +277,13 @@ import std.compat;
 #pragma once
 
 #ifndef SAFETYHOOK_USE_CXXMODULES
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <expected>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <vector>
 #else
 import std.compat;
@@ -272,6 +307,10 @@ public:
     /// @note This is called automatically when the Allocation object is destroyed.
     void free();
 
+    /// @brief Gives up the allocation without freeing it.
+    /// @details The memory stays valid for the lifetime of the process, the Allocator it came from is kept alive.
+    void leak();
+
     /// @brief Returns a pointer to the data of the allocation.
     /// @return Pointer to the data of the allocation.
     [[nodiscard]] uint8_t* data() const noexcept { return m_address; }
@@ -335,6 +374,14 @@ public:
     [[nodiscard]] std::expected<Allocation, Error> allocate_near(
         const std::vector<uint8_t*>& desired_addresses, size_t size, size_t max_distance = 0x7FFF'FFFF);
 
+    /// @brief Returns the memory this Allocator holds from the OS.
+    /// @return The size of all memory blocks in bytes, including their free space.
+    [[nodiscard]] size_t resident_bytes() const noexcept { return m_resident_bytes.load(std::memory_order_relaxed); }
+
+    /// @brief Returns the memory currently handed out in Allocations.
+    /// @return The size of all live Allocations in bytes.
+    [[nodiscard]] size_t allocated_bytes() const noexcept { return m_allocated_bytes.load(std::memory_order_relaxed); }
+
 protected:
     friend Allocation;
 
@@ -355,16 +402,38 @@ private:
         ~Memory();
     };
 
-    std::vector<std::unique_ptr<Memory>> m_memory{};
-    std::mutex m_mutex{};
+    /// @brief A set of memory blocks with its own lock.
+    /// @details Blocks are sharded by the 2GB region their address lies in, so hooks in unrelated modules allocate
+    /// in parallel and only contend when their regions map to the same shard.
+    struct Shard {
+        std::vector<std::unique_ptr<Memory>> memory{};
+        size_t unused_blocks{}; ///< Blocks without any live Allocation.
+        std::mutex mutex{};
+    };
+
+    static constexpr size_t SHARD_COUNT = 64;
+    static constexpr size_t SHARD_REGION_SHIFT = 31;
+
+    /// @brief Blocks that become entirely free are returned to the OS, except for this many per shard. Keeping one
+    /// around avoids unmapping and remapping a block when a single hook is destroyed and recreated.
+    static constexpr size_t MAX_UNUSED_BLOCKS_PER_SHARD = 1;
+
+    std::array<Shard, SHARD_COUNT> m_shards{};
+    std::atomic<size_t> m_resident_bytes{};
+    std::atomic<size_t> m_allocated_bytes{};
 
     Allocator() = default;
 
-    [[nodiscard]] std::expected<Allocation, Error> internal_allocate_near(
-        const std::vector<uint8_t*>& desired_addresses, size_t size, size_t max_distance = 0x7FFF'FFFF);
-    void internal_free(uint8_t* address, size_t size);
+    [[nodiscard]] Shard& shard_for(uintptr_t address) noexcept {
+        return m_shards[(address >> SHARD_REGION_SHIFT) % SHARD_COUNT];
+    }
+
+    [[nodiscard]] std::optional<Allocation> internal_allocate_near(Shard& shard,
+        const std::vector<uint8_t*>& desired_addresses, size_t size, size_t aligned_size, size_t max_distance);
+    [[nodiscard]] bool internal_free(Shard& shard, uint8_t* address, size_t size);
 
     static void combine_adjacent_freenodes(Memory& memory);
+    [[nodiscard]] static bool is_unused(const Memory& memory);
     [[nodiscard]] static std::expected<uint8_t*, Error> allocate_nearby_memory(
         const std::vector<uint8_t*>& desired_addresses, size_t size, size_t max_distance);
     [[nodiscard]] static bool in_range(
@@ -430,6 +499,21 @@ private:
 
 [[nodiscard]] std::optional<UnprotectMemory> SAFETYHOOK_API unprotect(uint8_t* address, size_t size);
 
+/// @brief Enables or disables fast exit.
+/// @details With fast exit, hooks that are destroyed while the process is exiting stay in place and leak their
+/// trampolines and stubs, instead of trapping threads and flipping page protections to unpatch every target. See
+/// process_is_exiting for which hooks count as destroyed while exiting on Linux.
+void SAFETYHOOK_API set_fast_exit(bool enabled);
+
+/// @brief Marks the process as exiting.
+/// @details For hosts that know before process_is_exiting does, e.g. from DllMain(DLL_PROCESS_DETACH) with a non-null
+/// lpReserved, or from their own exit path on Linux.
+void SAFETYHOOK_API notify_process_exit();
+
+/// @brief Tests if hooks that are destroyed now should be leaked instead of unpatched.
+/// @return True if fast exit is enabled and the process is exiting.
+[[nodiscard]] bool SAFETYHOOK_API leak_on_destroy();
+
 template <typename T> constexpr T align_up(T address, size_t align) {
     const auto unaligned_address = address_cast<uintptr_t>(address);
     const auto aligned_address = (unaligned_address + align - 1) & ~(align - 1);
@@ -443,6 +527,127 @@ template <typename T> constexpr T align_down(T address, size_t align) {
 }
 } // namespace safetyhook
 
+//
+// Header: safetyhook/hook_plan.hpp
+//
+// Include stack:
+//   - safetyhook.hpp
+//   - safetyhook/easy.hpp
+//   - safetyhook/inline_hook.hpp
+//
+
+/// @file safetyhook/hook_plan.hpp
+/// @brief Decoded hook targets and a persistent cache for them.
+
+#pragma once
+
+#ifndef SAFETYHOOK_USE_CXXMODULES
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+#else
+import std.compat;
+#endif
+
+
+namespace safetyhook {
+/// @brief What an InlineHook learns from decoding its target.
+/// @details The instructions the hook displaces and how each of them is fixed up when it is copied into the
+/// trampoline. A plan only depends on the bytes at the target, so it stays valid for as long as they are unchanged.
+struct HookPlan {
+    /// @brief How an instruction is fixed up when it is copied into the trampoline.
+    enum class Fixup : uint8_t {
+        None,     ///< Copied as is.
+        Disp32,   ///< IP-relative 32-bit displacement.
+        Imm32,    ///< Relative 32-bit immediate.
+        ShortJcc, ///< Short conditional branch, rewritten as a near one.
+        ShortJmp, ///< Short unconditional branch, rewritten as a near one.
+    };
+
+    struct Instruction {
+        uint8_t length{};
+        Fixup fixup{};
+        uint8_t offset{}; ///< Offset of the displacement or immediate in the instruction.
+        uint8_t opcode{}; ///< Opcode of a short conditional branch.
+    };
+
+    std::vector<uint8_t> original_bytes{};
+    std::vector<Instruction> instructions{};
+
+    /// @brief Size of the displaced instructions once they are rewritten into the trampoline.
+    /// @return The size in bytes, not including the trampoline epilogue.
+    [[nodiscard]] size_t trampoline_code_size() const;
+};
+
+/// @brief Cache of HookPlans keyed by module build ID and RVA.
+/// @details Lets InlineHook skip decoding targets it already planned on an earlier launch. Plans are only used if the
+/// bytes at the target still match the ones they were made from; targets outside of a module are never cached.
+class SAFETYHOOK_API HookPlanCache final {
+public:
+    /// @brief The error type returned by load and save.
+    enum class Error : uint8_t {
+        FAILED_TO_OPEN,  ///< The file could not be opened.
+        BAD_FORMAT,      ///< The file is not a hook plan cache of this version and architecture.
+        FAILED_TO_WRITE, ///< The file could not be written.
+    };
+
+    /// @brief Returns the cache used by InlineHook.
+    /// @return The cache, or nullptr if none was set.
+    [[nodiscard]] static std::shared_ptr<HookPlanCache> global();
+
+    /// @brief Sets the cache used by InlineHook.
+    /// @param cache The cache, or nullptr to stop caching.
+    static void set_global(std::shared_ptr<HookPlanCache> cache);
+
+    /// @brief Creates a new, empty HookPlanCache.
+    /// @return The new HookPlanCache.
+    [[nodiscard]] static std::shared_ptr<HookPlanCache> create();
+
+    HookPlanCache(const HookPlanCache&) = delete;
+    HookPlanCache(HookPlanCache&&) noexcept = delete;
+    HookPlanCache& operator=(const HookPlanCache&) = delete;
+    HookPlanCache& operator=(HookPlanCache&&) noexcept = delete;
+    ~HookPlanCache() = default;
+
+    /// @brief Replaces the contents of the cache with a file written by save.
+    /// @param path The path of the file.
+    /// @return Nothing, or a HookPlanCache::Error. The cache is left empty on error.
+    [[nodiscard]] std::expected<void, Error> load(const std::filesystem::path& path);
+
+    /// @brief Writes the cache to a file.
+    /// @param path The path of the file. It is replaced atomically.
+    /// @return Nothing, or a HookPlanCache::Error.
+    [[nodiscard]] std::expected<void, Error> save(const std::filesystem::path& path) const;
+
+    /// @brief Looks up the plan for a target.
+    /// @param target The address of the target.
+    /// @return The plan, if one is cached and the bytes at the target still match it.
+    [[nodiscard]] std::optional<HookPlan> find(uint8_t* target) const;
+
+    /// @brief Adds or replaces the plan for a target.
+    /// @param target The address of the target.
+    /// @param plan The plan.
+    void insert(uint8_t* target, const HookPlan& plan);
+
+    /// @brief Returns the number of cached plans.
+    [[nodiscard]] size_t size() const;
+
+private:
+    using Key = std::pair<uint64_t, uintptr_t>; ///< Module build ID and RVA.
+
+    std::map<Key, HookPlan> m_plans{};
+    mutable std::shared_mutex m_mutex{};
+
+    HookPlanCache() = default;
+};
+} // namespace safetyhook
+
 namespace safetyhook {
 /// @brief An inline hook.
 class SAFETYHOOK_API InlineHook final {
@@ -541,6 +746,7 @@ public:
     enum Flags : int {
         Default = 0,            ///< Default flags.
         StartDisabled = 1 << 0, ///< Start the hook disabled.
+        SoftToggle = 1 << 1,    ///< Patch the target once and toggle with a flag tested in the trampoline.
     };
 
     /// @brief Create an inline hook.
@@ -749,14 +955,28 @@ public:
     }
 
     /// @brief Enable the hook.
+    /// @note For a SoftToggle hook this only sets a flag, no code is patched.
     [[nodiscard]] std::expected<void, Error> enable();
 
     /// @brief Disable the hook.
+    /// @note For a SoftToggle hook this only clears a flag, the target stays patched until the hook is destroyed.
     [[nodiscard]] std::expected<void, Error> disable();
 
     /// @brief Check if the hook is enabled.
     [[nodiscard]] bool enabled() const { return m_enabled; }
 
+    /// @brief Check if the hook was created with SoftToggle.
+    [[nodiscard]] bool soft_toggle() const { return m_soft_state != nullptr; }
+
+    /// @brief Only send every period-th call to the destination while the hook is enabled, the others go straight to
+    /// the original. 0 and 1 send every call.
+    /// @param period The sampling period.
+    /// @return False if the hook was not created with SoftToggle.
+    /// @note The countdown is shared by all threads and updated with locked instructions. A single thread gets exactly
+    /// every period-th call sampled. Threads calling at the same time can get up to one extra sampled call each per
+    /// period, never fewer than the number of calls divided by the period.
+    bool set_sample_period(uint32_t period);
+
 private:
     friend class MidHook;
 
@@ -766,6 +986,8 @@ private:
         FF,
     };
 
+    struct SoftState;
+
     uint8_t* m_target{};
     uint8_t* m_destination{};
     Allocation m_trampoline{};
@@ -774,10 +996,20 @@ private:
     std::recursive_mutex m_mutex{};
     bool m_enabled{};
     Type m_type{Type::Unset};
+    Flags m_flags{Default};
+    SoftState* m_soft_state{};
+    uint32_t m_sample_period{1};
 
     std::expected<void, Error> setup(
-        const std::shared_ptr<Allocator>& allocator, uint8_t* target, uint8_t* destination);
+        const std::shared_ptr<Allocator>& allocator, uint8_t* target, uint8_t* destination, Flags flags = Default);
+    std::expected<void, Error> patch();
+    void unpatch();
+    uint8_t* entry() const;
+    size_t gate_allocation_size() const;
+    void emit_soft_gate();
+    void store_soft_mode() const;
     std::expected<void, Error> e9_hook(const std::shared_ptr<Allocator>& allocator);
+    std::expected<void, Error> e9_hook(const std::shared_ptr<Allocator>& allocator, const HookPlan& plan);
 
 #if SAFETYHOOK_ARCH_X86_64
     std::expected<void, Error> ff_hook(const std::shared_ptr<Allocator>& allocator);
@@ -975,7 +1207,7 @@ public:
     MidHook(MidHook&& other) noexcept;
     MidHook& operator=(const MidHook&) = delete;
     MidHook& operator=(MidHook&& other) noexcept;
-    ~MidHook() = default;
+    ~MidHook();
 
     /// @brief Reset the hook.
     /// @details This will remove the hook and free the stub.
@@ -1038,7 +1270,9 @@ private:
 #ifndef SAFETYHOOK_USE_CXXMODULES
 #include <cstdint>
 #include <expected>
-#include <unordered_map>
+#include <span>
+#include <utility>
+#include <vector>
 #else
 import std.compat;
 #endif
@@ -1048,6 +1282,44 @@ namespace safetyhook {
 /// @brief A hook class that allows for hooking a single method in a VMT.
 class SAFETYHOOK_API VmHook final {
 public:
+    /// @brief Error type for VmHook.
+    struct Error {
+        /// @brief The type of error.
+        enum : uint8_t {
+            FAILED_TO_UNPROTECT, ///< Failed to make the VMT entry writable.
+        } type;
+
+        /// @brief Extra error information.
+        union {
+            uint8_t* address; ///< Address of the VMT entry.
+        };
+
+        /// @brief Create a FAILED_TO_UNPROTECT error.
+        /// @param address The address of the VMT entry.
+        /// @return The new FAILED_TO_UNPROTECT error.
+        [[nodiscard]] static Error failed_to_unprotect(uint8_t* address) {
+            Error error{};
+            error.type = FAILED_TO_UNPROTECT;
+            error.address = address;
+            return error;
+        }
+    };
+
+    /// @brief Hooks a method by swapping its entry in the original VMT of an object in place.
+    /// @param object An object whose VMT contains the method to hook.
+    /// @param index The index of the method to hook.
+    /// @param new_function The new function to use.
+    /// @return The VmHook object or a VmHook::Error if an error occurred.
+    /// @details The entry is replaced with a single atomic pointer store, so every existing and future object using
+    /// that VMT is hooked without any per-object cost. Use this for singletons or types whose instances can't be
+    /// enumerated. Use VmtHook to hook individual objects instead.
+    template <typename T>
+    [[nodiscard]] static std::expected<VmHook, Error> create_in_place(void* object, size_t index, T new_function) {
+        uint8_t* new_vm{};
+        store(reinterpret_cast<uint8_t*>(&new_vm), new_function);
+        return in_place(&(*reinterpret_cast<uint8_t***>(object))[index], new_vm);
+    }
+
     VmHook() = default;
     VmHook(const VmHook&) = delete;
     VmHook(VmHook&& other) noexcept;
@@ -1117,6 +1389,10 @@ private:
     // This keeps the allocation alive until the hook is destroyed.
     std::shared_ptr<Allocation> m_new_vmt_allocation{};
 
+    // True if m_vmt_entry points into the original VMT rather than a copy owned by a VmtHook.
+    bool m_in_place{};
+
+    [[nodiscard]] static std::expected<VmHook, Error> in_place(uint8_t** vmt_entry, uint8_t* new_vm);
     void destroy();
 };
 
@@ -1127,7 +1403,8 @@ public:
     struct Error {
         /// @brief The type of error.
         enum : uint8_t {
-            BAD_ALLOCATION, ///< An error occurred while allocating memory.
+            BAD_ALLOCATION,       ///< An error occurred while allocating memory.
+            CLASS_ALREADY_HOOKED, ///< Another ClassLevel VmtHook already hooks the class of the object.
         } type;
 
         /// @brief Extra error information.
@@ -1144,12 +1421,30 @@ public:
             error.allocator_error = err;
             return error;
         }
+
+        /// @brief Create a CLASS_ALREADY_HOOKED error.
+        /// @return The new CLASS_ALREADY_HOOKED error.
+        [[nodiscard]] static Error class_already_hooked() {
+            Error error{};
+            error.type = CLASS_ALREADY_HOOKED;
+            return error;
+        }
+    };
+
+    /// @brief Flags for VmtHook.
+    enum Flags : int {
+        Default = 0,         ///< Default flags.
+        ClassLevel = 1 << 0, ///< Share one hooked VMT per original VMT and only accept objects of that class.
     };
 
     /// @brief Creates a new VmtHook object. Will clone the VMT of the given object and replace it.
     /// @param object The object to hook.
+    /// @param flags The flags to use.
     /// @return The VmtHook object or a VmtHook::Error if an error occurred.
-    [[nodiscard]] static std::expected<VmtHook, Error> create(void* object);
+    /// @note With ClassLevel, there is at most one VmtHook per original VMT. Creating a second one for an object of
+    /// the same class fails with CLASS_ALREADY_HOOKED until the first one is destroyed, apply() the existing hook to
+    /// the object instead.
+    [[nodiscard]] static std::expected<VmtHook, Error> create(void* object, Flags flags = Default);
 
     VmtHook() = default;
     VmtHook(const VmtHook&) = delete;
@@ -1163,10 +1458,24 @@ public:
     /// @note This will replace the VMT of the object with the new VMT. You can apply the hook to multiple objects.
     void apply(void* object);
 
+    /// @brief Applies the hook to many objects at once.
+    /// @param objects The objects to apply the hook to.
+    /// @note With ClassLevel, objects whose VMT is not the original VMT of the hooked class are skipped.
+    void apply(std::span<void* const> objects);
+
     /// @brief Removes the hook.
     /// @param object The object to remove the hook from.
     void remove(void* object);
 
+    /// @brief Removes the hook from many objects at once.
+    /// @param objects The objects to remove the hook from.
+    /// @note Unlike remove(void*), this does not query the protection of every object. The objects must still be
+    /// alive.
+    void remove(std::span<void* const> objects);
+
+    /// @brief Gets the number of objects the hook is currently applied to.
+    [[nodiscard]] size_t size() const { return m_objects.size(); }
+
     /// @brief Removes the hook from all objects.
     void reset();
 
@@ -1187,13 +1496,65 @@ public:
     }
 
 private:
+    /// @brief Flat open-addressing map of object instance to its original VMT.
+    /// @details Uses linear probing with backward-shift deletion, so lookups touch a single contiguous run of
+    /// entries and no tombstones accumulate when objects are removed.
+    class ObjectTable {
+    public:
+        struct Entry {
+            void* object{};
+            uint8_t** original_vmt{};
+        };
+
+        ObjectTable() = default;
+        ObjectTable(const ObjectTable&) = delete;
+        ObjectTable(ObjectTable&& other) noexcept;
+        ObjectTable& operator=(const ObjectTable&) = delete;
+        ObjectTable& operator=(ObjectTable&& other) noexcept;
+        ~ObjectTable() = default;
+
+        /// @brief Inserts an object. Does nothing if the object is already present.
+        /// @return True if the object was inserted.
+        bool insert(void* object, uint8_t** original_vmt);
+
+        /// @brief Removes an object.
+        /// @return The original VMT of the object or nullptr if the object was not present.
+        uint8_t** erase(void* object);
+
+        /// @brief Grows the table so that it can hold at least count objects without rehashing.
+        void reserve(size_t count);
+
+        void clear();
+
+        [[nodiscard]] size_t size() const { return m_size; }
+
+        template <typename Fn> void for_each(Fn&& fn) const {
+            for (const auto& entry : m_entries) {
+                if (entry.object != nullptr) {
+                    fn(entry.object, entry.original_vmt);
+                }
+            }
+        }
+
+    private:
+        std::vector<Entry> m_entries{};
+        size_t m_size{};
+        uint32_t m_shift{64};
+
+        [[nodiscard]] size_t index_of(void* object) const;
+        void rehash(size_t capacity);
+    };
+
     // Map of object instance to their original VMT.
-    std::unordered_map<void*, uint8_t**> m_objects{};
+    ObjectTable m_objects{};
 
     // The allocation is a shared_ptr, so it can be shared with VmHooks to ensure the memory is kept alive.
     std::shared_ptr<Allocation> m_new_vmt_allocation{};
     uint8_t** m_new_vmt{};
 
+    // The original VMT of the hooked class. Only set for ClassLevel hooks.
+    uint8_t** m_original_vmt{};
+
     void destroy();
 };
 } // namespace safetyhook
@@ -1237,8 +1598,9 @@ template <typename T>
 
 /// @brief Easy to use API for creating a VmtHook.
 /// @param object The object to hook.
+/// @param flags The flags to use.
 /// @return The VmtHook object.
-[[nodiscard]] VmtHook SAFETYHOOK_API create_vmt(void* object);
+[[nodiscard]] VmtHook SAFETYHOOK_API create_vmt(void* object, VmtHook::Flags flags = VmtHook::Default);
 
 /// @brief Easy to use API for creating a VmHook.
 /// @param vmt The VmtHook to use to create the VmHook.
@@ -1253,6 +1615,371 @@ template <typename T> [[nodiscard]] VmHook create_vm(VmtHook& vmt, size_t index,
     }
 }
 
+/// @brief Easy to use API for creating a VmHook that patches the original VMT of an object in place.
+/// @param object An object whose VMT contains the method to hook.
+/// @param index The index of the method to hook.
+/// @param destination The destination function.
+/// @return The VmHook object.
+template <typename T> [[nodiscard]] VmHook create_vm_in_place(void* object, size_t index, T destination) {
+    if (auto hook = VmHook::create_in_place(object, index, destination)) {
+        return std::move(*hook);
+    } else {
+        return {};
+    }
+}
+
+} // namespace safetyhook
+
+//
+// Header: safetyhook/import_hook.hpp
+//
+// Include stack:
+//   - safetyhook.hpp
+//
+
+/// @file safetyhook/import_hook.hpp
+/// @brief Import table hooking class.
+
+#pragma once
+
+#ifndef SAFETYHOOK_USE_CXXMODULES
+#include <cstdint>
+#include <expected>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#else
+import std.compat;
+#endif
+
+
+#if SAFETYHOOK_OS_LINUX
+
+namespace safetyhook {
+/// @brief A hook that redirects calls to an imported function by rewriting the GOT entries of ELF modules.
+/// @details Unlike InlineHook this doesn't relocate any instructions, allocate a trampoline or trap threads. Each
+/// hooked module costs a single pointer write. Only calls made through the dynamic linker are redirected, so calls
+/// from within the module that defines the symbol are not affected.
+/// @note The GOT entries are collected when the hook is created. Modules loaded afterwards (dlopen) are not patched,
+/// create another ImportHook for them once they are loaded.
+class SAFETYHOOK_API ImportHook final {
+public:
+    /// @brief Error type for ImportHook.
+    struct Error {
+        /// @brief The type of error.
+        enum : uint8_t {
+            MODULE_NOT_FOUND,    ///< The module is not loaded.
+            SYMBOL_NOT_FOUND,    ///< No module imports the symbol.
+            FAILED_TO_UNPROTECT, ///< Failed to make a GOT entry writable.
+        } type;
+
+        /// @brief Extra error information.
+        union {
+            uint8_t* address; ///< Address of the GOT entry.
+        };
+
+        /// @brief Create a MODULE_NOT_FOUND error.
+        /// @return The new MODULE_NOT_FOUND error.
+        [[nodiscard]] static Error module_not_found() {
+            Error error{};
+            error.type = MODULE_NOT_FOUND;
+            return error;
+        }
+
+        /// @brief Create a SYMBOL_NOT_FOUND error.
+        /// @return The new SYMBOL_NOT_FOUND error.
+        [[nodiscard]] static Error symbol_not_found() {
+            Error error{};
+            error.type = SYMBOL_NOT_FOUND;
+            return error;
+        }
+
+        /// @brief Create a FAILED_TO_UNPROTECT error.
+        /// @param address The address of the GOT entry.
+        /// @return The new FAILED_TO_UNPROTECT error.
+        [[nodiscard]] static Error failed_to_unprotect(uint8_t* address) {
+            Error error{};
+            error.type = FAILED_TO_UNPROTECT;
+            error.address = address;
+            return error;
+        }
+    };
+
+    /// @brief Hooks an imported function in every loaded module.
+    /// @param symbol The name of the imported function.
+    /// @param destination The destination address.
+    /// @return The ImportHook or an ImportHook::Error if an error occurred.
+    [[nodiscard]] static std::expected<ImportHook, Error> create(std::string_view symbol, void* destination);
+
+    /// @brief Hooks an imported function in a single module.
+    /// @param module The file name or path of the module. An empty name selects the main executable.
+    /// @param symbol The name of the imported function.
+    /// @param destination The destination address.
+    /// @return The ImportHook or an ImportHook::Error if an error occurred.
+    [[nodiscard]] static std::expected<ImportHook, Error> create(
+        std::string_view module, std::string_view symbol, void* destination);
+
+    /// @brief Hooks an imported function in every loaded module.
+    /// @param symbol The name of the imported function.
+    /// @param destination The destination address.
+    /// @return The ImportHook or an ImportHook::Error if an error occurred.
+    template <typename T>
+    [[nodiscard]] static std::expected<ImportHook, Error> create(std::string_view symbol, T destination) {
+        return create(symbol, reinterpret_cast<void*>(destination));
+    }
+
+    /// @brief Hooks an imported function in a single module.
+    /// @param module The file name or path of the module. An empty name selects the main executable.
+    /// @param symbol The name of the imported function.
+    /// @param destination The destination address.
+    /// @return The ImportHook or an ImportHook::Error if an error occurred.
+    template <typename T>
+    [[nodiscard]] static std::expected<ImportHook, Error> create(
+        std::string_view module, std::string_view symbol, T destination) {
+        return create(module, symbol, reinterpret_cast<void*>(destination));
+    }
+
+    ImportHook() = default;
+    ImportHook(const ImportHook&) = delete;
+    ImportHook(ImportHook&& other) noexcept;
+    ImportHook& operator=(const ImportHook&) = delete;
+    ImportHook& operator=(ImportHook&& other) noexcept;
+    ~ImportHook();
+
+    /// @brief Reset the hook.
+    /// @details This will restore every GOT entry that still points to the destination.
+    /// @note This is called automatically in the destructor.
+    void reset();
+
+    /// @brief Get a pointer to the destination.
+    /// @return A pointer to the destination.
+    [[nodiscard]] uint8_t* destination() const { return m_destination; }
+
+    /// @brief Get the number of GOT entries that were rewritten.
+    /// @return The number of GOT entries that were rewritten.
+    [[nodiscard]] size_t size() const { return m_entries.size(); }
+
+    /// @brief Tests if the hook is valid.
+    /// @return True if the hook is valid, false otherwise.
+    explicit operator bool() const { return !m_entries.empty(); }
+
+    /// @brief Returns the address of the original function.
+    /// @tparam T The type of the function pointer.
+    /// @return The address of the original function.
+    template <typename T> [[nodiscard]] T original() const { return reinterpret_cast<T>(m_original); }
+
+    /// @brief Calls the original function.
+    /// @tparam RetT The return type of the function.
+    /// @tparam ...Args The argument types of the function.
+    /// @param ...args The arguments to pass to the function.
+    /// @return The result of calling the original function.
+    template <typename RetT = void, typename... Args> RetT call(Args... args) {
+        return original<RetT (*)(Args...)>()(args...);
+    }
+
+private:
+    struct Entry {
+        uintptr_t module_base{};
+        uint8_t** address{};
+        uint8_t* original{};
+    };
+
+    std::vector<Entry> m_entries{};
+    uint8_t* m_original{};
+    uint8_t* m_destination{};
+
+    std::expected<void, Error> setup(const std::string_view* module, std::string_view symbol, uint8_t* destination);
+    void destroy();
+};
+
+/// @brief Resolves exported symbols of loaded ELF modules through their .gnu.hash (or .hash) and .dynsym sections.
+/// @details The dynamic sections of the loaded modules are parsed once and cached by load address, so a lookup costs a
+/// bloom filter test and a short hash chain walk instead of a dlsym call. The cache is rebuilt when the dynamic linker
+/// reports that modules were loaded or unloaded since the last lookup. That check takes the dynamic linker's lock once
+/// per call, so looking up many names in one call is considerably faster than looking them up one by one.
+/// Only the default version of a versioned symbol is returned, as with dlsym. Unlike dlsym, a lookup by symbol name
+/// alone searches every loaded module in load order, including the ones opened with RTLD_LOCAL, and TLS symbols are
+/// not resolved.
+class SAFETYHOOK_API SymbolResolver final {
+public:
+    /// @brief The error type returned by find.
+    enum class Error : uint8_t {
+        MODULE_NOT_FOUND, ///< The module is not loaded.
+        NO_HASH_TABLE,    ///< The module has neither a .gnu.hash nor a .hash section.
+    };
+
+    /// @brief Returns the resolver shared by all callers of the process.
+    /// @return The shared resolver.
+    [[nodiscard]] static std::shared_ptr<SymbolResolver> global();
+
+    /// @brief Creates a new resolver with an empty cache.
+    /// @return The new SymbolResolver.
+    [[nodiscard]] static std::shared_ptr<SymbolResolver> create();
+
+    SymbolResolver(const SymbolResolver&) = delete;
+    SymbolResolver(SymbolResolver&&) noexcept = delete;
+    SymbolResolver& operator=(const SymbolResolver&) = delete;
+    SymbolResolver& operator=(SymbolResolver&&) noexcept = delete;
+    ~SymbolResolver();
+
+    /// @brief Looks up an exported symbol of a module.
+    /// @param module The file name or path of the module. An empty name selects the main executable.
+    /// @param symbol The name of the symbol.
+    /// @return The address of the symbol, nullptr if the module does not export it, or a SymbolResolver::Error.
+    [[nodiscard]] std::expected<void*, Error> find(std::string_view module, std::string_view symbol);
+
+    /// @brief Looks up many exported symbols of a module at once.
+    /// @param module The file name or path of the module. An empty name selects the main executable.
+    /// @param symbols The names of the symbols.
+    /// @param addresses Receives the address of each symbol, or nullptr if it is not exported. Must be at least as
+    /// large as symbols.
+    /// @return The number of symbols that were found, or a SymbolResolver::Error.
+    [[nodiscard]] std::expected<size_t, Error> find(
+        std::string_view module, std::span<const std::string_view> symbols, std::span<void*> addresses);
+
+    /// @brief Looks up a symbol in every loaded module, in load order.
+    /// @param symbol The name of the symbol.
+    /// @return The address of the first definition, or nullptr if no module exports the symbol.
+    [[nodiscard]] void* find(std::string_view symbol);
+
+    /// @brief Returns the number of cached modules.
+    [[nodiscard]] size_t size() const;
+
+private:
+    struct Module;
+
+    std::map<uintptr_t, std::unique_ptr<Module>> m_modules; ///< Keyed by load address.
+    std::vector<const Module*> m_load_order{};
+    std::map<std::string, const Module*, std::less<>> m_names{}; ///< Path and file name of every module.
+    unsigned long long m_adds{};
+    unsigned long long m_subs{};
+    bool m_synced{};
+    mutable std::shared_mutex m_mutex{};
+
+    SymbolResolver();
+
+    std::shared_lock<std::shared_mutex> sync();
+    void rebuild();
+    const Module* find_module(std::string_view module) const;
+};
+} // namespace safetyhook
+
+#endif
+
+//
+// Header: safetyhook/scanner.hpp
+//
+// Include stack:
+//   - safetyhook.hpp
+//
+
+/// @file safetyhook/scanner.hpp
+/// @brief Multi-pattern byte signature scanner.
+
+#pragma once
+
+#ifndef SAFETYHOOK_USE_CXXMODULES
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string_view>
+#include <vector>
+#else
+import std.compat;
+#endif
+
+
+namespace safetyhook {
+/// @brief A byte signature with wildcards.
+class SAFETYHOOK_API Pattern final {
+public:
+    /// @brief The error type returned by parse.
+    enum class Error : uint8_t {
+        BAD_TOKEN,     ///< A token is neither a hex byte nor a wildcard.
+        NO_FIXED_BYTE, ///< The pattern is empty or only made of wildcards.
+    };
+
+    /// @brief Parses a pattern such as "48 8B 05 ?? ?? ?? ?? C3". Wildcards are written as ? or ??.
+    /// @param text The pattern.
+    /// @return The Pattern or a Pattern::Error if the text is malformed.
+    [[nodiscard]] static std::expected<Pattern, Error> parse(std::string_view text);
+
+    /// @brief Creates a pattern from bytes and a mask.
+    /// @param bytes The bytes to match.
+    /// @param mask Nonzero for bytes that have to match, zero for wildcards. Must be as long as bytes.
+    /// @return The Pattern or a Pattern::Error if no byte has to match.
+    [[nodiscard]] static std::expected<Pattern, Error> create(
+        std::span<const uint8_t> bytes, std::span<const uint8_t> mask);
+
+    /// @brief Tests if the pattern matches at an address.
+    /// @param address The address of the first byte. size() bytes must be readable.
+    /// @return True if every fixed byte matches.
+    [[nodiscard]] bool matches(const uint8_t* address) const;
+
+    /// @brief Returns the length of the pattern.
+    /// @return The length in bytes, including wildcards.
+    [[nodiscard]] size_t size() const noexcept { return m_bytes.size(); }
+
+    /// @brief Returns the offset of the first anchor byte.
+    /// @details The scanner only verifies the pattern where the anchor bytes match. They are the pair of adjacent
+    /// fixed bytes (or the single fixed byte) least likely to occur in x86 code.
+    /// @return The offset of the anchor in the pattern.
+    [[nodiscard]] size_t anchor() const noexcept { return m_anchor; }
+
+    /// @brief Tests if the anchor is a pair of bytes.
+    /// @return True if the byte after the anchor is fixed as well.
+    [[nodiscard]] bool has_anchor_pair() const noexcept { return m_anchor_pair; }
+
+    /// @brief Returns the pattern bytes. Wildcard bytes are zero.
+    [[nodiscard]] const std::vector<uint8_t>& bytes() const noexcept { return m_bytes; }
+
+    /// @brief Returns the pattern mask, 0xFF for fixed bytes and zero for wildcards.
+    [[nodiscard]] const std::vector<uint8_t>& mask() const noexcept { return m_mask; }
+
+private:
+    std::vector<uint8_t> m_bytes{};
+    std::vector<uint8_t> m_mask{};
+    size_t m_anchor{};
+    bool m_anchor_pair{};
+
+    Pattern() = default;
+
+    void choose_anchor();
+};
+
+/// @brief A pattern found by a scan.
+struct ScanMatch {
+    size_t pattern; ///< Index of the pattern in the list that was scanned for.
+    uint8_t* address; ///< Address of the first byte of the match.
+};
+
+/// @brief Options for scan and scan_module.
+struct ScanOptions {
+    size_t threads{};                   ///< Number of threads, 0 for one per hardware thread.
+    size_t min_chunk_size{1024 * 1024}; ///< Smallest range handed to a thread. Smaller inputs are scanned inline.
+};
+
+/// @brief Scans memory for many patterns in one pass.
+/// @details Candidates are found by comparing the anchor bytes of all patterns 32 (AVX2) or 16 (SSE2) bytes at a
+/// time, and only those are verified against the full patterns. Large inputs are split across threads.
+/// @param data The memory to scan.
+/// @param patterns The patterns to scan for.
+/// @param options The ScanOptions.
+/// @return Every match, ordered by pattern index and then by address.
+[[nodiscard]] std::vector<ScanMatch> SAFETYHOOK_API scan(
+    std::span<const uint8_t> data, std::span<const Pattern> patterns, const ScanOptions& options = {});
+
+/// @brief Scans the executable sections of a module for many patterns in one pass.
+/// @param module An address inside the module, e.g. its base address.
+/// @param patterns The patterns to scan for.
+/// @param options The ScanOptions.
+/// @return Every match, ordered by pattern index and then by address, or an OsError if the module was not found.
+[[nodiscard]] std::expected<std::vector<ScanMatch>, OsError> SAFETYHOOK_API scan_module(
+    uint8_t* module, std::span<const Pattern> patterns, const ScanOptions& options = {});
 } // namespace safetyhook
 
 using SafetyHookContext = safetyhook::Context;
@@ -1261,4 +1988,7 @@ using SafetyHookMid = safetyhook::MidHook;
 using SafetyInlineHook [[deprecated("Use SafetyHookInline instead.")]] = safetyhook::InlineHook;
 using SafetyMidHook [[deprecated("Use SafetyHookMid instead.")]] = safetyhook::MidHook;
 using SafetyHookVmt = safetyhook::VmtHook;
-using SafetyHookVm = safetyhook::VmHook;
\ No newline at end of file
+using SafetyHookVm = safetyhook::VmHook;
+#if SAFETYHOOK_OS_LINUX
+using SafetyHookImport = safetyhook::ImportHook;
+#endif
\ No newline at end of file
@@ -0,0 +1,121 @@
+// Checks the CPU list parsing and the Linux branch of apply_process_placement against the CPUs and NUMA nodes of the
+// machine the test runs on.
+
+#include "test.h"
+
+#include "affinity.h"
+
+#include <sched.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+namespace
+{
+std::vector<uint32_t> get_current_cpus()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    TEST_CHECK(sched_getaffinity(0, sizeof(set), &set) == 0);
+
+    std::vector<uint32_t> cpus;
+    for (uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &set))
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+void test_cpu_list()
+{
+    std::vector<uint32_t> cpus;
+    TEST_CHECK(parse_cpu_list(L" 3, 0-1,8-9,1 ,", cpus));
+    TEST_CHECK((cpus == std::vector<uint32_t>{ 0, 1, 3, 8, 9 }));
+    TEST_CHECK(format_cpu_list(cpus) == L"0-1,3,8-9");
+
+    TEST_CHECK(parse_cpu_list(L"", cpus) && cpus.empty());
+    TEST_CHECK(!parse_cpu_list(L"3-1", cpus));
+    TEST_CHECK(!parse_cpu_list(L"1-", cpus));
+    TEST_CHECK(!parse_cpu_list(L"a", cpus));
+    TEST_CHECK(!parse_cpu_list(L"4096", cpus));
+}
+
+void test_priority_names()
+{
+    TEST_CHECK(parse_process_priority(L"Below_Normal") == process_priority::below_normal);
+    TEST_CHECK(parse_process_priority(L"high") == process_priority::high);
+    TEST_CHECK(parse_process_priority(L"") == process_priority::unchanged);
+    TEST_CHECK(parse_process_priority(L"realtime") == process_priority::unchanged);
+}
+
+void test_affinity()
+{
+    const std::vector<uint32_t> original = get_current_cpus();
+    TEST_CHECK(!original.empty());
+
+    const std::vector<uint32_t> first{ original.front() };
+    const placement_result result = apply_process_placement(first, -1, process_priority::unchanged);
+    TEST_CHECK(result.m_affinity_applied && result.m_numa_node_applied && result.m_priority_applied);
+    TEST_CHECK(result.m_cpus == first);
+    TEST_CHECK(get_current_cpus() == first);
+
+    // A CPU that does not exist is reported, and the process keeps its CPUs.
+    const placement_result missing = apply_process_placement({ 4095 }, -1, process_priority::unchanged);
+    TEST_CHECK(!missing.m_affinity_applied);
+    TEST_CHECK(missing.m_cpus.empty());
+    TEST_CHECK(get_current_cpus() == first);
+
+    TEST_CHECK(apply_process_placement(original, -1, process_priority::unchanged).m_affinity_applied);
+}
+
+void test_numa_node()
+{
+    // Without cpus, the process is restricted to the node's CPUs. Node 0 is only missing without NUMA support.
+    if (std::filesystem::exists("/sys/devices/system/node/node0/cpulist"))
+    {
+        const std::vector<uint32_t> original = get_current_cpus();
+        const placement_result result = apply_process_placement({}, 0, process_priority::unchanged);
+        TEST_CHECK(result.m_numa_node_applied);
+        TEST_CHECK(!result.m_cpus.empty());
+        apply_process_placement(original, -1, process_priority::unchanged);
+    }
+
+    const placement_result missing = apply_process_placement({}, 63, process_priority::unchanged);
+    TEST_CHECK(!missing.m_numa_node_applied);
+    TEST_CHECK(missing.m_cpus.empty());
+}
+
+void test_gc_placement()
+{
+    unsetenv("DOTNET_GCHeapAffinitizeRanges");
+    unsetenv("DOTNET_GCHeapCount");
+    apply_gc_placement({ 0, 1, 2, 5 });
+    TEST_CHECK(std::string(std::getenv("DOTNET_GCHeapAffinitizeRanges")) == "0-2,5");
+    TEST_CHECK(std::getenv("DOTNET_GCHeapCount") == nullptr);
+
+    // Heap affinity configured by the user, with either prefix, is left alone.
+    setenv("DOTNET_GCHeapAffinitizeRanges", "7", 1);
+    apply_gc_placement({ 0 });
+    TEST_CHECK(std::string(std::getenv("DOTNET_GCHeapAffinitizeRanges")) == "7");
+
+    unsetenv("DOTNET_GCHeapAffinitizeRanges");
+    setenv("COMPlus_GCHeapAffinitizeMask", "f", 1);
+    apply_gc_placement({ 0 });
+    TEST_CHECK(std::getenv("DOTNET_GCHeapAffinitizeRanges") == nullptr);
+    unsetenv("COMPlus_GCHeapAffinitizeMask");
+}
+}
+
+int main()
+{
+    test_cpu_list();
+    test_priority_names();
+    test_affinity();
+    test_numa_node();
+    test_gc_placement();
+    return 0;
+}
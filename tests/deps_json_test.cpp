@@ -0,0 +1,114 @@
+// Parses deps file shaped documents and malformed JSON with the parser deps validation reads .deps.json files with.
+
+#include "test.h"
+
+#include "deps_json.h"
+
+#include <string>
+
+namespace
+{
+bool parses(std::string_view text)
+{
+    json_value value;
+    return parse_json(text, value);
+}
+
+void test_deps_file()
+{
+    constexpr std::string_view text = R"({
+  "runtimeTarget": { "name": ".NETCoreApp,Version=v8.0", "signature": "" },
+  "compilationOptions": {},
+  "targets": {
+    ".NETCoreApp,Version=v8.0": {
+      "App/1.0.0": {
+        "dependencies": { "Lib": "2.1.0-rc.1" },
+        "runtime": { "App.dll": {} }
+      },
+      "Lib/2.1.0-rc.1": {
+        "runtime": { "lib/net8.0/Lib.dll": { "assemblyVersion": "2.1.0.0", "fileVersion": "2.1.0.0" } },
+        "native": { "runtimes/win-x64/native/lib.dll": { "fileVersion": "0.0.0.0" } }
+      }
+    }
+  },
+  "libraries": {
+    "App/1.0.0": { "type": "project", "serviceable": false, "sha512": "" },
+    "Lib/2.1.0-rc.1": { "type": "package", "serviceable": true, "path": "lib/2.1.0-rc.1", "size": -1.5e+3, "x": null }
+  }
+})";
+
+    json_value root;
+    TEST_CHECK(parse_json(text, root));
+    TEST_CHECK(root.m_kind == json_value::kind::object);
+    TEST_CHECK(root.find("runtimeTarget")->string_member("name") == ".NETCoreApp,Version=v8.0");
+
+    // Members keep their order.
+    const json_value* target = root.find("targets")->find(".NETCoreApp,Version=v8.0");
+    TEST_CHECK(target && target->m_members.size() == 2);
+    TEST_CHECK(target->m_members[0].first == "App/1.0.0");
+    TEST_CHECK(target->m_members[1].first == "Lib/2.1.0-rc.1");
+    TEST_CHECK(target->m_members[1].second.find("native")->m_members[0].first == "runtimes/win-x64/native/lib.dll");
+
+    const json_value* library = root.find("libraries")->find("Lib/2.1.0-rc.1");
+    TEST_CHECK(library->string_member("path") == "lib/2.1.0-rc.1");
+    TEST_CHECK(library->find("serviceable")->m_kind == json_value::kind::other);
+    TEST_CHECK(library->string_member("serviceable").empty());
+    TEST_CHECK(library->find("missing") == nullptr);
+}
+
+void test_strings()
+{
+    json_value value;
+    TEST_CHECK(parse_json(R"("a\"\\\/\b\f\n\r\tAé€😀")", value));
+    TEST_CHECK(value.m_string == "a\"\\/\b\f\n\r\tA\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80");
+
+    TEST_CHECK(!parses(R"("\x")"));
+    TEST_CHECK(!parses(R"("\u12")"));
+    TEST_CHECK(!parses(R"("\ud83d")"));
+    TEST_CHECK(!parses(R"("\ud83dA")"));
+    TEST_CHECK(!parses(R"("\ude00")"));
+    TEST_CHECK(!parses("\"tab\there\""));
+    TEST_CHECK(!parses(R"("unterminated)"));
+}
+
+void test_numbers_and_literals()
+{
+    for (const char* text : { "0", "-0", "12", "-12.5", "1e5", "1E+5", "2.5e-3", "true", "false", "null",
+        " [ 1 , true , null ] " })
+    {
+        TEST_CHECK(parses(text));
+    }
+
+    for (const char* text : { "01", "+1", "1.", ".5", "1e", "1e+", "--1", "0x10", "1.2.3", "tru", "truex", "True",
+        "nul", "NaN", "Infinity", "abc", "2.1.0-rc.1" })
+    {
+        TEST_CHECK(!parses(text));
+    }
+}
+
+void test_structure()
+{
+    for (const char* text : { "", " ", "{", "}", "{\"a\":1,}", "[1,]", "[,1]", "{\"a\" 1}", "{a:1}", "{\"a\":1}x",
+        "[1] [2]", "{\"a\":1 \"b\":2}", "// comment\n{}" })
+    {
+        TEST_CHECK(!parses(text));
+    }
+
+    TEST_CHECK(parses("{}"));
+    TEST_CHECK(parses("[]"));
+    TEST_CHECK(parses(" {\"a\":[{}, [], \"\"]}\r\n"));
+
+    // Nesting is bounded.
+    TEST_CHECK(parses(std::string(64, '[') + std::string(64, ']')));
+    TEST_CHECK(!parses(std::string(100, '[') + std::string(100, ']')));
+}
+}
+
+int main()
+{
+    test_deps_file();
+    test_strings();
+    test_numbers_and_literals();
+    test_structure();
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Hooks the fixtures once by decoding them and once from a HookPlanCache that went through save and load, and checks
+// that both ways build the same trampoline and that a plan whose original bytes no longer match is not used.
+
+#include "test.h"
+
+#include <safetyhook.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+extern "C" int fixture_add_bias(int value);
+extern "C" int fixture_clamp(int value);
+
+namespace
+{
+safetyhook::InlineHook g_hook;
+
+int add_bias_hook(int value)
+{
+    return 2 * g_hook.call<int>(value);
+}
+
+int clamp_hook(int value)
+{
+    return -g_hook.call<int>(value);
+}
+
+struct trampoline_copy
+{
+    const uint8_t* m_address;
+    std::vector<uint8_t> m_bytes;
+};
+
+trampoline_copy copy_trampoline(const safetyhook::InlineHook& hook)
+{
+    const safetyhook::Allocation& trampoline = hook.trampoline();
+    return { trampoline.data(), std::vector<uint8_t>(trampoline.data(), trampoline.data() + trampoline.size()) };
+}
+
+template <typename Fn>
+void test_plan_matches_decode(Fn* target, void* destination, int argument, int hooked, int original)
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "hook_plan_test.plans";
+
+    // A fresh allocator hands the trampoline of the second hook the memory the first one freed, at the same address,
+    // so the relocated displacements match as well.
+    const auto allocator = safetyhook::Allocator::create();
+    const auto first_launch = safetyhook::HookPlanCache::create();
+    safetyhook::HookPlanCache::set_global(first_launch);
+
+    auto decoded = safetyhook::InlineHook::create(allocator, target, destination);
+    TEST_CHECK(decoded);
+    g_hook = std::move(*decoded);
+    TEST_CHECK(first_launch->size() == 1);
+    TEST_CHECK(target(argument) == hooked);
+
+    const trampoline_copy from_decode = copy_trampoline(g_hook);
+    g_hook.reset();
+    TEST_CHECK(target(argument) == original);
+    TEST_CHECK(first_launch->save(path));
+
+    const auto later_launch = safetyhook::HookPlanCache::create();
+    TEST_CHECK(later_launch->load(path));
+    TEST_CHECK(later_launch->find(reinterpret_cast<uint8_t*>(target)));
+    safetyhook::HookPlanCache::set_global(later_launch);
+
+    auto planned = safetyhook::InlineHook::create(allocator, target, destination);
+    TEST_CHECK(planned);
+    g_hook = std::move(*planned);
+    TEST_CHECK(target(argument) == hooked);
+
+    const trampoline_copy from_plan = copy_trampoline(g_hook);
+    TEST_CHECK(from_plan.m_address == from_decode.m_address);
+    TEST_CHECK(from_plan.m_bytes == from_decode.m_bytes);
+
+    g_hook.reset();
+    TEST_CHECK(target(argument) == original);
+
+    safetyhook::HookPlanCache::set_global(nullptr);
+    std::filesystem::remove(path);
+}
+
+void test_stale_plan_rejected()
+{
+    const auto target = reinterpret_cast<uint8_t*>(&fixture_add_bias);
+    const auto cache = safetyhook::HookPlanCache::create();
+    safetyhook::HookPlanCache::set_global(cache);
+
+    auto hook = safetyhook::InlineHook::create(&fixture_add_bias, &add_bias_hook);
+    TEST_CHECK(hook);
+    const std::vector<uint8_t> original_bytes = hook->original_bytes();
+    // While the target is patched, its bytes do not match the plan either.
+    TEST_CHECK(!cache->find(target));
+    hook->reset();
+
+    std::optional<safetyhook::HookPlan> plan = cache->find(target);
+    TEST_CHECK(plan);
+    TEST_CHECK(plan->original_bytes == original_bytes);
+
+    // The same plan for bytes the target no longer has, as after an update of the module that kept its build ID.
+    plan->original_bytes[0] ^= 0xFF;
+    cache->insert(target, *plan);
+    TEST_CHECK(!cache->find(target));
+
+    // Hooking decodes again, replaces the stale plan and works.
+    auto redecoded = safetyhook::InlineHook::create(&fixture_add_bias, &add_bias_hook);
+    TEST_CHECK(redecoded);
+    g_hook = std::move(*redecoded);
+    TEST_CHECK(fixture_add_bias(1) == 22);
+    g_hook.reset();
+    TEST_CHECK(fixture_add_bias(1) == 11);
+    TEST_CHECK(cache->find(target));
+
+    safetyhook::HookPlanCache::set_global(nullptr);
+}
+}
+
+int main()
+{
+    // Disp32: the RIP-relative load of g_fixture_bias.
+    test_plan_matches_decode(&fixture_add_bias, reinterpret_cast<void*>(&add_bias_hook), 1, 22, 11);
+    // ShortJcc: js out of the displaced bytes, rewritten as a near branch. Both paths of the branch are called.
+    test_plan_matches_decode(&fixture_clamp, reinterpret_cast<void*>(&clamp_hook), 4, -5, 5);
+    test_plan_matches_decode(&fixture_clamp, reinterpret_cast<void*>(&clamp_hook), -4, 0, 0);
+    test_stale_plan_rejected();
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Runs the hostfxr lookup against the dotnet roots checked in under tests/hostfxr_locator: version ordering with
+// pre-releases and invalid directory names, a highest version without hostfxr, install_location files and the
+// precedence of DOTNET_ROOT_<ARCH> and DOTNET_ROOT.
+
+#include "test.h"
+
+#include "hostfxr_locator.h"
+
+#include <cstdlib>
+#include <filesystem>
+
+namespace
+{
+const std::filesystem::path g_fixtures = HOSTFXR_LOCATOR_FIXTURES;
+
+#if defined(__x86_64__)
+constexpr const char* arch_variable = "DOTNET_ROOT_X64";
+#elif defined(__aarch64__)
+constexpr const char* arch_variable = "DOTNET_ROOT_ARM64";
+#else
+constexpr const char* arch_variable = "DOTNET_ROOT_X86";
+#endif
+
+fx_version parse(const char* text)
+{
+    fx_version version;
+    TEST_CHECK(parse_fx_version(text, version));
+    return version;
+}
+
+bool less(const char* a, const char* b)
+{
+    return compare_fx_version(parse(a), parse(b)) < 0 && compare_fx_version(parse(b), parse(a)) > 0;
+}
+
+void test_parse()
+{
+    const fx_version version = parse("9.0.0-rc.1.24431.7+abc");
+    TEST_CHECK(version.m_major == 9 && version.m_minor == 0 && version.m_patch == 0);
+    TEST_CHECK(version.m_prerelease == "rc.1.24431.7");
+
+    fx_version invalid;
+    for (const char* text : { "", "9", "9.0", "09.0.0", "9.0.0-", "9.0.0-rc..1", "9.0.0-rc.01", "9.0.0+", "9.0.0 ",
+        "1234567890.0.0" })
+    {
+        TEST_CHECK(!parse_fx_version(text, invalid));
+    }
+}
+
+void test_ordering()
+{
+    TEST_CHECK(less("8.0.2", "8.0.10"));
+    TEST_CHECK(less("8.0.10", "9.0.0-alpha"));
+    TEST_CHECK(less("9.0.0-preview.7", "9.0.0-rc.1"));
+    TEST_CHECK(less("9.0.0-rc.1", "9.0.0-rc.1.1"));
+    TEST_CHECK(less("9.0.0-rc.2", "9.0.0-rc.10"));
+    TEST_CHECK(less("9.0.0-rc.1", "9.0.0-rc.a"));
+    TEST_CHECK(less("9.0.0-rc.2", "9.0.0"));
+    TEST_CHECK(compare_fx_version(parse("9.0.0+build.1"), parse("9.0.0+build.2")) == 0);
+}
+
+void test_latest()
+{
+    // The release candidate beats the preview and 8.0.10; 09.0.0 and 9.0 are not versions and are skipped.
+    hostfxr_location location;
+    TEST_CHECK(find_latest_hostfxr(g_fixtures / "versions", location));
+    TEST_CHECK(location.m_hostfxr_path == g_fixtures / "versions/host/fxr/9.0.0-rc.1.24431.7/libhostfxr.so");
+    TEST_CHECK(location.m_version.m_prerelease == "rc.1.24431.7");
+
+    // A release beats its pre-release, build metadata is ignored.
+    TEST_CHECK(find_latest_hostfxr(g_fixtures / "release", location));
+    TEST_CHECK(location.m_hostfxr_path == g_fixtures / "release/host/fxr/9.0.0+build.5/libhostfxr.so");
+
+    // Like nethost, the highest version is used even without hostfxr in it.
+    TEST_CHECK(!find_latest_hostfxr(g_fixtures / "no_hostfxr", location));
+    TEST_CHECK(location.m_hostfxr_path.empty());
+    TEST_CHECK(location.m_version.m_major == 9);
+
+    TEST_CHECK(!find_latest_hostfxr(g_fixtures / "missing", location));
+}
+
+void test_install_location()
+{
+    TEST_CHECK(read_install_location(g_fixtures / "etc_arch") == "/opt/dotnet-arch");
+    TEST_CHECK(read_install_location(g_fixtures / "etc_plain") == "/opt/dotnet");
+    TEST_CHECK(read_install_location(g_fixtures / "missing").empty());
+}
+
+void test_precedence()
+{
+    const std::filesystem::path versions = g_fixtures / "versions";
+    const std::filesystem::path release = g_fixtures / "release";
+
+    unsetenv(arch_variable);
+    setenv("DOTNET_ROOT", release.c_str(), 1);
+    hostfxr_sources sources = get_hostfxr_sources();
+    TEST_CHECK(sources.m_environment == release);
+    TEST_CHECK(sources.m_install_location.empty() && sources.m_default_location.empty());
+
+    // The architecture specific variable wins over DOTNET_ROOT.
+    setenv(arch_variable, versions.c_str(), 1);
+    sources = get_hostfxr_sources();
+    TEST_CHECK(sources.m_environment == versions);
+
+    // A root passed by the host wins over both variables, which are not read at all.
+    sources = get_hostfxr_sources(release);
+    TEST_CHECK(sources.m_explicit == release);
+    TEST_CHECK(sources.m_environment.empty() && sources.m_install_location.empty());
+    hostfxr_location location = locate_hostfxr(sources);
+    TEST_CHECK(location.m_source == hostfxr_source::explicit_root);
+    TEST_CHECK(location.m_hostfxr_path.parent_path().filename() == "9.0.0+build.5");
+
+    unsetenv(arch_variable);
+    unsetenv("DOTNET_ROOT");
+    sources = get_hostfxr_sources();
+    TEST_CHECK(sources.m_environment.empty() && !sources.m_default_location.empty());
+
+    // The first source that names a root is used, without falling back if it has no hostfxr.
+    location = locate_hostfxr({ {}, g_fixtures / "no_hostfxr", versions, release });
+    TEST_CHECK(location.m_source == hostfxr_source::environment);
+    TEST_CHECK(location.m_dotnet_root == g_fixtures / "no_hostfxr");
+    TEST_CHECK(location.m_hostfxr_path.empty());
+
+    location = locate_hostfxr({ {}, {}, versions, release });
+    TEST_CHECK(location.m_source == hostfxr_source::install_location);
+    TEST_CHECK(location.m_hostfxr_path.parent_path().filename() == "9.0.0-rc.1.24431.7");
+
+    location = locate_hostfxr({ {}, {}, {}, release });
+    TEST_CHECK(location.m_source == hostfxr_source::default_location);
+    TEST_CHECK(location.m_hostfxr_path.parent_path().filename() == "9.0.0+build.5");
+
+    TEST_CHECK(locate_hostfxr(hostfxr_sources{}).m_source == hostfxr_source::none);
+}
+}
+
+int main()
+{
+    test_parse();
+    test_ordering();
+    test_latest();
+    test_install_location();
+    test_precedence();
+    return 0;
+}
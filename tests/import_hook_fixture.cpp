@@ -0,0 +1,14 @@
+// Shared library whose imports of strlen and abs are hooked by import_hook_test.
+
+#include <cstdlib>
+#include <cstring>
+
+extern "C" size_t fixture_length(const char* text)
+{
+    return std::strlen(text);
+}
+
+extern "C" int fixture_abs(int value)
+{
+    return std::abs(value);
+}
@@ -0,0 +1,108 @@
+// Hooks the strlen and abs imports of libimport_hook_fixture.so and checks that its calls are redirected while the
+// hook is alive and reach libc again once it is reset.
+
+#include "test.h"
+
+#include <safetyhook.hpp>
+
+#include <cstdlib>
+#include <cstring>
+
+extern "C" size_t fixture_length(const char* text);
+extern "C" int fixture_abs(int value);
+
+namespace
+{
+constexpr const char* fixture_module = "libimport_hook_fixture.so";
+
+safetyhook::ImportHook g_strlen_hook;
+safetyhook::ImportHook g_abs_hook;
+
+size_t strlen_hook(const char* text)
+{
+    return 1000 + g_strlen_hook.call<size_t>(text);
+}
+
+int abs_hook(int value)
+{
+    return -g_abs_hook.call<int>(value);
+}
+
+void test_redirect_and_restore()
+{
+    TEST_CHECK(fixture_length("abc") == 3);
+
+    auto hook = safetyhook::ImportHook::create(fixture_module, "strlen", &strlen_hook);
+    TEST_CHECK(hook);
+    g_strlen_hook = std::move(*hook);
+
+    // One GOT entry in the fixture, the original is libc's strlen.
+    TEST_CHECK(g_strlen_hook.size() == 1);
+    TEST_CHECK(g_strlen_hook.original<size_t (*)(const char*)>()("abcd") == 4);
+    TEST_CHECK(fixture_length("abc") == 1003);
+
+    g_strlen_hook.reset();
+    TEST_CHECK(!g_strlen_hook);
+    TEST_CHECK(fixture_length("abc") == 3);
+}
+
+void test_all_modules()
+{
+    TEST_CHECK(fixture_abs(-5) == 5);
+
+    // Without a module name, every loaded module importing abs is patched, the fixture among them.
+    auto hook = safetyhook::ImportHook::create("abs", &abs_hook);
+    TEST_CHECK(hook);
+    g_abs_hook = std::move(*hook);
+
+    TEST_CHECK(g_abs_hook.size() >= 1);
+    TEST_CHECK(fixture_abs(-5) == -5);
+
+    g_abs_hook.reset();
+    TEST_CHECK(fixture_abs(-5) == 5);
+}
+
+size_t (*g_original_strlen)(const char*) = nullptr;
+
+size_t strlen_hook_plain(const char* text)
+{
+    return 2000 + g_original_strlen(text);
+}
+
+void test_destroy_restores()
+{
+    {
+        auto hook = safetyhook::ImportHook::create(fixture_module, "strlen", &strlen_hook_plain);
+        TEST_CHECK(hook);
+        g_original_strlen = hook->original<size_t (*)(const char*)>();
+        TEST_CHECK(fixture_length("ab") == 2002);
+
+        // Moving the hook keeps the entries patched, destroying the new owner restores them.
+        safetyhook::ImportHook moved = std::move(*hook);
+        TEST_CHECK(!*hook);
+        TEST_CHECK(fixture_length("ab") == 2002);
+    }
+
+    TEST_CHECK(fixture_length("ab") == 2);
+}
+
+void test_errors()
+{
+    auto missing_module = safetyhook::ImportHook::create("libnot_loaded.so", "strlen", &strlen_hook);
+    TEST_CHECK(!missing_module);
+    TEST_CHECK(missing_module.error().type == safetyhook::ImportHook::Error::MODULE_NOT_FOUND);
+
+    auto missing_symbol = safetyhook::ImportHook::create(fixture_module, "not_imported", &strlen_hook);
+    TEST_CHECK(!missing_symbol);
+    TEST_CHECK(missing_symbol.error().type == safetyhook::ImportHook::Error::SYMBOL_NOT_FOUND);
+}
+}
+
+int main()
+{
+    test_redirect_and_restore();
+    test_all_modules();
+    test_destroy_restores();
+    test_errors();
+    return 0;
+}
@@ -0,0 +1,39 @@
+// Functions hooked by hook_plan_test and soft_toggle_test. They are written in assembly so that their first
+// instructions, and with them the trampolines, do not depend on the compiler: fixture_add_bias starts with a
+// RIP-relative load and fixture_clamp with a short conditional branch out of the displaced bytes.
+
+extern "C"
+{
+int g_fixture_bias = 10;
+}
+
+// int fixture_add_bias(int value): value + g_fixture_bias
+// int fixture_clamp(int value): value < 0 ? 0 : value + 1
+asm(R"(
+    .intel_syntax noprefix
+    .text
+
+    .globl fixture_add_bias
+    .type fixture_add_bias, @function
+    .p2align 4
+fixture_add_bias:
+    mov eax, dword ptr [rip + g_fixture_bias]
+    add eax, edi
+    ret
+    .size fixture_add_bias, . - fixture_add_bias
+
+    .globl fixture_clamp
+    .type fixture_clamp, @function
+    .p2align 4
+fixture_clamp:
+    test edi, edi
+    js 1f
+    lea eax, [rdi + 1]
+    ret
+1:
+    xor eax, eax
+    ret
+    .size fixture_clamp, . - fixture_clamp
+
+    .att_syntax prefix
+)");
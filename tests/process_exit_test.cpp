@@ -0,0 +1,89 @@
+// Enables fast exit and checks that hooks destroyed while main runs are removed, and that a global hook destroyed by
+// exit() is left in place because process_is_exiting tells exit() has started.
+
+#include "test.h"
+
+#include <safetyhook.hpp>
+
+// Outside the anonymous namespace, where the compiler would see that no class derives from it, and call_area kept
+// out of interprocedural optimization, which knows the dynamic type of every Shape passed in. Either way the call
+// would go to Shape::area directly instead of through the VMT of the object.
+struct Shape
+{
+    virtual ~Shape() = default;
+    virtual int area() const { return 9; }
+};
+
+namespace
+{
+[[gnu::noipa]] int call_area(const Shape& shape)
+{
+    return shape.area();
+}
+
+int area_hook(const Shape*)
+{
+    return 1000;
+}
+
+void check_at_exit(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        // exit() is already running, it must not be called again.
+        std::fprintf(stderr, "check failed at exit: %s\n", what);
+        std::_Exit(1);
+    }
+}
+
+Shape g_shape;
+
+// Destroyed after g_hook, the globals of one file are destroyed in the reverse order they are defined in.
+struct exit_probe
+{
+    ~exit_probe()
+    {
+        check_at_exit(safetyhook::process_is_exiting(), "process_is_exiting()");
+        check_at_exit(call_area(g_shape) == 1000, "the hook of g_shape was left in place");
+    }
+} g_probe;
+
+// Its destructor is registered during static initialization, before set_fast_exit registers the exit handler, so it
+// runs after the handler.
+safetyhook::VmtHook g_hook;
+safetyhook::VmHook g_area_hook;
+
+void test_destroyed_before_exit()
+{
+    Shape shape;
+    auto hook = safetyhook::VmtHook::create(&shape);
+    TEST_CHECK(hook);
+    auto area = hook->hook_method(2, &area_hook);
+    TEST_CHECK(area);
+    TEST_CHECK(call_area(shape) == 1000);
+
+    // Not exiting yet, so the hook is removed as usual.
+    TEST_CHECK(!safetyhook::leak_on_destroy());
+    area->reset();
+    hook->reset();
+    TEST_CHECK(call_area(shape) == 9);
+}
+}
+
+int main()
+{
+    TEST_CHECK(!safetyhook::process_is_exiting());
+    safetyhook::set_fast_exit(true);
+    TEST_CHECK(!safetyhook::process_is_exiting());
+
+    test_destroyed_before_exit();
+
+    auto hook = safetyhook::VmtHook::create(&g_shape);
+    TEST_CHECK(hook);
+    g_hook = std::move(*hook);
+    auto area = g_hook.hook_method(2, &area_hook);
+    TEST_CHECK(area);
+    g_area_hook = std::move(*area);
+    TEST_CHECK(call_area(g_shape) == 1000);
+    return 0;
+}
@@ -0,0 +1,267 @@
+// Compares scan and scan_module against a plain loop over every position: random data and wildcard patterns, matches
+// planted across the boundaries of the chunks handed to the threads, and patterns that share one anchor.
+
+#include "test.h"
+
+#include <safetyhook.hpp>
+
+#include <link.h>
+
+#include <algorithm>
+#include <random>
+#include <span>
+#include <vector>
+
+namespace
+{
+std::mt19937 g_random{ 40 };
+
+// Few distinct bytes, so that random patterns match often. 0x48 and 0x8B are avoided as anchors, 0x11 and 0x22 are not.
+constexpr uint8_t alphabet[] = { 0x11, 0x22, 0x48, 0x8B };
+
+uint8_t random_byte()
+{
+    return alphabet[g_random() % std::size(alphabet)];
+}
+
+std::vector<uint8_t> random_data(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    for (uint8_t& byte : data)
+    {
+        byte = random_byte();
+    }
+    return data;
+}
+
+safetyhook::Pattern make_pattern(std::span<const uint8_t> bytes, std::span<const uint8_t> mask)
+{
+    auto pattern = safetyhook::Pattern::create(bytes, mask);
+    TEST_CHECK(pattern);
+    return std::move(*pattern);
+}
+
+safetyhook::Pattern random_pattern()
+{
+    const size_t size = 2 + g_random() % 7;
+    std::vector<uint8_t> bytes(size);
+    std::vector<uint8_t> mask(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        bytes[i] = random_byte();
+        mask[i] = g_random() % 4 != 0;
+    }
+    mask[g_random() % size] = 1;
+    return make_pattern(bytes, mask);
+}
+
+// Every match of every pattern, in the order scan returns them.
+std::vector<safetyhook::ScanMatch> naive_scan(std::span<const std::span<const uint8_t>> ranges,
+    std::span<const safetyhook::Pattern> patterns)
+{
+    std::vector<safetyhook::ScanMatch> matches;
+    for (size_t index = 0; index < patterns.size(); ++index)
+    {
+        const safetyhook::Pattern& pattern = patterns[index];
+        for (const std::span<const uint8_t> range : ranges)
+        {
+            for (size_t start = 0; start + pattern.size() <= range.size(); ++start)
+            {
+                bool match = true;
+                for (size_t i = 0; i < pattern.size() && match; ++i)
+                {
+                    match = (range[start + i] & pattern.mask()[i]) == pattern.bytes()[i];
+                }
+                if (match)
+                {
+                    matches.push_back({ index, const_cast<uint8_t*>(range.data() + start) });
+                }
+            }
+        }
+    }
+    return matches;
+}
+
+bool same_matches(const std::vector<safetyhook::ScanMatch>& a, const std::vector<safetyhook::ScanMatch>& b)
+{
+    return std::ranges::equal(a, b, [](const safetyhook::ScanMatch& x, const safetyhook::ScanMatch& y) {
+        return x.pattern == y.pattern && x.address == y.address;
+    });
+}
+
+bool contains(const std::vector<safetyhook::ScanMatch>& matches, size_t pattern, const uint8_t* address)
+{
+    return std::ranges::any_of(matches, [&](const safetyhook::ScanMatch& match) {
+        return match.pattern == pattern && match.address == address;
+    });
+}
+
+void test_random_data()
+{
+    // Sizes around the 16 and 32 byte blocks leave tails for the scalar loop, the large ones are split into chunks.
+    const size_t sizes[] = { 1, 2, 15, 16, 17, 31, 32, 33, 63, 100, 4099, 65537 };
+    const safetyhook::ScanOptions options[] = {
+        {},
+        { .threads = 1, .min_chunk_size = 1 },
+        { .threads = 4, .min_chunk_size = 37 },
+        { .threads = 3, .min_chunk_size = 1000 },
+    };
+
+    for (const size_t size : sizes)
+    {
+        const std::vector<uint8_t> data = random_data(size);
+        std::vector<safetyhook::Pattern> patterns;
+        for (int i = 0; i < 24; ++i)
+        {
+            patterns.push_back(random_pattern());
+        }
+
+        const std::span<const uint8_t> range{ data };
+        const std::vector<safetyhook::ScanMatch> expected = naive_scan({ &range, 1 }, patterns);
+        for (const safetyhook::ScanOptions& option : options)
+        {
+            TEST_CHECK(same_matches(safetyhook::scan(data, patterns, option), expected));
+        }
+    }
+}
+
+void test_chunk_boundaries()
+{
+    // Bytes that never occur in the data, so the planted copies are the only matches.
+    const uint8_t bytes[] = { 0xA5, 0x00, 0x5A, 0xC3, 0x00, 0x3C };
+    const uint8_t mask[] = { 1, 0, 1, 1, 0, 1 };
+    const std::vector<safetyhook::Pattern> patterns{ make_pattern(bytes, mask) };
+    const size_t anchor = patterns[0].anchor();
+    TEST_CHECK(anchor != 0);
+
+    // With 4 threads and this size the chunks are min_chunk_size long, so they start at every multiple of 1000.
+    constexpr size_t chunk = 1000;
+    std::vector<uint8_t> data = random_data(8 * chunk);
+    const safetyhook::ScanOptions options{ .threads = 4, .min_chunk_size = chunk };
+
+    // Copies that start before a boundary with the anchor on either side of it, and one at the very end.
+    std::vector<size_t> starts;
+    for (size_t boundary = chunk; boundary < data.size(); boundary += chunk)
+    {
+        starts.push_back(boundary - sizeof(bytes) + 1 + boundary / chunk % (sizeof(bytes) - 1));
+    }
+    starts.push_back(data.size() - sizeof(bytes));
+    for (const size_t start : starts)
+    {
+        for (size_t i = 0; i < sizeof(bytes); ++i)
+        {
+            if (mask[i] != 0)
+            {
+                data[start + i] = bytes[i];
+            }
+        }
+    }
+
+    const std::vector<safetyhook::ScanMatch> matches = safetyhook::scan(data, patterns, options);
+    TEST_CHECK(matches.size() == starts.size());
+    for (const size_t start : starts)
+    {
+        TEST_CHECK(contains(matches, 0, data.data() + start));
+    }
+}
+
+void test_shared_anchor()
+{
+    // All of them are anchored on 11 22, at different offsets, so they are verified from one anchor comparison.
+    const char* const texts[] = {
+        "11 22",
+        "11 22 ?? 48",
+        "?? 11 22 8B",
+        "48 ? 11 22 ?? ?? 11",
+        "8B 48 11 22",
+    };
+    std::vector<safetyhook::Pattern> patterns;
+    for (const char* text : texts)
+    {
+        auto pattern = safetyhook::Pattern::parse(text);
+        TEST_CHECK(pattern);
+        TEST_CHECK(pattern->has_anchor_pair());
+        TEST_CHECK(pattern->bytes()[pattern->anchor()] == 0x11);
+        TEST_CHECK(pattern->bytes()[pattern->anchor() + 1] == 0x22);
+        patterns.push_back(std::move(*pattern));
+    }
+
+    // An anchor at the very start of the data, where only the patterns that start with it can match.
+    std::vector<uint8_t> data = random_data(20000);
+    data[0] = 0x11;
+    data[1] = 0x22;
+
+    const std::span<const uint8_t> range{ data };
+    const std::vector<safetyhook::ScanMatch> expected = naive_scan({ &range, 1 }, patterns);
+    TEST_CHECK(contains(expected, 0, data.data()));
+    TEST_CHECK(same_matches(safetyhook::scan(data, patterns), expected));
+    TEST_CHECK(same_matches(safetyhook::scan(data, patterns, { .threads = 4, .min_chunk_size = 64 }), expected));
+}
+
+// The executable segments of the test itself, from its program headers.
+std::vector<std::span<const uint8_t>> executable_segments()
+{
+    std::vector<std::span<const uint8_t>> segments;
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, size_t, void* context) {
+            // The first entry is the executable.
+            auto& out = *static_cast<std::vector<std::span<const uint8_t>>*>(context);
+            for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i)
+            {
+                const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+                if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_X) != 0)
+                {
+                    out.emplace_back(reinterpret_cast<const uint8_t*>(info->dlpi_addr + phdr.p_vaddr), phdr.p_memsz);
+                }
+            }
+            return 1;
+        },
+        &segments);
+    return segments;
+}
+
+void test_scan_module()
+{
+    const std::vector<std::span<const uint8_t>> segments = executable_segments();
+    TEST_CHECK(!segments.empty());
+
+    // Patterns cut out of the code at random places, with a few bytes turned into wildcards, match at least there.
+    std::vector<safetyhook::Pattern> patterns;
+    std::vector<const uint8_t*> sources;
+    for (int i = 0; i < 16; ++i)
+    {
+        const std::span<const uint8_t> segment = segments[g_random() % segments.size()];
+        const size_t size = 4 + g_random() % 8;
+        const uint8_t* source = segment.data() + g_random() % (segment.size() - size);
+        std::vector<uint8_t> mask(size);
+        for (uint8_t& fixed : mask)
+        {
+            fixed = g_random() % 5 != 0;
+        }
+        mask[0] = 1;
+        patterns.push_back(make_pattern({ source, size }, mask));
+        sources.push_back(source);
+    }
+
+    auto matches = safetyhook::scan_module(reinterpret_cast<uint8_t*>(&test_scan_module), patterns);
+    TEST_CHECK(matches);
+    TEST_CHECK(same_matches(*matches, naive_scan(segments, patterns)));
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        TEST_CHECK(contains(*matches, i, sources[i]));
+    }
+
+    // Heap memory is not part of any module.
+    std::vector<uint8_t> heap(64);
+    TEST_CHECK(!safetyhook::scan_module(heap.data(), patterns));
+}
+}
+
+int main()
+{
+    test_random_data();
+    test_chunk_boundaries();
+    test_shared_anchor();
+    test_scan_module();
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Calls through a SoftToggle hook while it is disabled, enabled and sampled, and counts the calls that reach the
+// destination.
+
+#include "test.h"
+
+#include <safetyhook.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+extern "C" int fixture_add_bias(int value);
+
+namespace
+{
+safetyhook::InlineHook g_hook;
+std::atomic<int> g_destination_calls{ 0 };
+
+int add_bias_hook(int value)
+{
+    g_destination_calls.fetch_add(1, std::memory_order_relaxed);
+    return g_hook.unsafe_call<int>(value);
+}
+
+// Returns how many of count calls reached the destination. Every call must still return the original's result.
+int call_many(int count)
+{
+    const int before = g_destination_calls.load();
+    for (int i = 0; i < count; ++i)
+    {
+        TEST_CHECK(fixture_add_bias(i) == i + 10);
+    }
+    return g_destination_calls.load() - before;
+}
+
+void test_toggle_and_sample()
+{
+    auto hook = safetyhook::InlineHook::create(&fixture_add_bias, &add_bias_hook,
+        static_cast<safetyhook::InlineHook::Flags>(
+            safetyhook::InlineHook::StartDisabled | safetyhook::InlineHook::SoftToggle));
+    TEST_CHECK(hook);
+    g_hook = std::move(*hook);
+    TEST_CHECK(g_hook.soft_toggle());
+
+    // Disabled, the gate sends every call through the trampoline to the original.
+    TEST_CHECK(call_many(1000) == 0);
+
+    TEST_CHECK(g_hook.enable());
+    TEST_CHECK(call_many(1000) == 1000);
+
+    TEST_CHECK(g_hook.set_sample_period(10));
+    TEST_CHECK(call_many(1000) == 100);
+    TEST_CHECK(call_many(5) == 0);
+    TEST_CHECK(call_many(5) == 1);
+
+    TEST_CHECK(g_hook.set_sample_period(7));
+    TEST_CHECK(call_many(700) == 100);
+
+    TEST_CHECK(g_hook.disable());
+    TEST_CHECK(call_many(1000) == 0);
+
+    // Enabling again keeps the period.
+    TEST_CHECK(g_hook.enable());
+    TEST_CHECK(call_many(700) == 100);
+
+    TEST_CHECK(g_hook.set_sample_period(1));
+    TEST_CHECK(call_many(1000) == 1000);
+
+    g_hook.reset();
+    TEST_CHECK(call_many(1000) == 0);
+}
+
+void test_sample_threads()
+{
+    constexpr int thread_count = 4;
+    constexpr int calls_per_thread = 200000;
+    constexpr int period = 16;
+
+    auto hook = safetyhook::InlineHook::create(&fixture_add_bias, &add_bias_hook, safetyhook::InlineHook::SoftToggle);
+    TEST_CHECK(hook);
+    g_hook = std::move(*hook);
+    TEST_CHECK(g_hook.set_sample_period(period));
+
+    const int before = g_destination_calls.load();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([] {
+            for (int i = 0; i < calls_per_thread; ++i)
+            {
+                fixture_add_bias(i);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    // No decrement is lost. Threads that take the countdown to 0 or below together are all sampled, at most one extra
+    // call per thread.
+    const int sampled = g_destination_calls.load() - before;
+    const int expected = thread_count * calls_per_thread / period;
+    TEST_CHECK(sampled >= expected);
+    TEST_CHECK(sampled <= expected + thread_count - 1);
+
+    g_hook.reset();
+}
+}
+
+int main()
+{
+    test_toggle_and_sample();
+    test_sample_threads();
+    return 0;
+}
@@ -0,0 +1,16 @@
+// Shared library that symbol_resolver_test opens and closes at run time, so it is never linked to anything.
+
+extern "C"
+{
+int g_fixture_counter = 47;
+
+int fixture_first()
+{
+    return 1;
+}
+
+int fixture_second()
+{
+    return 2;
+}
+}
@@ -0,0 +1,167 @@
+// Resolves exports of libimport_hook_fixture.so, libc and the test itself with SymbolResolver and compares them with
+// dlsym, one by one and in batches, and checks that the cache follows a library that is opened and closed again.
+
+#include "test.h"
+
+#include <safetyhook.hpp>
+
+#include <dlfcn.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+extern "C" size_t fixture_length(const char* text);
+
+// Exported from the executable by its link options.
+extern "C" int symbol_resolver_test_export()
+{
+    return 47;
+}
+
+namespace
+{
+constexpr const char* fixture_module = "libimport_hook_fixture.so";
+constexpr const char* libc_module = "libc.so.6";
+
+// Indirect functions, symbols with a default and a hidden version, and data.
+constexpr std::string_view libc_symbols[] = {
+    "strlen",
+    "memcpy",
+    "realpath",
+    "pthread_cond_wait",
+    "fopen",
+    "malloc",
+    "environ",
+    "symbol_resolver_missing",
+};
+
+void* loaded(const char* module)
+{
+    void* const handle = dlopen(module, RTLD_NOW | RTLD_NOLOAD);
+    if (handle != nullptr)
+    {
+        // Only drops the reference RTLD_NOLOAD took.
+        dlclose(handle);
+    }
+    return handle;
+}
+
+void* dlsym_in(const char* module, std::string_view symbol)
+{
+    void* const handle = dlopen(module, RTLD_NOW | RTLD_NOLOAD);
+    TEST_CHECK(handle);
+    void* const address = dlsym(handle, std::string{ symbol }.c_str());
+    dlclose(handle);
+    return address;
+}
+
+void test_fixture_and_executable()
+{
+    const auto resolver = safetyhook::SymbolResolver::create();
+
+    auto length = resolver->find(fixture_module, "fixture_length");
+    TEST_CHECK(length);
+    TEST_CHECK(*length == reinterpret_cast<void*>(&fixture_length));
+    TEST_CHECK(*length == dlsym_in(fixture_module, "fixture_length"));
+
+    auto missing = resolver->find(fixture_module, "fixture_missing");
+    TEST_CHECK(missing);
+    TEST_CHECK(*missing == nullptr);
+
+    auto unknown = resolver->find("libsymbol_resolver_unknown.so", "fixture_length");
+    TEST_CHECK(!unknown);
+    TEST_CHECK(unknown.error() == safetyhook::SymbolResolver::Error::MODULE_NOT_FOUND);
+
+    // An empty module name is the executable.
+    auto exported = resolver->find("", "symbol_resolver_test_export");
+    TEST_CHECK(exported);
+    TEST_CHECK(*exported == reinterpret_cast<void*>(&symbol_resolver_test_export));
+
+    // Without a module, the first definition in load order, as with RTLD_DEFAULT.
+    TEST_CHECK(resolver->find("fixture_abs") == dlsym(RTLD_DEFAULT, "fixture_abs"));
+    TEST_CHECK(resolver->find("malloc") == dlsym(RTLD_DEFAULT, "malloc"));
+    TEST_CHECK(resolver->find("symbol_resolver_missing") == nullptr);
+}
+
+void test_libc()
+{
+    const auto resolver = safetyhook::SymbolResolver::create();
+
+    size_t expected_found = 0;
+    for (const std::string_view symbol : libc_symbols)
+    {
+        void* const expected = dlsym_in(libc_module, symbol);
+        expected_found += expected != nullptr;
+
+        auto address = resolver->find(libc_module, symbol);
+        TEST_CHECK(address);
+        TEST_CHECK(*address == expected);
+    }
+    TEST_CHECK(expected_found == std::size(libc_symbols) - 1);
+
+    // The same names in one call, also by the full path of libc.
+    std::vector<void*> addresses(std::size(libc_symbols));
+    auto found = resolver->find(libc_module, libc_symbols, addresses);
+    TEST_CHECK(found);
+    TEST_CHECK(*found == expected_found);
+    for (size_t i = 0; i < std::size(libc_symbols); ++i)
+    {
+        TEST_CHECK(addresses[i] == dlsym_in(libc_module, libc_symbols[i]));
+    }
+
+    Dl_info info{};
+    TEST_CHECK(dladdr(addresses[0], &info) != 0);
+    std::vector<void*> by_path(std::size(libc_symbols));
+    auto found_by_path = resolver->find(info.dli_fname, libc_symbols, by_path);
+    TEST_CHECK(found_by_path);
+    TEST_CHECK(by_path == addresses);
+}
+
+void test_open_close()
+{
+    const auto resolver = safetyhook::SymbolResolver::create();
+    const std::string_view module = "libsymbol_resolver_fixture.so";
+    constexpr std::string_view symbols[] = { "fixture_first", "g_fixture_counter", "fixture_second" };
+
+    TEST_CHECK(!resolver->find(module, "fixture_first"));
+    const size_t base_size = resolver->size();
+
+    for (int round = 0; round < 3; ++round)
+    {
+        void* const handle = dlopen(SYMBOL_RESOLVER_FIXTURE, RTLD_NOW | RTLD_LOCAL);
+        TEST_CHECK(handle);
+
+        // Found although it was opened with RTLD_LOCAL, where RTLD_DEFAULT does not look.
+        void* addresses[std::size(symbols)]{};
+        auto found = resolver->find(module, symbols, addresses);
+        TEST_CHECK(found);
+        TEST_CHECK(*found == std::size(symbols));
+        for (size_t i = 0; i < std::size(symbols); ++i)
+        {
+            TEST_CHECK(addresses[i] == dlsym(handle, std::string{ symbols[i] }.c_str()));
+        }
+        TEST_CHECK(*static_cast<int*>(addresses[1]) == 47);
+        TEST_CHECK(resolver->find("fixture_second") == addresses[2]);
+        TEST_CHECK(resolver->size() == base_size + 1);
+
+        TEST_CHECK(dlclose(handle) == 0);
+        TEST_CHECK(!loaded(SYMBOL_RESOLVER_FIXTURE));
+
+        // The module is gone from the cache, nothing of it is returned any more.
+        auto closed = resolver->find(module, "fixture_first");
+        TEST_CHECK(!closed);
+        TEST_CHECK(closed.error() == safetyhook::SymbolResolver::Error::MODULE_NOT_FOUND);
+        TEST_CHECK(resolver->find("fixture_second") == nullptr);
+        TEST_CHECK(resolver->size() == base_size);
+    }
+}
+}
+
+int main()
+{
+    test_fixture_and_executable();
+    test_libc();
+    test_open_close();
+    return 0;
+}
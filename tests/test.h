@@ -0,0 +1,16 @@
+#pragma once
+
+// Minimal checks for the Linux tests. A failed check is reported and makes the test exit with 1.
+
+#include <cstdio>
+#include <cstdlib>
+
+#define TEST_CHECK(condition)                                                                  \
+    do                                                                                         \
+    {                                                                                          \
+        if (!(condition))                                                                      \
+        {                                                                                      \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1);                                                                      \
+        }                                                                                      \
+    } while (false)
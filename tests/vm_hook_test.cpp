@@ -0,0 +1,127 @@
+// Hooks a method by swapping its entry in the original VMT with VmHook::create_in_place and checks that every object
+// of the class calls the hook, that destroying the hook restores the entry and that an entry another writer replaced
+// in the meantime is left alone.
+
+#include "test.h"
+
+#include <safetyhook.hpp>
+
+#include <atomic>
+
+namespace
+{
+struct Counter
+{
+    virtual int value() const = 0;
+    virtual int twice() const = 0;
+};
+
+struct Seven : Counter
+{
+    int value() const override { return 7; }
+    int twice() const override { return 14; }
+};
+
+struct Eight : Counter
+{
+    int value() const override { return 8; }
+    int twice() const override { return 16; }
+};
+
+safetyhook::VmHook g_value_hook;
+
+int value_hook(const Counter* self)
+{
+    return 100 + g_value_hook.thiscall<int>(self);
+}
+
+int other_writer(const Counter*)
+{
+    return -1;
+}
+
+// Kept out of line, so the calls go through the VMT of the object and are not devirtualized.
+[[gnu::noinline]] int call_value(const Counter& counter)
+{
+    return counter.value();
+}
+
+[[gnu::noinline]] int call_twice(const Counter& counter)
+{
+    return counter.twice();
+}
+
+uint8_t** value_entry(Counter& counter)
+{
+    return &(*reinterpret_cast<uint8_t***>(&counter))[0];
+}
+
+uint8_t* load_entry(uint8_t** entry)
+{
+    return std::atomic_ref{ *entry }.load();
+}
+
+void store_entry(uint8_t** entry, uint8_t* value)
+{
+    auto unprotect_guard = safetyhook::unprotect(reinterpret_cast<uint8_t*>(entry), sizeof(uint8_t*));
+    TEST_CHECK(unprotect_guard);
+    std::atomic_ref{ *entry }.store(value);
+}
+
+void test_patch_and_restore()
+{
+    Seven before;
+    Eight other_class;
+    uint8_t** entry = value_entry(before);
+    uint8_t* const original = load_entry(entry);
+
+    auto hook = safetyhook::VmHook::create_in_place(&before, 0, &value_hook);
+    TEST_CHECK(hook);
+    g_value_hook = std::move(*hook);
+
+    // The shared VMT is patched, so objects created before and after the hook both call it, without being touched.
+    Seven after;
+    TEST_CHECK(*reinterpret_cast<void**>(&after) == *reinterpret_cast<void**>(&before));
+    TEST_CHECK(call_value(before) == 107);
+    TEST_CHECK(call_value(after) == 107);
+    TEST_CHECK(g_value_hook.original<uint8_t*>() == original);
+
+    // Neighbouring entries and other classes are not affected.
+    TEST_CHECK(call_twice(before) == 14);
+    TEST_CHECK(call_value(other_class) == 8);
+
+    g_value_hook.reset();
+    TEST_CHECK(load_entry(entry) == original);
+    TEST_CHECK(call_value(before) == 7);
+    TEST_CHECK(call_value(after) == 7);
+}
+
+void test_replaced_entry_left_alone()
+{
+    Eight counter;
+    uint8_t** entry = value_entry(counter);
+    uint8_t* const original = load_entry(entry);
+
+    auto hook = safetyhook::VmHook::create_in_place(&counter, 0, &value_hook);
+    TEST_CHECK(hook);
+    g_value_hook = std::move(*hook);
+    TEST_CHECK(call_value(counter) == 108);
+
+    // Someone else swaps the entry after us. Restoring the original would unhook them, so the entry is kept.
+    uint8_t* const replacement = reinterpret_cast<uint8_t*>(&other_writer);
+    store_entry(entry, replacement);
+    g_value_hook.reset();
+    TEST_CHECK(load_entry(entry) == replacement);
+    TEST_CHECK(call_value(counter) == -1);
+
+    store_entry(entry, original);
+    TEST_CHECK(call_value(counter) == 8);
+}
+}
+
+int main()
+{
+    test_patch_and_restore();
+    test_replaced_entry_left_alone();
+    return 0;
+}
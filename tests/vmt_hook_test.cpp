@@ -0,0 +1,200 @@
+// Applies a ClassLevel VmtHook to many objects and removes it again in mixed order, which moves entries of the
+// object table around on every removal, and checks which objects call through the hooked VMT after each step. Also
+// checks that only one ClassLevel hook per class is alive at a time and that destroying it frees the class again.
+
+#include "test.h"
+
+#include <safetyhook.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+struct Shape
+{
+    virtual ~Shape() = default;
+    virtual int area() const = 0;
+};
+
+struct Square : Shape
+{
+    int m_side{ 3 };
+    int area() const override { return m_side * m_side; }
+};
+
+struct Circle : Shape
+{
+    int area() const override { return 28; }
+};
+
+safetyhook::VmHook g_area_hook;
+
+int area_hook(const Square* self)
+{
+    return 1000 + g_area_hook.thiscall<int>(self);
+}
+
+// Kept out of line, so the call goes through the VMT of the object and not to a devirtualized Square::area.
+[[gnu::noinline]] int call_area(const Shape& shape)
+{
+    return shape.area();
+}
+
+bool is_hooked(const Shape& shape)
+{
+    return call_area(shape) >= 1000;
+}
+
+void* as_object(Shape* shape)
+{
+    return shape;
+}
+
+void test_apply_remove_mixed()
+{
+    constexpr size_t object_count = 500;
+
+    std::vector<std::unique_ptr<Square>> squares;
+    std::vector<void*> objects;
+    for (size_t i = 0; i < object_count; ++i)
+    {
+        squares.push_back(std::make_unique<Square>());
+        objects.push_back(as_object(squares.back().get()));
+    }
+    Circle circle;
+
+    auto hook = safetyhook::VmtHook::create(objects[0], safetyhook::VmtHook::ClassLevel);
+    TEST_CHECK(hook);
+    auto area = hook->hook_method(2, &area_hook);
+    TEST_CHECK(area);
+    g_area_hook = std::move(*area);
+
+    // Objects of another class are skipped by a ClassLevel hook, objects already hooked are not added twice.
+    std::vector<void*> batch = objects;
+    batch.push_back(as_object(&circle));
+    hook->apply(batch);
+    TEST_CHECK(hook->size() == object_count);
+    TEST_CHECK(!is_hooked(circle));
+    for (const auto& square : squares)
+    {
+        TEST_CHECK(call_area(*square) == 1009);
+    }
+
+    std::vector<size_t> order(object_count);
+    for (size_t i = 0; i < object_count; ++i)
+    {
+        order[i] = i;
+    }
+    std::mt19937 random{ 26 };
+    std::shuffle(order.begin(), order.end(), random);
+
+    // Remove the first half one by one, the rest must stay findable after every backward shift.
+    std::vector<bool> removed(object_count);
+    for (size_t n = 0; n < object_count / 2; ++n)
+    {
+        const size_t index = order[n];
+        hook->remove(objects[index]);
+        removed[index] = true;
+        TEST_CHECK(hook->size() == object_count - n - 1);
+        TEST_CHECK(call_area(*squares[index]) == 9);
+
+        // Removing it again does nothing.
+        hook->remove(objects[index]);
+        TEST_CHECK(hook->size() == object_count - n - 1);
+    }
+    for (size_t i = 0; i < object_count; ++i)
+    {
+        TEST_CHECK(is_hooked(*squares[i]) == !removed[i]);
+    }
+
+    // Re-apply every other removed object, then remove everything left in a different order through the batch
+    // overload. Objects that are not in the table are skipped.
+    size_t expected_size = hook->size();
+    for (size_t n = 0; n < object_count / 2; n += 2)
+    {
+        hook->apply(objects[order[n]]);
+        removed[order[n]] = false;
+        ++expected_size;
+    }
+    TEST_CHECK(hook->size() == expected_size);
+    for (size_t i = 0; i < object_count; ++i)
+    {
+        TEST_CHECK(is_hooked(*squares[i]) == !removed[i]);
+    }
+
+    std::shuffle(order.begin(), order.end(), random);
+    std::vector<void*> rest;
+    for (const size_t index : order)
+    {
+        rest.push_back(objects[index]);
+    }
+    hook->remove(std::span<void* const>(rest.data(), rest.size() / 3));
+    hook->remove(objects[order[rest.size() / 3]]);
+    hook->remove(std::span<void* const>(rest).subspan(rest.size() / 3 + 1));
+    TEST_CHECK(hook->size() == 0);
+    for (const auto& square : squares)
+    {
+        TEST_CHECK(call_area(*square) == 9);
+    }
+
+    // The table is empty, but the hook is still alive and can be applied again.
+    hook->apply(objects);
+    TEST_CHECK(hook->size() == object_count);
+    for (const auto& square : squares)
+    {
+        TEST_CHECK(call_area(*square) == 1009);
+    }
+
+    // Destroying the hook restores every object it still tracks.
+    g_area_hook.reset();
+    hook->reset();
+    for (const auto& square : squares)
+    {
+        TEST_CHECK(call_area(*square) == 9);
+    }
+}
+
+void test_one_class_level_hook_per_class()
+{
+    Square first;
+    Square second;
+    Circle circle;
+
+    for (int round = 0; round < 3; ++round)
+    {
+        auto hook = safetyhook::VmtHook::create(as_object(&first), safetyhook::VmtHook::ClassLevel);
+        TEST_CHECK(hook);
+
+        auto duplicate = safetyhook::VmtHook::create(as_object(&second), safetyhook::VmtHook::ClassLevel);
+        TEST_CHECK(!duplicate);
+        TEST_CHECK(duplicate.error().type == safetyhook::VmtHook::Error::CLASS_ALREADY_HOOKED);
+
+        // Other classes and per-object hooks are not affected.
+        auto other_class = safetyhook::VmtHook::create(as_object(&circle), safetyhook::VmtHook::ClassLevel);
+        TEST_CHECK(other_class);
+        auto per_object = safetyhook::VmtHook::create(as_object(&second));
+        TEST_CHECK(per_object);
+        per_object->reset();
+        other_class->reset();
+
+        // Moving the hook keeps the class registered, only destroying it frees the class again.
+        safetyhook::VmtHook moved = std::move(*hook);
+        TEST_CHECK(!safetyhook::VmtHook::create(as_object(&second), safetyhook::VmtHook::ClassLevel));
+        moved.reset();
+    }
+
+    auto hook = safetyhook::VmtHook::create(as_object(&second), safetyhook::VmtHook::ClassLevel);
+    TEST_CHECK(hook);
+    TEST_CHECK(hook->size() == 1);
+}
+}
+
+int main()
+{
+    test_apply_remove_mixed();
+    test_one_class_level_hook_per_class();
+    return 0;
+}